@@ -20,6 +20,7 @@
 #include "SimAst.h"
 #include "SimLexer.h"
 #include <limits>
+#include <algorithm>
 #include <QTextStream>
 #include <QtDebug>
 using namespace Sim;
@@ -247,7 +248,7 @@ void Declaration::deleteAll(Declaration* d) {
     }
 }
 
-Expression::Expression(Kind k, const RowCol& rc) : Node(E), kind(k), lhs(0), rhs(0), next(0), condition(0), u(0) { pos = rc; }
+Expression::Expression(Kind k, const RowCol& rc) : Node(E), kind(k), folded(false), local(false), lhs(0), rhs(0), next(0), condition(0), u(0) { pos = rc; }
 Expression::~Expression() {
     if (lhs) delete lhs;
     if (rhs) delete rhs;
@@ -425,6 +426,59 @@ Declaration* AstModel::resolveInClass(Declaration* cls, Atom name)
     return 0;
 }
 
+void AstModel::buildDisplay(Declaration* cls)
+{
+    // only cls is written, so the validator owning cls can call this concurrently to the others
+    if( cls == 0 || !cls->display.isEmpty() )
+        return;
+    QList<Declaration*> chain;
+    Declaration* cur = cls;
+    while( cur && cur->display.isEmpty() )
+    {
+        if( chain.contains(cur) )
+            return; // prefix cycle, reported by the validator
+        chain.prepend(cur);
+        cur = cur->prefix;
+    }
+    if( cur )
+        cls->display = cur->display; // reuse the display of an ancestor already done
+    cls->display += chain;
+}
+
+int AstModel::prefixLevel(Declaration* cls)
+{
+    if( cls == 0 )
+        return -1;
+    if( !cls->display.isEmpty() )
+        return cls->display.size() - 1;
+    int level = 0;
+    while( cls->prefix )
+    {
+        cls = cls->prefix;
+        level++;
+    }
+    return level;
+}
+
+bool AstModel::isSubclassOf(Declaration* sub, Declaration* super)
+{
+    if( sub == 0 || super == 0 )
+        return false;
+    if( !sub->display.isEmpty() && !super->display.isEmpty() )
+    {
+        const int level = super->display.size() - 1;
+        return level < sub->display.size() && sub->display[level] == super;
+    }
+    // displays are not yet built during validation of the class itself
+    while( sub )
+    {
+        if( sub == super )
+            return true;
+        sub = sub->prefix;
+    }
+    return false;
+}
+
 Declaration* AstModel::findInScope(Declaration* scope, const char *sym, bool includeBodyscope)
 {
     if (!scope)
@@ -437,9 +491,9 @@ Declaration* AstModel::findInScope(Declaration* scope, const char *sym, bool inc
         d = d->next;
     }
 
-    if( includeBodyscope && scope->kind == Declaration::Class && scope->body && scope->body->scope )
+    if( includeBodyscope && scope->kind == Declaration::Class && scope->body && scope->body->getScope() )
     {
-        d = scope->body->scope->link;
+        d = scope->body->getScope()->link;
         while (d) {
             if (d->sym == sym)
                 return d;
@@ -477,7 +531,7 @@ void AstModel::initBuiltins() {
 class AstDumper
 {
 public:
-    AstDumper(QTextStream& out) : out(out), indent(0) {}
+    AstDumper(QTextStream& out, const QSet<Declaration*>& only) : out(out), only(only), indent(0) {}
 
     void dump(Declaration* d)
     {
@@ -487,6 +541,7 @@ public:
 
 private:
     QTextStream& out;
+    const QSet<Declaration*>& only; // the classes and procedures to dump, all if empty
     int indent;
 
     void writeIndent()
@@ -612,6 +667,12 @@ private:
                 d = d->next;
                 continue;
             }
+            if( !only.isEmpty() && ( d->kind == Declaration::Class || d->kind == Declaration::Procedure ) &&
+                    !only.contains(d) )
+            {
+                d = d->next;
+                continue;
+            }
             writeIndent();
             out << d->getKindName();
             if (!d->name.isEmpty())
@@ -1079,9 +1140,9 @@ private:
     }
 };
 
-void AstModel::dump(QTextStream & out, Declaration * d)
+void AstModel::dump(QTextStream & out, Declaration * d, const QSet<Declaration*>& only)
 {
-    AstDumper dumper(out);
+    AstDumper dumper(out, only);
     dumper.dump(d);
 }
 
@@ -1123,6 +1184,44 @@ Declaration *AstModel::getEnv() const
 }
 
 
+void Xref::merge(Xref& fragment)
+{
+    // the first symbol of a fragment is the header of its circle
+    Symbol* head = fragment.syms;
+    if( head == 0 )
+        return;
+    if( head->next && head->next != head )
+    {
+        Symbol* last = head->next;
+        while( last->next && last->next != head )
+            last = last->next;
+        if( syms == 0 )
+        {
+            syms = head->next;
+            last->next = syms;
+        }else
+        {
+            Symbol* tail = syms;
+            while( tail->next && tail->next != syms )
+                tail = tail->next;
+            tail->next = head->next;
+            last->next = syms;
+        }
+    }
+    head->next = 0;
+    Symbol::deleteAll(head);
+    fragment.syms = 0;
+
+    QHash<Declaration*, QList<Symbol*> >::const_iterator i;
+    for( i = fragment.uses.begin(); i != fragment.uses.end(); ++i )
+        uses[i.key()] += i.value();
+    QHash<Declaration*, QList<Declaration*> >::const_iterator j;
+    for( j = fragment.subs.begin(); j != fragment.subs.end(); ++j )
+        subs[j.key()] += j.value();
+    fragment.uses.clear();
+    fragment.subs.clear();
+}
+
 void Symbol::deleteAll(Symbol *first)
 {
     if( first == 0 )
@@ -1141,3 +1240,262 @@ void Symbol::deleteAll(Symbol *first)
     delete first;
 
 }
+
+struct PosExtent
+{
+    quint32 from, to;
+    Declaration* scope;
+    PosExtent(quint32 f = 0, quint32 t = 0, Declaration* s = 0):from(f),to(t),scope(s) {}
+    bool operator<(const PosExtent& rhs) const
+    {
+        // outer before inner if they start at the same position
+        return from < rhs.from || ( from == rhs.from && to > rhs.to );
+    }
+};
+
+// the AST has no end positions, so a scope extends to the end of the last node it contains
+class ExtentCollector
+{
+public:
+    QList<PosExtent> extents;
+
+    static inline quint32 end(const RowCol& pos, int len)
+    {
+        if( !pos.isValid() )
+            return 0;
+        RowCol rc(pos.d_row, pos.d_col + len);
+        return rc.packed();
+    }
+
+    quint32 expr(Expression* e)
+    {
+        quint32 res = 0;
+        while( e )
+        {
+            int len = 0;
+            if( e->kind == Expression::Identifier && e->a )
+                len = strlen(e->a);
+            else if( e->kind == Expression::DeclRef && e->d )
+                len = e->d->name.size();
+            res = qMax(res, end(e->pos,len));
+            res = qMax(res, expr(e->lhs));
+            res = qMax(res, expr(e->rhs));
+            res = qMax(res, expr(e->condition));
+            e = e->next;
+        }
+        return res;
+    }
+
+    quint32 decl(Declaration* d)
+    {
+        quint32 res = 0;
+        while( d )
+        {
+            if( d->kind == Declaration::Block || d->kind == Declaration::LabelDecl )
+            {
+                // visited by the block or label statement
+                d = d->next;
+                continue;
+            }
+            quint32 to = end(d->pos, d->name.size());
+            to = qMax(to, expr(d->nameRef));
+            switch( d->kind )
+            {
+            case Declaration::Switch:
+                to = qMax(to, expr(d->list));
+                break;
+            case Declaration::Variable:
+            case Declaration::Parameter:
+                to = qMax(to, expr(d->init));
+                break;
+            default:
+                break;
+            }
+            to = qMax(to, decl(d->link));
+            to = qMax(to, stmt(d->body));
+            if( d->pos.isValid() && ( d->kind == Declaration::Class ||
+                                      d->kind == Declaration::Procedure || d->kind == Declaration::Program ) )
+                extents << PosExtent(d->pos.packed(), to, d);
+            res = qMax(res, to);
+            d = d->next;
+        }
+        return res;
+    }
+
+    quint32 stmt(Statement* s)
+    {
+        quint32 res = 0;
+        while( s )
+        {
+            quint32 to = end(s->pos, 0);
+            to = qMax(to, stmt(s->body));
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                to = qMax(to, expr(s->prefix));
+                to = qMax(to, expr(s->args));
+                if( s->scope )
+                {
+                    to = qMax(to, decl(s->scope->link));
+                    if( s->pos.isValid() )
+                        extents << PosExtent(s->pos.packed(), to, s->scope);
+                }
+                break;
+            case Statement::If:
+            case Statement::While:
+                to = qMax(to, expr(s->cond));
+                to = qMax(to, stmt(s->elseStmt));
+                break;
+            case Statement::For:
+                to = qMax(to, expr(s->var));
+                to = qMax(to, expr(s->list));
+                break;
+            case Statement::Inspect:
+                {
+                    to = qMax(to, expr(s->obj));
+                    Connection* c = s->conn;
+                    while( c )
+                    {
+                        to = qMax(to, end(c->pos, c->className ? strlen(c->className) : 0));
+                        to = qMax(to, stmt(c->body));
+                        c = c->next;
+                    }
+                    to = qMax(to, stmt(s->otherwise));
+                }
+                break;
+            case Statement::Activate:
+                if( s->activate )
+                {
+                    to = qMax(to, expr(s->activate->obj));
+                    to = qMax(to, expr(s->activate->at));
+                    to = qMax(to, expr(s->activate->delay));
+                    to = qMax(to, expr(s->activate->priorObj));
+                }
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+            case Statement::Detach:
+            case Statement::Resume:
+            case Statement::Goto:
+                to = qMax(to, expr(s->lhs));
+                to = qMax(to, expr(s->rhs));
+                break;
+            case Statement::Label:
+                if( s->label )
+                    to = qMax(to, end(s->label->pos, s->label->name.size()));
+                break;
+            default:
+                break;
+            }
+            res = qMax(res, to);
+            s = s->next;
+        }
+        return res;
+    }
+};
+
+static inline bool symbolLessThan(Symbol* lhs, Symbol* rhs)
+{
+    return lhs->pos.packed() < rhs->pos.packed();
+}
+
+static inline bool segmentLessThan(quint32 pos, const PosIndex::Segment& s)
+{
+    return pos < s.from;
+}
+
+void PosIndex::build(Declaration* module, Symbol* syms)
+{
+    clear();
+    if( module == 0 )
+        return;
+
+    Symbol* s = syms;
+    while( s )
+    {
+        if( s->pos.isValid() )
+            symbols << s;
+        s = s->next;
+        if( s == syms )
+            break; // symbols can build a circle
+    }
+    std::stable_sort(symbols.begin(), symbols.end(), symbolLessThan);
+
+    ExtentCollector c;
+    const quint32 to = c.decl(module->link);
+    c.extents << PosExtent(RowCol(1,1).packed(), qMax(to, RowCol(1,1).packed()), module);
+    std::sort(c.extents.begin(), c.extents.end());
+
+    // flatten the nested extents into consecutive segments, each denoting its innermost scope
+    QList<PosExtent> stack;
+    for( int i = 0; i < c.extents.size(); i++ )
+    {
+        const PosExtent& e = c.extents[i];
+        while( !stack.isEmpty() && stack.back().to < e.from )
+        {
+            const quint32 from = stack.back().to + 1;
+            stack.pop_back();
+            addSegment(from, stack.isEmpty() ? 0 : stack.back().scope);
+        }
+        stack << e;
+        addSegment(e.from, e.scope);
+    }
+    while( !stack.isEmpty() )
+    {
+        const quint32 from = stack.back().to + 1;
+        stack.pop_back();
+        addSegment(from, stack.isEmpty() ? 0 : stack.back().scope);
+    }
+}
+
+void PosIndex::clear()
+{
+    symbols.clear();
+    segments.clear();
+}
+
+Symbol* PosIndex::findSymbol(quint32 line, quint16 col) const
+{
+    if( symbols.isEmpty() )
+        return 0;
+    const quint32 pos = RowCol(line, col).packed();
+    int lo = 0, hi = symbols.size();
+    while( lo < hi )
+    {
+        // find the first symbol starting after pos
+        const int mid = ( lo + hi ) / 2;
+        if( symbols[mid]->pos.packed() <= pos )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    Symbol* hit = 0;
+    for( int i = lo - 1; i >= 0 && symbols[i]->pos.d_row == line; i-- )
+    {
+        Symbol* s = symbols[i];
+        if( hit && hit->pos.d_col != s->pos.d_col )
+            break;
+        if( col <= s->pos.d_col + s->len )
+            hit = s; // continue to prefer the first of several symbols at the same position
+    }
+    return hit;
+}
+
+Declaration* PosIndex::findScope(quint32 line, quint16 col) const
+{
+    const quint32 pos = RowCol(line, col).packed();
+    QList<Segment>::const_iterator i = std::upper_bound(segments.begin(), segments.end(), pos, segmentLessThan);
+    if( i == segments.begin() )
+        return 0;
+    --i;
+    return (*i).scope;
+}
+
+void PosIndex::addSegment(quint32 from, Declaration* scope)
+{
+    if( !segments.isEmpty() && segments.back().from == from )
+        segments.back().scope = scope;
+    else if( segments.isEmpty() || segments.back().scope != scope )
+        segments << Segment(from, scope);
+}
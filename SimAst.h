@@ -23,6 +23,8 @@
 #include <QByteArray>
 #include <QList>
 #include <QVariant>
+#include <QAtomicPointer>
+#include <QSet>
 #include "SimRowCol.h"
 
 class QTextStream;
@@ -36,6 +38,7 @@ namespace Sim
     class Statement;
     class Expression;
     class Connection;
+    class Validator2;
 
     typedef const char* Atom;
 
@@ -87,7 +90,7 @@ namespace Sim
 
         // Statement
         uint re : 1;               // reactivate
-        uint prior: 1;
+        uint prior: 1;             // PRIOR, or BEFORE instead of AFTER with priorObj
         // 2
 
         // Type
@@ -124,6 +127,7 @@ namespace Sim
         static const char* name[];
 
         Kind kind;
+        QAtomicPointer<Validator2> claim; // the validator currently validating this type, see Validator2::Type_
 
         bool isArithmetic() const;
         bool isInteger() const { return kind == Integer || kind == ShortInteger; }
@@ -160,10 +164,10 @@ namespace Sim
         Declaration* next;   // Next in scope
         Declaration* outer;  // Parent scope
         Statement*   body;   // class, procedure
-        Expression*  nameRef;     // Class prefix name, External ext name, Mode refs, owned
+        Expression*  nameRef;     // Class or block prefix name, External ext name, Mode refs, owned
         union {
-            // Class / Procedure
-            Declaration* prefix; // Superclass, not owned
+            // Class / Procedure / Block
+            Declaration* prefix; // Superclass or the class prefixing the block, not owned
 
             // Switch
             Expression* list; // Chain of label expressions
@@ -180,6 +184,8 @@ namespace Sim
             // VirtualSpec
             Declaration* forward; // points to actual declaration or null for abstract, not owned
         };
+        QAtomicPointer<Validator2> claim; // the validator currently validating this declaration, see Validator2::claim
+        QList<Declaration*> display; // Class: the ancestor at each prefix level, the class itself last, see AstModel::buildDisplay
 
 
         Declaration(Kind k = Invalid);
@@ -215,6 +221,8 @@ namespace Sim
         };
 
         Kind kind;
+        bool folded; // the value is known at compile time, see Folder
+        bool local; // an allocation which doesn't outlive its block, see EscapeAnalyzer
         union {
             quint64 u;
             double r;
@@ -343,6 +351,27 @@ namespace Sim
         QHash<Declaration*, QList<Declaration*> > subs;
 
         Xref() : syms(0) {}
+        void merge(Xref& fragment); // takes the symbols of the fragment
+    };
+
+    // Position index of a module; finds the innermost symbol and scope at (line,col) in O(log n)
+    class PosIndex
+    {
+    public:
+        struct Segment {
+            quint32 from; // packed RowCol; the scope reaches up to the start of the next segment
+            Declaration* scope;
+            Segment(quint32 f = 0, Declaration* s = 0):from(f),scope(s) {}
+        };
+
+        void build(Declaration* module, Symbol* syms);
+        void clear();
+        Symbol* findSymbol(quint32 line, quint16 col) const;
+        Declaration* findScope(quint32 line, quint16 col) const;
+    private:
+        void addSegment(quint32 from, Declaration* scope);
+        QList<Symbol*> symbols; // sorted by start position
+        QList<Segment> segments; // sorted by start position
     };
 
     typedef QList<Symbol*> SymList;
@@ -373,9 +402,12 @@ namespace Sim
         void clear();
 
         static Declaration* resolveInClass(Declaration* cls, Atom name);
+        static void buildDisplay(Declaration* cls);
+        static int prefixLevel(Declaration* cls);
+        static bool isSubclassOf(Declaration* sub, Declaration* super);
         static Declaration* findInScope(Declaration* scope, const char* sym, bool includeBodyscope = true);
 
-        static void dump(QTextStream&, Declaration*);
+        static void dump(QTextStream&, Declaration*, const QSet<Declaration*>& only = QSet<Declaration*>());
     private:
         AstModel& operator=(const AstModel& rhs);
         AstModel(const AstModel&);
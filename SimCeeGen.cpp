@@ -18,6 +18,8 @@
 */
 
 #include "SimCeeGen.h"
+#include "SimFolder.h"
+#include "SimLoopAnalyzer.h"
 #include <QFile>
 #include <QFileInfo>
 #include <QtDebug>
@@ -28,9 +30,19 @@ CeeGen::CeeGen()
     : indentLevel(0)
     , tempVarCounter(0)
     , labelCounter(0)
+    , literalCounter(0)
     , currentModule(0)
     , currentClass(0)
     , currentProc(0)
+    , mainStreamed(false)
+    , streaming(false)
+    , closedWorld(false)
+    , stackless(false)
+    , checks(false)
+    , stepClass(0)
+    , resumePoints(0)
+    , openedBlock(0)
+    , virtualCalls(0)
 {
 }
 
@@ -142,9 +154,8 @@ QString CeeGen::mangleProcName(Declaration* proc)
     QString name = proc->name.constData();
     
     // If procedure is a class member, include class name
-    if (proc->outer && (proc->outer->kind == Declaration::Class || 
-                        proc->outer->kind == Declaration::StandardClass)) {
-        return QString("%1_%2").arg(mangleClassName(proc->outer)).arg(name);
+    if (Declaration* cls = ClassHierarchy::owner(proc)) {
+        return QString("%1_%2").arg(mangleClassName(cls)).arg(name);
     }
     
     return QString("sim_%1").arg(name);
@@ -154,8 +165,15 @@ QString CeeGen::mangleVarName(Declaration* var)
 {
     if (!var)
         return "sim_unknown_var";
+    if (globalVars.contains(var))
+        return globalVars.value(var); // see emitLocal
     
-    QString name = var->name.constData();
+    return mangleIdent(var->name);
+}
+
+QString CeeGen::mangleIdent(const QByteArray& ident)
+{
+    QString name = ident.constData();
     
     // Avoid C keywords
     static QSet<QString> cKeywords;
@@ -318,6 +336,10 @@ QString CeeGen::getBuiltinProcName(Declaration* d)
     if (name == "entier") return "sim_entier";
     if (name == "mod") return "fmod";
     
+    // Simulation, see sim_simulation.c; hold, passivate, current etc. keep their names
+    Declaration* owner = ClassHierarchy::owner(d);
+    if (owner && owner->name.toLower() == "simulation" && name == "time") return "sim_simulation_time";
+    
     // System
     if (name == "error") return "sim_error";
     if (name == "time") return "sim_time";
@@ -380,29 +402,74 @@ bool CeeGen::transpile(Declaration* module, const QString& outputPath)
         return false;
     }
     
+    beginModule(module);
+    
+    // a module with the main program is the whole program, together with the external classes it uses
+    hierarchy.add(module);
+    for (Declaration* d = module->link; d; d = d->next)
+        if (d->kind == Declaration::Program)
+            closedWorld = true;
+    
+    // only the classes and procedures used by the program, or by the library module, are emitted
+    reachable = TreeShaker::reachable(module);
+    
+    addStackSlots(EscapeAnalyzer::analyze(module));
+    addThunkVariants(ThunkAnalyzer::analyze(module));
+    
+    // Generate code
+    emitModule(module);
+    
+    return endModule(outputPath);
+}
+
+void CeeGen::beginModule(Declaration* module)
+{
     errors.clear();
     generatedCode.clear();
     headerCode.clear();
     forwardDecls.clear();
     structDefs.clear();
+    procDecls.clear();
     vtableDefs.clear();
     funcDefs.clear();
+    globalDefs.clear();
     mainCode.clear();
     
     indentLevel = 0;
     tempVarCounter = 0;
     labelCounter = 0;
+    literalCounter = 0;
+    mainStreamed = false;
+    openedBlock = 0;
     
     emittedClasses.clear();
     emittedProcs.clear();
     classIdMap.clear();
     mangledNames.clear();
+    stackSlots.clear();
+    hoisted.clear();
+    globalVars.clear();
+    globalVarNames.clear();
+    nestedDecls.clear();
+    connections.clear();
+    pointerFree.clear();
+    indexRanges.clear();
+    thunkVariants.clear();
+    streaming = false;
+    emittedVariants.clear();
+    constantVariants.clear();
+    namePassing.clear();
+    hierarchy.clear();
+    reachable.clear(); // a streamed unit may use any declaration delivered before
+    closedWorld = false; // a streamed module may be followed by units declaring further subclasses
+    devirtualized.clear();
+    virtualCalls = 0;
     
     currentModule = module;
-    
-    // Generate code
-    emitModule(module);
-    
+}
+
+bool CeeGen::endModule(const QString& outputPath)
+{
     if (!errors.isEmpty())
         return false;
     
@@ -411,12 +478,14 @@ bool CeeGen::transpile(Declaration* module, const QString& outputPath)
     
     emitIncludes(out);
     out << "\n";
-    emitRuntimeDecls(out);
-    out << "\n";
     out << forwardDecls;
     out << "\n";
     out << structDefs;
     out << "\n";
+    out << procDecls;
+    out << "\n";
+    out << globalDefs;
+    out << "\n";
     out << vtableDefs;
     out << "\n";
     out << funcDefs;
@@ -438,6 +507,81 @@ bool CeeGen::transpile(Declaration* module, const QString& outputPath)
     return errors.isEmpty();
 }
 
+void CeeGen::openBlock(Statement* block)
+{
+    // the outermost block of the program; its declarations and statements follow as units
+    streaming = true;
+    QTextStream out(&mainCode);
+    emitMainHead(out);
+    indentLevel = 1;
+    out << indent() << "{\n";
+    increaseIndent();
+    openedBlock = block;
+    mainStreamed = true;
+}
+
+void CeeGen::emitUnit(Declaration* d)
+{
+    if (d->kind == Declaration::Block || d->kind == Declaration::LabelDecl)
+        return; // handled in the corresponding statements
+    
+    streaming = true;
+    addStackSlots(EscapeAnalyzer::analyze(d));
+    addThunkVariants(ThunkAnalyzer::analyze(d));
+    
+    if (d->outer && d->outer->kind == Declaration::Module) {
+        if (d->kind == Declaration::Program && mainStreamed)
+            return; // the members were already delivered as units
+        collectForwardDecl(d);
+        emitDeclaration(d);
+        if (d->kind == Declaration::Program) {
+            QTextStream out(&mainCode);
+            emitMainHead(out);
+            if (d->body) {
+                indentLevel = 1;
+                emitStatementSeq(d->body, out);
+                indentLevel = 0;
+            }
+            emitMainTail(out);
+        }
+    } else {
+        collectForwardDecl(d);
+        QTextStream out(&mainCode);
+        if (d->kind == Declaration::Class || d->kind == Declaration::Procedure)
+            emitNestedDeclaration(d);
+        else
+            emitLocal(d, out, isProgramBlock(d->outer));
+    }
+}
+
+void CeeGen::emitUnit(Statement* s)
+{
+    streaming = true;
+    QTextStream out(&mainCode);
+    if (openedBlock) {
+        // the prefix follows the locals like in emitBlockStmt
+        emitBlockPrefix(openedBlock, out);
+        openedBlock = 0;
+    }
+    addStackSlots(EscapeAnalyzer::analyze(s));
+    addThunkVariants(ThunkAnalyzer::analyze(s));
+    emitStatementSeq(s, out);
+}
+
+void CeeGen::closeBlock(Statement* block)
+{
+    QTextStream out(&mainCode);
+    if (openedBlock) {
+        emitBlockPrefix(openedBlock, out);
+        openedBlock = 0;
+    }
+    emitBlockPrefixEnd(block, out);
+    decreaseIndent();
+    out << indent() << "}\n";
+    indentLevel = 0;
+    emitMainTail(out);
+}
+
 void CeeGen::emitIncludes(QTextStream& out)
 {
     out << "/* Generated by SimTranspiler - Simula 67 to C99 */\n";
@@ -448,19 +592,7 @@ void CeeGen::emitIncludes(QTextStream& out)
     out << "#include <string.h>\n";
     out << "#include <math.h>\n";
     out << "#include <gc.h>\n";
-    out << "#include \"sim_runtime.h\"\n";
-}
-
-void CeeGen::emitRuntimeDecls(QTextStream& out)
-{
-    out << "/* Forward declarations */\n";
-    out << "typedef struct SimObject SimObject;\n";
-    out << "typedef struct SimText SimText;\n";
-    out << "typedef struct SimArray SimArray;\n";
-    out << "typedef struct SimLabel SimLabel;\n";
-    out << "typedef struct SimSwitch SimSwitch;\n";
-    out << "typedef void* SimProcRef;\n";
-    out << "\n";
+    out << "#include \"sim_runtime.h\"\n"; // declares SimObject, SimText, SimArray etc., see runtime/
 }
 
 // ============================================================================
@@ -488,10 +620,7 @@ void CeeGen::emitModule(Declaration* mod)
         // Emit main function if this is a program
         if (d->kind == Declaration::Program) {
             QTextStream out(&mainCode);
-            out << "\nint main(int argc, char* argv[]) {\n";
-            out << "    GC_INIT();\n";
-            out << "    sim_init();\n";
-            out << "\n";
+            emitMainHead(out);
 
             // Emit module body
             if (d->body) {
@@ -500,15 +629,28 @@ void CeeGen::emitModule(Declaration* mod)
                 indentLevel = 0;
             }
 
-            out << "\n";
-            out << "    sim_cleanup();\n";
-            out << "    return 0;\n";
-            out << "}\n";
+            emitMainTail(out);
         }
         d = d->next;
     }
 }
 
+void CeeGen::emitMainHead(QTextStream& out)
+{
+    out << "\nint main(int argc, char* argv[]) {\n";
+    out << "    GC_INIT();\n";
+    out << "    sim_init();\n";
+    out << "\n";
+}
+
+void CeeGen::emitMainTail(QTextStream& out)
+{
+    out << "\n";
+    out << "    sim_cleanup();\n";
+    out << "    return 0;\n";
+    out << "}\n";
+}
+
 void CeeGen::emitDeclarations(Declaration *d)
 {
     while (d) {
@@ -522,20 +664,33 @@ void CeeGen::emitDeclarations(Declaration *d)
 void CeeGen::collectForwardDecls(Declaration* d)
 {
     while (d) {
-        if (d->kind == Declaration::Class && !isBuiltinDecl(d)) {
-            QTextStream out(&forwardDecls);
-            QString className = mangleClassName(d);
-            out << "typedef struct " << className << " " << className << ";\n";
-        }
-        
-        // Recurse into members
-        if (d->link)
-            collectForwardDecls(d->link);
-        
+        collectForwardDecl(d);
         d = d->next;
     }
 }
 
+void CeeGen::collectForwardDecl(Declaration* d)
+{
+    if (d->kind == Declaration::Class && !isBuiltinDecl(d) && isReachable(d)) {
+        QTextStream out(&forwardDecls);
+        QString className = mangleClassName(d);
+        out << "typedef struct " << className << " " << className << ";\n";
+        // a class body may generate an object of a class declared after it; the prototypes precede the
+        // structs, after the typedefs of all classes their parameters may refer to
+        QList<Declaration*> allParams;
+        const QStringList params = constructorParams(d, allParams);
+        QTextStream protos(&structDefs);
+        protos << className << "* " << className << "_init(" << className << "* self"
+            << (params.isEmpty() ? QString() : ", " + params.join(", ")) << ");\n";
+        protos << className << "* " << className << "_new(" << (params.isEmpty() ? QString("void") : params.join(", "))
+            << ");\n";
+    }
+    
+    // Recurse into members
+    if (d->link)
+        collectForwardDecls(d->link);
+}
+
 void CeeGen::emitDeclaration(Declaration* d)
 {
     if (!d)
@@ -573,9 +728,14 @@ void CeeGen::emitDeclaration(Declaration* d)
 // Class Generation
 // ============================================================================
 
+bool CeeGen::isReachable(Declaration* d) const
+{
+    return reachable.isEmpty() || !TreeShaker::isShakeable(d) || reachable.contains(d);
+}
+
 void CeeGen::emitClass(Declaration* cls)
 {
-    if (!cls || emittedClasses.contains(cls))
+    if (!cls || emittedClasses.contains(cls) || !isReachable(cls))
         return;
     
     emittedClasses.insert(cls);
@@ -588,17 +748,35 @@ void CeeGen::emitClass(Declaration* cls)
     
     emitClassStruct(cls);
     emitClassVtable(cls);
+    if (isStepped(cls))
+        emitClassStep(cls);
+    else if (hasCoroutineBody(cls))
+        emitClassBody(cls);
     emitClassConstructor(cls);
     
-    // Emit member procedures
+    // Emit member procedures, the ones declared in the class body included; a class declared in a class would
+    // need the enclosing object, which its objects don't know
     Declaration* member = cls->link;
     while (member) {
         if (member->kind == Declaration::Procedure)
             emitProcedure(member);
+        else if (member->kind == Declaration::Class)
+            error(member->pos, QString("class '%1' declared in class '%2' not supported")
+                  .arg(member->name.constData()).arg(cls->name.constData()));
         member = member->next;
     }
+    if (cls->body && (cls->body->kind == Statement::Block || cls->body->kind == Statement::Compound) &&
+            cls->body->scope) {
+        for (member = cls->body->scope->link; member; member = member->next)
+            if (member->kind == Declaration::Procedure)
+                emitProcedure(member);
+            else if (member->kind == Declaration::Class)
+                error(member->pos, QString("class '%1' declared in class '%2' not supported")
+                      .arg(member->name.constData()).arg(cls->name.constData()));
+    }
     
     currentClass = 0;
+    emitNestedDeclarations();
 }
 
 void CeeGen::emitClassStruct(Declaration* cls)
@@ -609,10 +787,12 @@ void CeeGen::emitClassStruct(Declaration* cls)
     out << "/* Class " << cls->name.constData() << " */\n";
     out << "struct " << className << " {\n";
     
-    // If has prefix, embed it first
+    // If has prefix, embed it first; the classes of the runtime refer to other objects
+    bool pointers = false;
     if (cls->prefix) {
         QString prefixName = mangleClassName(cls->prefix);
         out << "    " << prefixName << " _base;\n";
+        pointers = isBuiltinDecl(cls->prefix) || !pointerFree.contains(cls->prefix);
     } else {
         out << "    SimObject _base;\n";
     }
@@ -625,6 +805,7 @@ void CeeGen::emitClassStruct(Declaration* cls)
         QString varType = mapType(member->type());
         QString varName = mangleVarName(member);
         out << "    " << varType << " " << varName << ";\n";
+        pointers = pointers || holdsPointer(member->type());
         member = member->next;
     }
     
@@ -634,14 +815,64 @@ void CeeGen::emitClassStruct(Declaration* cls)
             QString varType = mapType(member->type());
             QString varName = mangleVarName(member);
             out << "    " << varType << " " << varName << ";\n";
+            pointers = pointers || holdsPointer(member->type());
         } else if (member->kind == Declaration::Array) {
             QString varName = mangleVarName(member);
             out << "    SimArray* " << varName << ";\n";
+            pointers = true;
         }
         member = member->next;
     }
     
+    // the variables of the body block are attributes, which remote accesses see; a step function keeps the
+    // locals of all blocks of the body in the object, see emitClassStep
+    QList<Declaration*> locals;
+    if (isStepped(cls)) {
+        out << "    SimTask _task;\n";
+        pointers = true;
+        collectLocals(cls->body, locals);
+    } else if (Declaration* scope = bodyScope(cls)) {
+        for (member = scope->link; member; member = member->next)
+            if (member->kind == Declaration::Variable || member->kind == Declaration::Array)
+                locals.append(member);
+    }
+    if (!locals.isEmpty()) {
+        QSet<QString> names;
+        for (member = cls->link; member; member = member->next)
+            names.insert(mangleVarName(member));
+        for (int i = 0; i < locals.size(); i++) {
+            QString name = mangleVarName(locals[i]);
+            for (int n = 1; names.contains(name); n++)
+                name = QString("%1_%2").arg(mangleVarName(locals[i])).arg(n);
+            names.insert(name);
+            hoisted[locals[i]] = name;
+            stackSlots.remove(locals[i]); // the objects it refers to live on the heap
+            out << "    " << (locals[i]->kind == Declaration::Array ? QString("SimArray*") : mapType(locals[i]->type()))
+                << " " << name << ";\n";
+            pointers = pointers || locals[i]->kind == Declaration::Array || holdsPointer(locals[i]->type());
+        }
+    }
+    
     out << "};\n\n";
+    if (!pointers)
+        pointerFree.insert(cls); // see emitClassConstructor
+}
+
+bool CeeGen::holdsPointer(Type* t)
+{
+    if (!t)
+        return false;
+    switch (t->kind) {
+    case Type::Integer:
+    case Type::ShortInteger:
+    case Type::Real:
+    case Type::LongReal:
+    case Type::Boolean:
+    case Type::Character:
+        return false;
+    default:
+        return true;
+    }
 }
 
 void CeeGen::emitClassVtable(Declaration* cls)
@@ -649,46 +880,34 @@ void CeeGen::emitClassVtable(Declaration* cls)
     QTextStream out(&vtableDefs);
     QString className = mangleClassName(cls);
     
-    // Collect virtual procedures
-    QList<Declaration*> virtuals;
-    Declaration* member = cls->link;
-    while (member) {
-        if (member->kind == Declaration::VirtualSpec || 
-            (member->kind == Declaration::Procedure && member->isVirtual)) {
-            virtuals.append(member);
-        }
-        member = member->next;
-    }
-    
-    // Also collect inherited virtuals from prefix
-    if (cls->prefix) {
-        QList<Declaration*> hierarchy;
-        collectClassHierarchy(cls->prefix, hierarchy);
-        for (int i = 0; i < hierarchy.size(); i++) {
-            Declaration* prefixMember = hierarchy[i]->link;
-            while (prefixMember) {
-                if (prefixMember->kind == Declaration::VirtualSpec) {
-                    bool found = false;
-                    for (int j = 0; j < virtuals.size(); j++) {
-                        if (virtuals[j]->sym == prefixMember->sym) {
-                            found = true;
-                            break;
-                        }
-                    }
-                    if (!found)
-                        virtuals.append(prefixMember);
-                }
-                prefixMember = prefixMember->next;
-            }
-        }
+    // Collect virtual procedures; the inherited slots come first, so the vtable of a subclass starts
+    // with the one of its prefix and a call through the static class finds the same slot
+    const QList<Declaration*> virtuals = ClassHierarchy::virtuals(cls);
+    
+    // The display holds the class id of the ancestor at each prefix level, so that
+    // "x in C" is display[level(C)] == id(C) after a bounds check on the level.
+    const int level = AstModel::prefixLevel(cls);
+    out << "static const int " << className << "_display[] = { ";
+    Declaration* anc = cls;
+    QList<int> ids;
+    while (anc) {
+        ids.prepend(getClassId(anc));
+        anc = anc->prefix;
+    }
+    for (int i = 0; i < ids.size(); i++) {
+        if (i > 0) out << ", ";
+        out << ids[i];
     }
-    
+    out << " };\n";
+
     if (virtuals.isEmpty() && !cls->prefix) {
         // No vtable needed, use base vtable
         out << "static SimVtable " << className << "_vtable = {\n";
         out << "    .class_id = " << getClassId(cls) << ",\n";
         out << "    .class_name = \"" << cls->name.constData() << "\",\n";
-        out << "    .parent_id = 0\n";
+        out << "    .parent_id = 0,\n";
+        out << "    .level = " << level << ",\n";
+        out << "    .display = " << className << "_display\n";
         out << "};\n\n";
         return;
     }
@@ -699,36 +918,70 @@ void CeeGen::emitClassVtable(Declaration* cls)
     
     for (int i = 0; i < virtuals.size(); i++) {
         Declaration* v = virtuals[i];
-        QString retType = v->type() ? mapType(v->type()) : "void";
-        out << "    " << retType << " (*" << v->name.constData() << ")(" << className << "* self";
-        
-        // Add parameter types
-        Declaration* param = v->link;
-        while (param && param->kind == Declaration::Parameter) {
-            out << ", " << mapType(param->type());
-            param = param->next;
-        }
-        out << ");\n";
+        out << "    " << virtualSlotType(v).arg(ClassHierarchy::nameOf(v)) << ";\n";
     }
     
     out << "} " << className << "_Vtable;\n\n";
     
+    // Dispatch through the slots introduced by this class, see emitMethodCall
+    for (int i = 0; i < virtuals.size(); i++) {
+        Declaration* v = virtuals[i];
+        if (ClassHierarchy::owner(v) != cls)
+            continue;
+        Declaration* sig = virtualSignature(v);
+        const QString name = ClassHierarchy::nameOf(v);
+        const QString retType = sig->type() ? mapType(sig->type()) : "void";
+        QStringList params, args;
+        params << className + "* self";
+        args << "self";
+        for (Declaration* param = sig->link; param && param->kind == Declaration::Parameter; param = param->next) {
+            const QString paramName = mangleVarName(param);
+            if (param->mode == Declaration::ModeName)
+                params << "SimThunk* " + paramName + "_thunk";
+            else
+                params << mapType(param->type()) + " " + paramName;
+            args << (param->mode == Declaration::ModeName ? paramName + "_thunk" : paramName);
+        }
+        out << "static inline " << retType << " " << className << "_" << name << "_virtual(" << params.join(", ")
+            << ") {\n";
+        out << "    " << (retType == "void" ? "" : "return ") << "((" << className << "_Vtable*)((SimObject*)self)->_vt)->"
+            << name << "(" << args.join(", ") << ");\n";
+        out << "}\n\n";
+    }
+    
+    // the implementations are defined with the members of their classes, after all vtables
+    QList<Declaration*> matches;
+    for (int i = 0; i < virtuals.size(); i++) {
+        Declaration* match = findVirtualMatch(cls, virtuals[i]);
+        if (match && match->kind == Declaration::Procedure && isReachable(match)) {
+            out << procedurePrototype(match) << ";\n";
+            matches << match;
+        } else
+            matches << 0;
+    }
+    if (!virtuals.isEmpty())
+        out << "\n";
+    
     // Emit vtable instance
     out << "static " << className << "_Vtable " << className << "_vtable = {\n";
     out << "    .base = {\n";
     out << "        .class_id = " << getClassId(cls) << ",\n";
     out << "        .class_name = \"" << cls->name.constData() << "\",\n";
     if (cls->prefix)
-        out << "        .parent_id = " << getClassId(cls->prefix) << "\n";
+        out << "        .parent_id = " << getClassId(cls->prefix) << ",\n";
     else
-        out << "        .parent_id = 0\n";
+        out << "        .parent_id = 0,\n";
+    out << "        .level = " << level << ",\n";
+    out << "        .display = " << className << "_display\n";
     out << "    }";
     
     for (int i = 0; i < virtuals.size(); i++) {
         Declaration* v = virtuals[i];
-        Declaration* match = findVirtualMatch(cls, v);
-        out << ",\n    ." << v->name.constData() << " = ";
-        if (match && match->kind == Declaration::Procedure) {
+        Declaration* match = matches[i];
+        out << ",\n    ." << ClassHierarchy::nameOf(v) << " = ";
+        if (match) {
+            if (ClassHierarchy::owner(match) != ClassHierarchy::owner(v))
+                out << "(" << virtualSlotType(v).arg("") << ")"; // the implementation takes a subclass
             out << mangleProcName(match);
         } else {
             out << "NULL";
@@ -743,91 +996,250 @@ void CeeGen::emitClassConstructor(Declaration* cls)
     QTextStream out(&funcDefs);
     QString className = mangleClassName(cls);
     
-    // Constructor signature
-    out << className << "* " << className << "_new(";
-    
-    // Collect parameters from class hierarchy
-    QList<Declaration*> hierarchy;
-    collectClassHierarchy(cls, hierarchy);
-    
+    // Initializer signature; the object is allocated by the caller, see EscapeAnalyzer
     QList<Declaration*> allParams;
-    for (int i = 0; i < hierarchy.size(); i++) {
-        Declaration* param = hierarchy[i]->link;
-        while (param && param->kind == Declaration::Parameter) {
-            allParams.append(param);
-            param = param->next;
-        }
-    }
-    
-    for (int i = 0; i < allParams.size(); i++) {
-        if (i > 0) out << ", ";
-        out << mapType(allParams[i]->type()) << " " << mangleVarName(allParams[i]);
-    }
-    if (allParams.isEmpty())
-        out << "void";
-    out << ") {\n";
+    const QStringList params = constructorParams(cls, allParams);
+    QStringList args;
+    for (int i = 0; i < allParams.size(); i++)
+        args.append(mangleVarName(allParams[i]));
+    out << className << "* " << className << "_init(" << className << "* self"
+        << (params.isEmpty() ? QString() : ", " + params.join(", ")) << ") {\n";
     
-    // Allocate object
-    out << "    " << className << "* self = (" << className << "*)GC_MALLOC(sizeof(" << className << "));\n";
-    out << "    self->_base._vt = (SimVtable*)&" << className << "_vtable;\n";
+    out << "    ((SimObject*)self)->_vt = (SimVtable*)&" << className << "_vtable;\n";
     
     // Initialize parameters
     for (int i = 0; i < allParams.size(); i++) {
-        QString varName = mangleVarName(allParams[i]);
-        out << "    self->" << varName << " = " << varName << ";\n";
+        const QString value = mangleVarName(allParams[i]);
+        const bool copy = allParams[i]->mode == Declaration::ModeValue && allParams[i]->type() &&
+                allParams[i]->type()->kind == Type::Text;
+        out << "    " << emitAttribute("self", cls, allParams[i]) << " = " << (copy ? "sim_copy(" + value + ")" : value)
+            << ";\n";
     }
     
-    // Initialize member variables to default values
-    Declaration* member = cls->link;
-    while (member) {
-        if (member->kind == Declaration::Variable) {
-            QString varName = mangleVarName(member);
-            Type* t = member->type();
-            if (t) {
-                switch (t->kind) {
-                case Type::Integer:
-                case Type::ShortInteger:
-                    out << "    self->" << varName << " = 0;\n";
-                    break;
-                case Type::Real:
-                case Type::LongReal:
-                    out << "    self->" << varName << " = 0.0;\n";
-                    break;
-                case Type::Boolean:
-                    out << "    self->" << varName << " = false;\n";
-                    break;
-                case Type::Character:
-                    out << "    self->" << varName << " = '\\0';\n";
-                    break;
-                case Type::Text:
-                    out << "    self->" << varName << " = sim_notext();\n";
-                    break;
-                case Type::Ref:
-                    out << "    self->" << varName << " = NULL;\n";
-                    break;
-                default:
-                    break;
+    // Initialize member variables to default values, the ones of the prefixes first
+    QList<Declaration*> hierarchy;
+    collectClassHierarchy(cls, hierarchy);
+    for (int i = 0; i < hierarchy.size(); i++) {
+        if (isBuiltinDecl(hierarchy[i]))
+            continue;
+        for (Declaration* member = hierarchy[i]->link; member; member = member->next) {
+            const QString target = emitAttribute("self", cls, member);
+            if (member->kind == Declaration::Variable) {
+                Type* t = member->type();
+                if (t) {
+                    switch (t->kind) {
+                    case Type::Integer:
+                    case Type::ShortInteger:
+                        out << "    " << target << " = 0;\n";
+                        break;
+                    case Type::Real:
+                    case Type::LongReal:
+                        out << "    " << target << " = 0.0;\n";
+                        break;
+                    case Type::Boolean:
+                        out << "    " << target << " = false;\n";
+                        break;
+                    case Type::Character:
+                        out << "    " << target << " = '\\0';\n";
+                        break;
+                    case Type::Text:
+                        out << "    " << target << " = sim_notext();\n";
+                        break;
+                    case Type::Ref:
+                        out << "    " << target << " = NULL;\n";
+                        break;
+                    default:
+                        break;
+                    }
                 }
+            } else if (member->kind == Declaration::Array) {
+                const QString alloc = emitArrayBounds(member->type(), out);
+                out << "    " << target << " = " << alloc << ";\n";
             }
-        } else if (member->kind == Declaration::Array) {
-            QString varName = mangleVarName(member);
-            out << "    self->" << varName << " = NULL; /* Array initialized later */\n";
         }
-        member = member->next;
+        
+        // the attributes declared in the body block, see emitClassStruct
+        if (Declaration* scope = bodyScope(hierarchy[i])) {
+            indentLevel = 1;
+            for (Declaration* member = scope->link; member; member = member->next)
+                if (hoisted.contains(member))
+                    emitLocal(member, out);
+            indentLevel = 0;
+        }
     }
     
     // Execute class body
-    if (cls->body) {
+    if (isStepped(cls)) {
+        out << "    sim_begin((SimObject*)self, &self->_task, " << className << "_step);\n";
+    } else if (hasCoroutineBody(cls)) {
+        // the initializer continues when the body detaches or ends, see sim_coroutine.c
+        out << "    sim_start((SimObject*)self, " << className << "_body);\n";
+    } else if (!classBodies(cls).isEmpty()) {
         out << "    /* Class body */\n";
         out << "    {\n";
         indentLevel = 2;
-        emitStatementSeq(cls->body, out);
+        emitClassBodies(classBodies(cls), out);
         indentLevel = 0;
         out << "    }\n";
     }
     
     out << "    return self;\n";
     out << "}\n\n";
+    
+    // Constructor on the collected heap
+    out << className << "* " << className << "_new(" << (params.isEmpty() ? QString("void") : params.join(", "))
+        << ") {\n";
+    // the collector needn't scan an object of numbers only; its vtable is static and its _co points to
+    // a coroutine, which is no collected block
+    if (pointerFree.contains(cls))
+        args.prepend(QString("(%1*)memset(GC_MALLOC_ATOMIC(sizeof(%1)), 0, sizeof(%1))").arg(className));
+    else
+        args.prepend(QString("(%1*)GC_MALLOC(sizeof(%1))").arg(className));
+    out << "    return " << className << "_init(" << args.join(", ") << ");\n";
+    out << "}\n\n";
+}
+
+QStringList CeeGen::constructorParams(Declaration* cls, QList<Declaration*>& allParams)
+{
+    // the parameters of the class hierarchy, outermost prefix first
+    QList<Declaration*> hierarchy;
+    collectClassHierarchy(cls, hierarchy);
+    QStringList params;
+    for (int i = 0; i < hierarchy.size(); i++) {
+        for (Declaration* param = hierarchy[i]->link; param && param->kind == Declaration::Parameter;
+             param = param->next) {
+            allParams.append(param);
+            params.append(mapType(param->type()) + " " + mangleVarName(param));
+        }
+    }
+    return params;
+}
+
+void CeeGen::emitClassBody(Declaration* cls)
+{
+    // a body which may detach runs as a coroutine on a stack of its own
+    QTextStream out(&funcDefs);
+    QString className = mangleClassName(cls);
+    out << "static void " << className << "_body(SimObject* obj) {\n";
+    out << "    " << className << "* self = (" << className << "*)obj;\n";
+    const bool process = ClassHierarchy::isPrefixedBy(cls, "process");
+    if (process)
+        out << "    sim_process_begin(self);\n"; // the body of class process, see sim_simulation.c
+    indentLevel = 1;
+    emitClassBodies(classBodies(cls), out);
+    indentLevel = 0;
+    if (process)
+        out << "    sim_process_end(self);\n";
+    out << "}\n\n";
+}
+
+Declaration* CeeGen::bodyScope(Declaration* cls) const
+{
+    // the block of the body whose variables the constructor initializes, also for a step function: the one of
+    // a process detaches before it enters the block
+    if (!cls->body || !cls->body->scope ||
+            (cls->body->kind != Statement::Block && cls->body->kind != Statement::Compound))
+        return 0;
+    return cls->body->scope;
+}
+
+QList<Declaration*> CeeGen::classBodies(Declaration* cls) const
+{
+    // the bodies an object of cls runs, the one of the outermost prefix first; the runtime implements the
+    // ones of the standard classes
+    QList<Declaration*> res;
+    for (; cls; cls = cls->prefix)
+        if (cls->body && !isBuiltinDecl(cls))
+            res.prepend(cls);
+    return res;
+}
+
+void CeeGen::emitClassBodies(QList<Declaration*> bodies, QTextStream& out)
+{
+    // each body continues with the ones of its subclasses at inner, or after its end if it has none
+    if (bodies.isEmpty())
+        return;
+    Declaration* cls = bodies.takeFirst();
+    const QList<Declaration*> outer = innerBodies;
+    innerBodies = bodies;
+    emitStatementSeq(cls->body, out);
+    bodies = innerBodies; // cleared by emitInner
+    innerBodies = outer;
+    emitClassBodies(bodies, out);
+}
+
+bool CeeGen::hasCoroutineBody(Declaration* cls) const
+{
+    // a process detaches even if its class has no body of its own
+    return (!classBodies(cls).isEmpty() && ClassHierarchy::detaches(cls)) ||
+            ClassHierarchy::isPrefixedBy(cls, "process");
+}
+
+bool CeeGen::isStepped(Declaration* cls) const
+{
+    // the step function only has the body of cls itself
+    const QList<Declaration*> bodies = classBodies(cls);
+    return stackless && bodies.size() == 1 && bodies.first() == cls && ClassHierarchy::detaches(cls) &&
+            ClassHierarchy::isResumable(cls);
+}
+
+void CeeGen::emitClassStep(Declaration* cls)
+{
+    // the body as a state machine: the switch continues after the suspension the object left by, and
+    // the locals live in the object, so the object is all the memory a detached one needs
+    QTextStream out(&funcDefs);
+    QString className = mangleClassName(cls);
+    out << "static void " << className << "_step(SimObject* obj) {\n";
+    out << "    " << className << "* self = (" << className << "*)obj;\n";
+    out << "    switch (self->_task.pc) {\n";
+    out << "    case 0:\n";
+    indentLevel = 2;
+    stepClass = cls;
+    resumePoints = 0;
+    const bool process = ClassHierarchy::isPrefixedBy(cls, "process");
+    if (process) {
+        // the body of class process, see emitClassBody
+        const int point = ++resumePoints;
+        out << indent() << "self->_task.pc = " << point << ";\n";
+        out << indent() << "sim_frame_process_begin(self);\n";
+        out << indent() << "return;\n";
+        out << indent() << "case " << point << ":;\n";
+    }
+    emitStatementSeq(cls->body, out);
+    stepClass = 0;
+    indentLevel = 0;
+    out << "    }\n";
+    if (process)
+        out << "    sim_process_end(self);\n";
+    out << "    sim_frame_end(obj);\n";
+    out << "}\n\n";
+}
+
+void CeeGen::collectLocals(Statement* s, QList<Declaration*>& locals)
+{
+    for (; s; s = s->next) {
+        switch (s->kind) {
+        case Statement::Compound:
+        case Statement::Block:
+            if (s->scope)
+                for (Declaration* d = s->scope->link; d; d = d->next)
+                    if (d->kind == Declaration::Variable || d->kind == Declaration::Array)
+                        locals.append(d);
+            break;
+        case Statement::If:
+        case Statement::While:
+            collectLocals(s->elseStmt, locals);
+            break;
+        case Statement::Inspect:
+            for (Connection* c = s->conn; c; c = c->next)
+                collectLocals(c->body, locals);
+            collectLocals(s->otherwise, locals);
+            break;
+        default:
+            break;
+        }
+        collectLocals(s->body, locals);
+    }
 }
 
 void CeeGen::collectClassHierarchy(Declaration* cls, QList<Declaration*>& hierarchy)
@@ -846,33 +1258,81 @@ Declaration* CeeGen::findVirtualMatch(Declaration* cls, Declaration* vspec)
     if (!cls || !vspec)
         return 0;
     
-    // Search in current class
-    Declaration* member = cls->link;
-    while (member) {
-        if (member->kind == Declaration::Procedure && member->sym == vspec->sym)
-            return member;
-        member = member->next;
+    // Search in current class and its prefixes
+    return ClassHierarchy::implementation(cls, ClassHierarchy::nameOf(vspec));
+}
+
+Declaration* CeeGen::virtualSignature(Declaration* vspec)
+{
+    // a virtual procedure without an implementation in the class specifying it takes its parameters from the
+    // ones of the subclasses, which are only all known in a closed world
+    if (vspec->forward)
+        return vspec->forward;
+    if (closedWorld) {
+        const QList<Declaration*> impls = hierarchy.implementations(ClassHierarchy::owner(vspec),
+                                                                     ClassHierarchy::nameOf(vspec));
+        if (!impls.isEmpty())
+            return impls.first();
     }
-    
-    // Search in prefix
-    if (cls->prefix)
-        return findVirtualMatch(cls->prefix, vspec);
-    
+    return vspec;
+}
+
+QString CeeGen::virtualSlotType(Declaration* vspec)
+{
+    // the slot is typed by the class introducing it, so all subclass vtables agree on it; %1 is the slot name
+    Declaration* sig = virtualSignature(vspec);
+    QString res = sig->type() ? mapType(sig->type()) : "void";
+    res += " (*%1)(" + mangleClassName(ClassHierarchy::owner(vspec)) + "*";
+    for (Declaration* param = sig->link; param && param->kind == Declaration::Parameter; param = param->next)
+        res += ", " + (param->mode == Declaration::ModeName ? QString("SimThunk*") : mapType(param->type()));
+    return res + ")";
+}
+
+QString CeeGen::procedurePrototype(Declaration* proc)
+{
+    // the general variant taking thunks for all NAME parameters, see emitProcedureVariant
+    QStringList params;
+    if (Declaration* owner = ClassHierarchy::owner(proc))
+        params << mangleClassName(owner) + "* self";
+    for (Declaration* param = proc->link; param && param->kind == Declaration::Parameter; param = param->next)
+        params << (param->mode == Declaration::ModeName ? QString("SimThunk*") : mapType(param->type()));
+    return QString("%1 %2(%3)").arg(proc->type() ? mapType(proc->type()) : "void").arg(mangleProcName(proc))
+            .arg(params.isEmpty() ? QString("void") : params.join(", "));
+}
+
+Declaration* CeeGen::attributeOwner(Declaration* proc, QString& obj)
+{
+    // a procedure of link, head or process which the runtime implements, called without a remote access
+    // in a connection block or a subclass, applies to the connected object or self
+    if (!isBuiltinProc(proc) || !proc->isExternal)
+        return 0;
+    Declaration* owner = ClassHierarchy::owner(proc);
+    if (!owner)
+        return 0;
+    const QByteArray name = owner->name.toLower();
+    if (name != "linkage" && name != "link" && name != "head" && name != "process")
+        return 0;
+    if (const Connected* c = connectedObject(owner))
+        obj = c->obj;
+    else if (currentClass && isSubclassOf(currentClass, owner))
+        obj = "self";
+    else
+        return 0;
+    return owner;
+}
+
+const CeeGen::Connected* CeeGen::connectedObject(Declaration* owner) const
+{
+    // the innermost object connected by an inspect statement whose class has the attributes of owner
+    for (int i = connections.size() - 1; i >= 0; i--)
+        if (owner && isSubclassOf(connections[i].cls, owner))
+            return &connections[i];
     return 0;
 }
 
 bool CeeGen::isSubclassOf(Declaration* sub, Declaration* super)
 {
-    if (!sub || !super)
-        return false;
-    
-    if (sub == super)
-        return true;
-    
-    if (sub->prefix)
-        return isSubclassOf(sub->prefix, super);
-    
-    return false;
+    return AstModel::isSubclassOf(sub, super);
 }
 
 int CeeGen::getClassId(Declaration* cls)
@@ -883,8 +1343,18 @@ int CeeGen::getClassId(Declaration* cls)
     if (classIdMap.contains(cls))
         return classIdMap[cls].toInt();
     
-    static int nextId = 1;
-    int id = nextId++;
+    // the standard classes have the ids of the runtime, which creates e.g. SysOut; see sim_runtime.h
+    static const char* standard[] = { "SimEnvironment", "SimBasicIO", "SimFile", "SimImageFile", "SimInFile",
+        "SimOutFile", "SimPrintFile", "SimDirectFile", "SimSimset", "SimLinkage", "SimLink", "SimHead",
+        "SimSimulation", "SimProcess", 0 };
+    const QString name = mangleClassName(cls);
+    int id = 0;
+    for (int i = 0; standard[i] && id == 0; i++)
+        if (name == standard[i])
+            id = i + 1;
+    static int nextId = 16; // SIM_CLASS_USER
+    if (id == 0)
+        id = nextId++;
     classIdMap[cls] = QString::number(id);
     return id;
 }
@@ -895,7 +1365,7 @@ int CeeGen::getClassId(Declaration* cls)
 
 void CeeGen::emitProcedure(Declaration* proc)
 {
-    if (!proc || emittedProcs.contains(proc))
+    if (!proc || emittedProcs.contains(proc) || !isReachable(proc))
         return;
     
     if (isBuiltinProc(proc))
@@ -903,7 +1373,31 @@ void CeeGen::emitProcedure(Declaration* proc)
     
     emittedProcs.insert(proc);
     
-    QTextStream out(&funcDefs);
+    emitProcedureVariant(proc, QString());
+    
+    // the variants called with NAME parameters which need no thunk, see ThunkAnalyzer
+    QStringList sigs = thunkVariants.value(proc);
+    if (streaming) {
+        // the calls following in later units can only use variants emitted while the body is there
+        const QString ref = referenceVariant(proc);
+        if (ThunkAnalyzer::isSpecialized(ref) && !sigs.contains(ref))
+            sigs.append(ref);
+        const QString con = referenceVariant(proc, true);
+        constantVariants[proc] = con;
+        if (con != ref && !sigs.contains(con))
+            sigs.append(con);
+    }
+    for (int i = 0; i < sigs.size(); i++)
+        emitProcedureVariant(proc, sigs[i]);
+    emitNestedDeclarations();
+}
+
+void CeeGen::emitProcedureVariant(Declaration* proc, const QString& sig)
+{
+    emittedVariants[proc].append(sig);
+    
+    QString head;
+    QTextStream out(&head);
     
     currentProc = proc;
     
@@ -912,21 +1406,24 @@ void CeeGen::emitProcedure(Declaration* proc)
     
     // Function name
     QString funcName = mangleProcName(proc);
+    if (!sig.isEmpty())
+        funcName += "_" + sig;
     
     // Check if this is a class member
-    bool isClassMember = proc->outer && 
-        (proc->outer->kind == Declaration::Class || proc->outer->kind == Declaration::StandardClass);
+    Declaration* owner = ClassHierarchy::owner(proc);
+    bool isClassMember = owner != 0;
     
     out << retType << " " << funcName << "(";
     
     // If class member, first parameter is self
     if (isClassMember) {
-        out << mangleClassName(proc->outer) << "* self";
+        out << mangleClassName(owner) << "* self";
     }
     
     // Parameters
     Declaration* param = proc->link;
     bool first = !isClassMember;
+    int nameParam = 0;
     while (param && param->kind == Declaration::Parameter) {
         if (!first) out << ", ";
         first = false;
@@ -936,7 +1433,21 @@ void CeeGen::emitProcedure(Declaration* proc)
         
         // Handle call by name
         if (param->mode == Declaration::ModeName) {
-            out << "SimThunk* " << paramName << "_thunk";
+            const QChar passing = nameParam < sig.size() ? sig[nameParam] : QChar('t');
+            nameParam++;
+            if (passing == 'r') {
+                namePassing[param] = ThunkAnalyzer::Reference;
+                out << paramType << "* " << paramName;
+            } else if (passing == 'v') {
+                namePassing[param] = ThunkAnalyzer::Value;
+                out << paramType << " " << paramName;
+            } else if (passing == 'c') {
+                namePassing[param] = ThunkAnalyzer::Constant;
+                out << paramType << " " << paramName;
+            } else {
+                namePassing.remove(param);
+                out << "SimThunk* " << paramName << "_thunk";
+            }
         } else {
             out << paramType << " " << paramName;
         }
@@ -947,7 +1458,12 @@ void CeeGen::emitProcedure(Declaration* proc)
     if (first)
         out << "void";
     
-    out << ") {\n";
+    out << ")";
+    out.flush();
+    // the prototypes precede all functions, so that a procedure may call one declared after it
+    QTextStream(&procDecls) << head << ";\n";
+    out.setString(&funcDefs);
+    out << head << " {\n";
     
     // Local variables
     Declaration* local = proc->link;
@@ -986,6 +1502,7 @@ void CeeGen::emitProcedure(Declaration* proc)
                 }
             }
             out << ";\n";
+            emitStackSlots(local, "    ", out);
         } else if (local->kind == Declaration::Array) {
             QString varName = mangleVarName(local);
             out << "    SimArray* " << varName << " = NULL;\n";
@@ -1024,6 +1541,11 @@ void CeeGen::emitProcedure(Declaration* proc)
         out << ";\n";
     }
     
+    // a text passed by value is a copy, which the caller's text doesn't alias
+    for (param = proc->link; param && param->kind == Declaration::Parameter; param = param->next)
+        if (param->mode == Declaration::ModeValue && param->type() && param->type()->kind == Type::Text)
+            out << "    " << mangleVarName(param) << " = sim_copy(" << mangleVarName(param) << ");\n";
+    
     out << "\n";
     
     // Procedure body
@@ -1040,9 +1562,22 @@ void CeeGen::emitProcedure(Declaration* proc)
     
     out << "}\n\n";
     
+    namePassing.clear();
     currentProc = 0;
 }
 
+void CeeGen::addThunkVariants(const ThunkAnalyzer::Result& res)
+{
+    QHash<Declaration*, QStringList>::const_iterator i;
+    for (i = res.variants.begin(); i != res.variants.end(); ++i) {
+        QStringList& sigs = thunkVariants[i.key()];
+        for (int j = 0; j < i.value().size(); j++) {
+            if (!sigs.contains(i.value()[j]))
+                sigs.append(i.value()[j]);
+        }
+    }
+}
+
 void CeeGen::emitVariable(Declaration* var)
 {
     // Global variables are emitted in the module scope
@@ -1072,6 +1607,198 @@ void CeeGen::emitBlock(Declaration* blk)
     // Blocks are handled as statements
 }
 
+void CeeGen::emitLocal(Declaration* local, QTextStream& out, bool global)
+{
+    // the variables of the blocks of the program which declare classes or procedures are globals, so that their
+    // bodies see them, see isGlobalBlock; they are initialized where the block is entered
+    QTextStream globals(&globalDefs);
+    const QString member = hoisted.value(local); // see emitClassStruct
+    if (global && !globalVars.contains(local)) {
+        // the globals of the blocks nested in the main program may have the names of other ones
+        QString name = mangleVarName(local);
+        for (int n = 1; globalVarNames.contains(name); n++)
+            name = QString("%1_%2").arg(mangleVarName(local)).arg(n);
+        globalVarNames.insert(name);
+        globalVars[local] = name;
+    }
+    if (local->kind == Declaration::Variable) {
+        QString varType = mapType(local->type());
+        QString varName = mangleVarName(local);
+        if (global) {
+            globals << "static " << varType << " " << varName << ";\n";
+            emitStackSlots(local, "static ", globals);
+            out << indent() << varName;
+        } else if (!member.isEmpty())
+            out << indent() << emitAttribute("self", currentClass, local);
+        else
+            out << indent() << varType << " " << varName;
+        
+        // Initialize
+        Type* t = local->type();
+        if (t && local->init && local->init->folded && local->init->type()->kind == t->kind) {
+            out << " = " << emitConstant(local->init, out);
+        } else if (t) {
+            switch (t->kind) {
+            case Type::Integer:
+            case Type::ShortInteger:
+                out << " = 0";
+                break;
+            case Type::Real:
+            case Type::LongReal:
+                out << " = 0.0";
+                break;
+            case Type::Boolean:
+                out << " = false";
+                break;
+            case Type::Character:
+                out << " = '\\0'";
+                break;
+            case Type::Text:
+                out << " = sim_notext()";
+                break;
+            case Type::Ref:
+                out << " = NULL";
+                break;
+            default:
+                break;
+            }
+        }
+        out << ";\n";
+        if (!global && member.isEmpty())
+            emitStackSlots(local, indent(), out);
+    } else if (local->kind == Declaration::Array) {
+        QString varName = mangleVarName(local);
+        const QString alloc = emitArrayBounds(local->type(), out);
+        if (global) {
+            globals << "static SimArray* " << varName << ";\n";
+            out << indent() << varName << " = " << alloc << ";\n";
+        } else if (!member.isEmpty())
+            out << indent() << emitAttribute("self", currentClass, local) << " = " << alloc << ";\n";
+        else
+            out << indent() << "SimArray* " << varName << " = " << alloc << ";\n";
+    }
+}
+
+void CeeGen::emitNestedDeclaration(Declaration* d)
+{
+    // a class or procedure of the block being emitted becomes a function of its own
+    const int level = indentLevel;
+    Declaration* cls = currentClass;
+    Declaration* proc = currentProc;
+    const QHash<Declaration*, ThunkAnalyzer::Passing> passing = namePassing;
+    const QHash<Declaration*, Expression*> ranges = indexRanges; // the function runs outside of the loops
+    const QList<Connected> conns = connections;
+    indentLevel = 0;
+    currentClass = 0;
+    currentProc = 0;
+    indexRanges.clear();
+    connections.clear();
+    emitDeclaration(d);
+    indentLevel = level;
+    currentClass = cls;
+    currentProc = proc;
+    namePassing = passing;
+    indexRanges = ranges;
+    connections = conns;
+}
+
+void CeeGen::emitNestedDeclarations()
+{
+    // the classes and procedures declared in the blocks of the function just emitted, see emitBlockStmt
+    while (!nestedDecls.isEmpty())
+        emitNestedDeclaration(nestedDecls.takeFirst());
+}
+
+bool CeeGen::isProgramBlock(Declaration* scope) const
+{
+    return scope && scope->kind == Declaration::Block && scope->outer &&
+            scope->outer->kind == Declaration::Program;
+}
+
+static bool declaresRoutines(Declaration* scope)
+{
+    for (Declaration* d = scope->link; d; d = d->next)
+        if (d->kind == Declaration::Class || d->kind == Declaration::Procedure ||
+                (d->kind == Declaration::Block && declaresRoutines(d)))
+            return true;
+    return false;
+}
+
+bool CeeGen::isGlobalBlock(Declaration* scope) const
+{
+    // the variables of a block of the main program are globals if a class or procedure declared in the block
+    // or a block within it may see them; the main program isn't recursive, so the block has one instance
+    if (isProgramBlock(scope))
+        return true;
+    for (Declaration* o = scope; o && o->kind != Declaration::Program; o = o->outer)
+        if (o->kind != Declaration::Block)
+            return false;
+    return declaresRoutines(scope);
+}
+
+Declaration* CeeGen::frameOf(Declaration* local) const
+{
+    // the procedure, class or main program whose C function has local as a variable, or 0 for a global
+    for (Declaration* o = local->outer; o; o = o->outer) {
+        if (o->kind == Declaration::Block && isGlobalBlock(o))
+            return 0;
+        if (o->kind == Declaration::Procedure || o->kind == Declaration::Class || o->kind == Declaration::Program)
+            return o;
+    }
+    return 0;
+}
+
+bool CeeGen::isVisible(Declaration* local) const
+{
+    // a class or procedure declared in a procedure or a class body becomes a function of its own, which doesn't
+    // see the variables of the enclosing one
+    Declaration* frame = frameOf(local);
+    if (!frame || isBuiltinDecl(local))
+        return true;
+    switch (frame->kind) {
+    case Declaration::Procedure:
+        return currentProc == frame;
+    case Declaration::Class:
+        return !currentProc && currentClass && isSubclassOf(currentClass, frame);
+    default:
+        return !currentProc && !currentClass;
+    }
+}
+
+QString CeeGen::emitArrayBounds(Type* arrType, QTextStream& out)
+{
+    // the allocation of an array declared with these bounds; the elements are zeroed by the runtime
+    if (!arrType || !arrType->getExpr())
+        return "NULL";
+    Type integer(Type::Integer);
+    QStringList args;
+    for (Expression* b = arrType->getExpr(); b; b = b->next)
+        args.append(emitConverted(b, &integer, out)); // lower and upper bound of each dimension
+    args.prepend(QString::number(args.size() / 2));
+    args.prepend(QString("sizeof(%1)").arg(arrType->type() ? mapType(arrType->type()) : QString("double")));
+    return QString("sim_array_new(%1)").arg(args.join(", "));
+}
+
+void CeeGen::emitStackSlots(Declaration* var, const QString& ind, QTextStream& out)
+{
+    // storage of the objects which never escape var, see EscapeAnalyzer
+    const QList<Declaration*> classes = stackSlots.value(var);
+    for (int i = 0; i < classes.size(); i++)
+        out << ind << mangleClassName(classes[i]) << " " << stackSlotName(var, classes[i]) << ";\n";
+}
+
+void CeeGen::addStackSlots(const EscapeAnalyzer::Result& res)
+{
+    QHash<Declaration*, QList<Declaration*> >::const_iterator i;
+    for (i = res.stackVars.begin(); i != res.stackVars.end(); ++i)
+        stackSlots[i.key()] = i.value();
+}
+
+QString CeeGen::stackSlotName(Declaration* var, Declaration* cls)
+{
+    return QString("%1_%2_slot").arg(mangleVarName(var)).arg(mangleClassName(cls));
+}
+
 // ============================================================================
 // Statement Generation
 // ============================================================================
@@ -1151,10 +1878,11 @@ void CeeGen::emitCompound(Statement* s, QTextStream& out)
     if (s->scope) {
         Declaration* local = s->scope->link;
         while (local) {
-            if (local->kind == Declaration::Variable) {
+            if (local->kind == Declaration::Variable && !hoisted.contains(local)) {
                 QString varType = mapType(local->type());
                 QString varName = mangleVarName(local);
                 out << indent() << varType << " " << varName << ";\n";
+                emitStackSlots(local, indent(), out);
             }
             local = local->next;
         }
@@ -1172,84 +1900,145 @@ void CeeGen::emitBlockStmt(Statement* s, QTextStream& out)
     out << indent() << "{\n";
     increaseIndent();
     
-    // Emit local declarations
-    if (s->scope) {
+    // Emit local declarations; the ones of a class body are initialized by the constructor
+    Declaration* owner = s->scope ? s->scope->outer : 0;
+    if (s->scope && !(currentClass && owner && owner->kind == Declaration::Class && bodyScope(owner) == s->scope &&
+                      isSubclassOf(currentClass, owner))) {
+        const bool global = isGlobalBlock(s->scope);
+        if (streaming && global && (owner->kind == Declaration::Program || isProgramBlock(owner)))
+            collectForwardDecls(s->scope->link); // declared after the declarations of the main block were delivered
         Declaration* local = s->scope->link;
         while (local) {
-            if (local->kind == Declaration::Variable) {
-                QString varType = mapType(local->type());
-                QString varName = mangleVarName(local);
-                out << indent() << varType << " " << varName;
-                
-                // Initialize
-                Type* t = local->type();
-                if (t) {
-                    switch (t->kind) {
-                    case Type::Integer:
-                    case Type::ShortInteger:
-                        out << " = 0";
-                        break;
-                    case Type::Real:
-                    case Type::LongReal:
-                        out << " = 0.0";
-                        break;
-                    case Type::Boolean:
-                        out << " = false";
-                        break;
-                    case Type::Character:
-                        out << " = '\\0'";
-                        break;
-                    case Type::Text:
-                        out << " = sim_notext()";
-                        break;
-                    case Type::Ref:
-                        out << " = NULL";
-                        break;
-                    default:
-                        break;
-                    }
-                }
-                out << ";\n";
-            } else if (local->kind == Declaration::Array) {
-                QString varName = mangleVarName(local);
-                out << indent() << "SimArray* " << varName << " = NULL;\n";
-            }
+            if (local->kind == Declaration::Class || local->kind == Declaration::Procedure) {
+                // the function being emitted in funcDefs is completed first
+                if (global)
+                    emitNestedDeclaration(local);
+                else
+                    nestedDecls.append(local);
+            } else
+                emitLocal(local, out, global);
             local = local->next;
         }
     }
     
-    // Handle prefixed block (class instantiation)
-    if (s->prefix) {
-        QString prefixExpr = emitExpr(s->prefix, out);
-        // TODO: Handle prefixed blocks properly
-        out << indent() << "/* Prefixed block: " << prefixExpr << " */\n";
-    }
+    emitBlockPrefix(s, out);
     
     if (s->body)
         emitStatementSeq(s->body, out);
     
+    emitBlockPrefixEnd(s, out);
     decreaseIndent();
     out << indent() << "}\n";
 }
 
+static Declaration* blockPrefix(Statement* block)
+{
+    // resolved by the validator when it enters the block; in streaming mode the prefix of the outermost block
+    // is never validated as an expression
+    return block->prefix && block->scope ? block->scope->prefix : 0;
+}
+
+static bool isStandardPrefix(Statement* block, const char* name)
+{
+    Declaration* cls = blockPrefix(block);
+    return cls && cls->name.toLower() == name && ClassHierarchy::isPrefixedBy(cls, name);
+}
+
+static bool isSimulationBlock(Statement* block)
+{
+    return isStandardPrefix(block, "simulation");
+}
+
+void CeeGen::emitBlockPrefix(Statement* block, QTextStream& out)
+{
+    // the prefix follows the locals; SIMULATION sets up its sequencing set, see sim_simulation.c, and the
+    // classes of SIMSET are part of the runtime; the attributes and the body of a class of the program are
+    // not available in a block, so the block can't be translated
+    if (!block->prefix)
+        return;
+    if (isSimulationBlock(block))
+        out << indent() << "sim_simulation_begin();\n";
+    else if (!isStandardPrefix(block, "simset")) {
+        Declaration* cls = blockPrefix(block);
+        error(block->prefix->pos, QString("block prefixed by class '%1' not supported")
+              .arg(cls ? cls->name.constData() : "?"));
+    }
+}
+
+void CeeGen::emitBlockPrefixEnd(Statement* block, QTextStream& out)
+{
+    if (isSimulationBlock(block))
+        out << indent() << "sim_simulation_end();\n";
+}
+
 void CeeGen::emitAssign(Statement* s, QTextStream& out)
 {
-    if (!s->lhs || !s->rhs)
+    if (!s->rhs)
+        return;
+    
+    if (!s->lhs) {
+        // the parser delivers the assignment as an AssignVal or AssignRef expression
+        emitExprStmt(s->rhs, out);
+        return;
+    }
+    
+    if (isConstantName(s->lhs)) {
+        out << indent() << "(void)(" << emitConverted(s->rhs, s->lhs->type(), out) << ");\n";
+        out << indent() << constantNameError() << ";\n";
         return;
+    }
     
     QString lhsExpr = emitExpr(s->lhs, out);
-    QString rhsExpr = emitExpr(s->rhs, out);
+    QString rhsExpr = emitConverted(s->rhs, s->lhs->type(), out);
     
     out << indent() << lhsExpr << " = " << rhsExpr << ";\n";
 }
 
+bool CeeGen::isConstantName(Expression* e) const
+{
+    return e && e->kind == Expression::DeclRef && e->d && e->d->kind == Declaration::Parameter &&
+            namePassing.value(e->d, ThunkAnalyzer::Thunk) == ThunkAnalyzer::Constant;
+}
+
+QString CeeGen::constantNameError()
+{
+    // the actual of the NAME parameter is a constant, see ThunkAnalyzer
+    return "sim_error_cstr(\"assignment to a NAME parameter whose actual is no variable\")";
+}
+
 void CeeGen::emitCallStmt(Statement* s, QTextStream& out)
 {
-    if (!s->lhs)
+    Expression* call = s->lhs ? s->lhs : s->rhs;
+    if (!call)
+        return;
+    
+    if (stepClass) {
+        const bool process = ClassHierarchy::isPrefixedBy(stepClass, "process");
+        if (Declaration* proc = ClassHierarchy::transferOf(call, process)) {
+            emitSuspension(proc, call->kind == Expression::Call ? call->rhs : 0, out);
+            return;
+        }
+    }
+    emitExprStmt(call, out);
+}
+
+void CeeGen::emitExprStmt(Expression* e, QTextStream& out)
+{
+    if (!EscapeAnalyzer::hasTemporaries(e)) {
+        QString expr = emitExpr(e, out);
+        out << indent() << expr << ";\n";
         return;
+    }
     
-    QString callExpr = emitExpr(s->lhs, out);
-    out << indent() << callExpr << ";\n";
+    // the text temporaries of the statement are released when it completes
+    out << indent() << "{\n";
+    increaseIndent();
+    out << indent() << "SimTmpMark _tm = sim_tmp_mark();\n";
+    QString expr = emitExpr(e, out);
+    out << indent() << expr << ";\n";
+    out << indent() << "sim_tmp_release(_tm);\n";
+    decreaseIndent();
+    out << indent() << "}\n";
 }
 
 void CeeGen::emitIf(Statement* s, QTextStream& out)
@@ -1290,36 +2079,76 @@ void CeeGen::emitWhile(Statement* s, QTextStream& out)
     out << indent() << "}\n";
 }
 
+static bool transfers(Statement* s, bool process)
+{
+    // s contains a suspension of a step function, see CeeGen::emitSuspension
+    for (; s; s = s->next) {
+        if (s->kind == Statement::Call && ClassHierarchy::transferOf(s->lhs ? s->lhs : s->rhs, process))
+            return true;
+        if ((s->kind == Statement::If || s->kind == Statement::While) && transfers(s->elseStmt, process))
+            return true;
+        if (transfers(s->body, process))
+            return true;
+    }
+    return false;
+}
+
 void CeeGen::emitFor(Statement* s, QTextStream& out)
 {
     if (!s->var || !s->list)
         return;
+    if (isConstantName(s->var)) {
+        // the first element would assign the controlled variable
+        out << indent() << constantNameError() << ";\n";
+        return;
+    }
     
     QString varExpr = emitExpr(s->var, out);
+    LoopAnalyzer* loops = 0; // only needed for step-until elements
     
     // Handle each for-list element
     Expression* elem = s->list;
     while (elem) {
         if (elem->kind == Expression::StepUntil) {
             // for i := start step step until limit do
-            QString startExpr = emitExpr(elem->lhs, out);
+            QString startExpr = emitConverted(elem->lhs, s->var->type(), out);
             QString stepExpr = emitExpr(elem->rhs, out);
             QString limitExpr = emitExpr(elem->condition, out);
             
-            out << indent() << "for (" << varExpr << " = " << startExpr << "; ";
-            out << "(" << stepExpr << " >= 0 ? " << varExpr << " <= " << limitExpr;
-            out << " : " << varExpr << " >= " << limitExpr << "); ";
-            out << varExpr << " += " << stepExpr << ") {\n";
-            
-            increaseIndent();
-            if (s->body)
-                emitStatementSeq(s->body, out);
-            decreaseIndent();
-            
-            out << indent() << "}\n";
+            if (loops == 0)
+                loops = new LoopAnalyzer(s);
+            Type* step = elem->rhs->type();
+            Type* limit = elem->condition->type();
+            if (step && limit && step->isArithmetic() && limit->isArithmetic() &&
+                    (s->var->type()->isReal() || step->isInteger()) &&
+                    loops->isInvariant(elem->rhs) && loops->isInvariant(elem->condition) &&
+                    (!stepClass || (elem->rhs->folded && elem->condition->folded) ||
+                     !transfers(s->body, ClassHierarchy::isPrefixedBy(stepClass, "process")))) {
+                // the control variable stays between start and limit in the body if only the loop assigns it
+                Declaration* control = 0;
+                if (loops->isFixedControl() && s->var->type()->isInteger() && elem->rhs->folded &&
+                        step->isInteger() && Folder::integer(elem->rhs) != 0)
+                    control = s->var->d;
+                if (control)
+                    indexRanges.insert(control, elem);
+                emitCountedFor(s, elem, varExpr, startExpr, stepExpr, limitExpr, out);
+                indexRanges.remove(control);
+            } else {
+                out << indent() << "for (" << varExpr << " = " << startExpr << "; ";
+                out << "(" << stepExpr << " >= 0 ? " << varExpr << " <= " << limitExpr;
+                out << " : " << varExpr << " >= " << limitExpr << "); ";
+                out << varExpr << " += " << stepExpr << ") {\n";
+                
+                increaseIndent();
+                if (s->body)
+                    emitStatementSeq(s->body, out);
+                decreaseIndent();
+                
+                out << indent() << "}\n";
+            }
         } else if (elem->kind == Expression::WhileLoop) {
             // for i := expr while cond do
-            QString startExpr = emitExpr(elem->lhs, out);
+            QString startExpr = emitConverted(elem->lhs, s->var->type(), out);
             QString condExpr = emitExpr(elem->condition, out);
             
             out << indent() << varExpr << " = " << startExpr << ";\n";
@@ -1334,7 +2163,7 @@ void CeeGen::emitFor(Statement* s, QTextStream& out)
             out << indent() << "}\n";
         } else {
             // Simple expression
-            QString valExpr = emitExpr(elem, out);
+            QString valExpr = emitConverted(elem, s->var->type(), out);
             out << indent() << varExpr << " = " << valExpr << ";\n";
             out << indent() << "{\n";
             increaseIndent();
@@ -1346,6 +2175,51 @@ void CeeGen::emitFor(Statement* s, QTextStream& out)
         
         elem = elem->next;
     }
+    delete loops;
+}
+
+void CeeGen::emitCountedFor(Statement* s, Expression* elem, const QString& var, const QString& start,
+                            QString step, QString limit, QTextStream& out)
+{
+    // step and limit don't change while the loop runs, see LoopAnalyzer; they are evaluated once, and
+    // a constant step decides the direction of the test at compile time
+    const bool block = !elem->rhs->folded || !elem->condition->folded;
+    if (block) {
+        out << indent() << "{\n";
+        increaseIndent();
+    }
+    if (!elem->condition->folded) {
+        const QString tmp = newTempVar("limit");
+        out << indent() << "const " << mapType(elem->condition->type()) << " " << tmp << " = " << limit << ";\n";
+        limit = tmp;
+    }
+    QString test, next;
+    if (elem->rhs->folded) {
+        const bool real = elem->rhs->type()->isReal();
+        const bool down = real ? Folder::real(elem->rhs) < 0 : Folder::integer(elem->rhs) < 0;
+        test = QString("%1 %2 %3").arg(var).arg(down ? ">=" : "<=").arg(limit);
+        if (!real && Folder::integer(elem->rhs) == 1)
+            next = var + "++";
+        else if (!real && Folder::integer(elem->rhs) == -1)
+            next = var + "--";
+        else
+            next = QString("%1 += %2").arg(var).arg(step);
+    } else {
+        const QString tmp = newTempVar("step");
+        out << indent() << "const " << mapType(elem->rhs->type()) << " " << tmp << " = " << step << ";\n";
+        test = QString("(%1 >= 0 ? %2 <= %3 : %2 >= %3)").arg(tmp).arg(var).arg(limit);
+        next = QString("%1 += %2").arg(var).arg(tmp);
+    }
+    out << indent() << "for (" << var << " = " << start << "; " << test << "; " << next << ") {\n";
+    increaseIndent();
+    if (s->body)
+        emitStatementSeq(s->body, out);
+    decreaseIndent();
+    out << indent() << "}\n";
+    if (block) {
+        decreaseIndent();
+        out << indent() << "}\n";
+    }
 }
 
 void CeeGen::emitInspect(Statement* s, QTextStream& out)
@@ -1360,7 +2234,7 @@ void CeeGen::emitInspect(Statement* s, QTextStream& out)
     increaseIndent();
     out << indent() << "SimObject* " << tempVar << " = (SimObject*)" << objExpr << ";\n";
     
-    // Emit WHEN clauses
+    // Emit WHEN clauses; the unqualified attributes of the class in the body are the ones of the object
     Connection* conn = s->conn;
     bool first = true;
     while (conn) {
@@ -1370,13 +2244,17 @@ void CeeGen::emitInspect(Statement* s, QTextStream& out)
             
             out << indent();
             if (!first) out << "} else ";
-            out << "if (" << tempVar << " != NULL && sim_is_instance(" << tempVar << ", " << classId << ")) {\n";
+            out << "if (sim_in_class(" << tempVar << ", " << AstModel::prefixLevel(conn->classDecl) << ", "
+                << classId << ")) {\n";
             
             increaseIndent();
-            out << indent() << className << "* this_" << conn->className << " = (" << className << "*)" << tempVar << ";\n";
+            const QString thisVar = QString("this_%1").arg(conn->className);
+            out << indent() << className << "* " << thisVar << " = (" << className << "*)" << tempVar << ";\n";
             
+            connections.append(Connected(conn->classDecl, thisVar));
             if (conn->body)
                 emitStatementSeq(conn->body, out);
+            connections.removeLast();
             
             decreaseIndent();
             first = false;
@@ -1384,6 +2262,23 @@ void CeeGen::emitInspect(Statement* s, QTextStream& out)
         conn = conn->next;
     }
     
+    // DO clause, if the object isn't none
+    if (s->body) {
+        out << indent();
+        if (!first) out << "} else ";
+        out << "if (" << tempVar << ") {\n";
+        increaseIndent();
+        Type* t = s->obj->type();
+        Declaration* cls = t && t->kind == Type::Ref ? t->getRefType() : 0;
+        if (cls)
+            connections.append(Connected(cls, QString("((%1*)%2)").arg(mangleClassName(cls)).arg(tempVar)));
+        emitStatementSeq(s->body, out);
+        if (cls)
+            connections.removeLast();
+        decreaseIndent();
+        first = false;
+    }
+    
     // OTHERWISE clause
     if (s->otherwise) {
         out << indent();
@@ -1392,32 +2287,48 @@ void CeeGen::emitInspect(Statement* s, QTextStream& out)
         increaseIndent();
         emitStatementSeq(s->otherwise, out);
         decreaseIndent();
+        first = false;
     }
     
     if (!first)
         out << indent() << "}\n";
     
-    // DO clause
-    if (s->body) {
-        out << indent() << "/* DO clause */\n";
-        emitStatementSeq(s->body, out);
-    }
-    
     decreaseIndent();
     out << indent() << "}\n";
 }
 
 void CeeGen::emitGoto(Statement* s, QTextStream& out)
 {
-    if (!s->lhs)
-        return;
-    
+    if (s->lhs)
+        emitGoto(s->lhs, out);
+}
+
+void CeeGen::emitGoto(Expression* e, QTextStream& out)
+{
     // Simple label reference
-    if (s->lhs->kind == Expression::DeclRef && s->lhs->d) {
-        out << indent() << "goto " << mangleVarName(s->lhs->d) << ";\n";
+    if (e->kind == Expression::DeclRef && e->d && e->d->kind == Declaration::LabelDecl) {
+        out << indent() << "goto " << mangleIdent(e->d->sym) << ";\n";
+    } else if (e->kind == Expression::DeclRef && e->d) {
+        out << indent() << "goto " << mangleVarName(e->d) << ";\n";
+    } else if (e->kind == Expression::Identifier) {
+        // streamed label declared after the goto
+        out << indent() << "goto " << mangleIdent(e->a) << ";\n";
+    } else if (e->kind == Expression::IfExpr) {
+        // conditional designational expression; each alternative is a goto of its own, so that it may be a
+        // streamed label as well
+        QString condExpr = emitExpr(e->condition, out);
+        out << indent() << "if (" << condExpr << ") {\n";
+        increaseIndent();
+        emitGoto(e->lhs, out);
+        decreaseIndent();
+        out << indent() << "} else {\n";
+        increaseIndent();
+        emitGoto(e->rhs, out);
+        decreaseIndent();
+        out << indent() << "}\n";
     } else {
         // Computed goto (switch designator)
-        QString labelExpr = emitExpr(s->lhs, out);
+        QString labelExpr = emitExpr(e, out);
         out << indent() << "sim_goto(" << labelExpr << ");\n";
     }
 }
@@ -1427,25 +2338,42 @@ void CeeGen::emitLabel(Statement* s, QTextStream& out)
     if (!s->label)
         return;
     
-    out << mangleVarName(s->label) << ":;\n";
+    // labels are case insensitive and may be referenced before they are declared, so use the symbol
+    out << mangleIdent(s->label->sym) << ":;\n";
 }
 
 void CeeGen::emitInner(Statement* s, QTextStream& out)
 {
-    out << indent() << "/* INNER - subclass body would be called here */\n";
-    // In the actual implementation, this would call the subclass body function
-    // For now, we emit a placeholder
+    // the bodies of the subclasses of the object being emitted, see emitClassBodies
+    const QList<Declaration*> bodies = innerBodies;
+    innerBodies.clear();
+    emitClassBodies(bodies, out);
 }
 
 void CeeGen::emitActivate(Statement* s, QTextStream& out)
 {
-    out << indent() << "/* ACTIVATE - Stage 2 feature */\n";
-    // Stage 2 implementation
+    // each scheduling clause has a function of its own, see sim_simulation.c
+    ActivateData* a = s->activate;
+    if (!a || !a->obj)
+        return;
+    const QString obj = "(void*)" + emitExpr(a->obj, out);
+    const QString re = s->re ? "true" : "false";
+    Type real(Type::Real);
+    if (a->at || a->delay) {
+        const QString t = emitConverted(a->at ? a->at : a->delay, &real, out);
+        out << indent() << (a->at ? "sim_activate_at(" : "sim_activate_delay(") << obj << ", " << t << ", "
+            << (s->prior ? "true" : "false") << ", " << re << ");\n";
+    } else if (a->priorObj) {
+        const QString y = "(void*)" + emitExpr(a->priorObj, out);
+        out << indent() << (s->prior ? "sim_activate_before(" : "sim_activate_after(") << obj << ", " << y << ", "
+            << re << ");\n";
+    } else
+        out << indent() << "sim_activate(" << obj << ", " << re << ");\n";
 }
 
 void CeeGen::emitDetach(Statement* s, QTextStream& out)
 {
-    out << indent() << "sim_detach();\n";
+    out << indent() << "sim_detach(" << (currentClass ? "self" : "NULL") << ");\n";
 }
 
 void CeeGen::emitResume(Statement* s, QTextStream& out)
@@ -1456,6 +2384,24 @@ void CeeGen::emitResume(Statement* s, QTextStream& out)
     }
 }
 
+void CeeGen::emitSuspension(Declaration* proc, Expression* args, QTextStream& out)
+{
+    // detach, resume or call in a step function, or hold, passivate or wait in the one of a process, which
+    // returns and continues at the label when the object operates again; nothing but the object is live
+    // across it, see emitClassStep
+    const int point = ++resumePoints;
+    const QByteArray name = proc->name.toLower();
+    QString target = args ? emitExpr(args, out) : QString("self");
+    if (name == "passivate")
+        target.clear(); // of the operating process, see sim_simulation.c
+    else if (name == "wait")
+        target = "(SimHead*)" + target;
+    out << indent() << "self->_task.pc = " << point << ";\n";
+    out << indent() << "sim_frame_" << name.constData() << "(" << target << ");\n";
+    out << indent() << "return;\n";
+    out << indent() << "case " << point << ":;\n";
+}
+
 // ============================================================================
 // Expression Generation
 // ============================================================================
@@ -1465,6 +2411,9 @@ QString CeeGen::emitExpr(Expression* e, QTextStream& out)
     if (!e)
         return "NULL";
     
+    if (e->folded)
+        return emitConstant(e, out);
+    
     switch (e->kind) {
     case Expression::Add:
     case Expression::Sub:
@@ -1539,6 +2488,19 @@ QString CeeGen::emitExpr(Expression* e, QTextStream& out)
     }
 }
 
+static bool isText(Expression* e)
+{
+    return e && e->type() && ( e->type()->kind == Type::Text || e->type()->kind == Type::Notext );
+}
+
+QString CeeGen::realLiteral(double r)
+{
+    QString str = QString::number(r, 'g', 17);
+    if (!str.contains('.') && !str.contains('e'))
+        str += ".0"; // keep it a floating point literal in C
+    return str;
+}
+
 QString CeeGen::emitBinaryOp(Expression* e, QTextStream& out)
 {
     QString lhs = emitExpr(e->lhs, out);
@@ -1552,11 +2514,13 @@ QString CeeGen::emitBinaryOp(Expression* e, QTextStream& out)
     case Expression::Mul:
         return QString("(%1 * %2)").arg(lhs).arg(rhs);
     case Expression::Div:
+        if (e->type() && e->type()->isReal())
+            return QString("((double)(%1) / (%2))").arg(lhs).arg(rhs); // never the C integer division
         return QString("(%1 / %2)").arg(lhs).arg(rhs);
     case Expression::IntDiv:
-        return QString("((%1) / (%2))").arg(lhs).arg(rhs);
+        return QString("((%1) / (%2))").arg(lhs).arg(rhs); // both truncate towards zero
     case Expression::Exp:
-        return QString("pow(%1, %2)").arg(lhs).arg(rhs);
+        return emitPower(e, lhs, rhs);
     case Expression::And:
         return QString("(%1 && %2)").arg(lhs).arg(rhs);
     case Expression::Or:
@@ -1595,8 +2559,12 @@ QString CeeGen::emitBinaryOp(Expression* e, QTextStream& out)
             return QString("(sim_text_cmp(%1, %2) >= 0)").arg(lhs).arg(rhs);
         return QString("(%1 >= %2)").arg(lhs).arg(rhs);
     case Expression::RefEq:
+        if (isText(e->lhs) || isText(e->rhs))
+            return QString("sim_text_same(%1, %2)").arg(lhs).arg(rhs);
         return QString("(%1 == %2)").arg(lhs).arg(rhs);
     case Expression::RefNeq:
+        if (isText(e->lhs) || isText(e->rhs))
+            return QString("!sim_text_same(%1, %2)").arg(lhs).arg(rhs);
         return QString("(%1 != %2)").arg(lhs).arg(rhs);
     case Expression::Is:
         if (e->rhs && e->rhs->kind == Expression::DeclRef && e->rhs->d) {
@@ -1607,17 +2575,87 @@ QString CeeGen::emitBinaryOp(Expression* e, QTextStream& out)
     case Expression::In:
         if (e->rhs && e->rhs->kind == Expression::DeclRef && e->rhs->d) {
             int classId = getClassId(e->rhs->d);
-            return QString("sim_is_instance((SimObject*)%1, %2)").arg(lhs).arg(classId);
+            return QString("sim_in_class((SimObject*)%1, %2, %3)").arg(lhs)
+                    .arg(AstModel::prefixLevel(e->rhs->d)).arg(classId);
         }
-        return QString("sim_is_instance((SimObject*)%1, 0)").arg(lhs);
+        return QString("sim_in_class((SimObject*)%1, 0, 0)").arg(lhs);
     default:
         return QString("(%1 ? %2)").arg(lhs).arg(rhs);
     }
 }
 
+QString CeeGen::emitConverted(Expression* e, Type* to, QTextStream& out)
+{
+    // the value of e as the arithmetic type to, e.g. of an assignment or value parameter
+    Type* from = e ? e->type() : 0;
+    if (!from || !to || !from->isArithmetic() || !to->isArithmetic() || from->isReal() == to->isReal())
+        return emitExpr(e, out);
+    if (to->isInteger()) {
+        // real to integer rounds, where C truncates
+        if (e->folded)
+            return QString::number(Folder::integer(e));
+        return QString("sim_round(%1)").arg(emitExpr(e, out));
+    }
+    if (e->folded)
+        return emitConstant(e, out) + ".0";
+    return QString("(double)%1").arg(emitExpr(e, out));
+}
+
+static bool isPlain(Expression* e)
+{
+    // evaluating e again has no effect and costs no more than a load
+    if (e->folded)
+        return true;
+    switch (e->kind) {
+    case Expression::DeclRef:
+        return e->d && (e->d->kind == Declaration::Variable ||
+                        (e->d->kind == Declaration::Parameter && e->d->mode != Declaration::ModeName));
+    case Expression::Dot:
+        return e->lhs && isPlain(e->lhs) && e->rhs && isPlain(e->rhs);
+    default:
+        return false;
+    }
+}
+
+QString CeeGen::emitPower(Expression* e, const QString& lhs, const QString& rhs)
+{
+    Type* base = e->lhs->type();
+    Type* exp = e->rhs->type();
+    if (!base || !exp || !exp->isInteger())
+        return QString("pow(%1, %2)").arg(lhs).arg(rhs);
+    const qint64 n = e->rhs->folded ? Folder::integer(e->rhs) : -1;
+    if (n >= 1 && n <= 4 && isPlain(e->lhs)) {
+        // small constant exponents are multiplied out
+        QStringList factors;
+        for (int i = 0; i < n; i++)
+            factors.append(lhs);
+        return QString("(%1)").arg(factors.join(" * "));
+    }
+    if (base->isInteger())
+        return QString("sim_ipow(%1, %2)").arg(lhs).arg(rhs); // an integer result, no rounding through pow
+    return QString("sim_rpowi(%1, %2)").arg(lhs).arg(rhs);
+}
+
+QString CeeGen::emitArithmeticCall(Declaration* proc, Expression* args, QTextStream& out)
+{
+    // the generic procedures of the environment with integer arguments, see Validator2::arithmeticCall;
+    // returns an empty string for all other calls
+    Declaration* env = proc->outer ? proc->outer->outer : 0; // the class of the body block declaring proc
+    if (!args || !args->type() || env == 0 || env->name.toLower() != "environment")
+        return QString();
+    const bool integer = args->type()->isInteger() && (!args->next || (args->next->type() && args->next->type()->isInteger()));
+    if (qstrcmp(proc->sym, "entier") == 0 && integer)
+        return emitExpr(args, out);
+    if (qstrcmp(proc->sym, "abs") == 0)
+        return QString(integer ? "abs(%1)" : "fabs(%1)").arg(emitExpr(args, out));
+    if (qstrcmp(proc->sym, "mod") == 0 && integer && args->next)
+        return QString("sim_mod(%1, %2)").arg(emitExpr(args, out)).arg(emitExpr(args->next, out));
+    return QString();
+}
+
 QString CeeGen::emitUnaryOp(Expression* e, QTextStream& out)
 {
-    QString operand = emitExpr(e->lhs, out);
+    QString operand = emitExpr(e->rhs, out); // the parser puts the operand to the right
     
     switch (e->kind) {
     case Expression::Neg:
@@ -1636,6 +2674,15 @@ QString CeeGen::emitIdentifier(Expression* e, QTextStream& out)
     return "/* unknown identifier */";
 }
 
+static bool isCallable(Declaration* d)
+{
+    // a procedure, or a virtual procedure without an implementation in the static class
+    if (d->kind == Declaration::Procedure)
+        return true;
+    return d->kind == Declaration::VirtualSpec &&
+            !(d->type() && (d->type()->kind == Type::Label || d->type()->kind == Type::Switch));
+}
+
 QString CeeGen::emitDeclRef(Expression* e, QTextStream& out)
 {
     if (!e->d)
@@ -1643,29 +2690,51 @@ QString CeeGen::emitDeclRef(Expression* e, QTextStream& out)
     
     Declaration* d = e->d;
     
-    // Check if it's a class member access
-    if (currentClass && d->outer == currentClass) {
-        return QString("self->%1").arg(mangleVarName(d));
+    // Check if it's a call of a member procedure without arguments
+    if (isCallable(d) && !isBuiltinProc(d) && isMember(d))
+        return emitMethodCall(e, 0, d, 0, out);
+    
+    // an attribute of the connected object or of self, declared in its class or a prefix, or a local of a
+    // step function, which lives in the object too, see emitClassStruct
+    if (isAttribute(d)) {
+        if (const Connected* c = connectedObject(ClassHierarchy::owner(d)))
+            return emitAttribute(c->obj, c->cls, d);
+        if (currentClass && isSubclassOf(currentClass, ClassHierarchy::owner(d)))
+            return emitAttribute("self", currentClass, d);
     }
+    if (hoisted.contains(d))
+        return "self->" + hoisted.value(d);
     
     // Check if it's a procedure parameter
     if (currentProc && d->outer == currentProc && d->kind == Declaration::Parameter) {
         if (d->mode == Declaration::ModeName) {
-            return QString("sim_thunk_eval(%1_thunk)").arg(mangleVarName(d));
+            switch (namePassing.value(d, ThunkAnalyzer::Thunk)) {
+            case ThunkAnalyzer::Reference:
+                return QString("(*%1)").arg(mangleVarName(d));
+            case ThunkAnalyzer::Value:
+            case ThunkAnalyzer::Constant:
+                return mangleVarName(d);
+            default:
+                // the thunk returns the address of the location or value, see sim_runtime.h
+                return QString("(*(%1*)sim_thunk_eval(%2_thunk))").arg(mapType(d->type())).arg(mangleVarName(d));
+            }
         }
         return mangleVarName(d);
     }
     
     // Check if it's a local variable
-    if (d->kind == Declaration::Variable || d->kind == Declaration::Parameter) {
+    if (d->kind == Declaration::Variable || d->kind == Declaration::Parameter || d->kind == Declaration::Array) {
+        if (!isVisible(d))
+            error(e->pos, QString("'%1' of '%2' is not accessible from a class or procedure declared in it")
+                  .arg(d->name.constData()).arg(frameOf(d)->name.constData()));
         return mangleVarName(d);
     }
     
-    // Check if it's a procedure
+    // Check if it's a procedure; the designator without arguments is a call
     if (d->kind == Declaration::Procedure) {
         if (isBuiltinProc(d))
-            return getBuiltinProcName(d);
-        return mangleProcName(d);
+            return emitBuiltinCall(d, 0, out);
+        return mangleProcName(d) + "()";
     }
     
     // Check if it's a class
@@ -1678,18 +2747,20 @@ QString CeeGen::emitDeclRef(Expression* e, QTextStream& out)
 
 QString CeeGen::emitDot(Expression* e, QTextStream& out)
 {
+    // Check if it's a procedure call without arguments
+    if (e->rhs && e->rhs->kind == Expression::DeclRef && e->rhs->d && isCallable(e->rhs->d)) {
+        if (isBuiltinProc(e->rhs->d))
+            return emitBuiltinMethod(e->lhs, e->rhs->d, 0, out);
+        if (ClassHierarchy::owner(e->rhs->d))
+            return emitMethodCall(e, e->lhs, e->rhs->d, 0, out);
+    }
+    
     QString lhs = emitExpr(e->lhs, out);
     
     if (e->rhs && e->rhs->kind == Expression::DeclRef && e->rhs->d) {
         Declaration* member = e->rhs->d;
-        
-        // Check if it's a procedure call
-        if (member->kind == Declaration::Procedure) {
-            // This will be handled by emitCall
-            return QString("%1->%2").arg(lhs).arg(mangleVarName(member));
-        }
-        
-        return QString("%1->%2").arg(lhs).arg(mangleVarName(member));
+        Type* t = e->lhs->type();
+        return emitAttribute(lhs, t && t->kind == Type::Ref ? t->getRefType() : 0, member);
     }
     
     if (e->rhs && e->rhs->kind == Expression::Identifier && e->rhs->a) {
@@ -1699,6 +2770,30 @@ QString CeeGen::emitDot(Expression* e, QTextStream& out)
     return lhs;
 }
 
+QString CeeGen::emitAttribute(const QString& obj, Declaration* cls, Declaration* attr)
+{
+    // obj is of class cls; an attribute declared in a prefix is in the struct of the prefix, which begins the
+    // one of cls, see emitClassStruct
+    const QString name = hoisted.contains(attr) ? hoisted.value(attr) : mangleVarName(attr);
+    Declaration* owner = ClassHierarchy::owner(attr);
+    if (cls && owner && owner != cls && !isBuiltinDecl(owner))
+        return QString("((%1*)%2)->%3").arg(mangleClassName(owner)).arg(obj).arg(name);
+    return QString("%1->%2").arg(obj).arg(name);
+}
+
+bool CeeGen::isMember(Declaration* proc) const
+{
+    // called without a remote access on the connected object or self
+    Declaration* owner = ClassHierarchy::owner(proc);
+    return owner && (connectedObject(owner) || (currentClass && isSubclassOf(currentClass, owner)));
+}
+
+bool CeeGen::isAttribute(Declaration* d)
+{
+    return (d->kind == Declaration::Variable || d->kind == Declaration::Parameter ||
+            d->kind == Declaration::Array) && ClassHierarchy::owner(d) != 0;
+}
+
 QString CeeGen::emitSubscript(Expression* e, QTextStream& out)
 {
     QString arr = emitExpr(e->lhs, out);
@@ -1706,17 +2801,68 @@ QString CeeGen::emitSubscript(Expression* e, QTextStream& out)
     // Collect indices
     QStringList indices;
     Expression* idx = e->rhs;
+    Type integer(Type::Integer);
     while (idx) {
-        indices.append(emitExpr(idx, out));
+        indices.append(emitConverted(idx, &integer, out));
         idx = idx->next;
     }
     
-    if (indices.size() == 1) {
-        return QString("sim_array_get(%1, %2)").arg(arr).arg(indices[0]);
-    } else {
-        QString idxList = indices.join(", ");
-        return QString("sim_array_get_multi(%1, %2, %3)").arg(arr).arg(indices.size()).arg(idxList);
+    // the element is addressed by inline arithmetic on the strides, see sim_array_elem; an index is only checked
+    // if it isn't proven in range, and the number of indices if the array isn't declared with as many dimensions
+    Type* arrType = e->lhs->type();
+    Type* elemType = arrType && arrType->kind == Type::Array ? arrType->type() : e->type();
+    const QString elem = elemType ? mapType(elemType) : QString("double");
+    Declaration* array = e->lhs->kind == Expression::DeclRef ? e->lhs->d : 0;
+    int rank = 0;
+    if (array && array->kind == Declaration::Array && array->type())
+        for (Expression* b = array->type()->getExpr(); b; b = b->next)
+            rank++;
+    quint32 mask = 0;
+    int dim = 0;
+    for (idx = e->rhs; idx; idx = idx->next, dim++)
+        if (checks || !isInBounds(idx, array, dim))
+            mask |= 1u << dim;
+    QString check = rank / 2 != indices.size() ? QString("SIM_CHECK_RANK") : QString();
+    if (mask != 0 || check.isEmpty())
+        check += QString(check.isEmpty() ? "0x%1" : " | 0x%1").arg(mask, 0, 16);
+    return QString("(*(%1*)sim_array_elem(%2, sizeof(%1), %3, (const int32_t[]){ %4 }, %5))").arg(elem).arg(arr)
+            .arg(indices.size()).arg(indices.join(", ")).arg(check);
+}
+
+bool CeeGen::isInBounds(Expression* index, Declaration* array, int dim) const
+{
+    // the index is a constant within the constant bounds of the dimension, or the control variable of a loop being
+    // emitted, see emitFor, whose least value is not below the lower bound and whose greatest value is not above
+    // the upper bound; the loop doesn't run if the former is greater than the latter
+    if (array == 0 || index == 0)
+        return false;
+    QList<qint64> bounds;
+    const bool fixed = array->kind == Declaration::Array && Folder::staticBounds(array->type(), bounds) &&
+            bounds.size() > 2 * dim + 1;
+    if (fixed && index->folded && index->type() && index->type()->isInteger()) {
+        const qint64 v = Folder::integer(index);
+        return v >= bounds[2 * dim] && v <= bounds[2 * dim + 1];
+    }
+    if (index->kind != Expression::DeclRef || !indexRanges.contains(index->d))
+        return false;
+    Expression* elem = indexRanges.value(index->d);
+    const bool down = Folder::integer(elem->rhs) < 0;
+    Expression* least = down ? elem->condition : elem->lhs;
+    Expression* greatest = down ? elem->lhs : elem->condition;
+    for (int i = 0; i < 2; i++) {
+        Expression* e = i == 0 ? least : greatest;
+        bool upper;
+        qint64 d;
+        if (LoopAnalyzer::arrayBound(e, upper, d) == array && upper == (i == 1) && d == dim + 1)
+            continue;
+        if (fixed && e->folded && e->type() && e->type()->isInteger()) {
+            const qint64 v = Folder::integer(e);
+            if (v >= bounds[2 * dim] && v <= bounds[2 * dim + 1])
+                continue;
+        }
+        return false;
     }
+    return true;
 }
 
 QString CeeGen::emitCall(Expression* e, QTextStream& out)
@@ -1724,97 +2870,26 @@ QString CeeGen::emitCall(Expression* e, QTextStream& out)
     if (!e->lhs)
         return "/* invalid call */";
     
+    if (e->lhs->kind == Expression::New)
+        return emitNew(e, out); // NEW C(args)
+    
     // Check if it's a dot call (method call)
     if (e->lhs->kind == Expression::Dot) {
-        QString obj = emitExpr(e->lhs->lhs, out);
-        
         if (e->lhs->rhs && e->lhs->rhs->kind == Expression::DeclRef && e->lhs->rhs->d) {
             Declaration* proc = e->lhs->rhs->d;
+            if (!isBuiltinProc(proc) && ClassHierarchy::owner(proc))
+                return emitMethodCall(e, e->lhs->lhs, proc, e->rhs, out);
             
-            // Check for TEXT methods
-            if (e->lhs->lhs && e->lhs->lhs->type() && e->lhs->lhs->type()->kind == Type::Text) {
-                QString methodName = QString(proc->name.constData()).toLower();
-                
-                if (methodName == "length") return QString("sim_text_length(%1)").arg(obj);
-                if (methodName == "pos") return QString("sim_text_pos(%1)").arg(obj);
-                if (methodName == "setpos") {
-                    QString arg = e->rhs ? emitExpr(e->rhs, out) : "1";
-                    return QString("sim_text_setpos(&%1, %2)").arg(obj).arg(arg);
-                }
-                if (methodName == "more") return QString("sim_text_more(%1)").arg(obj);
-                if (methodName == "getchar") return QString("sim_text_getchar(&%1)").arg(obj);
-                if (methodName == "putchar") {
-                    QString arg = e->rhs ? emitExpr(e->rhs, out) : "'\\0'";
-                    return QString("sim_text_putchar(&%1, %2)").arg(obj).arg(arg);
-                }
-                if (methodName == "sub") {
-                    QString arg1 = "1", arg2 = "0";
-                    if (e->rhs) {
-                        arg1 = emitExpr(e->rhs, out);
-                        if (e->rhs->next)
-                            arg2 = emitExpr(e->rhs->next, out);
-                    }
-                    return QString("sim_text_sub(%1, %2, %3)").arg(obj).arg(arg1).arg(arg2);
-                }
-                if (methodName == "strip") return QString("sim_text_strip(%1)").arg(obj);
-                if (methodName == "getint") return QString("sim_text_getint(&%1)").arg(obj);
-                if (methodName == "getreal") return QString("sim_text_getreal(&%1)").arg(obj);
-                if (methodName == "putint") {
-                    QString arg1 = "0", arg2 = "0";
-                    if (e->rhs) {
-                        arg1 = emitExpr(e->rhs, out);
-                        if (e->rhs->next)
-                            arg2 = emitExpr(e->rhs->next, out);
-                    }
-                    return QString("sim_text_putint(&%1, %2, %3)").arg(obj).arg(arg1).arg(arg2);
-                }
-                if (methodName == "putfix") {
-                    QString arg1 = "0.0", arg2 = "0", arg3 = "0";
-                    if (e->rhs) {
-                        arg1 = emitExpr(e->rhs, out);
-                        if (e->rhs->next) {
-                            arg2 = emitExpr(e->rhs->next, out);
-                            if (e->rhs->next->next)
-                                arg3 = emitExpr(e->rhs->next->next, out);
-                        }
-                    }
-                    return QString("sim_text_putfix(&%1, %2, %3, %4)").arg(obj).arg(arg1).arg(arg2).arg(arg3);
-                }
-                if (methodName == "putreal") {
-                    QString arg1 = "0.0", arg2 = "0", arg3 = "0";
-                    if (e->rhs) {
-                        arg1 = emitExpr(e->rhs, out);
-                        if (e->rhs->next) {
-                            arg2 = emitExpr(e->rhs->next, out);
-                            if (e->rhs->next->next)
-                                arg3 = emitExpr(e->rhs->next->next, out);
-                        }
-                    }
-                    return QString("sim_text_putreal(&%1, %2, %3, %4)").arg(obj).arg(arg1).arg(arg2).arg(arg3);
-                }
-            }
-            
-            // Regular method call
-            if (isBuiltinProc(proc)) {
-                QString funcName = getBuiltinProcName(proc);
-                QStringList args;
-                args.append(obj);
-                Expression* arg = e->rhs;
-                while (arg) {
-                    args.append(emitExpr(arg, out));
-                    arg = arg->next;
-                }
-                return QString("%1(%2)").arg(funcName).arg(args.join(", "));
-            }
+            if (isBuiltinProc(proc))
+                return emitBuiltinMethod(e->lhs->lhs, proc, e->rhs, out);
             
+            QString obj = emitExpr(e->lhs->lhs, out);
             QString funcName = mangleProcName(proc);
-            QStringList args;
-            args.append(obj);
-            Expression* arg = e->rhs;
-            while (arg) {
-                args.append(emitExpr(arg, out));
-                arg = arg->next;
-            }
+            const QString sig = procedureVariant(proc, e->rhs);
+            if (!sig.isEmpty())
+                funcName += "_" + sig;
+            QStringList args = emitArgs(proc, e->rhs, sig, out);
+            args.prepend(obj);
             return QString("%1(%2)").arg(funcName).arg(args.join(", "));
         }
     }
@@ -1823,23 +2898,30 @@ QString CeeGen::emitCall(Expression* e, QTextStream& out)
     if (e->lhs->kind == Expression::DeclRef && e->lhs->d) {
         Declaration* proc = e->lhs->d;
         
+        // a member procedure of the connected object, or of the class or one of its prefixes, is called on it
+        if (!isBuiltinProc(proc) && isMember(proc))
+            return emitMethodCall(e, 0, proc, e->rhs, out);
+        
         QString funcName;
-        if (isBuiltinProc(proc))
+        const QString sig = procedureVariant(proc, e->rhs);
+        if (isBuiltinProc(proc)) {
+            const QString arith = emitArithmeticCall(proc, e->rhs, out);
+            if (!arith.isEmpty())
+                return arith;
             funcName = getBuiltinProcName(proc);
+        }
         else
             funcName = mangleProcName(proc);
+        if (!sig.isEmpty())
+            funcName += "_" + sig;
+        if (e->local)
+            funcName += "_tmp"; // blanks or copy released after the statement, see emitExprStmt
         
-        QStringList args;
-        
-        // If class member procedure, add self
-        if (currentClass && proc->outer == currentClass) {
-            args.append("self");
-        }
-        
-        Expression* arg = e->rhs;
-        while (arg) {
-            args.append(emitExpr(arg, out));
-            arg = arg->next;
+        QStringList args = emitArgs(proc, e->rhs, sig, out);
+        QString obj;
+        if (Declaration* owner = attributeOwner(proc, obj)) {
+            args.prepend(QString("(%1*)%2").arg(mangleClassName(owner)).arg(obj));
+            funcName = mangleProcName(proc);
         }
         
         if (args.isEmpty())
@@ -1861,43 +2943,209 @@ QString CeeGen::emitCall(Expression* e, QTextStream& out)
     return QString("%1(%2)").arg(callable).arg(args.join(", "));
 }
 
+static bool isDesignator(Expression* e)
+{
+    // a variable, attribute or element, which has an address in C
+    switch (e->kind) {
+    case Expression::DeclRef:
+        return e->d && e->d->kind != Declaration::Procedure;
+    case Expression::Dot:
+        return e->rhs && isDesignator(e->rhs);
+    case Expression::Subscript:
+        return true;
+    default:
+        return false;
+    }
+}
+
+QString CeeGen::emitBuiltinMethod(Expression* objExpr, Declaration* proc, Expression* args, QTextStream& out)
+{
+    QString obj = emitExpr(objExpr, out);
+    
+    // Check for TEXT methods
+    if (objExpr->type() && objExpr->type()->kind == Type::Text) {
+        Type integer(Type::Integer), real(Type::Real);
+        QString methodName = QString(proc->name.constData()).toLower();
+        // the methods which move pos take the text by address, a temporary copy if it isn't a variable
+        const QString ref = isDesignator(objExpr) ? "&" + obj : QString("&(SimText){%1}").arg(obj);
+        
+        if (methodName == "constant") return QString("sim_text_constant(%1)").arg(obj);
+        if (methodName == "length") return QString("sim_text_length(%1)").arg(obj);
+        if (methodName == "pos") return QString("sim_text_pos(%1)").arg(obj);
+        if (methodName == "start") return QString("sim_text_start(%1)").arg(obj);
+        if (methodName == "main") return QString("sim_text_main(%1)").arg(obj);
+        if (methodName == "setpos") {
+            QString arg = args ? emitConverted(args, &integer, out) : "1";
+            return QString("sim_text_setpos(%1, %2)").arg(ref).arg(arg);
+        }
+        if (methodName == "more") return QString("sim_text_more(%1)").arg(obj);
+        if (methodName == "getchar") return QString("sim_text_getchar(%1)").arg(ref);
+        if (methodName == "putchar") {
+            QString arg = args ? emitExpr(args, out) : "'\\0'";
+            return QString("sim_text_putchar(%1, %2)").arg(ref).arg(arg);
+        }
+        if (methodName == "sub") {
+            QString arg1 = "1", arg2 = "0";
+            if (args) {
+                arg1 = emitConverted(args, &integer, out);
+                if (args->next)
+                    arg2 = emitConverted(args->next, &integer, out);
+            }
+            return QString("sim_text_sub(%1, %2, %3)").arg(obj).arg(arg1).arg(arg2);
+        }
+        if (methodName == "strip") return QString("sim_text_strip(%1)").arg(obj);
+        if (methodName == "getint") return QString("sim_text_getint(%1)").arg(ref);
+        if (methodName == "getreal") return QString("sim_text_getreal(%1)").arg(ref);
+        if (methodName == "putint") {
+            QString arg1 = "0";
+            if (args)
+                arg1 = emitConverted(args, &integer, out);
+            return QString("sim_text_putint(%1, %2)").arg(ref).arg(arg1);
+        }
+        if (methodName == "putfix") {
+            QString arg1 = "0.0", arg2 = "0";
+            if (args) {
+                arg1 = emitConverted(args, &real, out);
+                if (args->next)
+                    arg2 = emitConverted(args->next, &integer, out);
+            }
+            return QString("sim_text_putfix(%1, %2, %3)").arg(ref).arg(arg1).arg(arg2);
+        }
+        if (methodName == "putreal") {
+            QString arg1 = "0.0", arg2 = "0";
+            if (args) {
+                arg1 = emitConverted(args, &real, out);
+                if (args->next)
+                    arg2 = emitConverted(args->next, &integer, out);
+            }
+            return QString("sim_text_putreal(%1, %2, %3)").arg(ref).arg(arg1).arg(arg2);
+        }
+        if (methodName == "getfrac") return QString("sim_text_getfrac(%1)").arg(ref);
+        if (methodName == "putfrac") {
+            QString arg1 = "0", arg2 = "0";
+            if (args) {
+                arg1 = emitConverted(args, &integer, out);
+                if (args->next)
+                    arg2 = emitConverted(args->next, &integer, out);
+            }
+            return QString("sim_text_putfrac(%1, %2, %3)").arg(ref).arg(arg1).arg(arg2);
+        }
+    }
+    
+    // the attributes of the standard classes take the object first, like the members of the classes of
+    // the program; all file classes share the layout of SimFile, see sim_runtime.h
+    QStringList argList = emitArgs(proc, args, QString(), out);
+    if (Declaration* owner = ClassHierarchy::owner(proc)) {
+        argList.prepend(QString("(%1*)%2").arg(mangleClassName(owner)).arg(obj));
+        return QString("%1(%2)").arg(mangleProcName(proc)).arg(argList.join(", "));
+    }
+    argList.prepend(obj);
+    return QString("%1(%2)").arg(getBuiltinProcName(proc)).arg(argList.join(", "));
+}
+
 QString CeeGen::emitNew(Expression* e, QTextStream& out)
 {
-    if (!e->lhs)
+    Expression* args = 0;
+    Expression* n = EscapeAnalyzer::generator(e, &args);
+    if (!n)
         return "NULL";
     
-    Declaration* cls = 0;
-    if (e->lhs->kind == Expression::DeclRef)
-        cls = e->lhs->d;
-    else if (e->lhs->kind == Expression::Identifier) {
+    if (n->lhs && n->lhs->kind == Expression::Identifier) {
         // Need to resolve
-        return QString("/* NEW %1 - unresolved */").arg(e->lhs->a ? e->lhs->a : "?");
+        return QString("/* NEW %1 - unresolved */").arg(n->lhs->a ? n->lhs->a : "?");
     }
     
+    Declaration* cls = EscapeAnalyzer::generatedClass(n);
     if (!cls)
         return "NULL";
     
     QString className = mangleClassName(cls);
     
     // Collect arguments
-    QStringList args;
-    Expression* arg = e->rhs;
+    QStringList argList;
+    Expression* arg = args;
     while (arg) {
-        args.append(emitExpr(arg, out));
+        argList.append(emitExpr(arg, out));
         arg = arg->next;
     }
     
-    if (args.isEmpty())
+    if (n->local) {
+        // the reference is consumed where it occurs; the compound literal lives until the end of the C block
+        argList.prepend(QString("&(%1){0}").arg(className));
+        return QString("%1_init(%2)").arg(className).arg(argList.join(", "));
+    }
+    
+    if (argList.isEmpty())
         return QString("%1_new()").arg(className);
-    return QString("%1_new(%2)").arg(className).arg(args.join(", "));
+    return QString("%1_new(%2)").arg(className).arg(argList.join(", "));
+}
+
+QString CeeGen::emitMethodCall(Expression* site, Expression* obj, Declaration* proc, Expression* args, QTextStream& out)
+{
+    // obj is 0 for a call on the connected object or self; the receiver is the static class of the object
+    Declaration* recv = currentClass;
+    QString self = "self";
+    if (obj) {
+        Type* t = obj->type();
+        recv = t && t->kind == Type::Ref && t->getRefType() ? t->getRefType() : ClassHierarchy::owner(proc);
+        self = emitExpr(obj, out);
+    } else if (const Connected* c = connectedObject(ClassHierarchy::owner(proc))) {
+        recv = c->cls;
+        self = c->obj;
+    }
+    const Atom name = ClassHierarchy::nameOf(proc);
+    
+    Declaration* target = proc;
+    Declaration* spec = recv ? ClassHierarchy::virtualSpec(recv, name) : 0;
+    if (spec) {
+        virtualCalls++;
+        Declaration* impl = closedWorld ? hierarchy.uniqueImplementation(recv, name) : 0;
+        if (impl == 0) {
+            // dispatch through the slot of the class introducing the virtual, see emitClassVtable
+            Declaration* slotOwner = ClassHierarchy::owner(spec);
+            Declaration* sig = virtualSignature(spec);
+            int params = 0, actuals = 0;
+            for (Declaration* param = sig->link; param && param->kind == Declaration::Parameter; param = param->next)
+                params++;
+            for (Expression* arg = args; arg; arg = arg->next)
+                actuals++;
+            if (params != actuals)
+                error(site->pos, QString("the parameters of virtual '%1' were unknown when its class was "
+                                         "emitted, since the class doesn't implement it").arg(name));
+            QStringList argList = emitArgs(sig, args, QString(), out);
+            argList.prepend(slotOwner != recv ? QString("(%1*)%2").arg(mangleClassName(slotOwner)).arg(self) : self);
+            return QString("%1_%2_virtual(%3)").arg(mangleClassName(slotOwner)).arg(name)
+                    .arg(argList.join(", "));
+        }
+        // no subclass of the receiver overrides the implementation it inherits or declares
+        devirtualized.append(Devirtualized(site->pos, recv, proc, impl));
+        target = impl;
+    }
+    
+    QString funcName = mangleProcName(target);
+    QString sig = procedureVariant(target, args);
+    if (target != proc && !thunkVariants.value(target).contains(sig) && !emittedVariants.value(target).contains(sig))
+        sig.clear(); // the variants were collected for the procedure named at the call site
+    if (!sig.isEmpty())
+        funcName += "_" + sig;
+    QStringList argList = emitArgs(target, args, sig, out);
+    Declaration* owner = ClassHierarchy::owner(target);
+    if (owner != recv)
+        argList.prepend(QString("(%1*)%2").arg(mangleClassName(owner)).arg(self));
+    else
+        argList.prepend(self);
+    return QString("%1(%2)").arg(funcName).arg(argList.join(", "));
 }
 
 QString CeeGen::emitThis(Expression* e, QTextStream& out)
 {
-    // THIS class-identifier
-    if (e->lhs && e->lhs->kind == Expression::DeclRef && e->lhs->d) {
-        QString className = mangleClassName(e->lhs->d);
-        return QString("((%1*)self)").arg(className);
+    // THIS class-identifier, in a connection block for the class or in the class body; the validator
+    // qualifies the type with the class
+    Type* t = e->type();
+    if (t && t->kind == Type::Ref && t->getRefType()) {
+        Declaration* cls = t->getRefType();
+        const Connected* c = connectedObject(cls);
+        return QString("((%1*)%2)").arg(mangleClassName(cls)).arg(c ? c->obj : QString("self"));
     }
     
     return "self";
@@ -1910,7 +3158,8 @@ QString CeeGen::emitQua(Expression* e, QTextStream& out)
     if (e->rhs && e->rhs->kind == Expression::DeclRef && e->rhs->d) {
         QString className = mangleClassName(e->rhs->d);
         int classId = getClassId(e->rhs->d);
-        return QString("sim_qua(%1, %2, \"%3\")").arg(obj).arg(classId).arg(className);
+        return QString("((%4*)sim_qua((SimObject*)%1, %2, %3, \"%4\"))").arg(obj).arg(AstModel::prefixLevel(e->rhs->d))
+                .arg(classId).arg(className);
     }
     
     return obj;
@@ -1932,7 +3181,7 @@ QString CeeGen::emitLiteral(Expression* e, QTextStream& out)
         return QString::number(e->u);
         
     case Expression::RealConst:
-        return QString::number(e->r, 'g', 17);
+        return realLiteral(e->r);
         
     case Expression::BoolConst:
         return e->u ? "true" : "false";
@@ -1953,14 +3202,21 @@ QString CeeGen::emitLiteral(Expression* e, QTextStream& out)
         return QString("'\\x%1'").arg(e->u, 2, 16, QChar('0'));
         
     case Expression::StringConst:
-        if (e->a) {
+        if (e->a && *e->a) {
             QString str = QString::fromUtf8(e->a);
             str.replace("\\", "\\\\");
             str.replace("\"", "\\\"");
             str.replace("\n", "\\n");
             str.replace("\t", "\\t");
             str.replace("\r", "\\r");
-            return QString("sim_text_const(\"%1\")").arg(str);
+            // the text of a literal is a static designating a frame of read-only characters, so evaluating it
+            // neither allocates nor measures the string; each literal is a frame of its own, i.e. two equal
+            // literals are not the same text, thus the characters are an array the compiler doesn't merge
+            const QString name = QString("sim_lit_%1").arg(++literalCounter);
+            QTextStream globals(&globalDefs);
+            globals << "static const char " << name << "_[] = \"" << str << "\";\n";
+            globals << "static const SimText " << name << " = SIM_TEXT_LITERAL(" << name << "_);\n";
+            return name;
         }
         return "sim_notext()";
         
@@ -1975,10 +3231,72 @@ QString CeeGen::emitLiteral(Expression* e, QTextStream& out)
     }
 }
 
+QString CeeGen::emitConstant(Expression* e, QTextStream& out)
+{
+    // the value was computed by the Folder
+    switch (e->kind) {
+    case Expression::UnsignedConst:
+    case Expression::RealConst:
+    case Expression::BoolConst:
+    case Expression::CharConst:
+    case Expression::StringConst:
+    case Expression::Notext:
+        return emitLiteral(e, out);
+    default:
+        break;
+    }
+    
+    switch (e->type()->kind) {
+    case Type::Integer:
+    case Type::ShortInteger:
+        return QString::number(Folder::integer(e));
+    case Type::Real:
+    case Type::LongReal:
+        return realLiteral(Folder::real(e));
+    case Type::Boolean:
+        return Folder::boolean(e) ? "true" : "false";
+    case Type::Character: {
+        Expression lit(Expression::CharConst);
+        lit.u = Folder::character(e);
+        return emitLiteral(&lit, out);
+    }
+    case Type::Text: {
+        Expression lit(Expression::StringConst);
+        lit.a = Folder::text(e);
+        return emitLiteral(&lit, out);
+    }
+    default:
+        return "0";
+    }
+}
+
 QString CeeGen::emitAssignExpr(Expression* e, QTextStream& out)
 {
-    QString lhs = emitExpr(e->lhs, out);
-    QString rhs = emitExpr(e->rhs, out);
+    if (isConstantName(e->lhs)) {
+        // the right side is evaluated before the assignment fails
+        const QString rhs = emitConverted(e->rhs, e->lhs->type(), out);
+        return QString("((void)(%1), %2, %1)").arg(rhs).arg(constantNameError());
+    }
+    QString lhs;
+    if (currentProc && e->lhs->kind == Expression::DeclRef && e->lhs->d == currentProc)
+        lhs = "_result"; // the value of the function procedure, see emitProcedureVariant
+    else
+        lhs = emitExpr(e->lhs, out);
+    
+    Expression* newArgs = 0;
+    Expression* n = EscapeAnalyzer::generator(e->rhs, &newArgs);
+    Declaration* cls = n ? EscapeAnalyzer::generatedClass(n) : 0;
+    if (e->kind == Expression::AssignRef && n && n->local && cls && e->lhs->kind == Expression::DeclRef &&
+            stackSlots.value(e->lhs->d).contains(cls)) {
+        // the object never escapes the variable; it lives in the stack slot declared with the variable
+        QStringList args;
+        args.append("&" + stackSlotName(e->lhs->d, cls));
+        for (Expression* arg = newArgs; arg; arg = arg->next)
+            args.append(emitExpr(arg, out));
+        return QString("(%1 = %2_init(%3))").arg(lhs).arg(mangleClassName(cls)).arg(args.join(", "));
+    }
+    
+    QString rhs = emitConverted(e->rhs, e->lhs->type(), out);
     
     if (e->kind == Expression::AssignRef) {
         // Reference assignment
@@ -1994,6 +3312,86 @@ QString CeeGen::emitAssignExpr(Expression* e, QTextStream& out)
     return QString("(%1 = %2)").arg(lhs).arg(rhs);
 }
 
+QStringList CeeGen::emitArgs(Declaration* proc, Expression* args, const QString& sig, QTextStream& out)
+{
+    // sig is the variant called, see procedureVariant
+    QStringList res;
+    const bool builtin = isBuiltinProc(proc);
+    int nameParam = 0;
+    Declaration* formal = proc->link;
+    for (Expression* arg = args; arg; arg = arg->next) {
+        if (formal && formal->kind != Declaration::Parameter)
+            formal = 0;
+        QString val;
+        if (formal && formal->type() && formal->type()->kind == Type::Procedure && arg->kind == Expression::DeclRef &&
+                arg->d && arg->d->kind == Declaration::Procedure)
+            val = isBuiltinProc(arg->d) ? getBuiltinProcName(arg->d) : mangleProcName(arg->d); // not a call
+        else if (formal && formal->mode != Declaration::ModeName) {
+            val = emitConverted(arg, formal->type(), out);
+            if (builtin && formal->type() && formal->type()->kind == Type::Ref && arg->type() &&
+                    arg->type()->kind == Type::Ref && mapType(arg->type()) != mapType(formal->type()))
+                val = QString("(%1)%2").arg(mapType(formal->type())).arg(val); // e.g. a subclass of head for into
+        } else
+            val = emitExpr(arg, out);
+        if (formal && formal->mode == Declaration::ModeName) {
+            const ThunkAnalyzer::Passing passing = ThunkAnalyzer::passing(formal, arg);
+            Type* t = formal->type();
+            const QChar p = nameParam < sig.size() ? sig[nameParam] : QChar('t');
+            nameParam++;
+            if ((builtin && t && t->kind >= Type::Integer && t->kind <= Type::Character) || p == 'r') {
+                // the runtime takes the simple NAME parameters by address, e.g. the seed of the random drawings
+                if (passing == ThunkAnalyzer::Reference)
+                    val = "&" + val;
+                else
+                    val = QString("&(%1){%2}").arg(mapType(t)).arg(val);
+            }
+        }
+        res.append(val);
+        if (formal)
+            formal = formal->next;
+    }
+    return res;
+}
+
+QString CeeGen::procedureVariant(Declaration* proc, Expression* args)
+{
+    const QString sig = ThunkAnalyzer::signature(proc, args);
+    if (isBuiltinProc(proc) || !ThunkAnalyzer::isSpecialized(sig))
+        return QString();
+    if (!emittedProcs.contains(proc) || emittedVariants.value(proc).contains(sig))
+        return sig;
+    // streaming mode, where the body is gone once the procedure is emitted; a constant can be passed by
+    // address to the variants emitted up front, see emitProcedure
+    QString ref = sig;
+    ref.replace(QChar('v'), QChar('r'));
+    const QString con = constantVariants.value(proc);
+    for (int i = 0; i < ref.size() && i < con.size(); i++)
+        if (ref[i] == QChar('c') && con[i] == QChar('r'))
+            ref[i] = QChar('r'); // the body, which ThunkAnalyzer can't look at any more, doesn't assign it
+    if (!sig.contains('t') && emittedVariants.value(proc).contains(ref) && (ref == referenceVariant(proc) || ref == con))
+        return ref;
+    return QString();
+}
+
+QString CeeGen::referenceVariant(Declaration* proc, bool constants)
+{
+    QString sig;
+    for (Declaration* formal = proc->link; formal && formal->kind == Declaration::Parameter; formal = formal->next) {
+        if (formal->mode != Declaration::ModeName)
+            continue;
+        Type* t = formal->type();
+        if (t == 0 || t->kind == Type::Procedure || t->kind == Type::Label || t->kind == Type::Switch)
+            sig += 't';
+        else if (t->kind == Type::Array)
+            sig += 'v';
+        else if (constants && ThunkAnalyzer::isAssigned(formal))
+            sig += 'c';
+        else
+            sig += 'r';
+    }
+    return sig;
+}
+
 QString CeeGen::emitBuiltinCall(Declaration* proc, Expression* args, QTextStream& out)
 {
     QString funcName = getBuiltinProcName(proc);
@@ -2005,6 +3403,16 @@ QString CeeGen::emitBuiltinCall(Declaration* proc, Expression* args, QTextStream
         arg = arg->next;
     }
     
+    QString obj;
+    if (Declaration* owner = attributeOwner(proc, obj)) {
+        argList.prepend(QString("(%1*)%2").arg(mangleClassName(owner)).arg(obj));
+        funcName = mangleProcName(proc);
+    }
+    
+    // detach applies to the object whose body or procedure calls it
+    if (funcName == "sim_detach" && argList.isEmpty())
+        argList.append(currentClass ? "self" : "NULL");
+    
     if (argList.isEmpty())
         return QString("%1()").arg(funcName);
     return QString("%1(%2)").arg(funcName).arg(argList.join(", "));
@@ -21,6 +21,10 @@
 */
 
 #include "SimAst.h"
+#include "SimEscapeAnalyzer.h"
+#include "SimThunkAnalyzer.h"
+#include "SimClassHierarchy.h"
+#include "SimTreeShaker.h"
 #include <QTextStream>
 #include <QSet>
 #include <QMap>
@@ -36,6 +40,20 @@ namespace Sim
         // Main entry point: transpile a validated module to C99
         bool transpile(Declaration* module, const QString& outputPath);
 
+        // Streaming mode, see Parser3::Consumer; units are emitted in the order they are parsed and
+        // the output is assembled by endModule
+        void beginModule(Declaration* module);
+        void openBlock(Statement* block);
+        void emitUnit(Declaration* d);
+        void emitUnit(Statement* s);
+        void closeBlock(Statement* block);
+        bool endModule(const QString& outputPath);
+
+        // Compile the class bodies ClassHierarchy::isResumable accepts to state machines instead of coroutines
+        // with a stack of their own, see emitClassStep
+        void setStackless(bool on) { stackless = on; }
+        void setChecks(bool on) { checks = on; }
+
         // Get generated C code as string (for testing)
         QString getGeneratedCode() const { return generatedCode; }
 
@@ -48,28 +66,71 @@ namespace Sim
         };
         QList<Error> errors;
 
+        // Virtual procedure calls bound to their only implementation, see ClassHierarchy
+        struct Devirtualized {
+            RowCol pos;
+            Declaration* receiver; // static class of the object
+            Declaration* proc; // the procedure named at the call site
+            Declaration* impl; // the procedure called
+            Devirtualized(const RowCol& p = RowCol(), Declaration* r = 0, Declaration* c = 0, Declaration* i = 0)
+                : pos(p), receiver(r), proc(c), impl(i) {}
+        };
+        QList<Devirtualized> devirtualized;
+        quint32 virtualCalls; // including the devirtualized ones
+
     private:
         // Code generation state
         QString generatedCode;
         QString headerCode;
         QString forwardDecls;
         QString structDefs;
+        QString procDecls; // the prototypes of all procedure variants
         QString vtableDefs;
         QString funcDefs;
+        QString globalDefs; // the variables of the blocks of the program with classes or procedures, see isGlobalBlock
         QString mainCode;
         
         int indentLevel;
         int tempVarCounter;
         int labelCounter;
+        int literalCounter; // the texts of the literals are statics, see emitLiteral
         
         Declaration* currentModule;
         Declaration* currentClass;
         Declaration* currentProc;
+        bool mainStreamed;
+        bool streaming; // the units are emitted as they are parsed, see emitUnit
+        bool closedWorld; // all subclasses are known, i.e. the module has the main program and isn't streamed
+        bool stackless;
+        bool checks; // all array indices are checked, even the ones proven in range
+        Declaration* stepClass; // whose step function is being emitted
+        int resumePoints;
+        Statement* openedBlock;
         
         QSet<Declaration*> emittedClasses;
         QSet<Declaration*> emittedProcs;
         QMap<Declaration*, QString> classIdMap;
         QMap<Declaration*, QString> mangledNames;
+        QHash<Declaration*, QList<Declaration*> > stackSlots; // see EscapeAnalyzer::Result
+        QHash<Declaration*, QStringList> thunkVariants; // see ThunkAnalyzer::Result
+        QHash<Declaration*, QStringList> emittedVariants;
+        QHash<Declaration*, QString> constantVariants; // streaming, see emitProcedure and procedureVariant
+        QHash<Declaration*, ThunkAnalyzer::Passing> namePassing; // NAME parameters of the variant being emitted
+        QHash<Declaration*, QString> hoisted; // the locals of a class body which are members of its object
+        QList<Declaration*> innerBodies; // the class bodies inner continues with, see emitClassBodies
+        QHash<Declaration*, QString> globalVars; // the names of the globals, see emitLocal
+        QSet<QString> globalVarNames;
+        QList<Declaration*> nestedDecls; // emitted after the function declaring them, see emitBlockStmt
+        struct Connected {
+            Declaration* cls;
+            QString obj; // the C expression of the object
+            Connected(Declaration* c = 0, const QString& o = QString()):cls(c),obj(o) {}
+        };
+        QList<Connected> connections; // the objects of the enclosing inspect statements, innermost last
+        QSet<Declaration*> pointerFree; // the classes whose objects hold no pointers, see emitClassStruct
+        QHash<Declaration*, Expression*> indexRanges; // the control variables of the loops being emitted, see emitSubscript
+        ClassHierarchy hierarchy;
+        QSet<Declaration*> reachable; // see TreeShaker; all declarations are emitted if empty
         
         // Helper methods
         void error(const RowCol& pos, const QString& msg);
@@ -85,63 +146,111 @@ namespace Sim
         QString mangleClassName(Declaration* cls);
         QString mangleProcName(Declaration* proc);
         QString mangleVarName(Declaration* var);
+        QString mangleIdent(const QByteArray& name);
         QString mangleTypeName(Type* t);
         
         // Type mapping
         QString mapType(Type* t);
         QString mapBasicType(Type::Kind k);
-        bool isBuiltinDecl(Declaration* d);
-        bool isBuiltinProc(Declaration* d);
+        static bool isBuiltinDecl(Declaration* d);
+        static bool isBuiltinProc(Declaration* d);
         QString getBuiltinProcName(Declaration* d);
         
         // Code generation - Declarations
         void emitModule(Declaration* mod);
+        void emitMainHead(QTextStream& out);
+        void emitMainTail(QTextStream& out);
         void emitDeclarations(Declaration* d);
         void emitDeclaration(Declaration* d);
+        bool isReachable(Declaration* d) const;
         void emitClass(Declaration* cls);
         void emitClassStruct(Declaration* cls);
+        static bool holdsPointer(Type* t);
         void emitClassVtable(Declaration* cls);
         void emitClassConstructor(Declaration* cls);
+        QStringList constructorParams(Declaration* cls, QList<Declaration*>& allParams);
         void emitClassBody(Declaration* cls);
+        Declaration* bodyScope(Declaration* cls) const;
+        QList<Declaration*> classBodies(Declaration* cls) const;
+        void emitClassBodies(QList<Declaration*> bodies, QTextStream& out);
+        bool hasCoroutineBody(Declaration* cls) const;
+        bool isStepped(Declaration* cls) const;
+        void emitClassStep(Declaration* cls);
+        void collectLocals(Statement* s, QList<Declaration*>& locals);
         void emitProcedure(Declaration* proc);
+        void emitProcedureVariant(Declaration* proc, const QString& sig);
+        void addThunkVariants(const ThunkAnalyzer::Result& res);
+        QStringList emitArgs(Declaration* proc, Expression* args, const QString& sig, QTextStream& out);
+        QString procedureVariant(Declaration* proc, Expression* args);
+        QString referenceVariant(Declaration* proc, bool constants = false);
         void emitVariable(Declaration* var);
         void emitArray(Declaration* arr);
         void emitSwitch(Declaration* sw);
         void emitParameter(Declaration* param);
         void emitBlock(Declaration* blk);
+        void emitLocal(Declaration* local, QTextStream& out, bool global = false);
+        void emitNestedDeclaration(Declaration* d);
+        void emitNestedDeclarations();
+        bool isProgramBlock(Declaration* scope) const;
+        bool isGlobalBlock(Declaration* scope) const;
+        Declaration* frameOf(Declaration* local) const;
+        bool isVisible(Declaration* local) const;
+        void emitStackSlots(Declaration* var, const QString& ind, QTextStream& out);
+        void addStackSlots(const EscapeAnalyzer::Result& res);
+        QString stackSlotName(Declaration* var, Declaration* cls);
         
         // Code generation - Statements
         void emitStatement(Statement* s, QTextStream& out);
         void emitStatementSeq(Statement* s, QTextStream& out);
         void emitCompound(Statement* s, QTextStream& out);
         void emitBlockStmt(Statement* s, QTextStream& out);
+        void emitBlockPrefix(Statement* block, QTextStream& out);
+        void emitBlockPrefixEnd(Statement* block, QTextStream& out);
         void emitAssign(Statement* s, QTextStream& out);
+        bool isConstantName(Expression* e) const;
+        static QString constantNameError();
         void emitCallStmt(Statement* s, QTextStream& out);
+        void emitExprStmt(Expression* e, QTextStream& out);
         void emitIf(Statement* s, QTextStream& out);
         void emitWhile(Statement* s, QTextStream& out);
         void emitFor(Statement* s, QTextStream& out);
+        void emitCountedFor(Statement* s, Expression* elem, const QString& var, const QString& start,
+                            QString step, QString limit, QTextStream& out);
         void emitInspect(Statement* s, QTextStream& out);
         void emitGoto(Statement* s, QTextStream& out);
+        void emitGoto(Expression* e, QTextStream& out);
         void emitLabel(Statement* s, QTextStream& out);
         void emitInner(Statement* s, QTextStream& out);
         void emitActivate(Statement* s, QTextStream& out);
         void emitDetach(Statement* s, QTextStream& out);
         void emitResume(Statement* s, QTextStream& out);
+        void emitSuspension(Declaration* proc, Expression* args, QTextStream& out);
         
         // Code generation - Expressions
         QString emitExpr(Expression* e, QTextStream& out);
         QString emitBinaryOp(Expression* e, QTextStream& out);
+        QString emitConverted(Expression* e, Type* to, QTextStream& out);
+        QString emitPower(Expression* e, const QString& lhs, const QString& rhs);
+        QString emitArithmeticCall(Declaration* proc, Expression* args, QTextStream& out);
         QString emitUnaryOp(Expression* e, QTextStream& out);
         QString emitIdentifier(Expression* e, QTextStream& out);
         QString emitDeclRef(Expression* e, QTextStream& out);
         QString emitDot(Expression* e, QTextStream& out);
+        QString emitAttribute(const QString& obj, Declaration* cls, Declaration* attr);
+        static bool isAttribute(Declaration* d);
+        bool isMember(Declaration* proc) const;
         QString emitSubscript(Expression* e, QTextStream& out);
+        bool isInBounds(Expression* index, Declaration* array, int dim) const;
         QString emitCall(Expression* e, QTextStream& out);
         QString emitNew(Expression* e, QTextStream& out);
+        QString emitMethodCall(Expression* site, Expression* obj, Declaration* proc, Expression* args, QTextStream& out);
+        QString emitBuiltinMethod(Expression* obj, Declaration* proc, Expression* args, QTextStream& out);
         QString emitThis(Expression* e, QTextStream& out);
         QString emitQua(Expression* e, QTextStream& out);
         QString emitIfExpr(Expression* e, QTextStream& out);
         QString emitLiteral(Expression* e, QTextStream& out);
+        static QString realLiteral(double r);
+        QString emitConstant(Expression* e, QTextStream& out);
         QString emitAssignExpr(Expression* e, QTextStream& out);
         
         // Builtin procedure calls
@@ -150,7 +259,12 @@ namespace Sim
         // Class hierarchy helpers
         void collectClassHierarchy(Declaration* cls, QList<Declaration*>& hierarchy);
         Declaration* findVirtualMatch(Declaration* cls, Declaration* vspec);
-        bool isSubclassOf(Declaration* sub, Declaration* super);
+        Declaration* virtualSignature(Declaration* vspec);
+        QString virtualSlotType(Declaration* vspec);
+        QString procedurePrototype(Declaration* proc);
+        static bool isSubclassOf(Declaration* sub, Declaration* super);
+        Declaration* attributeOwner(Declaration* proc, QString& obj);
+        const Connected* connectedObject(Declaration* owner) const;
         int getClassId(Declaration* cls);
         
         // Array helpers
@@ -162,8 +276,8 @@ namespace Sim
         
         // Utility
         void collectForwardDecls(Declaration* d);
+        void collectForwardDecl(Declaration* d);
         void emitIncludes(QTextStream& out);
-        void emitRuntimeDecls(QTextStream& out);
     };
 }
 
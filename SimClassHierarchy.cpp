@@ -0,0 +1,448 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimClassHierarchy.h"
+using namespace Sim;
+
+static bool isStandard(Declaration* d, const char* name)
+{
+    // the standard declarations, see runtime/builtins.sim
+    if( d == 0 || d->name.toLower() != name )
+        return false;
+    for( Declaration* o = d->outer; o != 0; o = o->outer )
+    {
+        const QByteArray outer = o->name.toLower();
+        if( outer == "environment" || outer == "basicio" || outer == "simulation" )
+            return true;
+    }
+    return false;
+}
+
+class DetachFinder
+{
+public:
+    static bool decls(Declaration* d)
+    {
+        for( ; d != 0; d = d->next )
+        {
+            if( d->kind == Declaration::Procedure && ( decls(d->link) || stats(d->body) ) )
+                return true;
+        }
+        return false;
+    }
+
+    static bool stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( s->scope && decls(s->scope->link) )
+                    return true;
+                break;
+            case Statement::If:
+            case Statement::While:
+                if( exprs(s->cond) || stats(s->elseStmt) )
+                    return true;
+                break;
+            case Statement::For:
+                if( exprs(s->list) )
+                    return true;
+                break;
+            case Statement::Inspect:
+                if( exprs(s->obj) || stats(s->otherwise) )
+                    return true;
+                for( Connection* c = s->conn; c != 0; c = c->next )
+                    if( stats(c->body) )
+                        return true;
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+                if( exprs(s->lhs) || exprs(s->rhs) )
+                    return true;
+                break;
+            case Statement::Detach:
+                return true;
+            default:
+                break;
+            }
+            if( stats(s->body) )
+                return true;
+        }
+        return false;
+    }
+
+    static bool exprs(Expression* e)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            if( e->kind == Expression::DeclRef && e->d && e->d->kind == Declaration::Procedure &&
+                    isStandard(e->d, "detach") )
+                return true;
+            if( exprs(e->lhs) || exprs(e->rhs) || exprs(e->condition) )
+                return true;
+        }
+        return false;
+    }
+};
+
+class StepChecker
+{
+public:
+    QSet<Declaration*> visited; // the procedures checked so far, or being checked
+    bool process; // hold, passivate and wait suspend the object itself
+    StepChecker(bool p):process(p) {}
+
+    bool stats(Statement* s, bool top)
+    {
+        // top: a transfer statement may be compiled to a return from the step function here
+        for( ; s != 0; s = s->next )
+        {
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( s->prefix )
+                    return false; // runs the body of the prefix class
+                break;
+            case Statement::If:
+            case Statement::While:
+                if( !exprs(s->cond) || !stats(s->elseStmt, top) )
+                    return false;
+                break;
+            case Statement::For:
+                if( !exprs(s->var) || !exprs(s->list) )
+                    return false;
+                break;
+            case Statement::Inspect:
+                if( !exprs(s->obj) || !stats(s->otherwise, false) )
+                    return false;
+                for( Connection* c = s->conn; c != 0; c = c->next )
+                    if( !stats(c->body, false) )
+                        return false;
+                if( !stats(s->body, false) )
+                    return false;
+                continue;
+            case Statement::Call:
+                {
+                    Expression* e = s->lhs ? s->lhs : s->rhs;
+                    if( top && ClassHierarchy::transferOf(e, process) )
+                    {
+                        if( e->kind == Expression::Call && !exprs(e->rhs) )
+                            return false;
+                        break;
+                    }
+                    if( !exprs(s->lhs) || !exprs(s->rhs) )
+                        return false;
+                }
+                break;
+            case Statement::Assign:
+            case Statement::Goto:
+                if( !exprs(s->lhs) || !exprs(s->rhs) )
+                    return false;
+                break;
+            case Statement::Activate:
+            case Statement::Detach:
+            case Statement::Resume:
+                return false;
+            default:
+                break;
+            }
+            if( !stats(s->body, top) )
+                return false;
+        }
+        return true;
+    }
+
+    bool exprs(Expression* e)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            if( e->kind == Expression::DeclRef && e->d && !callable(e->d) )
+                return false;
+            if( !exprs(e->lhs) || !exprs(e->rhs) || !exprs(e->condition) )
+                return false;
+        }
+        return true;
+    }
+
+    bool callable(Declaration* d)
+    {
+        // calling d doesn't transfer control
+        if( d->kind == Declaration::Parameter )
+            return d->type() == 0 || d->type()->kind != Type::Procedure; // a formal procedure
+        if( d->kind != Declaration::Procedure )
+            return true;
+        if( isStandard(d, "detach") || isStandard(d, "resume") || isStandard(d, "call") )
+            return false;
+        for( Declaration* o = d->outer; o != 0; o = o->outer )
+        {
+            const QByteArray outer = o->name.toLower();
+            if( outer == "simulation" )
+            {
+                // time, current etc. don't schedule
+                const QByteArray name = d->name.toLower();
+                return name != "hold" && name != "passivate" && name != "wait" && name != "cancel";
+            }
+            if( outer == "environment" || outer == "basicio" )
+                return true;
+        }
+        if( Declaration* cls = ClassHierarchy::owner(d) )
+            if( ClassHierarchy::virtualSpec(cls, d->sym) )
+                return false; // any implementation might be called
+        if( visited.contains(d) )
+            return true;
+        visited.insert(d);
+        return stats(d->body, false);
+    }
+};
+
+Declaration* ClassHierarchy::transferOf(Expression* e, bool process)
+{
+    if( e != 0 && e->kind == Expression::Call )
+        e = e->lhs;
+    if( e == 0 || e->kind != Expression::DeclRef || e->d == 0 || e->d->kind != Declaration::Procedure )
+        return 0;
+    if( isStandard(e->d, "detach") || isStandard(e->d, "resume") || isStandard(e->d, "call") )
+        return e->d;
+    if( process && ( isStandard(e->d, "hold") || isStandard(e->d, "passivate") || isStandard(e->d, "wait") ) )
+        return e->d;
+    return 0;
+}
+
+bool ClassHierarchy::isResumable(Declaration* cls)
+{
+    // in the body of a process, hold, passivate and wait suspend the process, which is current; the other
+    // scheduling statements switch in the runtime, see sim_simulation.c
+    StepChecker c(isPrefixedBy(cls, "process"));
+    return cls->body != 0 && c.stats(cls->body, true);
+}
+
+void ClassHierarchy::add(Declaration* d)
+{
+    if( d != 0 && d->kind == Declaration::Module )
+    {
+        if( seen.contains(d) )
+            return;
+        seen.insert(d);
+        for( Declaration* m = d->link; m != 0; m = m->next )
+            walk(m);
+    }else if( d != 0 )
+        walk(d);
+}
+
+void ClassHierarchy::add(Statement* s)
+{
+    walk(s);
+}
+
+void ClassHierarchy::clear()
+{
+    subs.clear();
+    seen.clear();
+}
+
+void ClassHierarchy::walk(Declaration* d)
+{
+    switch( d->kind )
+    {
+    case Declaration::Class:
+        if( seen.contains(d) )
+            return;
+        seen.insert(d);
+        if( d->prefix )
+            subs[d->prefix].append(d);
+        // fall through
+    case Declaration::Program:
+    case Declaration::Procedure:
+        for( Declaration* m = d->link; m != 0; m = m->next )
+            walk(m);
+        walk(d->body);
+        break;
+    case Declaration::ExternalClass:
+        // the whole program includes the separately compiled modules
+        if( d->ext && d->ext != d )
+            add(d->ext->getModule());
+        break;
+    default:
+        break;
+    }
+}
+
+void ClassHierarchy::walk(Statement* s)
+{
+    for( ; s != 0; s = s->next )
+    {
+        switch( s->kind )
+        {
+        case Statement::Compound:
+        case Statement::Block:
+            if( s->scope )
+                for( Declaration* m = s->scope->link; m != 0; m = m->next )
+                    walk(m);
+            break;
+        case Statement::If:
+        case Statement::While:
+            walk(s->elseStmt);
+            break;
+        case Statement::Inspect:
+            for( Connection* c = s->conn; c != 0; c = c->next )
+                walk(c->body);
+            walk(s->otherwise);
+            break;
+        default:
+            break;
+        }
+        walk(s->body);
+    }
+}
+
+QList<Declaration*> ClassHierarchy::implementations(Declaration* cls, Atom name) const
+{
+    QList<Declaration*> res;
+    Declaration* inherited = implementation(cls, name);
+    if( inherited )
+        res.append(inherited);
+    QList<Declaration*> todo = subs.value(cls);
+    while( !todo.isEmpty() )
+    {
+        Declaration* sub = todo.takeFirst();
+        Declaration* p = findProc(sub, name);
+        if( p && !res.contains(p) )
+            res.append(p);
+        todo += subs.value(sub);
+    }
+    return res;
+}
+
+Declaration* ClassHierarchy::uniqueImplementation(Declaration* cls, Atom name) const
+{
+    const QList<Declaration*> impls = implementations(cls, name);
+    if( impls.size() == 1 )
+        return impls.first();
+    return 0;
+}
+
+Declaration* ClassHierarchy::owner(Declaration* member)
+{
+    // the members of a class are its parameters and virtual specs, and the declarations of its body block
+    Declaration* o = member ? member->outer : 0;
+    if( o == 0 )
+        return 0;
+    if( o->kind == Declaration::Class )
+        return o;
+    if( o->kind == Declaration::Block && o->outer && o->outer->kind == Declaration::Class &&
+            o->outer->body && o->outer->body->scope == o )
+        return o->outer;
+    return 0;
+}
+
+Declaration* ClassHierarchy::prefixOf(Declaration* cls)
+{
+    // the prefix field of an external class is shared with ext
+    if( cls->kind != Declaration::Class && cls->kind != Declaration::StandardClass )
+        return 0;
+    return cls->prefix;
+}
+
+Atom ClassHierarchy::nameOf(Declaration* proc)
+{
+    if( proc->kind == Declaration::VirtualSpec && proc->sym == 0 && proc->forward )
+        return proc->forward->sym;
+    return proc->sym;
+}
+
+Declaration* ClassHierarchy::findProc(Declaration* cls, Atom name)
+{
+    if( cls->body && ( cls->body->kind == Statement::Block || cls->body->kind == Statement::Compound ) &&
+            cls->body->scope )
+    {
+        for( Declaration* d = cls->body->scope->link; d != 0; d = d->next )
+            if( d->kind == Declaration::Procedure && d->sym == name )
+                return d;
+    }
+    for( Declaration* d = cls->link; d != 0; d = d->next )
+        if( d->kind == Declaration::Procedure && d->sym == name )
+            return d;
+    return 0;
+}
+
+Declaration* ClassHierarchy::implementation(Declaration* cls, Atom name)
+{
+    for( ; cls != 0; cls = prefixOf(cls) )
+    {
+        Declaration* p = findProc(cls, name);
+        if( p )
+            return p;
+    }
+    return 0;
+}
+
+Declaration* ClassHierarchy::virtualSpec(Declaration* cls, Atom name)
+{
+    for( ; cls != 0; cls = prefixOf(cls) )
+    {
+        for( Declaration* d = cls->link; d != 0; d = d->next )
+            if( d->kind == Declaration::VirtualSpec && nameOf(d) == name )
+                return d;
+    }
+    return 0;
+}
+
+QList<Declaration*> ClassHierarchy::virtuals(Declaration* cls)
+{
+    // a subclass extends the slots of its prefix, so the slot of a virtual is the same in all subclasses
+    QList<Declaration*> res;
+    if( cls == 0 )
+        return res;
+    res = virtuals(prefixOf(cls));
+    for( Declaration* d = cls->link; d != 0; d = d->next )
+    {
+        if( d->kind != Declaration::VirtualSpec )
+            continue;
+        bool found = false;
+        for( int i = 0; i < res.size() && !found; i++ )
+            found = nameOf(res[i]) == nameOf(d);
+        if( !found )
+            res.append(d);
+    }
+    return res;
+}
+
+bool ClassHierarchy::isPrefixedBy(Declaration* cls, const char* name)
+{
+    for( ; cls != 0; cls = prefixOf(cls) )
+        if( isStandard(cls, name) )
+            return true;
+    return false;
+}
+
+bool ClassHierarchy::detaches(Declaration* cls)
+{
+    for( ; cls != 0; cls = prefixOf(cls) )
+    {
+        if( isStandard(cls, "process") )
+            return true; // passivate, hold etc. detach the current process
+        if( DetachFinder::decls(cls->link) || DetachFinder::stats(cls->body) )
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,71 @@
+#ifndef __SIM_CLASSHIERARCHY__
+#define __SIM_CLASSHIERARCHY__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+#include <QHash>
+#include <QSet>
+
+namespace Sim
+{
+    // Class hierarchy analysis: the subclasses of each class found in the trees handed to add(), i.e. the
+    // same relation as Xref::subs, but independent of a validator with cross references. If the trees are
+    // the whole program (a main program and the modules of its external classes), the implementations a
+    // virtual procedure call can reach are known from the static type of the receiver.
+    class ClassHierarchy
+    {
+    public:
+        void add(Declaration* d); // d, the classes it contains and the modules of the external classes it uses
+        void add(Statement* s); // the classes declared in the blocks of the statement sequence
+        void clear();
+
+        const QList<Declaration*> subclasses(Declaration* cls) const { return subs.value(cls); }
+
+        // the implementations of the virtual procedure name a receiver of static type cls can dispatch to
+        QList<Declaration*> implementations(Declaration* cls, Atom name) const;
+        Declaration* uniqueImplementation(Declaration* cls, Atom name) const;
+
+        static Declaration* owner(Declaration* member); // the class declaring member, or 0
+        static Declaration* prefixOf(Declaration* cls);
+        static Atom nameOf(Declaration* proc); // also of the VirtualSpec annotating a later declaration
+        static Declaration* findProc(Declaration* cls, Atom name); // declared in cls itself
+        static Declaration* implementation(Declaration* cls, Atom name); // in cls or the nearest prefix
+        static Declaration* virtualSpec(Declaration* cls, Atom name); // in cls or a prefix
+        static QList<Declaration*> virtuals(Declaration* cls); // the specs of cls and its prefixes, outermost first
+        // cls is the standard class name, e.g. "process", or a subclass of it
+        static bool isPrefixedBy(Declaration* cls, const char* name);
+        // the body of cls or a prefix, or one of their procedures, calls detach, or cls is a process
+        static bool detaches(Declaration* cls);
+        // the standard procedure if e is the statement detach, resume(x) or call(x), or in the body of a
+        // process hold(t), passivate or wait(q), else 0
+        static Declaration* transferOf(Expression* e, bool process = false);
+        // the body of cls transfers control only by such statements of its own, not in a procedure it calls,
+        // a prefixed block, an inspect or an activation statement; see CeeGen::emitClassStep
+        static bool isResumable(Declaration* cls);
+    private:
+        void walk(Declaration* d);
+        void walk(Statement* s);
+        QHash<Declaration*, QList<Declaration*> > subs;
+        QSet<Declaration*> seen;
+    };
+}
+
+#endif // __SIM_CLASSHIERARCHY__
@@ -0,0 +1,514 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimEscapeAnalyzer.h"
+#include <QSet>
+using namespace Sim;
+
+static bool inEnvironment(Declaration* d)
+{
+    // the standard declarations, see runtime/builtins.sim
+    for( Declaration* o = d->outer; o != 0; o = o->outer )
+    {
+        const QByteArray name = o->name.toLower();
+        if( name == "environment" || name == "basicio" || name == "simset" || name == "simulation" )
+            return true;
+    }
+    return false;
+}
+
+static bool isStandardProc(Declaration* d, const char* name)
+{
+    return d != 0 && d->kind == Declaration::Procedure && d->name.toLower() == name && inEnvironment(d);
+}
+
+static inline bool isText(Expression* e)
+{
+    return e != 0 && e->type() != 0 && e->type()->kind == Type::Text;
+}
+
+static Declaration* callee(Expression* call)
+{
+    Expression* e = call->lhs;
+    if( e && e->kind == Expression::Dot )
+        e = e->rhs;
+    if( e && e->kind == Expression::DeclRef )
+        return e->d;
+    return 0;
+}
+
+class CaptureFinder
+{
+public:
+    // true if the object of the code can become known outside the code or outlive its creator
+    static bool decls(Declaration* d)
+    {
+        for( ; d != 0; d = d->next )
+        {
+            switch( d->kind )
+            {
+            case Declaration::Class:
+                return true; // the objects of a local class refer to the enclosing object
+            case Declaration::Procedure:
+            case Declaration::Program:
+                if( decls(d->link) || stats(d->body) )
+                    return true;
+                break;
+            case Declaration::Variable:
+                if( exprs(d->init) )
+                    return true;
+                break;
+            case Declaration::Array:
+                if( d->type() && exprs(d->type()->getExpr()) )
+                    return true;
+                break;
+            case Declaration::Switch:
+                if( exprs(d->list) )
+                    return true;
+                break;
+            default:
+                break;
+            }
+        }
+        return false;
+    }
+
+    static bool stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( ( s->scope && decls(s->scope->link) ) || exprs(s->prefix) || exprs(s->args) )
+                    return true;
+                break;
+            case Statement::If:
+            case Statement::While:
+                if( exprs(s->cond) || stats(s->elseStmt) )
+                    return true;
+                break;
+            case Statement::For:
+                if( exprs(s->var) || exprs(s->list) )
+                    return true;
+                break;
+            case Statement::Inspect:
+                if( exprs(s->obj) || stats(s->otherwise) )
+                    return true;
+                for( Connection* c = s->conn; c != 0; c = c->next )
+                    if( stats(c->body) )
+                        return true;
+                break;
+            case Statement::Activate:
+                if( s->activate && ( exprs(s->activate->obj) || exprs(s->activate->at) ||
+                                     exprs(s->activate->delay) || exprs(s->activate->priorObj) ) )
+                    return true;
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+            case Statement::Goto:
+                if( exprs(s->lhs) || exprs(s->rhs) )
+                    return true;
+                break;
+            case Statement::Detach:
+            case Statement::Resume:
+                return true;
+            default:
+                break;
+            }
+            if( stats(s->body) )
+                return true;
+        }
+        return false;
+    }
+
+    static bool exprs(Expression* e)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            if( e->kind == Expression::This )
+                return true;
+            if( e->kind == Expression::Call )
+            {
+                Declaration* d = callee(e);
+                if( isStandardProc(d, "detach") || isStandardProc(d, "resume") || isStandardProc(d, "call") )
+                    return true;
+            }
+            if( e->kind == Expression::DeclRef && isStandardProc(e->d, "detach") )
+                return true; // the statement detach is a designator without arguments
+            if( exprs(e->lhs) || exprs(e->rhs) || exprs(e->condition) )
+                return true;
+        }
+        return false;
+    }
+};
+
+class EscapeWalker
+{
+public:
+    enum Use { Escaping, Harmless }; // Harmless: the reference is consumed without being stored
+
+    QSet<Declaration*> candidates; // reference variables local to a procedure or block of the tree
+    QSet<Declaration*> escaped;
+    QList<QPair<Declaration*,Expression*> > bound; // x :- NEW C
+    QList<Expression*> unbound; // NEW C consumed where it occurs
+    QList<Expression*> temps;
+    QHash<Declaration*,bool> classes; // cache of stackable()
+    int classLevel;
+    bool inStatement; // walking the expression of an assignment or procedure statement
+
+    EscapeWalker():classLevel(0),inStatement(false) {}
+
+    void decls(Declaration* d)
+    {
+        for( ; d != 0; d = d->next )
+            decl(d);
+    }
+
+    void decl(Declaration* d)
+    {
+        switch( d->kind )
+        {
+        case Declaration::Module:
+        case Declaration::Program:
+        case Declaration::Procedure:
+            decls(d->link);
+            stats(d->body);
+            break;
+        case Declaration::Class:
+            // the objects of a local class can outlive the block and keep reading its variables
+            classLevel++;
+            decls(d->link);
+            stats(d->body);
+            classLevel--;
+            break;
+        case Declaration::Variable:
+            if( d->type() && d->type()->kind == Type::Ref && d->outer &&
+                    ( d->outer->kind == Declaration::Procedure || d->outer->kind == Declaration::Block ) )
+                candidates.insert(d);
+            exprList(d->init, Escaping);
+            break;
+        case Declaration::Array:
+            if( d->type() )
+                exprList(d->type()->getExpr(), Escaping);
+            break;
+        case Declaration::Switch:
+            exprList(d->list, Escaping);
+            break;
+        default:
+            break; // Block declarations are walked with their statement
+        }
+    }
+
+    void stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( s->scope )
+                    decls(s->scope->link);
+                exprList(s->prefix, Escaping);
+                exprList(s->args, Escaping);
+                break;
+            case Statement::Assign:
+                inStatement = true;
+                if( s->lhs ) // not used by the parser, which puts an AssignVal or AssignRef to rhs
+                    target(s->lhs);
+                if( s->rhs )
+                    assignment(s->rhs);
+                inStatement = false;
+                break;
+            case Statement::Call:
+                inStatement = true;
+                expr(s->lhs, Harmless);
+                expr(s->rhs, Harmless);
+                inStatement = false;
+                break;
+            case Statement::If:
+            case Statement::While:
+                expr(s->cond, Harmless);
+                stats(s->elseStmt);
+                break;
+            case Statement::For:
+                expr(s->var, Escaping);
+                exprList(s->list, Escaping);
+                break;
+            case Statement::Inspect:
+                inspect(s);
+                break;
+            case Statement::Activate:
+                if( s->activate )
+                {
+                    expr(s->activate->obj, Escaping);
+                    expr(s->activate->at, Escaping);
+                    expr(s->activate->delay, Escaping);
+                    expr(s->activate->priorObj, Escaping);
+                }
+                break;
+            case Statement::Goto:
+            case Statement::Detach:
+            case Statement::Resume:
+                expr(s->lhs, Escaping);
+                expr(s->rhs, Escaping);
+                break;
+            default:
+                break;
+            }
+            stats(s->body);
+        }
+    }
+
+    void inspect(Statement* s)
+    {
+        // the connection blocks see the object as THIS
+        bool harmless = EscapeAnalyzer::generator(s->obj) != 0 && !CaptureFinder::stats(s->otherwise) &&
+                !CaptureFinder::stats(s->body);
+        for( Connection* c = s->conn; c != 0; c = c->next )
+        {
+            if( CaptureFinder::stats(c->body) )
+                harmless = false;
+            stats(c->body);
+        }
+        expr(s->obj, harmless ? Harmless : Escaping);
+        stats(s->otherwise);
+    }
+
+    void assignment(Expression* e)
+    {
+        if( e->kind == Expression::AssignRef )
+        {
+            target(e->lhs);
+            Expression* args = 0;
+            Expression* n = EscapeAnalyzer::generator(e->rhs, &args);
+            if( e->lhs->kind == Expression::DeclRef && n != 0 )
+            {
+                exprList(args, Escaping);
+                bound.append(qMakePair(e->lhs->d, n));
+            }else
+                expr(e->rhs, Escaping);
+        }else if( e->kind == Expression::AssignVal )
+        {
+            target(e->lhs);
+            // a text value assignment copies the characters
+            expr(e->rhs, isText(e->lhs) ? Harmless : Escaping);
+        }else
+            expr(e, Escaping);
+    }
+
+    void target(Expression* e)
+    {
+        // storing to a variable doesn't let its previous value escape
+        if( e == 0 || e->kind == Expression::DeclRef )
+        {
+            if( e && classLevel > 0 )
+                escaped.insert(e->d);
+            return;
+        }
+        expr(e, Escaping);
+    }
+
+    void exprList(Expression* e, Use use)
+    {
+        for( ; e != 0; e = e->next )
+            expr(e, use);
+    }
+
+    void expr(Expression* e, Use use)
+    {
+        if( e == 0 )
+            return;
+        switch( e->kind )
+        {
+        case Expression::DeclRef:
+            if( use == Escaping || classLevel > 0 )
+                escaped.insert(e->d);
+            break;
+        case Expression::New:
+            if( use == Harmless )
+                unbound.append(e);
+            break;
+        case Expression::Dot:
+            // the remote attribute is in rhs; a text attribute like sub or main shares the characters
+            expr(e->lhs, isText(e->lhs) ? Escaping : Harmless);
+            break;
+        case Expression::Qua:
+            expr(e->lhs, use);
+            break;
+        case Expression::RefEq:
+        case Expression::RefNeq:
+        case Expression::Is:
+        case Expression::In:
+        case Expression::Eq:
+        case Expression::Neq:
+        case Expression::Lt:
+        case Expression::Leq:
+        case Expression::Gt:
+        case Expression::Geq:
+            expr(e->lhs, Harmless);
+            expr(e->rhs, Harmless);
+            break;
+        case Expression::IfExpr:
+            expr(e->condition, Harmless);
+            expr(e->lhs, Escaping);
+            expr(e->rhs, Escaping);
+            break;
+        case Expression::Call:
+            call(e, use);
+            break;
+        case Expression::AssignVal:
+        case Expression::AssignRef:
+            target(e->lhs);
+            expr(e->rhs, Escaping);
+            break;
+        case Expression::This:
+            break;
+        default:
+            exprList(e->lhs, Escaping);
+            exprList(e->rhs, Escaping);
+            exprList(e->condition, Escaping);
+            break;
+        }
+    }
+
+    void call(Expression* e, Use use)
+    {
+        if( e->lhs && e->lhs->kind == Expression::New )
+        {
+            // NEW C(args)
+            exprList(e->rhs, Escaping);
+            expr(e->lhs, use);
+            return;
+        }
+        Declaration* d = callee(e);
+        if( e->lhs && e->lhs->kind == Expression::Dot )
+            expr(e->lhs->lhs, isText(e->lhs->lhs) ? Escaping : Harmless);
+        else if( e->lhs && e->lhs->kind != Expression::DeclRef )
+            expr(e->lhs, Escaping);
+        exprList(e->rhs, isStandardProc(d, "outtext") ? Harmless : Escaping);
+        if( use == Harmless && inStatement && ( isStandardProc(d, "blanks") || isStandardProc(d, "copy") ) )
+            temps.append(e);
+    }
+
+    bool stackable(Declaration* cls)
+    {
+        if( classes.contains(cls) )
+            return classes.value(cls);
+        bool res = true;
+        for( Declaration* c = cls; c != 0 && res; c = c->prefix )
+        {
+            if( c->kind != Declaration::Class || c->isExternal || inEnvironment(c) ||
+                    CaptureFinder::decls(c->link) || CaptureFinder::stats(c->body) )
+                res = false;
+        }
+        classes.insert(cls, res);
+        return res;
+    }
+
+    void finish(EscapeAnalyzer::Result& res)
+    {
+        for( int i = 0; i < bound.size(); i++ )
+        {
+            Declaration* var = bound[i].first;
+            Expression* n = bound[i].second;
+            Declaration* cls = EscapeAnalyzer::generatedClass(n);
+            if( !candidates.contains(var) || escaped.contains(var) || cls == 0 || !stackable(cls) )
+                continue;
+            n->local = true;
+            QList<Declaration*>& classes = res.stackVars[var];
+            if( !classes.contains(cls) )
+                classes.append(cls);
+            res.objects++;
+        }
+        for( int i = 0; i < unbound.size(); i++ )
+        {
+            Declaration* cls = EscapeAnalyzer::generatedClass(unbound[i]);
+            if( cls == 0 || !stackable(cls) )
+                continue;
+            unbound[i]->local = true;
+            res.objects++;
+        }
+        for( int i = 0; i < temps.size(); i++ )
+            temps[i]->local = true;
+        res.temporaries = temps.size();
+    }
+};
+
+EscapeAnalyzer::Result EscapeAnalyzer::analyze(Declaration* d)
+{
+    Result res;
+    if( d == 0 || d->kind == Declaration::Block )
+        return res; // analyzed with the block statement
+    EscapeWalker w;
+    w.decl(d);
+    w.finish(res);
+    return res;
+}
+
+EscapeAnalyzer::Result EscapeAnalyzer::analyze(Statement* s)
+{
+    Result res;
+    EscapeWalker w;
+    w.stats(s);
+    w.finish(res);
+    return res;
+}
+
+bool EscapeAnalyzer::hasTemporaries(Expression* e)
+{
+    for( ; e != 0; e = e->next )
+    {
+        if( e->kind == Expression::Call && e->local )
+            return true;
+        if( hasTemporaries(e->lhs) || hasTemporaries(e->rhs) || hasTemporaries(e->condition) )
+            return true;
+    }
+    return false;
+}
+
+Expression* EscapeAnalyzer::generator(Expression* e, Expression** args)
+{
+    if( args )
+        *args = 0;
+    if( e == 0 )
+        return 0;
+    if( e->kind == Expression::Call && e->lhs && e->lhs->kind == Expression::New )
+    {
+        if( args )
+            *args = e->rhs;
+        return e->lhs;
+    }
+    if( e->kind == Expression::New )
+        return e;
+    return 0;
+}
+
+Declaration* EscapeAnalyzer::generatedClass(Expression* n)
+{
+    // the validator moves the class identifier to the type of the expression
+    Expression* cls = n->lhs;
+    if( cls == 0 && n->type() && n->type()->kind == Type::Ref )
+        cls = n->type()->getExpr();
+    if( cls && cls->kind == Expression::DeclRef )
+        return cls->d;
+    return 0;
+}
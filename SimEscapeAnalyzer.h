@@ -0,0 +1,58 @@
+#ifndef __SIM_ESCAPEANALYZER__
+#define __SIM_ESCAPEANALYZER__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+#include <QHash>
+
+namespace Sim
+{
+    // Finds the allocations of a validated tree which don't outlive the block they are made in and sets
+    // Expression::local on them, so the backends can put them on the stack instead of the collected heap.
+    // Two kinds of NEW qualify: a NEW assigned to a local reference variable which never escapes (i.e. is only
+    // dereferenced, compared, inspected or assigned to), and a NEW whose reference is consumed where it
+    // occurs (procedure statement, remote access, comparison, inspect). In both cases the class and its
+    // prefixes must not hand out the object (no THIS, DETACH, RESUME or local classes) and must be user
+    // classes. Calls of the standard blanks and copy are local if the text is consumed by the statement
+    // (outtext argument, text relation, value assignment); the backends release them after the statement.
+    class EscapeAnalyzer
+    {
+    public:
+        struct Result
+        {
+            QHash<Declaration*, QList<Declaration*> > stackVars; // local variable -> classes of the NEW assigned to it
+            quint32 objects;
+            quint32 temporaries;
+            Result():objects(0),temporaries(0) {}
+        };
+
+        static Result analyze(Declaration* d); // d and all it contains
+        static Result analyze(Statement* s); // the statement sequence
+
+        static bool hasTemporaries(Expression* e); // e contains local text temporaries
+
+        // e is NEW C or NEW C(args), the latter being a Call of the New expression; returns the New expression
+        static Expression* generator(Expression* e, Expression** args = 0);
+        static Declaration* generatedClass(Expression* n); // C of the New expression n
+    };
+}
+
+#endif // __SIM_ESCAPEANALYZER__
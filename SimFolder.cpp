@@ -0,0 +1,569 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimFolder.h"
+#include <QSet>
+#include <math.h>
+#include <string.h>
+using namespace Sim;
+
+static inline bool isReal(Expression* e)
+{
+    return e->type() && e->type()->isReal();
+}
+
+static inline bool inRange(Type* t, qint64 v)
+{
+    // the backends represent integer as 32 and short integer as 16 bit
+    if( t->kind == Type::ShortInteger )
+        return v >= -32768 && v <= 32767;
+    return v >= -2147483647 - 1 && v <= 2147483647;
+}
+
+class FoldWalker
+{
+public:
+    quint32 count;
+    QSet<Declaration*> busy; // constant declarations being folded, to stop at circular definitions
+
+    FoldWalker():count(0) {}
+
+    void exprList(Expression* e)
+    {
+        while( e )
+        {
+            expr(e);
+            e = e->next;
+        }
+    }
+
+    void target(Expression* e)
+    {
+        // the designator of an assignment or for statement stays a variable, only its parts are folded
+        if( e == 0 )
+            return;
+        exprList(e->lhs);
+        exprList(e->rhs);
+        exprList(e->condition);
+    }
+
+    void expr(Expression* e)
+    {
+        if( e->folded )
+            return; // e.g. bound expressions shared by the arrays of a segment
+        if( e->kind == Expression::AssignVal || e->kind == Expression::AssignRef )
+        {
+            target(e->lhs);
+            exprList(e->rhs);
+            return;
+        }
+        exprList(e->lhs);
+        exprList(e->rhs);
+        exprList(e->condition);
+        if( eval(e) )
+        {
+            e->folded = true;
+            switch( e->kind )
+            {
+            case Expression::UnsignedConst:
+            case Expression::RealConst:
+            case Expression::BoolConst:
+            case Expression::CharConst:
+            case Expression::StringConst:
+            case Expression::Notext:
+                break;
+            default:
+                count++;
+                break;
+            }
+        }
+    }
+
+    bool eval(Expression* e)
+    {
+        Type* t = e->type();
+        if( t == 0 )
+            return false; // not validated
+        switch( e->kind )
+        {
+        case Expression::UnsignedConst:
+        case Expression::RealConst:
+        case Expression::BoolConst:
+        case Expression::CharConst:
+        case Expression::StringConst:
+        case Expression::Notext:
+            return true;
+        case Expression::DeclRef:
+            return declRef(e);
+        case Expression::Neg: // the operand of unary operators is rhs
+            if( !e->rhs->folded )
+                return false;
+            if( isReal(e) )
+                return setReal(e, -Folder::real(e->rhs));
+            return setInteger(e, -Folder::integer(e->rhs));
+        case Expression::Not:
+            if( !e->rhs->folded )
+                return false;
+            e->u = !Folder::boolean(e->rhs);
+            return true;
+        case Expression::Add:
+        case Expression::Sub:
+        case Expression::Mul:
+        case Expression::Div:
+        case Expression::IntDiv:
+        case Expression::Exp:
+            return arithmetic(e);
+        case Expression::AndThen:
+        case Expression::OrElse:
+            if( e->lhs->folded && Folder::boolean(e->lhs) == ( e->kind == Expression::OrElse ) )
+            {
+                // the right side is not evaluated
+                e->u = e->kind == Expression::OrElse;
+                return true;
+            }
+            // fall through
+        case Expression::And:
+        case Expression::Or:
+        case Expression::Imp:
+        case Expression::Eqv:
+            return logical(e);
+        case Expression::Eq:
+        case Expression::Neq:
+        case Expression::Lt:
+        case Expression::Leq:
+        case Expression::Gt:
+        case Expression::Geq:
+            return relation(e);
+        case Expression::IfExpr:
+            {
+                if( e->condition == 0 || !e->condition->folded )
+                    return false;
+                Expression* branch = Folder::boolean(e->condition) ? e->lhs : e->rhs;
+                // the validator takes the type of the then branch; don't convert values of the other one
+                if( branch == 0 || branch->type() == 0 || branch->type()->kind != t->kind )
+                    return false;
+                return copy(e, branch);
+            }
+        default:
+            return false;
+        }
+    }
+
+    bool declRef(Expression* e)
+    {
+        Declaration* d = e->d;
+        if( d == 0 || d->kind != Declaration::Variable || d->init == 0 || busy.contains(d) )
+            return false;
+        // a SIM86 initialized declaration is a constant; it may be declared after the reference
+        busy.insert(d);
+        exprList(d->init);
+        busy.remove(d);
+        if( !d->init->folded )
+            return false;
+        Type* t = e->type();
+        if( t->isArithmetic() )
+            return d->init->type()->isArithmetic() && ( t->isReal() || inRange(t, Folder::integer(d->init)) );
+        return t->kind == d->init->type()->kind || ( t->kind == Type::Text && d->init->type()->kind == Type::Notext );
+    }
+
+    bool copy(Expression* to, Expression* from)
+    {
+        if( !from->folded )
+            return false;
+        Type* t = to->type();
+        switch( t->kind )
+        {
+        case Type::Integer:
+        case Type::ShortInteger:
+            return setInteger(to, Folder::integer(from));
+        case Type::Real:
+        case Type::LongReal:
+            return setReal(to, Folder::real(from));
+        case Type::Boolean:
+            to->u = Folder::boolean(from);
+            return true;
+        case Type::Character:
+            to->u = Folder::character(from);
+            return true;
+        case Type::Text:
+            to->a = Folder::text(from);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool setInteger(Expression* e, qint64 v)
+    {
+        if( !inRange(e->type(), v) )
+            return false; // leave the overflow to the run time
+        e->u = v;
+        return true;
+    }
+
+    bool setReal(Expression* e, double v)
+    {
+        if( isnan(v) || isinf(v) )
+            return false;
+        e->r = v;
+        return true;
+    }
+
+    bool arithmetic(Expression* e)
+    {
+        if( !e->lhs->folded || !e->rhs->folded )
+            return false;
+        if( isReal(e) || e->kind == Expression::Div )
+        {
+            const double l = Folder::real(e->lhs);
+            const double r = Folder::real(e->rhs);
+            switch( e->kind )
+            {
+            case Expression::Add:
+                return setReal(e, l + r);
+            case Expression::Sub:
+                return setReal(e, l - r);
+            case Expression::Mul:
+                return setReal(e, l * r);
+            case Expression::Div:
+                if( r == 0.0 )
+                    return false;
+                if( !isReal(e) )
+                    return false;
+                return setReal(e, l / r);
+            case Expression::Exp:
+                return setReal(e, pow(l, r));
+            default:
+                return false;
+            }
+        }
+        const qint64 l = Folder::integer(e->lhs);
+        const qint64 r = Folder::integer(e->rhs);
+        switch( e->kind )
+        {
+        case Expression::Add:
+            return setInteger(e, l + r);
+        case Expression::Sub:
+            return setInteger(e, l - r);
+        case Expression::Mul:
+            return setInteger(e, l * r);
+        case Expression::IntDiv:
+            if( r == 0 )
+                return false;
+            return setInteger(e, l / r);
+        case Expression::Exp:
+            {
+                if( r < 0 || ( l == 0 && r == 0 ) )
+                    return false; // a run time error
+                if( l == 0 || l == 1 )
+                    return setInteger(e, l);
+                if( l == -1 )
+                    return setInteger(e, r % 2 == 0 ? 1 : -1);
+                // square and multiply; the factors stay in range, so their products don't overflow
+                qint64 v = 1;
+                qint64 b = l;
+                for( qint64 n = r; ; )
+                {
+                    if( n & 1 )
+                    {
+                        v *= b;
+                        if( !inRange(e->type(), v) )
+                            return false;
+                    }
+                    n >>= 1;
+                    if( n == 0 )
+                        break;
+                    b *= b;
+                    if( !inRange(e->type(), b) )
+                        return false;
+                }
+                return setInteger(e, v);
+            }
+        default:
+            return false;
+        }
+    }
+
+    bool logical(Expression* e)
+    {
+        if( !e->lhs->folded || !e->rhs->folded )
+            return false;
+        const bool l = Folder::boolean(e->lhs);
+        const bool r = Folder::boolean(e->rhs);
+        switch( e->kind )
+        {
+        case Expression::And:
+        case Expression::AndThen:
+            e->u = l && r;
+            break;
+        case Expression::Or:
+        case Expression::OrElse:
+            e->u = l || r;
+            break;
+        case Expression::Imp:
+            e->u = !l || r;
+            break;
+        case Expression::Eqv:
+            e->u = l == r;
+            break;
+        default:
+            return false;
+        }
+        return true;
+    }
+
+    bool relation(Expression* e)
+    {
+        if( !e->lhs->folded || !e->rhs->folded )
+            return false;
+        Type* lt = e->lhs->type();
+        Type* rt = e->rhs->type();
+        int cmp;
+        if( lt->isArithmetic() && rt->isArithmetic() )
+        {
+            if( lt->isReal() || rt->isReal() )
+            {
+                const double l = Folder::real(e->lhs);
+                const double r = Folder::real(e->rhs);
+                cmp = l < r ? -1 : l > r ? 1 : 0;
+            }else
+            {
+                const qint64 l = Folder::integer(e->lhs);
+                const qint64 r = Folder::integer(e->rhs);
+                cmp = l < r ? -1 : l > r ? 1 : 0;
+            }
+        }else if( lt->kind == Type::Character && rt->kind == Type::Character )
+        {
+            const quint32 l = Folder::character(e->lhs);
+            const quint32 r = Folder::character(e->rhs);
+            cmp = l < r ? -1 : l > r ? 1 : 0;
+        }else if( ( lt->kind == Type::Text || lt->kind == Type::Notext ) &&
+                  ( rt->kind == Type::Text || rt->kind == Type::Notext ) )
+        {
+            // text values compare like their character sequences; notext equals ""
+            const char* l = Folder::text(e->lhs);
+            const char* r = Folder::text(e->rhs);
+            cmp = strcmp(l ? l : "", r ? r : "");
+        }else if( lt->kind == Type::Boolean && rt->kind == Type::Boolean &&
+                  ( e->kind == Expression::Eq || e->kind == Expression::Neq ) )
+        {
+            cmp = Folder::boolean(e->lhs) == Folder::boolean(e->rhs) ? 0 : 1;
+        }else
+            return false;
+        switch( e->kind )
+        {
+        case Expression::Eq:
+            e->u = cmp == 0;
+            break;
+        case Expression::Neq:
+            e->u = cmp != 0;
+            break;
+        case Expression::Lt:
+            e->u = cmp < 0;
+            break;
+        case Expression::Leq:
+            e->u = cmp <= 0;
+            break;
+        case Expression::Gt:
+            e->u = cmp > 0;
+            break;
+        case Expression::Geq:
+            e->u = cmp >= 0;
+            break;
+        default:
+            return false;
+        }
+        return true;
+    }
+
+    void decl(Declaration* d)
+    {
+        while( d )
+        {
+            if( d->kind == Declaration::Block || d->kind == Declaration::LabelDecl )
+            {
+                // visited by the block or label statement
+                d = d->next;
+                continue;
+            }
+            exprList(d->nameRef);
+            Type* t = d->type();
+            if( t && t->kind == Type::Array )
+                exprList(t->getExpr());
+            switch( d->kind )
+            {
+            case Declaration::Switch:
+                exprList(d->list);
+                break;
+            case Declaration::Variable:
+            case Declaration::Parameter:
+                if( d->init )
+                    exprList(d->init);
+                break;
+            default:
+                break;
+            }
+            decl(d->link);
+            stmt(d->body);
+            d = d->next;
+        }
+    }
+
+    void stmt(Statement* s)
+    {
+        while( s )
+        {
+            stmt(s->body);
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                exprList(s->prefix);
+                exprList(s->args);
+                if( s->scope )
+                    decl(s->scope->link);
+                break;
+            case Statement::If:
+            case Statement::While:
+                exprList(s->cond);
+                stmt(s->elseStmt);
+                break;
+            case Statement::For:
+                target(s->var);
+                exprList(s->list);
+                break;
+            case Statement::Inspect:
+                {
+                    exprList(s->obj);
+                    Connection* c = s->conn;
+                    while( c )
+                    {
+                        stmt(c->body);
+                        c = c->next;
+                    }
+                    stmt(s->otherwise);
+                }
+                break;
+            case Statement::Activate:
+                if( s->activate )
+                {
+                    exprList(s->activate->obj);
+                    exprList(s->activate->at);
+                    exprList(s->activate->delay);
+                    exprList(s->activate->priorObj);
+                }
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+            case Statement::Detach:
+            case Statement::Resume:
+            case Statement::Goto:
+                exprList(s->lhs);
+                exprList(s->rhs);
+                break;
+            default:
+                break;
+            }
+            s = s->next;
+        }
+    }
+};
+
+quint32 Folder::fold(Declaration* d)
+{
+    if( d == 0 )
+        return 0;
+    FoldWalker w;
+    // the module itself is not in a link chain
+    Declaration* next = d->next;
+    d->next = 0;
+    w.decl(d);
+    d->next = next;
+    return w.count;
+}
+
+quint32 Folder::fold(Statement* s)
+{
+    FoldWalker w;
+    w.stmt(s);
+    return w.count;
+}
+
+Expression* Folder::constant(Expression* e)
+{
+    if( e == 0 || !e->folded )
+        return 0;
+    if( e->kind == Expression::DeclRef )
+        return e->d->init;
+    return e;
+}
+
+qint64 Folder::integer(Expression* e)
+{
+    Expression* c = constant(e);
+    if( c == 0 )
+        return 0;
+    if( isReal(c) )
+        return qint64(floor(c->r + 0.5)); // real to integer conversion rounds
+    return qint64(c->u);
+}
+
+double Folder::real(Expression* e)
+{
+    Expression* c = constant(e);
+    if( c == 0 )
+        return 0.0;
+    if( isReal(c) )
+        return c->r;
+    return double(qint64(c->u));
+}
+
+bool Folder::boolean(Expression* e)
+{
+    Expression* c = constant(e);
+    return c && c->u;
+}
+
+quint32 Folder::character(Expression* e)
+{
+    Expression* c = constant(e);
+    return c ? c->u : 0;
+}
+
+Atom Folder::text(Expression* e)
+{
+    Expression* c = constant(e);
+    return c ? c->a : 0;
+}
+
+bool Folder::staticBounds(Type* array, QList<qint64>& bounds)
+{
+    bounds.clear();
+    if( array == 0 || array->kind != Type::Array )
+        return false;
+    Expression* e = array->getExpr();
+    while( e )
+    {
+        if( !e->folded || !e->type() || !e->type()->isArithmetic() )
+            return false;
+        bounds << integer(e);
+        e = e->next;
+    }
+    return !bounds.isEmpty();
+}
@@ -0,0 +1,49 @@
+#ifndef __SIM_FOLDER__
+#define __SIM_FOLDER__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+
+namespace Sim
+{
+    // Evaluates the constant expressions of a validated tree; runs between the validator and the backends.
+    // A folded expression has Expression::folded set and carries its value in u (integer as qint64, boolean,
+    // character), r (real) or a (text) according to its type. References to constant declarations (the
+    // SIM86 initialized declarations) are folded too; their value is in the initializer, see constant().
+    class Folder
+    {
+    public:
+        static quint32 fold(Declaration* d); // d and all it contains; returns the number of folded expressions
+        static quint32 fold(Statement* s); // the statement sequence
+
+        static Expression* constant(Expression* e); // the expression holding the value, or 0 if not folded
+        static qint64 integer(Expression* e);
+        static double real(Expression* e);
+        static bool boolean(Expression* e);
+        static quint32 character(Expression* e);
+        static Atom text(Expression* e);
+
+        // lower and upper bound of each dimension, if all of them are constant
+        static bool staticBounds(Type* array, QList<qint64>& bounds);
+    };
+}
+
+#endif // __SIM_FOLDER__
@@ -0,0 +1,648 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimInliner.h"
+#include "SimClassHierarchy.h"
+#include <QHash>
+using namespace Sim;
+
+static const int s_maxDepth = 4;
+
+static int size(Expression* e)
+{
+    int n = 0;
+    for( ; e != 0; e = e->next )
+        n += 1 + size(e->lhs) + size(e->rhs) + size(e->condition);
+    return n;
+}
+
+static bool isConstant(Expression* e)
+{
+    switch( e->kind )
+    {
+    case Expression::UnsignedConst:
+    case Expression::RealConst:
+    case Expression::BoolConst:
+    case Expression::CharConst:
+    case Expression::StringConst:
+    case Expression::None:
+    case Expression::Notext:
+        return true;
+    default:
+        return e->folded;
+    }
+}
+
+static bool isSimpleVar(Expression* e)
+{
+    // reading it twice or a little later yields the same value, as long as nothing is assigned in between
+    if( e->kind != Expression::DeclRef || e->d == 0 )
+        return false;
+    return e->d->kind == Declaration::Variable ||
+            ( e->d->kind == Declaration::Parameter && e->d->mode != Declaration::ModeName );
+}
+
+static bool isAssignment(Expression* e)
+{
+    return e->kind == Expression::AssignVal || e->kind == Expression::AssignRef;
+}
+
+static bool sameKind(Type* a, Type* b)
+{
+    return a != 0 && b != 0 && a->kind == b->kind;
+}
+
+class Scanner
+{
+public:
+    // the facts about an expression which decide whether it can replace a call
+    Declaration* proc;
+    bool self; // refers to the procedure itself
+    bool unsafe; // THIS, unresolved names, assignments below the root
+    bool calls; // calls procedures of the module, which might assign the variables passed
+    bool storesFormal; // assigns a parameter or passes it by name
+    Scanner(Declaration* p):proc(p),self(false),unsafe(false),calls(false),storesFormal(false) {}
+
+    bool isFormal(Expression* e) const
+    {
+        return e != 0 && e->kind == Expression::DeclRef && e->d && e->d->kind == Declaration::Parameter &&
+                e->d->outer == proc;
+    }
+
+    void callee(Declaration* d, Expression* args)
+    {
+        if( d == 0 || d->kind != Declaration::Procedure || d->getModule() == proc->getModule() )
+            calls = true;
+        Declaration* formal = d ? d->link : 0;
+        for( Expression* a = args; a != 0; a = a->next )
+        {
+            if( formal && formal->kind != Declaration::Parameter )
+                formal = 0;
+            if( isFormal(a) && ( formal == 0 || formal->mode == Declaration::ModeName ) )
+                storesFormal = true;
+            if( formal )
+                formal = formal->next;
+        }
+    }
+
+    void scan(Expression* e, bool root)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            switch( e->kind )
+            {
+            case Expression::This:
+            case Expression::Identifier:
+                unsafe = true;
+                break;
+            case Expression::AssignVal:
+            case Expression::AssignRef:
+                if( !root )
+                    unsafe = true;
+                if( isFormal(e->lhs) )
+                    storesFormal = true;
+                break;
+            case Expression::DeclRef:
+                if( e->d == proc )
+                    self = true;
+                else if( e->d && e->d->kind == Declaration::Procedure )
+                    callee(e->d, 0);
+                break;
+            case Expression::Call:
+                if( e->lhs && e->lhs->kind == Expression::DeclRef )
+                    callee(e->lhs->d, e->rhs);
+                else if( e->lhs && e->lhs->kind == Expression::Dot && e->lhs->rhs &&
+                         e->lhs->rhs->kind == Expression::DeclRef )
+                    callee(e->lhs->rhs->d, e->rhs);
+                else if( e->lhs && e->lhs->kind != Expression::New )
+                    calls = true;
+                break;
+            default:
+                break;
+            }
+            scan(e->lhs, false);
+            scan(e->rhs, false);
+            scan(e->condition, false);
+            root = false;
+        }
+    }
+};
+
+struct Binding
+{
+    QHash<Declaration*, Expression*> actuals;
+    Expression* obj; // the receiver, or 0 if the attributes stay unqualified
+    Declaration* cls;
+    Binding():obj(0),cls(0) {}
+
+    bool isMember(Declaration* d) const
+    {
+        if( d->kind != Declaration::Variable && d->kind != Declaration::Parameter &&
+                d->kind != Declaration::Array && d->kind != Declaration::Procedure )
+            return false;
+        Declaration* owner = ClassHierarchy::owner(d);
+        return owner != 0 && AstModel::isSubclassOf(cls, owner);
+    }
+
+    bool isRemote(Declaration* d) const
+    {
+        // obj.d denotes d, i.e. d is neither protected nor hidden by an attribute of a subclass
+        if( d->visi == Declaration::Private || d->visi == Declaration::Protected )
+            return false;
+        Type* t = obj->type();
+        Declaration* c = t && t->kind == Type::Ref ? t->getRefType() : 0;
+        for( ; c != 0; c = ClassHierarchy::prefixOf(c) )
+        {
+            if( Declaration* found = AstModel::findInScope(c, d->sym) )
+                return found == d;
+        }
+        return false;
+    }
+
+    bool canQualify(Expression* e) const
+    {
+        for( ; e != 0; e = e->next )
+        {
+            if( e->kind == Expression::DeclRef && e->d && !actuals.contains(e->d) && isMember(e->d) &&
+                    !isRemote(e->d) )
+                return false;
+            if( !canQualify(e->lhs) || !canQualify(e->condition) )
+                return false;
+            switch( e->kind )
+            {
+            case Expression::Dot:
+            case Expression::Qua:
+            case Expression::Is:
+            case Expression::In:
+                break;
+            default:
+                if( !canQualify(e->rhs) )
+                    return false;
+                break;
+            }
+        }
+        return true;
+    }
+};
+
+static Expression* cloneList(Expression* e, const Binding* b);
+
+static Expression* clone(Expression* e, const Binding* b)
+{
+    if( b && e->kind == Expression::DeclRef && e->d )
+    {
+        if( Expression* a = b->actuals.value(e->d) )
+            return clone(a, 0);
+        if( b->obj && b->isMember(e->d) )
+        {
+            Expression* dot = new Expression(Expression::Dot, e->pos);
+            dot->lhs = clone(b->obj, 0);
+            dot->rhs = clone(e, 0);
+            dot->setType(e->type());
+            return dot;
+        }
+    }
+    Expression* c = new Expression(e->kind, e->pos);
+    c->u = e->u;
+    c->folded = e->folded;
+    c->local = e->local;
+    c->setType(e->type()); // still owned by the original
+    switch( e->kind )
+    {
+    case Expression::Dot:
+    case Expression::Qua:
+    case Expression::Is:
+    case Expression::In:
+        // the right side names an attribute or a class
+        c->lhs = cloneList(e->lhs, b);
+        c->rhs = cloneList(e->rhs, 0);
+        break;
+    default:
+        c->lhs = cloneList(e->lhs, b);
+        c->rhs = cloneList(e->rhs, b);
+        c->condition = cloneList(e->condition, b);
+        break;
+    }
+    return c;
+}
+
+static Expression* cloneList(Expression* e, const Binding* b)
+{
+    Expression* head = 0;
+    Expression* last = 0;
+    for( ; e != 0; e = e->next )
+    {
+        Expression* c = clone(e, b);
+        if( last )
+            last->next = c;
+        else
+            head = c;
+        last = c;
+    }
+    return head;
+}
+
+static void replace(Expression* e, Expression* by)
+{
+    // e becomes by, keeping its place in the tree and in the list it is part of
+    delete e->lhs;
+    delete e->rhs;
+    delete e->condition;
+    e->kind = by->kind;
+    e->u = by->u;
+    e->folded = by->folded;
+    e->local = by->local;
+    e->lhs = by->lhs;
+    e->rhs = by->rhs;
+    e->condition = by->condition;
+    e->setType(by->type());
+    by->lhs = by->rhs = by->condition = 0;
+    delete by;
+}
+
+class Expander
+{
+public:
+    Inliner::Result& res;
+    int budget;
+    Declaration* cls; // the class of the code being walked, the receiver of unqualified calls
+    QList<Declaration*> scopes; // the scopes of the code being walked, innermost last, as the validator sees them
+    QHash<Declaration*, Expression*> bodies; // procedure -> inlineBody
+
+    Expander(Inliner::Result& r, int b):res(r),budget(b),cls(0) {}
+
+    Expression* body(Declaration* proc)
+    {
+        if( !bodies.contains(proc) )
+            bodies[proc] = Inliner::inlineBody(proc, budget);
+        return bodies.value(proc);
+    }
+
+    Declaration* resolve(Atom sym) const
+    {
+        // like Validator2::resolve, but only in the scopes of the module
+        for( int i = scopes.size() - 1; i >= 0; i-- )
+        {
+            for( Declaration* scope = scopes[i]; scope != 0; scope = scope->prefix )
+            {
+                if( Declaration* d = AstModel::findInScope(scope, sym) )
+                    return d;
+                if( scope->kind != Declaration::Class && scope->kind != Declaration::Block )
+                    break;
+            }
+        }
+        return 0;
+    }
+
+    bool visible(Expression* e, const Binding& b) const
+    {
+        // the names in the body must denote the same declarations at the call, since the backends emit
+        // them as they are written
+        for( ; e != 0; e = e->next )
+        {
+            if( e->kind == Expression::DeclRef && e->d && e->d->sym && !b.actuals.contains(e->d) &&
+                    !( b.obj && b.isMember(e->d) ) )
+            {
+                Declaration* d = resolve(e->d->sym);
+                if( d != 0 && d != e->d )
+                    return false; // e.g. a local of the caller hiding a global the procedure uses
+            }
+            if( !visible(e->lhs, b) || !visible(e->condition, b) )
+                return false;
+            switch( e->kind )
+            {
+            case Expression::Dot:
+            case Expression::Qua:
+            case Expression::Is:
+            case Expression::In:
+                break;
+            default:
+                if( !visible(e->rhs, b) )
+                    return false;
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool tryInline(Expression* e, bool statement, int depth)
+    {
+        if( depth >= s_maxDepth )
+            return false;
+        Expression* obj = 0;
+        Expression* args = 0;
+        Expression* callee = e;
+        if( e->kind == Expression::Call )
+        {
+            callee = e->lhs;
+            args = e->rhs;
+        }
+        if( callee == 0 )
+            return false;
+        if( callee->kind == Expression::Dot )
+        {
+            obj = callee->lhs;
+            callee = callee->rhs;
+        }
+        if( callee == 0 || callee->kind != Expression::DeclRef || callee->d == 0 ||
+                callee->d->kind != Declaration::Procedure )
+            return false;
+        Declaration* proc = callee->d;
+        const bool function = proc->type() && proc->type()->kind != Type::NoType;
+        if( function == statement )
+            return false;
+        Expression* E = body(proc);
+        if( E == 0 )
+            return false;
+
+        Binding b;
+        b.cls = ClassHierarchy::owner(proc);
+        if( b.cls && obj == 0 && !AstModel::isSubclassOf(cls, b.cls) )
+            return false; // e.g. an attribute of the object connected by INSPECT
+        if( obj && !isSimpleVar(obj) )
+            return false;
+        b.obj = obj;
+
+        bool constant = true;
+        Declaration* formal = proc->link;
+        for( Expression* a = args; a != 0; a = a->next, formal = formal->next )
+        {
+            if( formal == 0 || formal->kind != Declaration::Parameter )
+                return false;
+            if( !isConstant(a) && !isSimpleVar(a) )
+                return false;
+            if( formal->type()->kind != Type::Ref && !sameKind(formal->type(), a->type()) )
+                return false; // e.g. an integer passed to a real
+            if( !isConstant(a) )
+                constant = false;
+            b.actuals[formal] = a;
+        }
+        if( formal && formal->kind == Declaration::Parameter )
+            return false;
+
+        if( obj && !b.canQualify(E) )
+            return false;
+        if( !visible(E, b) )
+            return false;
+
+        Scanner s(proc);
+        s.scan(E, true);
+        if( s.calls && ( !constant || obj ) )
+            return false; // the call might change the variables, which were read on entry otherwise
+
+        const RowCol pos = e->pos;
+        replace(e, clone(E, &b));
+        e->pos = pos;
+        res.inlined.append(Inliner::Site(pos, proc));
+        exprs(e, depth + 1, true); // the inlined calls
+        return true;
+    }
+
+    void decl(Declaration* d)
+    {
+        switch( d->kind )
+        {
+        case Declaration::Module:
+        case Declaration::Program:
+        case Declaration::Class:
+        case Declaration::Procedure:
+            {
+                Declaration* old = cls;
+                if( d->kind == Declaration::Class )
+                    cls = d;
+                else if( d->kind == Declaration::Procedure )
+                    cls = ClassHierarchy::owner(d); // nested procedures don't see the object
+                scopes.append(d);
+                for( Declaration* m = d->link; m != 0; m = m->next )
+                    decl(m);
+                stats(d->body);
+                scopes.removeLast();
+                cls = old;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            const int depth = scopes.size();
+            Declaration* old = cls;
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                list(s->args, 0);
+                if( s->scope )
+                {
+                    scopes.append(s->scope);
+                    for( Declaration* m = s->scope->link; m != 0; m = m->next )
+                        decl(m);
+                }
+                break;
+            case Statement::If:
+            case Statement::While:
+                list(s->cond, 0);
+                stats(s->elseStmt);
+                break;
+            case Statement::For:
+                list(s->var, 0);
+                list(s->list, 0);
+                break;
+            case Statement::Inspect:
+                {
+                    list(s->obj, 0);
+                    // unqualified attributes may belong to the inspected object
+                    cls = 0;
+                    for( Connection* c = s->conn; c != 0; c = c->next )
+                    {
+                        if( c->classDecl )
+                            scopes.append(c->classDecl);
+                        stats(c->body);
+                        if( c->classDecl )
+                            scopes.removeLast();
+                    }
+                    stats(s->otherwise);
+                    Type* t = s->obj ? s->obj->type() : 0;
+                    if( t && t->kind == Type::Ref && t->getRefType() )
+                        scopes.append(t->getRefType()); // for the do body
+                }
+                break;
+            case Statement::Activate:
+                if( s->activate )
+                {
+                    list(s->activate->obj, 0);
+                    list(s->activate->at, 0);
+                    list(s->activate->delay, 0);
+                    list(s->activate->priorObj, 0);
+                }
+                break;
+            case Statement::Call:
+            case Statement::Assign:
+                {
+                    Expression* e = s->lhs ? s->lhs : s->rhs;
+                    if( s->kind == Statement::Call && e && tryInline(e, true, 0) )
+                    {
+                        if( isAssignment(e) )
+                            s->kind = Statement::Assign;
+                    }else
+                    {
+                        list(s->lhs, 0);
+                        list(s->rhs, 0);
+                    }
+                }
+                break;
+            case Statement::Goto:
+            case Statement::Detach:
+            case Statement::Resume:
+                list(s->lhs, 0);
+                list(s->rhs, 0);
+                break;
+            default:
+                break;
+            }
+            stats(s->body);
+            while( scopes.size() > depth )
+                scopes.removeLast();
+            cls = old;
+        }
+    }
+
+    void list(Expression* e, int depth)
+    {
+        for( ; e != 0; e = e->next )
+            exprs(e, depth, false);
+    }
+
+    void exprs(Expression* e, int depth, bool operandsOnly)
+    {
+        if( !operandsOnly && tryInline(e, false, depth) )
+            return;
+        switch( e->kind )
+        {
+        case Expression::Call:
+            {
+                Expression* callee = e->lhs;
+                if( callee && callee->kind == Expression::Dot )
+                    list(callee->lhs, depth);
+                else if( callee && callee->kind != Expression::DeclRef )
+                    list(callee, depth);
+                Declaration* proc = callee && callee->kind == Expression::DeclRef ? callee->d :
+                        callee && callee->kind == Expression::Dot && callee->rhs ? callee->rhs->d : 0;
+                Declaration* formal = proc ? proc->link : 0;
+                for( Expression* a = e->rhs; a != 0; a = a->next )
+                {
+                    if( formal && formal->kind != Declaration::Parameter )
+                        formal = 0;
+                    // a procedure passed as a parameter is not called here, and a NAME actual is
+                    // passed as written
+                    const bool asIs = formal && ( formal->mode == Declaration::ModeName ||
+                            ( formal->type() && formal->type()->kind == Type::Procedure ) );
+                    exprs(a, depth, asIs);
+                    if( formal )
+                        formal = formal->next;
+                }
+            }
+            break;
+        case Expression::AssignVal:
+        case Expression::AssignRef:
+            // the function designator on the left is the result of the function
+            if( e->lhs && !( e->lhs->kind == Expression::DeclRef && e->lhs->d &&
+                             e->lhs->d->kind == Declaration::Procedure ) )
+                list(e->lhs, depth);
+            list(e->rhs, depth);
+            break;
+        case Expression::Dot:
+        case Expression::Qua:
+        case Expression::Is:
+        case Expression::In:
+            list(e->lhs, depth);
+            break;
+        default:
+            list(e->lhs, depth);
+            list(e->rhs, depth);
+            list(e->condition, depth);
+            break;
+        }
+    }
+};
+
+Inliner::Result Inliner::expand(Declaration* module, int budget)
+{
+    Result res;
+    Expander x(res, budget);
+    x.decl(module);
+    return res;
+}
+
+Expression* Inliner::inlineBody(Declaration* proc, int budget)
+{
+    if( proc->kind != Declaration::Procedure || proc->isExternal || proc->body == 0 )
+        return 0;
+    Declaration* cls = ClassHierarchy::owner(proc);
+    if( cls && cls->kind != Declaration::Class )
+        return 0;
+    if( cls && ClassHierarchy::virtualSpec(cls, proc->sym) )
+        return 0;
+    for( Declaration* d = proc->link; d != 0; d = d->next )
+    {
+        if( d->kind != Declaration::Parameter || d->mode == Declaration::ModeName )
+            return 0; // locals, labels or NAME parameters
+        Type* t = d->type();
+        if( t == 0 )
+            return 0;
+        if( t->kind == Type::Text && d->mode == Declaration::ModeValue )
+            return 0; // a copy
+        if( t->kind != Type::Ref && t->kind != Type::Text && ( t->kind < Type::Integer || t->kind > Type::Character ) )
+            return 0;
+    }
+
+    Statement* s = proc->body;
+    while( s && ( s->kind == Statement::Compound || s->kind == Statement::Block ) && s->next == 0 &&
+           ( s->scope == 0 || s->scope->link == 0 ) && ( s->kind == Statement::Compound || s->prefix == 0 ) )
+        s = s->body;
+    if( s == 0 || s->next != 0 || ( s->kind != Statement::Assign && s->kind != Statement::Call ) )
+        return 0;
+    Expression* e = s->lhs ? s->lhs : s->rhs;
+    if( e == 0 || e->next != 0 )
+        return 0;
+
+    const bool function = proc->type() && proc->type()->kind != Type::NoType;
+    if( function )
+    {
+        // the value assigned to the function designator
+        if( s->kind != Statement::Assign || !isAssignment(e) || e->lhs == 0 || e->lhs->kind != Expression::DeclRef ||
+                e->lhs->d != proc || e->rhs == 0 )
+            return 0;
+        e = e->rhs;
+        if( isAssignment(e) || !sameKind(e->type(), proc->type()) )
+            return 0; // multiple assignment or conversion
+    }
+    if( size(e) > budget )
+        return 0;
+
+    Scanner sc(proc);
+    sc.scan(e, !function);
+    if( sc.self || sc.unsafe || sc.storesFormal )
+        return 0;
+    return e;
+}
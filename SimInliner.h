@@ -0,0 +1,60 @@
+#ifndef __SIM_INLINER__
+#define __SIM_INLINER__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+
+namespace Sim
+{
+    // Replaces the calls of small procedures of a validated module by their bodies, so the backends
+    // don't emit a call for e.g. an attribute accessor. A procedure is inlined if it is not virtual, has no
+    // local declarations and no NAME, array, procedure, label or switch parameters, and its body is a single
+    // statement without a goto, so that it can't leave the procedure early, which amounts to an expression
+    // of at most budget nodes: the value assigned to the function designator, or the assignment or
+    // procedure call of a proper procedure, which is only inlined in a procedure statement. The parameters
+    // are replaced by the actuals and the attributes of the class by remote accesses of the receiver, which
+    // must not be protected or hidden; actuals and receiver must be constants or simple variables, the body
+    // must not assign the parameters, and no name of the body may be hidden by a declaration of the caller,
+    // since the backends emit the names as written.
+    // Inlined calls are inlined again, up to a depth which stops mutual recursion.
+    class Inliner
+    {
+    public:
+        struct Site
+        {
+            RowCol pos;
+            Declaration* proc;
+            Site(const RowCol& p = RowCol(), Declaration* d = 0):pos(p),proc(d) {}
+        };
+        struct Result
+        {
+            QList<Site> inlined;
+        };
+
+        enum { DefaultBudget = 16 };
+        static Result expand(Declaration* module, int budget = DefaultBudget);
+
+        // the expression replacing a call of proc, or 0 if proc can't be inlined
+        static Expression* inlineBody(Declaration* proc, int budget = DefaultBudget);
+    };
+}
+
+#endif // __SIM_INLINER__
@@ -24,11 +24,14 @@
 #include <QDir>
 #include <QElapsedTimer>
 #include <QThread>
+#include <algorithm>
 #include "SimParser3.h"
 #include "SimAst.h"
 #include "SimValidator2.h"
+#include "SimFolder.h"
 #include "SimLexer.h"
 #include "SimCeeGen.h"
+#include "SimInliner.h"
 
 static QStringList collectFiles( const QDir& dir )
 {
@@ -58,40 +61,441 @@ public:
 };
 
 
-static void run( const QStringList& files, bool dump, bool cgen )
+class Units : public Sim::Parser3::Consumer {
+public:
+    Sim::Parser3* parser;
+    Sim::Validator2* va;
+    Sim::CeeGen* gen;
+    Sim::Declaration* module;
+    Units():parser(0),va(0),gen(0),module(0){}
+    bool begin(Sim::Declaration* scope)
+    {
+        // once there are errors the remaining units are still validated, but no longer translated
+        if( module == 0 )
+        {
+            module = scope->getModule();
+            gen->beginModule(module);
+        }
+        return parser->errors.isEmpty() && va->errors.isEmpty();
+    }
+    void openBlock(Sim::Statement* block)
+    {
+        if( begin(block->scope) )
+            gen->openBlock(block);
+    }
+    void unit(Sim::Declaration* d)
+    {
+        if( begin(d->outer) && va->validateUnit(d) )
+        {
+            Sim::Folder::fold(d);
+            gen->emitUnit(d);
+        }
+    }
+    void unit(Sim::Statement* s, Sim::Declaration* scope)
+    {
+        if( begin(scope) && va->validateUnit(s, scope) )
+        {
+            Sim::Folder::fold(s);
+            gen->emitUnit(s);
+        }
+    }
+    void closeBlock(Sim::Statement* block)
+    {
+        if( begin(block->scope) && va->finishUnits(block->scope) )
+            gen->closeBlock(block);
+    }
+};
+
+static void printDevirtualized( const Sim::CeeGen& gen, const QString& module )
+{
+    QTextStream out(stdout);
+    out << module << ": " << gen.devirtualized.size() << " of " << gen.virtualCalls
+        << " virtual calls bound statically" << endl;
+    foreach( const Sim::CeeGen::Devirtualized& d, gen.devirtualized )
+    {
+        Sim::Declaration* owner = Sim::ClassHierarchy::owner(d.impl);
+        out << "    " << d.pos.d_row << ":" << d.pos.d_col << " " << d.receiver->name << "." << d.proc->name
+            << " -> " << ( owner ? owner->name : QByteArray() ) << "." << d.impl->name << endl;
+    }
+}
+
+static void printInlined( const Sim::Inliner::Result& res, const QString& module )
+{
+    QTextStream out(stdout);
+    out << module << ": " << res.inlined.size() << " calls inlined" << endl;
+    foreach( const Sim::Inliner::Site& s, res.inlined )
+        out << "    " << s.pos.d_row << ":" << s.pos.d_col << " " << s.proc->name << endl;
+}
+
+static void runStreamed( Sim::AstModel& mdl, const QString& path, bool pratt, bool devirt, bool stackless,
+                         bool checks )
+{
+    Lex lex;
+    lex.lex.setStream(path);
+    lex.lex.setIgnoreComments(true);
+    lex.lex.setPackComments(true);
+    Sim::Parser3 p(&lex, &mdl);
+    p.setPratt(pratt);
+    Sim::Validator2 va(&mdl);
+    Sim::CeeGen gen;
+    gen.setStackless(stackless);
+    gen.setChecks(checks);
+    Units units;
+    units.parser = &p;
+    units.va = &va;
+    units.gen = &gen;
+    p.setConsumer(&units);
+    Sim::Declaration* module = p.RunParser();
+    if( !p.errors.isEmpty() )
+    {
+        foreach( const Sim::Parser3::Error& e, p.errors )
+            qCritical() << e.path << e.pos.d_row << e.pos.d_col << e.msg;
+    }else if( !va.errors.isEmpty() )
+    {
+        foreach( const Sim::Validator2::Error& e, va.errors )
+            qCritical() << e.path << e.pos.d_row << e.pos.d_col << e.msg;
+    }else if( units.module && !gen.endModule(module->name + ".c") )
+    {
+        foreach( const Sim::CeeGen::Error& e, gen.errors )
+            qCritical() << module->name << e.pos.d_row << e.msg;
+    }else if( units.module && devirt )
+        printDevirtualized(gen, module->name);
+}
+
+class CountingLex : public Lex {
+public:
+    quint32 count;
+    CountingLex():count(0){}
+    virtual Sim::Token next() { count++; return lex.nextToken(); }
+};
+
+static inline bool ruleLessThan(Sim::Parser3::RuleStat* lhs, Sim::Parser3::RuleStat* rhs)
+{
+    return lhs->self > rhs->self;
+}
+
+static inline bool fileLessThan(const QPair<qint64,QString>& lhs, const QPair<qint64,QString>& rhs)
+{
+    return lhs.first > rhs.first;
+}
+
+static void parseBench( const QStringList& files, bool pratt )
+{
+    QTextStream out(stdout);
+    Sim::Parser3::resetProfile();
+    QList< QPair<qint64,QString> > perFile;
+    quint64 tokens = 0;
+    qint64 total = 0;
+    int failed = 0;
+    foreach( const QString& path, files )
+    {
+        Sim::AstModel mdl;
+        CountingLex lex;
+        lex.lex.setIgnoreComments(true);
+        lex.lex.setPackComments(true);
+        QElapsedTimer t;
+        t.start();
+        lex.lex.setStream(path);
+        Sim::Parser3 p(&lex, &mdl);
+        p.setPratt(pratt);
+        p.RunParser();
+        const qint64 ns = t.nsecsElapsed();
+        total += ns;
+        tokens += lex.count;
+        if( !p.errors.isEmpty() )
+            failed++;
+        perFile << qMakePair(ns, QString("%1 tokens  %2").arg(lex.count, 8).arg(QFileInfo(path).fileName()));
+    }
+    out << "parsed " << files.size() << " files (" << failed << " with errors), " << tokens << " tokens in "
+        << QString::number(total / 1e6, 'f', 1) << " ms, "
+        << QString::number(total ? tokens * 1e6 / total : 0.0, 'f', 0) << " ktokens/s" << endl;
+
+    std::sort(perFile.begin(), perFile.end(), fileLessThan);
+    out << endl << "slowest files:" << endl;
+    for( int i = 0; i < perFile.size() && i < 10; i++ )
+        out << QString("%1 ms  ").arg(QString::number(perFile[i].first / 1e6, 'f', 2), 8) << perFile[i].second << endl;
+
+    if( !Sim::Parser3::isProfiling() )
+    {
+        out << endl << "no per rule profile; build SimLc with CONFIG+=parsebench (defines SIM_PARSER_PROFILE)" << endl;
+        return;
+    }
+    const Sim::Parser3::Profile& prof = Sim::Parser3::profile();
+    QList<Sim::Parser3::RuleStat*> rules = prof.rules;
+    std::sort(rules.begin(), rules.end(), ruleLessThan);
+    quint64 self = 0;
+    foreach( Sim::Parser3::RuleStat* r, rules )
+        self += r->self;
+    out << endl << "grammar rules ranked by self time (total includes callees, depth is max recursion):" << endl;
+    out << QString("%1 %2 %3 %4 %5 %6").arg("rule", -36).arg("calls", 10).arg("self ms", 10).arg("self %", 7)
+           .arg("total ms", 10).arg("depth", 6) << endl;
+    foreach( Sim::Parser3::RuleStat* r, rules )
+    {
+        if( r->calls == 0 )
+            continue;
+        out << QString("%1 %2 %3 %4 %5 %6").arg(r->name, -36).arg(r->calls, 10)
+               .arg(QString::number(r->self / 1e6, 'f', 2), 10)
+               .arg(QString::number(self ? r->self * 100.0 / self : 0.0, 'f', 1), 7)
+               .arg(QString::number(r->total / 1e6, 'f', 2), 10).arg(r->maxDepth, 6) << endl;
+    }
+    out << endl << "peek(offset) calls for " << prof.tokens << " consumed tokens, max offset " << prof.maxPeek << ":" << endl;
+    for( int i = 0; i <= Sim::Parser3::MaxPeek; i++ )
+    {
+        if( prof.peeks[i] == 0 )
+            continue;
+        out << QString("  %1%2 %3 per token").arg(i == Sim::Parser3::MaxPeek ? ">=" : "  ").arg(i, 2)
+               .arg(QString::number(prof.tokens ? double(prof.peeks[i]) / prof.tokens : 0.0, 'f', 3), 8)
+            << "  (" << prof.peeks[i] << ")" << endl;
+    }
+}
+
+static qint64 parseExpr( const QString& path, bool pratt, QString* dump )
 {
     Sim::AstModel mdl;
+    Lex lex;
+    lex.lex.setIgnoreComments(true);
+    lex.lex.setPackComments(true);
+    QElapsedTimer t;
+    t.start();
+    lex.lex.setStream(path);
+    Sim::Parser3 p(&lex, &mdl);
+    p.setPratt(pratt);
+    Sim::Declaration* module = p.RunParser();
+    const qint64 ns = t.nsecsElapsed();
+    if( dump )
+    {
+        QTextStream out(dump);
+        if( !p.errors.isEmpty() )
+            out << "errors " << p.errors.size() << endl;
+        Sim::AstModel::dump(out, module);
+    }
+    return ns;
+}
+
+static QString withoutAddresses( const QString& dump )
+{
+    // the dump includes some pointer values which differ between runs
+    QString res;
+    res.reserve(dump.size());
+    int i = 0;
+    while( i < dump.size() )
+    {
+        if( dump[i] == '0' && i + 1 < dump.size() && dump[i+1] == 'x' )
+        {
+            i += 2;
+            while( i < dump.size() && QString("0123456789abcdef").contains(dump[i]) )
+                i++;
+            res += "0x";
+        }else
+            res += dump[i++];
+    }
+    return res;
+}
+
+static void exprBench( const QStringList& files )
+{
+    // A/B comparison of the descending and the precedence climbing expression parser
+    QTextStream out(stdout);
+    const int rounds = 5;
+    qint64 descent = 0, climbing = 0;
+    int differ = 0;
+    foreach( const QString& path, files )
+    {
+        QString a, b;
+        parseExpr(path, false, &a);
+        parseExpr(path, true, &b);
+        if( withoutAddresses(a) != withoutAddresses(b) )
+        {
+            out << "different trees: " << path << endl;
+            differ++;
+        }
+        qint64 ta = 0, tb = 0;
+        for( int i = 0; i < rounds; i++ )
+        {
+            ta += parseExpr(path, false, 0);
+            tb += parseExpr(path, true, 0);
+        }
+        out << QString("%1 ms descent  %2 ms pratt  %3").arg(QString::number(ta / 1e6 / rounds, 'f', 2), 8)
+               .arg(QString::number(tb / 1e6 / rounds, 'f', 2), 8).arg(QFileInfo(path).fileName()) << endl;
+        descent += ta;
+        climbing += tb;
+    }
+    out << files.size() << " files, " << differ << " with different trees; descent "
+        << QString::number(descent / 1e6 / rounds, 'f', 1) << " ms, pratt "
+        << QString::number(climbing / 1e6 / rounds, 'f', 1) << " ms, speedup "
+        << QString::number(climbing ? double(descent) / climbing : 0.0, 'f', 2) << endl;
+}
+
+static void runParallel( Sim::AstModel& mdl, const QStringList& files, int threads, bool pratt, bool devirt,
+                         bool inlined, bool stackless, bool checks )
+{
+    // parse everything first, then validate all modules concurrently, then generate code
+    QList<Sim::Declaration*> modules;
+    foreach( const QString& path, files )
     {
         Lex lex;
-        lex.lex.setStream(":/runtime/builtins.sim");
+        lex.lex.setStream(path);
         lex.lex.setIgnoreComments(true);
         lex.lex.setPackComments(true);
         Sim::Parser3 p(&lex, &mdl);
-        Sim::Declaration* module = p.RunParser();
+        p.setPratt(pratt);
+        p.RunParser();
         if( !p.errors.isEmpty() )
         {
             foreach( const Sim::Parser3::Error& e, p.errors )
                 qCritical() << e.path << e.pos.d_row << e.pos.d_col << e.msg;
-        }
-        Sim::Declaration* decls = module->link;
-        module->link = 0;
-        Sim::Declaration* d = decls;
-        while( d )
+        }else
+            modules << p.takeResult();
+    }
+
+    QElapsedTimer t;
+    t.start();
+    QList<Sim::Validator2::Result> res = Sim::Validator2::validateAll(&mdl, modules, 0, false, threads);
+    qDebug() << "validated" << modules.size() << "modules on" << threads << "threads in" << t.elapsed() << "ms";
+
+    for( int i = 0; i < res.size(); i++ )
+    {
+        Sim::Declaration* module = res[i].module;
+        if( !res[i].errors.isEmpty() )
         {
-            d->outer = mdl.getGlobals();
-            d = d->next;
+            foreach( const Sim::Validator2::Error& e, res[i].errors )
+                qCritical() << e.path << e.pos.d_row << e.pos.d_col << e.msg;
+        }else
+        {
+            Sim::Folder::fold(module);
+            const Sim::Inliner::Result inl = Sim::Inliner::expand(module);
+            if( inlined )
+                printInlined(inl, module->name);
+            Sim::CeeGen gen;
+            gen.setStackless(stackless);
+            gen.setChecks(checks);
+            if( !gen.transpile(module, module->name + ".c") )
+            {
+                foreach( const Sim::CeeGen::Error& e, gen.errors )
+                    qCritical() << module->name << e.pos.d_row << e.msg;
+            }else if( devirt )
+                printDevirtualized(gen, module->name);
         }
-        mdl.getGlobals()->appendMember(decls);
+        Sim::Declaration::deleteAll(module);
+    }
+}
+
+static void loadBuiltins( Sim::AstModel& mdl, bool validate )
+{
+    Lex lex;
+    lex.lex.setStream(":/runtime/builtins.sim");
+    lex.lex.setIgnoreComments(true);
+    lex.lex.setPackComments(true);
+    Sim::Parser3 p(&lex, &mdl);
+    Sim::Declaration* module = p.RunParser();
+    if( !p.errors.isEmpty() )
+    {
+        foreach( const Sim::Parser3::Error& e, p.errors )
+            qCritical() << e.path << e.pos.d_row << e.pos.d_col << e.msg;
+    }
+    if( validate )
+    {
+        // validated up front, so the concurrent validators don't compete for the builtins
+        Sim::Validator2 va(&mdl);
+        va.validate(module);
+    }
+    Sim::Declaration* decls = module->link;
+    module->link = 0;
+    Sim::Declaration* d = decls;
+    while( d )
+    {
+        d->outer = mdl.getGlobals();
+        d = d->next;
+    }
+    mdl.getGlobals()->appendMember(decls);
+}
+
+static qint64 validateFile( Sim::AstModel& mdl, const QString& path, bool pratt )
+{
+    Lex lex;
+    lex.lex.setStream(path);
+    lex.lex.setIgnoreComments(true);
+    lex.lex.setPackComments(true);
+    Sim::Parser3 p(&lex, &mdl);
+    p.setPratt(pratt);
+    Sim::Declaration* module = p.RunParser();
+    if( !p.errors.isEmpty() )
+        return 0;
+    QElapsedTimer t;
+    t.start();
+    Sim::Validator2 va(&mdl);
+    va.validate(module);
+    return t.nsecsElapsed();
+}
+
+static QString percent( quint32 part, quint32 all )
+{
+    return QString::number(all ? 100.0 * part / all : 0.0, 'f', 1) + "%";
+}
+
+static void resolveBench( const QStringList& files, bool pratt )
+{
+    // validation time with and without the name resolution cache of Validator2
+    QTextStream out(stdout);
+    Sim::AstModel mdl;
+    loadBuiltins(mdl, true);
+    const int rounds = 5;
+    qint64 cached = 0, uncached = 0;
+    Sim::Validator2::resetResolveStats();
+    foreach( const QString& path, files )
+    {
+        qint64 ta = 0, tb = 0;
+        Sim::Validator2::ResolveStats before = Sim::Validator2::resolveStats();
+        Sim::Validator2::setResolveCache(true);
+        ta += validateFile(mdl, path, pratt);
+        Sim::Validator2::ResolveStats st = Sim::Validator2::resolveStats();
+        for( int i = 1; i < rounds; i++ )
+            ta += validateFile(mdl, path, pratt);
+        Sim::Validator2::setResolveCache(false);
+        for( int i = 0; i < rounds; i++ )
+            tb += validateFile(mdl, path, pratt);
+        const quint32 lookups = st.lookups - before.lookups;
+        out << QString("%1 ms cached %2 ms uncached  %3 lookups, %4 hits, %5 of scope searches avoided  %6")
+               .arg(QString::number(ta / 1e6 / rounds, 'f', 2), 8)
+               .arg(QString::number(tb / 1e6 / rounds, 'f', 2), 8)
+               .arg(lookups, 7).arg(percent(st.hits - before.hits, lookups), 6)
+               .arg(percent(st.avoided - before.avoided, st.avoided - before.avoided + st.searches - before.searches), 6)
+               .arg(QFileInfo(path).fileName()) << endl;
+        cached += ta;
+        uncached += tb;
+    }
+    Sim::Validator2::setResolveCache(true);
+    out << files.size() << " files; cached " << QString::number(cached / 1e6 / rounds, 'f', 1) << " ms, uncached "
+        << QString::number(uncached / 1e6 / rounds, 'f', 1) << " ms, speedup "
+        << QString::number(cached ? double(uncached) / cached : 0.0, 'f', 2) << endl;
+}
+
+static void run( const QStringList& files, bool dump, bool cgen, bool stream, bool pratt, int threads, bool devirt,
+                 bool inlined, bool stackless, bool checks )
+{
+    Sim::AstModel mdl;
+    loadBuiltins(mdl, threads > 0);
+    if( threads > 0 )
+    {
+        runParallel(mdl, files, threads, pratt, devirt, inlined, stackless, checks);
+        return;
     }
     foreach( const QString& path, files )
     {
         qDebug() << "processing" << path;
 
+        if( stream )
+        {
+            runStreamed(mdl, path, pratt, devirt, stackless, checks);
+            continue;
+        }
+
         Lex lex;
         lex.lex.setStream(path);
         lex.lex.setIgnoreComments(true);
         lex.lex.setPackComments(true);
         Sim::Parser3 p(&lex, &mdl);
+        p.setPratt(pratt);
         Sim::Declaration* module = p.RunParser();
         if( !p.errors.isEmpty() )
         {
@@ -114,12 +518,19 @@ static void run( const QStringList& files, bool dump, bool cgen )
                     qCritical() << e.path << e.pos.d_row << e.pos.d_col << e.msg;
             }else
             {
+                Sim::Folder::fold(module);
+                const Sim::Inliner::Result inl = Sim::Inliner::expand(module);
+                if( inlined )
+                    printInlined(inl, module->name);
                 Sim::CeeGen gen;
+                gen.setStackless(stackless);
+                gen.setChecks(checks);
                 if( !gen.transpile(module, module->name + ".c") )
                 {
                     foreach( const Sim::CeeGen::Error& e, gen.errors )
                         qCritical() << module->name << e.pos.d_row << e.msg;
-                }
+                }else if( devirt )
+                    printDevirtualized(gen, module->name);
             }
 #endif
         }
@@ -143,6 +554,16 @@ int main(int argc, char *argv[])
     QString outPath;
     bool dump = false;
     bool cgen = false;
+    bool stream = false;
+    bool parsebench = false;
+    bool exprbench = false;
+    bool resolvebench = false;
+    bool devirt = false;
+    bool inlined = false;
+    bool stackless = false;
+    bool checks = false;
+    bool pratt = false;
+    int threads = 0;
     QString ns;
     QString mod;
     const QStringList args = QCoreApplication::arguments();
@@ -158,12 +579,46 @@ int main(int argc, char *argv[])
             out << "  -ns=name  namespace for the generated files (default empty)" << endl;
             out << "  -mod=name directory of the generated files (default empty)" << endl;
             out << "  -cgen     generate C code from classes" << endl;
+            out << "  -stream   validate and generate each top-level unit as soon as it is parsed" << endl;
+            out << "  -parsebench  only parse the sources and print throughput and a per rule profile" << endl;
+            out << "  -pratt    parse expressions by precedence climbing" << endl;
+            out << "  -threads=n  parse all sources, then validate them concurrently on n threads (0 for ideal count)" << endl;
+            out << "  -exprbench  compare trees and parse times of both expression parsers" << endl;
+            out << "  -resolvebench  validate with and without the name resolution cache and print hit rates" << endl;
+            out << "  -devirt   print the call sites bound statically by class hierarchy analysis" << endl;
+            out << "  -inlined  print the calls replaced by the body of the procedure (not with -stream)" << endl;
+            out << "  -stackless  compile the bodies of coroutines to state machines where possible" << endl;
+            out << "  -checks   check all array indices, also the ones proven in range" << endl;
             out << "  -h        display this information" << endl;
             return 0;
         }else if( args[i] == "-dst" )
             dump = true;
         else if( args[i] == "-cgen" )
             cgen = true;
+        else if( args[i] == "-stream" )
+            stream = true;
+        else if( args[i] == "-parsebench" )
+            parsebench = true;
+        else if( args[i] == "-exprbench" )
+            exprbench = true;
+        else if( args[i] == "-resolvebench" )
+            resolvebench = true;
+        else if( args[i] == "-devirt" )
+            devirt = true;
+        else if( args[i] == "-inlined" )
+            inlined = true;
+        else if( args[i] == "-stackless" )
+            stackless = true;
+        else if( args[i] == "-checks" )
+            checks = true;
+        else if( args[i] == "-pratt" )
+            pratt = true;
+        else if( args[i].startsWith("-threads=") )
+        {
+            threads = args[i].mid(9).toInt();
+            if( threads <= 0 )
+                threads = QThread::idealThreadCount();
+        }
         else if( args[i].startsWith("-o=") )
             outPath = args[i].mid(3);
         else if( args[i].startsWith("-ns=") )
@@ -197,7 +652,14 @@ int main(int argc, char *argv[])
             files << path;
     }
 
-    run(files, dump, cgen);
+    if( exprbench )
+        exprBench(files);
+    else if( resolvebench )
+        resolveBench(files, pratt);
+    else if( parsebench )
+        parseBench(files, pratt);
+    else
+        run(files, dump, cgen, stream, pratt, threads, devirt, inlined, stackless, checks);
     Sim::Node::reportLeftovers();
 
     return 0;
@@ -36,6 +36,11 @@ CONFIG(debug, debug|release) {
         DEFINES += _DEBUG
 }
 
+# qmake CONFIG+=parsebench instruments Parser3 for SimLc -parsebench
+parsebench {
+        DEFINES += SIM_PARSER_PROFILE
+}
+
 QMAKE_CXXFLAGS += -Wno-reorder -Wno-unused-parameter -Wno-unused-function -Wno-unused-variable
 
 RESOURCES += \
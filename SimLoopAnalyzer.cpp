@@ -0,0 +1,314 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimLoopAnalyzer.h"
+#include "SimClassHierarchy.h"
+#include "SimEscapeAnalyzer.h"
+#include "SimFolder.h"
+using namespace Sim;
+
+static bool inScope(Declaration* d, const char* name)
+{
+    for( ; d != 0; d = d->outer )
+        if( d->name.toLower() == name )
+            return true;
+    return false;
+}
+
+class EffectCollector
+{
+public:
+    QSet<Declaration*>& assigned;
+    QList<Declaration*>& called;
+    bool& opaque;
+    bool inner; // the bodies of all prefixes are scanned, i.e. inner continues with a known body
+    EffectCollector(QSet<Declaration*>& a, QList<Declaration*>& c, bool& o):assigned(a),called(c),opaque(o),
+        inner(false) {}
+
+    void run(Declaration* d)
+    {
+        // the body of d runs; what it assigns and calls counts as if it were part of the loop body
+        if( called.contains(d) )
+            return;
+        called.append(d);
+        if( d->body == 0 && d->kind != Declaration::Class )
+            opaque = true; // external, or already emitted and deleted by the streaming parser
+        else
+            stats(d->body);
+    }
+
+    void generate(Declaration* cls)
+    {
+        // the bodies of the class and its prefixes run
+        const bool old = inner;
+        inner = true;
+        for( ; cls != 0 && !opaque; cls = cls->prefix )
+        {
+            if( cls->kind != Declaration::Class || inScope(cls, "simulation") )
+                opaque = true; // e.g. process, which passivates
+            else if( !inScope(cls, "simset") && !inScope(cls, "environment") )
+                run(cls);
+        }
+        inner = old;
+    }
+
+    void store(Expression* e)
+    {
+        if( e != 0 && e->kind == Expression::DeclRef && e->d )
+            assigned.insert(e->d);
+    }
+
+    void call(Declaration* proc, bool remote)
+    {
+        if( proc == 0 )
+        {
+            opaque = true;
+            return;
+        }
+        switch( proc->kind )
+        {
+        case Declaration::Procedure:
+            if( inScope(proc, "simset") || inScope(proc, "simulation") )
+                opaque = true; // e.g. hold, which resumes other processes
+            else if( inScope(proc, "environment") || inScope(proc, "basicio") )
+            {
+                const QByteArray name = proc->name.toLower();
+                if( name == "detach" || name == "resume" || name == "call" )
+                    opaque = true; // continues the body of another object
+            }else if( Declaration* cls = ClassHierarchy::owner(proc) )
+            {
+                if( ClassHierarchy::virtualSpec(cls, proc->sym) )
+                    opaque = true; // some implementation might see the variable
+                else
+                    run(proc);
+            }else
+                run(proc);
+            break;
+        case Declaration::Parameter:
+        case Declaration::Variable:
+            if( proc->type() && proc->type()->kind == Type::Procedure )
+                opaque = true; // a formal procedure
+            break;
+        case Declaration::VirtualSpec:
+            opaque = true; // any implementation might run
+            break;
+        default:
+            if( !remote )
+                opaque = true;
+            break;
+        }
+    }
+
+    void stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( s->prefix )
+                    opaque = true; // runs the body of the prefix class
+                exprs(s->args);
+                break;
+            case Statement::If:
+            case Statement::While:
+                exprs(s->cond);
+                stats(s->elseStmt);
+                break;
+            case Statement::For:
+                store(s->var);
+                exprs(s->var);
+                exprs(s->list);
+                break;
+            case Statement::Inspect:
+                exprs(s->obj);
+                for( Connection* c = s->conn; c != 0; c = c->next )
+                    stats(c->body);
+                stats(s->otherwise);
+                break;
+            case Statement::Inner:
+                if( !inner )
+                    opaque = true;
+                break;
+            case Statement::Activate:
+            case Statement::Detach:
+            case Statement::Resume:
+                opaque = true;
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+            case Statement::Goto:
+                exprs(s->lhs);
+                exprs(s->rhs);
+                break;
+            default:
+                break;
+            }
+            stats(s->body);
+        }
+    }
+
+    void exprs(Expression* e)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            switch( e->kind )
+            {
+            case Expression::AssignVal:
+            case Expression::AssignRef:
+                store(e->lhs);
+                break;
+            case Expression::DeclRef:
+                if( e->d && e->d->kind == Declaration::Procedure )
+                    call(e->d, false);
+                break;
+            case Expression::New:
+                if( Declaration* cls = EscapeAnalyzer::generatedClass(e) )
+                    generate(cls);
+                else
+                    opaque = true;
+                break;
+            case Expression::Call:
+                {
+                    Expression* callee = e->lhs;
+                    const bool remote = callee && callee->kind == Expression::Dot;
+                    if( remote )
+                        callee = callee->rhs;
+                    Declaration* proc = callee && callee->kind == Expression::DeclRef ? callee->d : 0;
+                    if( !( e->lhs && e->lhs->kind == Expression::New ) )
+                        call(proc, remote);
+                    // an actual of a NAME parameter may be assigned by the callee
+                    Declaration* formal = proc ? proc->link : 0;
+                    for( Expression* arg = e->rhs; arg != 0; arg = arg->next )
+                    {
+                        if( formal && formal->kind != Declaration::Parameter )
+                            formal = 0;
+                        if( formal == 0 || formal->mode == Declaration::ModeName )
+                            store(arg);
+                        if( formal )
+                            formal = formal->next;
+                    }
+                    if( remote )
+                    {
+                        exprs(e->lhs->lhs);
+                        exprs(e->rhs);
+                        continue; // the callee was handled above
+                    }
+                    if( callee == e->lhs && callee && callee->kind == Expression::DeclRef )
+                    {
+                        exprs(e->rhs);
+                        continue;
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+            exprs(e->lhs);
+            exprs(e->rhs);
+            exprs(e->condition);
+        }
+    }
+};
+
+LoopAnalyzer::LoopAnalyzer(Statement* forStat):opaque(false),fixedControl(false)
+{
+    EffectCollector c(assigned, called, opaque);
+    c.exprs(forStat->list); // the start values are assigned before the limits are evaluated
+    c.stats(forStat->body);
+    Expression* var = forStat->var;
+    fixedControl = var && var->kind == Expression::DeclRef && var->d && isInvariant(var->d);
+    c.store(var);
+}
+
+Declaration* LoopAnalyzer::arrayBound(Expression* e, bool& upper, qint64& dim)
+{
+    if( e == 0 || e->kind != Expression::Call || e->lhs == 0 || e->lhs->kind != Expression::DeclRef ||
+            e->lhs->d == 0 || !inScope(e->lhs->d, "environment") )
+        return 0;
+    const QByteArray name = e->lhs->d->name.toLower();
+    if( name != "lowerbound" && name != "upperbound" )
+        return 0;
+    Expression* arr = e->rhs;
+    if( arr == 0 || arr->kind != Expression::DeclRef || arr->d == 0 || arr->next == 0 || !arr->next->folded )
+        return 0;
+    Declaration* a = arr->d;
+    if( a->kind != Declaration::Array &&
+            ( a->kind != Declaration::Parameter || a->mode == Declaration::ModeName ) )
+        return 0;
+    if( a->type() == 0 || a->type()->kind != Type::Array )
+        return 0;
+    if( ClassHierarchy::owner(a) )
+        return 0; // in an inspect statement the name might designate the array of another object
+    upper = name == "upperbound";
+    dim = Folder::integer(arr->next);
+    return a;
+}
+
+bool LoopAnalyzer::isInvariant(Expression* e) const
+{
+    if( e == 0 )
+        return false;
+    if( e->folded )
+        return true;
+    switch( e->kind )
+    {
+    case Expression::DeclRef:
+        return e->d && isInvariant(e->d);
+    case Expression::Add:
+    case Expression::Sub:
+    case Expression::Mul:
+    case Expression::Div:
+    case Expression::IntDiv:
+        return isInvariant(e->lhs) && isInvariant(e->rhs);
+    case Expression::Neg:
+        return isInvariant(e->lhs);
+    case Expression::Call:
+        {
+            // the bounds of an array never change
+            bool upper;
+            qint64 dim;
+            return arrayBound(e, upper, dim) != 0;
+        }
+    default:
+        return false;
+    }
+}
+
+bool LoopAnalyzer::isInvariant(Declaration* var) const
+{
+    if( var->kind != Declaration::Variable &&
+            ( var->kind != Declaration::Parameter || var->mode == Declaration::ModeName ) )
+        return false;
+    if( var->type() == 0 || !var->type()->isArithmetic() )
+        return false;
+    if( opaque || assigned.contains(var) || var->outer == 0 )
+        return false;
+    if( ClassHierarchy::owner(var) )
+        return false; // any method of the object might assign an attribute
+    foreach( Declaration* d, called )
+    {
+        // the body of a procedure or class declared in the scope of the variable sees it
+        for( Declaration* o = d->outer; o != 0; o = o->outer )
+            if( o == var->outer )
+                return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef __SIM_LOOPANALYZER__
+#define __SIM_LOOPANALYZER__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+#include <QSet>
+
+namespace Sim
+{
+    // Finds out whether the step and limit of a for statement keep their value while the loop runs. Algol
+    // semantics re-evaluate them before each test of the control variable; if they only combine constants
+    // and variables the body can't assign, the backends evaluate them once and emit a counted loop. A
+    // variable is assigned by an assignment, as control variable or as actual of a NAME parameter, also in
+    // the bodies of the procedures and classes the loop calls or generates, which are scanned transitively;
+    // a body which sees the variable, i.e. is declared in its scope, is distrusted anyway. Any code at all may
+    // assign it if the loop switches coroutines or calls a procedure whose body isn't at hand, i.e. a virtual,
+    // formal or external one, or one the streaming parser already deleted.
+    class LoopAnalyzer
+    {
+    public:
+        LoopAnalyzer(Statement* forStat);
+
+        bool isInvariant(Expression* e) const;
+        bool isFixedControl() const { return fixedControl; } // only the for statement assigns the control variable
+
+        // the array of lowerbound(a, dim) or upperbound(a, dim) with a constant dim, if a always designates the
+        // same array, i.e. its bounds can't change
+        static Declaration* arrayBound(Expression* e, bool& upper, qint64& dim);
+    private:
+        bool isInvariant(Declaration* var) const;
+        QSet<Declaration*> assigned;
+        QList<Declaration*> called; // the procedures and classes whose bodies may run
+        bool opaque; // any code may run
+        bool fixedControl;
+    };
+}
+
+#endif // __SIM_LOOPANALYZER__
@@ -21,8 +21,15 @@
 #include "SimLexer.h"
 #include <QFileInfo>
 #include <QtDebug>
+#include <QElapsedTimer>
 using namespace Sim;
 
+#ifdef SIM_PARSER_PROFILE
+#define SIM_RULE() static RuleStat _stat(__FUNCTION__); RuleTimer _timer(this, &_stat)
+#else
+#define SIM_RULE()
+#endif
+
 // FIRST set helper functions (from SimParser2.cpp)
 
 static inline bool FIRST_module(int tt) {
@@ -1165,9 +1172,38 @@ static inline bool FIRST_string_(int tt) {
     return tt == Tok_string;
 }
 
+// Operator precedence levels for pratt_, from loosest to tightest binding
+enum { PrecOrElse = 1, PrecAndThen, PrecEqv, PrecImp, PrecOr, PrecAnd, PrecNot, PrecRel, PrecAdd, PrecMul, PrecPow };
+
+static inline int binaryPrec(int tt, int maxPrec) {
+    if (tt == Tok_2Eq) // both a relational and an equivalence operator; the relation wins where allowed
+        return maxPrec >= PrecRel ? PrecRel : PrecEqv;
+    if (FIRST_power_sym_(tt))
+        return PrecPow;
+    if (FIRST_multiplying_operator(tt))
+        return PrecMul;
+    if (FIRST_adding_operator(tt))
+        return PrecAdd;
+    if (FIRST_relational_operator(tt))
+        return PrecRel;
+    if (FIRST_and_sym_(tt))
+        return PrecAnd;
+    if (FIRST_or_sym_(tt))
+        return PrecOr;
+    if (FIRST_impl_sym_(tt))
+        return PrecImp;
+    if (FIRST_equiv_sym_(tt))
+        return PrecEqv;
+    if (tt == Tok_AND_THEN)
+        return PrecAndThen;
+    if (tt == Tok_OR_ELSE)
+        return PrecOrElse;
+    return 0;
+}
+
 // Parser implementation
 
-Parser3::Parser3(Scanner* s, AstModel* m) : scanner(s), mdl(m), thisMod(0) {
+Parser3::Parser3(Scanner* s, AstModel* m) : scanner(s), mdl(m), thisMod(0), consumer(0), streamBlock(false), pratt(false), rule(0) {
 }
 
 Parser3::~Parser3() {
@@ -1175,6 +1211,75 @@ Parser3::~Parser3() {
         Declaration::deleteAll(thisMod);
 }
 
+static QElapsedTimer s_clock;
+
+class Parser3::RuleTimer {
+public:
+    RuleTimer(Parser3* p, RuleStat* s):parser(p),stat(s),outer(p->rule),children(0) {
+        p->rule = this;
+        s->calls++;
+        if( ++s->active > s->maxDepth )
+            s->maxDepth = s->active;
+        start = s_clock.nsecsElapsed();
+    }
+    ~RuleTimer() {
+        const quint64 t = s_clock.nsecsElapsed() - start;
+        stat->self += t - children;
+        if( --stat->active == 0 )
+            stat->total += t;
+        if( outer )
+            outer->children += t;
+        parser->rule = outer;
+    }
+private:
+    Parser3* parser;
+    RuleStat* stat;
+    RuleTimer* outer;
+    quint64 start;
+    quint64 children;
+};
+
+Parser3::RuleStat::RuleStat(const char* n):name(n),calls(0),maxDepth(0),active(0),total(0),self(0)
+{
+    profile().rules.append(this);
+}
+
+Parser3::Profile::Profile():maxPeek(0),tokens(0)
+{
+    for( int i = 0; i <= MaxPeek; i++ )
+        peeks[i] = 0;
+}
+
+Parser3::Profile& Parser3::profile()
+{
+    static Profile p;
+    if( !s_clock.isValid() )
+        s_clock.start();
+    return p;
+}
+
+void Parser3::resetProfile()
+{
+    Profile& p = profile();
+    foreach( RuleStat* s, p.rules )
+    {
+        s->calls = s->maxDepth = 0;
+        s->total = s->self = 0;
+    }
+    for( int i = 0; i <= MaxPeek; i++ )
+        p.peeks[i] = 0;
+    p.maxPeek = p.tokens = 0;
+}
+
+bool Parser3::isProfiling()
+{
+#ifdef SIM_PARSER_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
 Declaration* Parser3::RunParser() {
     errors.clear();
     next();
@@ -1188,6 +1293,9 @@ Declaration* Parser3::takeResult() {
 }
 
 void Parser3::next() {
+#ifdef SIM_PARSER_PROFILE
+    profile().tokens++;
+#endif
     cur = la;
     la = scanner->next();
     while (la.d_type == Tok_Invalid) {
@@ -1206,7 +1314,41 @@ void Parser3::appendName(Declaration* d, const Token& id)
         d->nameRef = e;
 }
 
+Declaration* Parser3::deliver(Declaration* scope, Declaration* after)
+{
+    // hand the members of scope following 'after' to the consumer; returns the new last member
+    Declaration* d = after ? after->next : scope->link;
+    while( d )
+    {
+        consumer->unit(d);
+        // class bodies stay, since they carry the attributes declared in the body block
+        if( d->kind == Declaration::Procedure || d->kind == Declaration::Program )
+        {
+            Statement::deleteAll(d->body);
+            d->body = 0;
+        }
+        after = d;
+        d = d->next;
+    }
+    return after;
+}
+
+Statement* Parser3::deliver(Statement* s, Declaration* scope)
+{
+    if( s == 0 )
+        return 0;
+    consumer->unit(s, scope);
+    Statement::deleteAll(s);
+    return 0;
+}
+
 Token Parser3::peek(int off) {
+#ifdef SIM_PARSER_PROFILE
+    Profile& p = profile();
+    p.peeks[qMin(off, int(MaxPeek))]++;
+    if( off > 0 && quint32(off) > p.maxPeek )
+        p.maxPeek = off;
+#endif
     if (off == 1)
         return la;
     else if (off == 0)
@@ -1289,6 +1431,7 @@ bool Parser3::versionMax(SimulaVersion maxVersion, const char* feature) {
 // Module parsing
 
 Declaration* Parser3::module() {
+    SIM_RULE();
     Declaration* mod = new Declaration(Declaration::Module);
     if (thisMod)
         Declaration::deleteAll(thisMod);
@@ -1307,12 +1450,16 @@ Declaration* Parser3::module() {
     
     module_body_();
     // transfer body->body to mod->body?
+    Declaration* delivered = 0;
+    if( consumer )
+        delivered = deliver(mod, delivered);
 
     while (la.d_type == Tok_Semi) {
         expect(Tok_Semi, false, "module");
         if (FIRST_module_body_(la.d_type)) {
             module_body_();
-
+            if( consumer )
+                delivered = deliver(mod, delivered);
         }
     }
     
@@ -1321,6 +1468,7 @@ Declaration* Parser3::module() {
 }
 
 void Parser3::module_body_() {
+    SIM_RULE();
     if ((peek(1).d_type == Tok_CLASS || peek(1).d_type == Tok_identifier) &&
         (peek(2).d_type == Tok_CLASS || peek(2).d_type == Tok_identifier)) {
         class_declaration();
@@ -1334,6 +1482,7 @@ void Parser3::module_body_() {
 }
 
 void Parser3::external_head() {
+    SIM_RULE();
     external_declaration();
     expect(Tok_Semi, false, "external_head");
     while (FIRST_external_declaration(la.d_type)) {
@@ -1343,6 +1492,7 @@ void Parser3::external_head() {
 }
 
 void Parser3::program() {
+    SIM_RULE();
     
     // Handle labels
     while ((peek(1).d_type == Tok_identifier && peek(2).d_type == Tok_Colon)) {
@@ -1356,6 +1506,7 @@ void Parser3::program() {
     Declaration* prog = mdl->addDecl("","", Declaration::Program);
     prog->pos = toRowCol(la); // begin
     mdl->openScope(prog);
+    streamBlock = consumer != 0;
     prog->body = block();
     mdl->closeScope();
 }
@@ -1363,6 +1514,7 @@ void Parser3::program() {
 // Statement parsing
 
 Statement* Parser3::while_statement() {
+    SIM_RULE();
     expect(Tok_WHILE, false, "while_statement");
     RowCol pos = toRowCol(cur);
     
@@ -1377,6 +1529,7 @@ Statement* Parser3::while_statement() {
 }
 
 Statement* Parser3::block() {
+    SIM_RULE();
     Token prefixName;
     QList<Expression*> args;
     
@@ -1387,6 +1540,7 @@ Statement* Parser3::block() {
 }
 
 void Parser3::block_prefix(Token& prefixName, QList<Expression*>& args) {
+    SIM_RULE();
     prefixName = class_identifier();
     if (FIRST_actual_parameter_part(la.d_type)) {
         actual_parameter_part(args);
@@ -1394,12 +1548,18 @@ void Parser3::block_prefix(Token& prefixName, QList<Expression*>& args) {
 }
 
 void Parser3::actual_parameter_part(QList<Expression*>& args) {
+    SIM_RULE();
     expect(Tok_Lpar, false, "actual_parameter_part");
     actual_parameter_list(args);
     expect(Tok_Rpar, false, "actual_parameter_part");
 }
 
 Statement* Parser3::main_block(const Token &prefixName, const QList<Expression*>& args) {
+    SIM_RULE();
+    // only the outermost block of a program is streamed
+    const bool streaming = streamBlock;
+    streamBlock = false;
+
     expect(Tok_BEGIN, false, "main_block");
     RowCol pos = toRowCol(cur);
     
@@ -1425,7 +1585,15 @@ Statement* Parser3::main_block(const Token &prefixName, const QList<Expression*>
     // Open a new scope for the block
     Declaration* blockScope = mdl->addDecl("", "", Declaration::Block);
     blockScope->pos = pos;
+    if (blk->prefix) {
+        // the validator resolves it to the class whose attributes the block sees
+        blockScope->nameRef = new Expression(Expression::Identifier, blk->prefix->pos);
+        blockScope->nameRef->a = prefixName.d_id;
+    }
     mdl->openScope(blockScope);
+    blk->scope = blockScope;
+    if( streaming )
+        consumer->openBlock(blk);
     
     // Parse declarations
     if (((peek(1).d_type == Tok_ARRAY || peek(1).d_type == Tok_BOOLEAN ||
@@ -1452,24 +1620,37 @@ Statement* Parser3::main_block(const Token &prefixName, const QList<Expression*>
         expect(Tok_Semi, false, "main_block");
     }
     
-    blk->body = compound_tail();
+    if( streaming )
+    {
+        // the declaration part is complete, so declarations may refer to each other in any order
+        deliver(blockScope, 0);
+        blk->body = compound_tail(blockScope);
+    }else
+        blk->body = compound_tail();
     
     mdl->closeScope();
-    blk->scope = blockScope;
+    if( streaming )
+        consumer->closeBlock(blk);
     return blk;
 }
 
-Statement* Parser3::compound_tail() {
+Statement* Parser3::compound_tail(Declaration* stream) {
+    SIM_RULE();
+    // if stream is set, each statement is handed to the consumer and released instead of appended
     Statement* first = 0;
     Statement* last = 0;
     
     if (FIRST_statement(la.d_type) ||
         (peek(1).d_type == Tok_Semi && !(peek(2).d_type == Tok_END) && !(peek(2).d_type == Tok_INNER))) {
         first = statement();
+        if( stream )
+            first = deliver(first, stream);
         last = first;
         while ((peek(1).d_type == Tok_Semi && !(peek(2).d_type == Tok_END) && !(peek(2).d_type == Tok_INNER))) {
             expect(Tok_Semi, false, "compound_tail");
             Statement* s = statement();
+            if( stream )
+                s = deliver(s, stream);
             if (s) {
                 if (last)
                     last->append(s);
@@ -1485,6 +1666,8 @@ Statement* Parser3::compound_tail() {
         expect(Tok_Semi, false, "compound_tail");
         expect(Tok_INNER, false, "compound_tail");
         Statement* inner = new Statement(Statement::Inner, toRowCol(cur));
+        if( stream )
+            inner = deliver(inner, stream);
         if (last)
             last->append(inner);
         else
@@ -1494,8 +1677,13 @@ Statement* Parser3::compound_tail() {
         while ((peek(1).d_type == Tok_Semi && !(peek(2).d_type == Tok_END))) {
             expect(Tok_Semi, false, "compound_tail");
             Statement* s = statement();
+            if( stream )
+                s = deliver(s, stream);
             if (s) {
-                last->append(s);
+                if (last)
+                    last->append(s);
+                else
+                    first = s;
                 last = s;
             }
         }
@@ -1512,6 +1700,7 @@ Statement* Parser3::compound_tail() {
 // Declaration parsing
 
 void Parser3::declaration() {
+    SIM_RULE();
     if (FIRST_switch_declaration(la.d_type)) {
         switch_declaration();
     } else if (FIRST_external_declaration(la.d_type)) {
@@ -1534,6 +1723,7 @@ void Parser3::declaration() {
 }
 
 void Parser3::class_declaration() {
+    SIM_RULE();
     Token prefixName = prefix();
         
     Declaration* classDecl = main_part();
@@ -1547,6 +1737,7 @@ void Parser3::class_declaration() {
 }
 
 Token Parser3::prefix() {
+    SIM_RULE();
     if (FIRST_class_identifier(la.d_type)) {
         return class_identifier();
     }
@@ -1554,6 +1745,7 @@ Token Parser3::prefix() {
 }
 
 Declaration* Parser3::main_part() {
+    SIM_RULE();
     expect(Tok_CLASS, false, "main_part");
     
     expect(Tok_identifier, false, "main_part");
@@ -1650,6 +1842,7 @@ Declaration* Parser3::main_part() {
 }
 
 TokenList Parser3::protection_part() {
+    SIM_RULE();
     TokenList res;
     res << protection_specification();
     while ((peek(1).d_type == Tok_Semi && (peek(2).d_type == Tok_HIDDEN || peek(2).d_type == Tok_PROTECTED))) {
@@ -1660,6 +1853,7 @@ TokenList Parser3::protection_part() {
 }
 
 TokenList Parser3::protection_specification() {
+    SIM_RULE();
     Declaration::Visi visi = Declaration::NA;
     bool hidden = false;
     bool prot = false;
@@ -1695,6 +1889,7 @@ TokenList Parser3::protection_specification() {
 }
 
 Statement* Parser3::class_body() {
+    SIM_RULE();
     if (FIRST_statement(la.d_type)) {
         return statement();
     }
@@ -1702,6 +1897,7 @@ Statement* Parser3::class_body() {
 }
 
 DeclList Parser3::virtual_part() {
+    SIM_RULE();
     DeclList res;
     if (la.d_type == Tok_VIRTUAL) {
         expect(Tok_VIRTUAL, false, "virtual_part");
@@ -1726,6 +1922,7 @@ DeclList Parser3::virtual_part() {
 }
 
 DeclList Parser3::virtual_spec() {
+    SIM_RULE();
     bool isArray = false;
     bool isProcedure = false;
     Type* t = specifier(isArray, isProcedure);
@@ -1751,6 +1948,7 @@ DeclList Parser3::virtual_spec() {
 }
 
 void Parser3::procedure_declaration() {
+    SIM_RULE();
     Type* retType = 0;
     if (FIRST_type(la.d_type)) {
         retType = type();
@@ -1775,6 +1973,7 @@ void Parser3::procedure_declaration() {
 }
 
 Declaration* Parser3::procedure_heading() {
+    SIM_RULE();
     expect(Tok_identifier, false, "procedure_heading");
     Declaration* procDecl = mdl->addDecl(cur.d_id, cur.d_val, Declaration::Procedure);
     procDecl->pos = toRowCol(cur);
@@ -1806,6 +2005,7 @@ Declaration* Parser3::procedure_heading() {
 }
 
 void Parser3::mode_part(Declaration* procDecl) {
+    SIM_RULE();
     if (la.d_type == Tok_NAME) {
         name_part(procDecl);
         if (FIRST_value_part(la.d_type)) {
@@ -1820,6 +2020,7 @@ void Parser3::mode_part(Declaration* procDecl) {
 }
 
 void Parser3::value_part(Declaration* procDecl) {
+    SIM_RULE();
     expect(Tok_VALUE, false, "value_part");
     TokenList ids = identifier_list();
     expect(Tok_Semi, false, "value_part");
@@ -1844,6 +2045,7 @@ void Parser3::value_part(Declaration* procDecl) {
 }
 
 void Parser3::name_part(Declaration* procDecl) {
+    SIM_RULE();
     expect(Tok_NAME, false, "name_part");
     TokenList ids = identifier_list();
     expect(Tok_Semi, false, "name_part");
@@ -1868,6 +2070,7 @@ void Parser3::name_part(Declaration* procDecl) {
 }
 
 void Parser3::formal_parameter_part(Declaration* procDecl) {
+    SIM_RULE();
     if (FIRST_formal_parameter_part(la.d_type)) {
         expect(Tok_Lpar, false, "formal_parameter_part");
         if (FIRST_formal_parameter_list(la.d_type)) {
@@ -1878,6 +2081,7 @@ void Parser3::formal_parameter_part(Declaration* procDecl) {
 }
 
 void Parser3::formal_parameter_list(Declaration* procDecl) {
+    SIM_RULE();
     formal_parameter(procDecl);
     while (la.d_type == Tok_Comma) {
         expect(Tok_Comma, false, "formal_parameter_list");
@@ -1886,6 +2090,7 @@ void Parser3::formal_parameter_list(Declaration* procDecl) {
 }
 
 void Parser3::formal_parameter(Declaration* procDecl) {
+    SIM_RULE();
     expect(Tok_identifier, false, "formal_parameter");
     
     Declaration* param = mdl->addDecl(cur.d_id, cur.d_val,Declaration::Parameter);
@@ -1894,10 +2099,12 @@ void Parser3::formal_parameter(Declaration* procDecl) {
 }
 
 Statement* Parser3::procedure_body() {
+    SIM_RULE();
     return statement();
 }
 
 Statement* Parser3::statement() {
+    SIM_RULE();
     // Handle labels
     Statement* res = 0;
     while ((peek(1).d_type == Tok_identifier && peek(2).d_type == Tok_Colon)) {
@@ -1936,10 +2143,12 @@ Statement* Parser3::statement() {
 }
 
 Statement* Parser3::unconditional_statement() {
+    SIM_RULE();
     return unlabelled_basic_statement();
 }
 
 Statement* Parser3::Common_Base_statement() {
+    SIM_RULE();
     if (FIRST_unconditional_statement(la.d_type)) {
         return unconditional_statement();
     } else if (FIRST_Common_Base_conditional_statement(la.d_type)) {
@@ -1953,6 +2162,7 @@ Statement* Parser3::Common_Base_statement() {
 }
 
 Statement* Parser3::Common_Base_conditional_statement() {
+    SIM_RULE();
     Expression* cond = if_clause();
     RowCol pos = cond ? cond->pos : toRowCol(la);
     
@@ -1987,6 +2197,7 @@ Statement* Parser3::Common_Base_conditional_statement() {
 }
 
 Statement* Parser3::for_statement() {
+    SIM_RULE();
     Expression* varExpr = 0;
     bool isRefAssign = false;
     QList<Expression*> forList;
@@ -2012,6 +2223,7 @@ Statement* Parser3::for_statement() {
 }
 
 void Parser3::for_clause(Expression*& varExpr, bool& isRefAssign, QList<Expression*>& forList) {
+    SIM_RULE();
     expect(Tok_FOR, false, "for_clause");
     
     expect(Tok_identifier, false, "for_clause");
@@ -2023,6 +2235,7 @@ void Parser3::for_clause(Expression*& varExpr, bool& isRefAssign, QList<Expressi
 }
 
 void Parser3::for_right_part(bool& isRefAssign, QList<Expression*>& forList) {
+    SIM_RULE();
     if (la.d_type == Tok_ColonEq) {
         expect(Tok_ColonEq, false, "for_right_part");
         isRefAssign = false;
@@ -2037,6 +2250,7 @@ void Parser3::for_right_part(bool& isRefAssign, QList<Expression*>& forList) {
 }
 
 void Parser3::value_for_list(QList<Expression*>& forList) {
+    SIM_RULE();
     Expression* elem = value_for_list_element();
     if (elem)
         forList.append(elem);
@@ -2049,6 +2263,7 @@ void Parser3::value_for_list(QList<Expression*>& forList) {
 }
 
 void Parser3::object_for_list(QList<Expression*>& forList) {
+    SIM_RULE();
     Expression* elem = object_for_list_element();
     if (elem) forList.append(elem);
     while (la.d_type == Tok_Comma) {
@@ -2059,6 +2274,7 @@ void Parser3::object_for_list(QList<Expression*>& forList) {
 }
 
 Expression* Parser3::value_for_list_element() {
+    SIM_RULE();
     Expression* expr = expression();
     
     if (la.d_type == Tok_STEP) {
@@ -2095,6 +2311,7 @@ Expression* Parser3::value_for_list_element() {
 }
 
 Expression* Parser3::object_for_list_element() {
+    SIM_RULE();
     Expression* expr = expression();
     
     if (la.d_type == Tok_WHILE) {
@@ -2112,6 +2329,7 @@ Expression* Parser3::object_for_list_element() {
 }
 
 Statement* Parser3::go_to_statement() {
+    SIM_RULE();
     if (la.d_type == Tok_GOTO) {
         expect(Tok_GOTO, false, "go_to_statement");
     } else if (la.d_type == Tok_GO) {
@@ -2131,6 +2349,7 @@ Statement* Parser3::go_to_statement() {
 }
 
 Statement* Parser3::unlabelled_basic_statement() {
+    SIM_RULE();
     if (FIRST_go_to_statement(la.d_type)) {
         return go_to_statement();
     } else if (FIRST_activation_statement(la.d_type)) {
@@ -2238,6 +2457,7 @@ Statement* Parser3::unlabelled_basic_statement() {
 }
 
 Connection* Parser3::when_clause() {
+    SIM_RULE();
     expect(Tok_WHEN, false, "when_clause");
     RowCol pos = toRowCol(cur);
     
@@ -2254,11 +2474,13 @@ Connection* Parser3::when_clause() {
 }
 
 Statement* Parser3::otherwise_clause() {
+    SIM_RULE();
     expect(Tok_OTHERWISE, false, "otherwise_clause");
     return statement();
 }
 
 Statement* Parser3::connection_part() {
+    SIM_RULE();
     Connection* first = when_clause();
     Connection* last = first;
     
@@ -2275,6 +2497,7 @@ Statement* Parser3::connection_part() {
 }
 
 Statement* Parser3::connection_statement() {
+    SIM_RULE();
     expect(Tok_INSPECT, false, "connection_statement");
     RowCol pos = toRowCol(cur);
     
@@ -2307,6 +2530,7 @@ Statement* Parser3::connection_statement() {
 }
 
 bool Parser3::activator() {
+    SIM_RULE();
     if (la.d_type == Tok_ACTIVATE) {
         expect(Tok_ACTIVATE, false, "activator");
         return false;
@@ -2319,6 +2543,7 @@ bool Parser3::activator() {
 }
 
 Statement* Parser3::activation_statement() {
+    SIM_RULE();
     bool isReactivate = activator();
     RowCol pos = toRowCol(cur);
     
@@ -2337,6 +2562,7 @@ Statement* Parser3::activation_statement() {
 }
 
 void Parser3::simple_timing_clause(Statement* stmt) {
+    SIM_RULE();
     Q_ASSERT( stmt->kind == Statement::Activate && stmt->activate );
     if (la.d_type == Tok_AT) {
         expect(Tok_AT, false, "simple_timing_clause");
@@ -2350,6 +2576,7 @@ void Parser3::simple_timing_clause(Statement* stmt) {
 }
 
 void Parser3::timing_clause(Statement* stmt) {
+    SIM_RULE();
     simple_timing_clause(stmt);
     if (la.d_type == Tok_PRIOR) {
         expect(Tok_PRIOR, false, "timing_clause");
@@ -2358,12 +2585,14 @@ void Parser3::timing_clause(Statement* stmt) {
 }
 
 void Parser3::scheduling_clause(Statement* stmt) {
+    SIM_RULE();
     Q_ASSERT( stmt->kind == Statement::Activate && stmt->activate );
     if (FIRST_timing_clause(la.d_type)) {
         timing_clause(stmt);
     } else if (la.d_type == Tok_BEFORE) {
         expect(Tok_BEFORE, false, "scheduling_clause");
         stmt->activate->priorObj = expression();
+        stmt->prior = true; // distinguishes BEFORE from AFTER
     } else if (la.d_type == Tok_AFTER) {
         expect(Tok_AFTER, false, "scheduling_clause");
         stmt->activate->priorObj = expression();
@@ -2373,6 +2602,7 @@ void Parser3::scheduling_clause(Statement* stmt) {
 }
 
 Type* Parser3::specifier(bool& isArray, bool& isProcedure) {
+    SIM_RULE();
     isArray = false;
     isProcedure = false;
     
@@ -2410,6 +2640,7 @@ Type* Parser3::specifier(bool& isArray, bool& isProcedure) {
 }
 
 void Parser3::specification_part(Declaration* parent) {
+    SIM_RULE();
     bool isArray = false;
     bool isProcedure = false;
     Type* type = specifier(isArray, isProcedure);
@@ -2453,12 +2684,14 @@ void Parser3::specification_part(Declaration* parent) {
 }
 
 void Parser3::procedure_specification() {
+    SIM_RULE();
     expect(Tok_IS, false, "procedure_specification");
     procedure_declaration();
     qWarning() << "WARNING: parser doesn't implement IS procedure_specification:" << thisMod->name << la.d_lineNr;
 }
 
 Declaration* Parser3::external_item() {
+    SIM_RULE();
     Token localName;
     if ((peek(1).d_type == Tok_identifier && peek(2).d_type == Tok_Eq)) {
         expect(Tok_identifier, false, "external_item");
@@ -2477,6 +2710,7 @@ Declaration* Parser3::external_item() {
 }
 
 QList<Declaration*> Parser3::external_list() {
+    SIM_RULE();
     QList<Declaration*> res;
     res << external_item();
     while (la.d_type == Tok_Comma) {
@@ -2487,6 +2721,7 @@ QList<Declaration*> Parser3::external_list() {
 }
 
 void Parser3::external_declaration() {
+    SIM_RULE();
     expect(Tok_EXTERNAL, false, "external_declaration");
         
     if (la.d_type == Tok_identifier || FIRST_type(la.d_type) || la.d_type == Tok_PROCEDURE) {
@@ -2536,6 +2771,7 @@ void Parser3::external_declaration() {
 }
 
 Token Parser3::external_identifier() {
+    SIM_RULE();
     if (la.d_type == Tok_identifier) {
         expect(Tok_identifier, false, "external_identifier");
         return cur;
@@ -2552,6 +2788,7 @@ Token Parser3::external_identifier() {
 }
 
 Declaration* Parser3::switch_declaration() {
+    SIM_RULE();
     expect(Tok_SWITCH, false, "switch_declaration");
     RowCol pos = toRowCol(cur);
     
@@ -2574,6 +2811,7 @@ Declaration* Parser3::switch_declaration() {
 }
 
 void Parser3::switch_list(Declaration* switchDecl) {
+    SIM_RULE();
     Expression* first = expression();
     Expression* last = first;
     
@@ -2593,6 +2831,7 @@ void Parser3::switch_list(Declaration* switchDecl) {
 }
 
 void Parser3::type_list_element(Type* t) {
+    SIM_RULE();
     expect(Tok_identifier, false, "type_list_element");
     const Token name = cur;
     
@@ -2610,6 +2849,7 @@ void Parser3::type_list_element(Type* t) {
 }
 
 void Parser3::type_list(Type* t) {
+    SIM_RULE();
     type_list_element(t);
     while (la.d_type == Tok_Comma) {
         expect(Tok_Comma, false, "type_list");
@@ -2618,11 +2858,13 @@ void Parser3::type_list(Type* t) {
 }
 
 void Parser3::type_declaration() {
+    SIM_RULE();
     Type* t = type();
     type_list(t);
 }
 
 void Parser3::array_list(Type* elemType) {
+    SIM_RULE();
     array_segment(elemType);
     while (la.d_type == Tok_Comma) {
         expect(Tok_Comma, false, "array_list");
@@ -2631,6 +2873,7 @@ void Parser3::array_list(Type* elemType) {
 }
 
 void Parser3::array_segment(Type* elemType) {
+    SIM_RULE();
     TokenList names;
     
     expect(Tok_identifier, false, "array_segment");
@@ -2693,6 +2936,7 @@ void Parser3::array_segment(Type* elemType) {
 }
 
 void Parser3::bound_pair_list(QList<Expression*>& bounds) {
+    SIM_RULE();
     bound_pair(bounds);
     while (la.d_type == Tok_Comma) {
         expect(Tok_Comma, false, "bound_pair_list");
@@ -2701,6 +2945,7 @@ void Parser3::bound_pair_list(QList<Expression*>& bounds) {
 }
 
 void Parser3::bound_pair(QList<Expression*>& bounds) {
+    SIM_RULE();
     Expression* lower = expression();
     expect(Tok_Colon, false, "bound_pair");
     Expression* upper = expression();
@@ -2710,6 +2955,7 @@ void Parser3::bound_pair(QList<Expression*>& bounds) {
 }
 
 Declaration* Parser3::array_declaration() {
+    SIM_RULE();
     Type* elemType = 0;
     if (FIRST_type(la.d_type)) {
         elemType = type();
@@ -2722,6 +2968,7 @@ Declaration* Parser3::array_declaration() {
 }
 
 Type* Parser3::type() {
+    SIM_RULE();
     if (FIRST_value_type(la.d_type)) {
         return value_type();
     } else if (FIRST_reference_type(la.d_type)) {
@@ -2733,6 +2980,7 @@ Type* Parser3::type() {
 }
 
 Type* Parser3::value_type() {
+    SIM_RULE();
     if (la.d_type == Tok_INTEGER) {
         expect(Tok_INTEGER, false, "value_type");
         return mdl->getType(Type::Integer);
@@ -2766,6 +3014,7 @@ Type* Parser3::value_type() {
 }
 
 Type* Parser3::reference_type() {
+    SIM_RULE();
     if (FIRST_object_reference(la.d_type)) {
         return object_reference();
     } else if (la.d_type == Tok_TEXT) {
@@ -2778,6 +3027,7 @@ Type* Parser3::reference_type() {
 }
 
 Type* Parser3::object_reference() {
+    SIM_RULE();
     expect(Tok_REF, false, "object_reference");
     expect(Tok_Lpar, false, "object_reference");
     Token qual = qualification();
@@ -2790,15 +3040,18 @@ Type* Parser3::object_reference() {
 }
 
 Token Parser3::qualification() {
+    SIM_RULE();
     return class_identifier();
 }
 
 Token Parser3::label() {
+    SIM_RULE();
     expect(Tok_identifier, false, "label");
     return cur;
 }
 
 Expression* Parser3::if_clause() {
+    SIM_RULE();
     expect(Tok_IF, false, "if_clause");
     Expression* cond = expression();
     expect(Tok_THEN, false, "if_clause");
@@ -2806,6 +3059,7 @@ Expression* Parser3::if_clause() {
 }
 
 Expression* Parser3::local_object() {
+    SIM_RULE();
     expect(Tok_THIS, false, "local_object");
     Token className = class_identifier();
     
@@ -2815,6 +3069,7 @@ Expression* Parser3::local_object() {
 }
 
 Expression* Parser3::object_generator() {
+    SIM_RULE();
     expect(Tok_NEW, false, "object_generator");
     RowCol pos = toRowCol(cur);
     Token className = class_identifier();
@@ -2826,6 +3081,7 @@ Expression* Parser3::object_generator() {
 }
 
 void Parser3::actual_parameter_list(QList<Expression*>& args) {
+    SIM_RULE();
     Expression* arg = actual_parameter();
     if (arg)
         args.append(arg);
@@ -2838,6 +3094,7 @@ void Parser3::actual_parameter_list(QList<Expression*>& args) {
 }
 
 Expression* Parser3::actual_parameter() {
+    SIM_RULE();
     return expression();
 }
 
@@ -2845,11 +3102,12 @@ Expression* Parser3::actual_parameter() {
 
 
 Expression* Parser3::expression() {
+    SIM_RULE();
     if (FIRST_quaternary_(la.d_type)) {
-        return quaternary_();
+        return pratt ? pratt_(PrecOrElse) : quaternary_();
     } else if (FIRST_if_clause(la.d_type)) {
         Expression* cond = if_clause();
-        Expression* thenExpr = quaternary_();
+        Expression* thenExpr = pratt ? pratt_(PrecOrElse) : quaternary_();
         expect(Tok_ELSE, false, "expression");
         Expression* elseExpr = expression();
         
@@ -2865,6 +3123,7 @@ Expression* Parser3::expression() {
 }
 
 Expression* Parser3::quaternary_() {
+    SIM_RULE();
     Expression* left = tertiary_();
     while (la.d_type == Tok_OR_ELSE) {
         expect(Tok_OR_ELSE, false, "quaternary_");
@@ -2881,6 +3140,7 @@ Expression* Parser3::quaternary_() {
 }
 
 Expression* Parser3::tertiary_() {
+    SIM_RULE();
     Expression* left = equivalence_();
     while (la.d_type == Tok_AND_THEN) {
         expect(Tok_AND_THEN, false, "tertiary_");
@@ -2897,6 +3157,7 @@ Expression* Parser3::tertiary_() {
 }
 
 Expression* Parser3::equivalence_() {
+    SIM_RULE();
     Expression* left = implication();
     while (FIRST_equiv_sym_(la.d_type)) {
         Expression::Kind kind = equiv_sym_();
@@ -2910,6 +3171,7 @@ Expression* Parser3::equivalence_() {
 }
 
 Expression::Kind Parser3::equiv_sym_() {
+    SIM_RULE();
     if (la.d_type == Tok_EQUIV) {
         expect(Tok_EQUIV, false, "equiv_sym_");
     } else if (la.d_type == Tok_Ueq) {
@@ -2925,6 +3187,7 @@ Expression::Kind Parser3::equiv_sym_() {
 }
 
 Expression* Parser3::implication() {
+    SIM_RULE();
     // deintegrated simple_arithmetic_expression
     Expression* left = boolean_term();
     while (FIRST_impl_sym_(la.d_type)) {
@@ -2939,6 +3202,7 @@ Expression* Parser3::implication() {
 }
 
 Expression::Kind Parser3::impl_sym_() {
+    SIM_RULE();
     if (la.d_type == Tok_IMPL) {
         expect(Tok_IMPL, false, "impl_sym_");
     } else if (la.d_type == Tok_Uimpl) {
@@ -2954,6 +3218,7 @@ Expression::Kind Parser3::impl_sym_() {
 }
 
 Expression* Parser3::simple_arithmetic_expression() {
+    SIM_RULE();
     // boolean_term deintegrated
     Expression* left = arithmetic_term();
     while (FIRST_adding_operator(la.d_type)) {
@@ -2970,6 +3235,7 @@ Expression* Parser3::simple_arithmetic_expression() {
 
 Expression *Parser3::boolean_term()
 {
+    SIM_RULE();
     Expression* left = boolean_factor();
     while (FIRST_or_sym_(la.d_type)) {
         Expression::Kind kind;
@@ -2984,6 +3250,7 @@ Expression *Parser3::boolean_term()
 }
 
 Expression::Kind Parser3::adding_operator() {
+    SIM_RULE();
     if (la.d_type == Tok_Plus) {
         expect(Tok_Plus, false, "adding_operator");
         return Expression::Add;
@@ -2997,6 +3264,7 @@ Expression::Kind Parser3::adding_operator() {
 }
 
 Expression::Kind Parser3::or_sym_() {
+    SIM_RULE();
     if (la.d_type == Tok_OR) {
         expect(Tok_OR, false, "or_sym_");
     } else if (la.d_type == Tok_Uor) {
@@ -3010,6 +3278,7 @@ Expression::Kind Parser3::or_sym_() {
 }
 
 Expression* Parser3::arithmetic_term() {
+    SIM_RULE();
     // deintegrated boolean_factor
     Expression* left = factor();
     while (FIRST_multiplying_operator(la.d_type)) {
@@ -3026,6 +3295,7 @@ Expression* Parser3::arithmetic_term() {
 
 Expression *Parser3::boolean_factor()
 {
+    SIM_RULE();
     Expression* left = not_expression();
     while (FIRST_and_sym_(la.d_type)) {
         Expression::Kind kind;
@@ -3040,6 +3310,7 @@ Expression *Parser3::boolean_factor()
 }
 
 Expression::Kind Parser3::multiplying_operator() {
+    SIM_RULE();
     if (la.d_type == Tok_Star) {
         expect(Tok_Star, false, "multiplying_operator");
         return Expression::Mul;
@@ -3065,6 +3336,7 @@ Expression::Kind Parser3::multiplying_operator() {
 }
 
 Expression::Kind Parser3::and_sym_() {
+    SIM_RULE();
     if (la.d_type == Tok_AND) {
         expect(Tok_AND, false, "and_sym_");
     } else if (la.d_type == Tok_Uand) {
@@ -3078,6 +3350,7 @@ Expression::Kind Parser3::and_sym_() {
 }
 
 Expression* Parser3::factor() {
+    SIM_RULE();
     Expression* left = secondary();
     while (FIRST_power_sym_(la.d_type)) {
         Expression::Kind kind = power_sym_();
@@ -3091,6 +3364,7 @@ Expression* Parser3::factor() {
 }
 
 Expression::Kind Parser3::power_sym_() {
+    SIM_RULE();
     if (la.d_type == Tok_POWER) {
         expect(Tok_POWER, false, "power_sym_");
     } else if (la.d_type == Tok_Uexp) {
@@ -3106,6 +3380,7 @@ Expression::Kind Parser3::power_sym_() {
 }
 
 Expression* Parser3::secondary() {
+    SIM_RULE();
     // deintegrated not_expression
     Expression::Kind signKind = Expression::Invalid;
     RowCol pos = toRowCol(la);
@@ -3128,6 +3403,7 @@ Expression* Parser3::secondary() {
 
 Expression* Parser3::not_expression()
 {
+    SIM_RULE();
     Expression::Kind notKind = Expression::Invalid;
     RowCol pos = toRowCol(la);
 
@@ -3147,6 +3423,7 @@ Expression* Parser3::not_expression()
 }
 
 Expression::Kind Parser3::not_sym_() {
+    SIM_RULE();
     if (la.d_type == Tok_NOT) {
         expect(Tok_NOT, false, "not_sym_");
     } else if (la.d_type == Tok_Unot) {
@@ -3160,6 +3437,7 @@ Expression::Kind Parser3::not_sym_() {
 }
 
 Expression* Parser3::primary() {
+    SIM_RULE();
     Expression* result = 0;
     
     if (FIRST_unsigned_number(la.d_type)) {
@@ -3219,6 +3497,7 @@ Expression* Parser3::primary() {
 }
 
 Expression* Parser3::primary_nlr_(Expression* lhs) {
+    SIM_RULE();
     // deintegrated not_expression
     if (FIRST_selector_(la.d_type) || FIRST_qualified_(la.d_type)) {
         Expression* result = 0;
@@ -3233,6 +3512,7 @@ Expression* Parser3::primary_nlr_(Expression* lhs) {
 }
 
 Expression* Parser3::relation_() {
+    SIM_RULE();
     // refactored lhs in here
     Expression* lhs = simple_arithmetic_expression();
 
@@ -3251,6 +3531,7 @@ Expression* Parser3::relation_() {
 }
 
 Expression* Parser3::qualified_(Expression* lhs) {
+    SIM_RULE();
     expect(Tok_QUA, false, "qualified_");
     RowCol pos = toRowCol(cur);
     Token className = class_identifier();
@@ -3263,6 +3544,7 @@ Expression* Parser3::qualified_(Expression* lhs) {
 }
 
 Expression* Parser3::selector_(Expression* lhs) {
+    SIM_RULE();
     if (la.d_type == Tok_Dot) {
         expect(Tok_Dot, false, "selector_");
         RowCol pos = toRowCol(cur);
@@ -3313,6 +3595,7 @@ Expression* Parser3::selector_(Expression* lhs) {
 }
 
 Expression::Kind Parser3::relational_operator() {
+    SIM_RULE();
     Expression::Kind kind = Expression::Invalid;
     
     if (la.d_type == Tok_Lt || la.d_type == Tok_LESS || la.d_type == Tok_LT) {
@@ -3354,6 +3637,7 @@ Expression::Kind Parser3::relational_operator() {
 }
 
 Expression* Parser3::logical_value() {
+    SIM_RULE();
     if (la.d_type == Tok_TRUE) {
         expect(Tok_TRUE, false, "logical_value");
         Expression* expr = new Expression(Expression::BoolConst, toRowCol(cur));
@@ -3371,6 +3655,7 @@ Expression* Parser3::logical_value() {
 }
 
 Expression* Parser3::unsigned_number() {
+    SIM_RULE();
     if (la.d_type == Tok_unsigned_integer) {
         expect(Tok_unsigned_integer, false, "unsigned_number");
         Expression* expr = new Expression(Expression::UnsignedConst, toRowCol(cur));
@@ -3388,11 +3673,13 @@ Expression* Parser3::unsigned_number() {
 }
 
 Token Parser3::class_identifier() {
+    SIM_RULE();
     expect(Tok_identifier, false, "class_identifier");
     return cur;
 }
 
 TokenList Parser3::identifier_list() {
+    SIM_RULE();
     TokenList ids;
     expect(Tok_identifier, false, "identifier_list");
     ids.append(cur);
@@ -3405,6 +3692,7 @@ TokenList Parser3::identifier_list() {
 }
 
 void Parser3::subscript_list(QList<Expression*>& subs) {
+    SIM_RULE();
     Expression* e = subscript_expression();
     if (e)
         subs.append(e);
@@ -3417,15 +3705,72 @@ void Parser3::subscript_list(QList<Expression*>& subs) {
 }
 
 Expression* Parser3::subscript_expression() {
+    SIM_RULE();
     return expression();
 }
 
 Token Parser3::attribute_identifier() {
+    SIM_RULE();
     expect(Tok_identifier, false, "attribute_identifier");
     return cur;
 }
 
+Expression* Parser3::pratt_(int minPrec) {
+    SIM_RULE();
+    // equivalent to the descent from quaternary_ (minPrec PrecOrElse) down to secondary
+    Expression* left = 0;
+    int maxPrec = PrecPow;
+    if (minPrec <= PrecNot && FIRST_not_sym_(la.d_type)) {
+        RowCol pos = toRowCol(la);
+        not_sym_();
+        left = pratt_(PrecRel);
+        if (left) {
+            Expression* notExpr = new Expression(Expression::Not, pos);
+            notExpr->rhs = left;
+            left = notExpr;
+        }
+        maxPrec = PrecAnd;
+    } else
+        left = secondary();
+
+    for (;;) {
+        const int prec = binaryPrec(la.d_type, maxPrec);
+        if (prec < minPrec || prec > maxPrec)
+            break;
+        Expression::Kind kind = Expression::Invalid;
+        switch (prec) {
+        case PrecPow: kind = power_sym_(); break;
+        case PrecMul: kind = multiplying_operator(); break;
+        case PrecAdd: kind = adding_operator(); break;
+        case PrecRel: kind = relational_operator(); break;
+        case PrecAnd: kind = and_sym_(); break;
+        case PrecOr: kind = or_sym_(); break;
+        case PrecImp: kind = impl_sym_(); break;
+        case PrecEqv: kind = equiv_sym_(); break;
+        case PrecAndThen:
+            expect(Tok_AND_THEN, false, "tertiary_");
+            versionCheck(Sim86, "AND THEN");
+            kind = Expression::AndThen;
+            break;
+        case PrecOrElse:
+            expect(Tok_OR_ELSE, false, "quaternary_");
+            versionCheck(Sim86, "OR ELSE");
+            kind = Expression::OrElse;
+            break;
+        }
+        Expression* right = pratt_(prec + 1);
+        Expression* op = new Expression(kind, left ? left->pos : toRowCol(cur));
+        op->lhs = left;
+        op->rhs = right;
+        left = op;
+        // all operators are left associative, except relations which cannot be chained
+        maxPrec = prec == PrecRel ? PrecRel - 1 : prec;
+    }
+    return left;
+}
+
 Expression* Parser3::string_() {
+    SIM_RULE();
     expect(Tok_string, false, "string_");
     Expression* expr = new Expression(Expression::StringConst, toRowCol(cur));
     QByteArray val = cur.d_val;
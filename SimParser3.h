@@ -40,6 +40,21 @@ namespace Sim {
         
         Declaration* RunParser();
         Declaration* takeResult();
+
+        // Streaming mode: module level declarations, and the declarations and statements of the outermost
+        // program block, are handed to the consumer as soon as they are complete. Statements and the bodies of
+        // procedures and programs are released afterwards; only declarations (incl. class bodies) stay resident.
+        class Consumer {
+        public:
+            virtual void openBlock(Statement* block) {} // block->body stays empty, the statements follow as units
+            virtual void unit(Declaration* d) = 0;
+            virtual void unit(Statement* s, Declaration* scope) = 0;
+            virtual void closeBlock(Statement* block) {}
+        };
+        void setConsumer(Consumer* c) { consumer = c; }
+        // Parse expressions by precedence climbing instead of the descent through all precedence levels;
+        // both produce identical trees
+        void setPratt(bool on) { pratt = on; }
         
         struct Error {
             QString msg;
@@ -49,6 +64,28 @@ namespace Sim {
                 : msg(m), pos(rc), path(p) {}
         };
         QList<Error> errors;
+
+        // Instrumentation; only collected if built with SIM_PARSER_PROFILE, see SimLc -parsebench
+        struct RuleStat {
+            const char* name;
+            quint32 calls;
+            quint32 maxDepth; // max number of simultaneous activations, i.e. recursion
+            quint32 active;
+            quint64 total; // ns incl. callees, recursive activations only counted once
+            quint64 self; // ns excl. callees
+            RuleStat(const char* n);
+        };
+        enum { MaxPeek = 8 };
+        struct Profile {
+            QList<RuleStat*> rules;
+            quint32 peeks[MaxPeek+1]; // peek(off) calls by offset; the last entry collects all larger offsets
+            quint32 maxPeek;
+            quint32 tokens;
+            Profile();
+        };
+        static Profile& profile();
+        static void resetProfile();
+        static bool isProfiling();
         
     protected:
         Declaration* module();
@@ -60,7 +97,7 @@ namespace Sim {
         void block_prefix(Token &prefixName, QList<Expression*>& args);
         void actual_parameter_part(QList<Expression*>& args);
         Statement* main_block(const Token& prefixName, const QList<Expression*>& args);
-        Statement* compound_tail();
+        Statement* compound_tail(Declaration* stream = 0);
         void declaration();
         void class_declaration();
         Token prefix();
@@ -163,6 +200,7 @@ namespace Sim {
         Expression* subscript_expression();
         Token attribute_identifier();
         Expression* string_();
+        Expression* pratt_(int minPrec);
         
     protected:
         Token cur;
@@ -170,6 +208,11 @@ namespace Sim {
         Scanner* scanner;
         AstModel* mdl;
         Declaration* thisMod;
+        Consumer* consumer;
+        bool streamBlock;
+        bool pratt;
+        class RuleTimer;
+        RuleTimer* rule;
         
         void next();
         Token peek(int off);
@@ -179,6 +222,8 @@ namespace Sim {
         bool expect(int tt, bool pkw, const char* where);
         void fixParamTypes(Declaration*);
         void appendName(Declaration* d, const Token& id);
+        Declaration* deliver(Declaration* scope, Declaration* after);
+        Statement* deliver(Statement* s, Declaration* scope);
         
         RowCol toRowCol(const Token& t) const;
         bool versionCheck(SimulaVersion minVersion, const char* feature = 0);
@@ -23,6 +23,7 @@
 #include "SimParser3.h"
 #include "SimLexer.h"
 #include "SimValidator2.h"
+#include "SimTreeShaker.h"
 #include <QBuffer>
 #include <QDir>
 #include <QtDebug>
@@ -31,65 +32,6 @@
 #include <qdatetime.h>
 using namespace Sim;
 
-struct HitTest
-{
-    quint32 line, col;
-    QList<Declaration*> scopes;
-    Declaration* scopeHit;
-
-    HitTest():scopeHit(0){}
-
-    QVariant findHit( Declaration* module, int row, int col )
-    {
-        this->col = row;
-        this->line = line;
-        try
-        {
-            visitDecl(module);
-        }catch( Expression* e )
-        {
-            Q_ASSERT( !scopes.isEmpty() );
-            scopeHit = scopes.back();
-            return QVariant::fromValue(e);
-        }catch( Declaration* d )
-        {
-            Q_ASSERT( !scopes.isEmpty() );
-            scopeHit = scopes.back();
-            return QVariant::fromValue(d);
-        }catch(...)
-        {
-
-        }
-        return 0;
-    }
-
-    void test( Declaration* d )
-    {
-        if( line == d->pos.d_row && col >= d->pos.d_col && col <= d->pos.d_col + strlen(d->name) )
-            throw d;
-    }
-
-    void test(Expression* e)
-    {
-        if( e == 0 )
-            return;
-        if( e->pos.d_row > line )
-            return;
-        Declaration* n = 0;
-        if( e->kind == Expression::DeclRef )
-            n = e->d;
-        if( n == 0 )
-            return;
-        if( line == e->pos.d_row && col >= e->pos.d_col && col <= e->pos.d_col + strlen(n->name) )
-            throw e;
-    }
-
-    void visitDecl(Declaration* d)
-    {
-        test(d);
-    }
-};
-
 class Lex : public Sim::Scanner {
 public:
     Sim::Lexer lex;
@@ -191,16 +133,11 @@ Symbol* Project::findSymbolByModule(Declaration* m, quint32 line, quint16 col, D
 {
     Q_ASSERT(m && m->kind == Declaration::Module);
     const ModuleSlot* module = findModule(m);
-    if( module == 0 || module->xref.syms == 0 )
+    if( module == 0 )
         return 0;
-    Symbol* s = module->xref.syms;
-    do
-    {
-        if( line == s->pos.d_row && col >= s->pos.d_col && col <= s->pos.d_col + s->len )
-            return s;
-        s = s->next;
-    }while( s && s != module->xref.syms );
-    return 0;
+    if( scopePtr )
+        *scopePtr = module->index.findScope(line, col);
+    return module->index.findSymbol(line, col);
 }
 
 Project::File* Project::findFile(const QString& file) const
@@ -327,21 +264,15 @@ void Project::setArguments(const QStringList& args)
 
 bool Project::printTreeShaken(const QString& module, const QString& fileName)
 {
-#if 0
-    // TODO
-    FileRef f = d_files.value(module);
-    if( f->d_mod.isNull() )
+    File* f = findFile(module);
+    if( f == 0 || f->d_mod == 0 )
         return false;
-    Declaration* m = d_mdl->treeShaken(f->d_mod.data());
     QFile out(fileName);
     if( !out.open(QIODevice::WriteOnly) )
         return false;
 
-
-    ObxModuleDump dump;
-    dump.out.setDevice( &out );
-    m->accept(&dump);
-#endif
+    QTextStream s(&out);
+    AstModel::dump(s, f->d_mod, TreeShaker::reachable(f->d_mod));
     return true;
 }
 
@@ -493,30 +424,38 @@ Declaration *Project::parse(const QString &path)
         return p.takeResult();
 }
 
-bool Project::validate(Declaration * module)
+bool Project::validate(const DeclList& toValidate)
 {
-    Sim::Validator2 va(&mdl, this, true);
-    va.validate(module);
-    if( !va.errors.isEmpty() )
+    // the modules are validated concurrently; each result carries the errors and symbols of its module
+    QList<Sim::Validator2::Result> res = Sim::Validator2::validateAll(&mdl, toValidate, this, true);
+    bool ok = true;
+    for( int n = 0; n < res.size(); n++ )
     {
-        foreach( const Sim::Validator2::Error& e, va.errors )
-            errors << Error(e.msg, e.pos, e.path);
-        return false;
-    }// else
+        Sim::Validator2::Result& r = res[n];
+        if( !r.errors.isEmpty() )
+        {
+            foreach( const Sim::Validator2::Error& e, r.errors )
+                errors << Error(e.msg, e.pos, e.path);
+            Symbol::deleteAll(r.xref.syms);
+            ok = false;
+            continue;
+        }// else
 
-    ModuleSlot* slot = const_cast<ModuleSlot*>(findModule(module));
-    if( slot )
-    {
-        slot->xref = va.takeXref();
+        ModuleSlot* slot = const_cast<ModuleSlot*>(findModule(r.module));
+        if( slot )
+        {
+            slot->xref = r.xref;
+            slot->index.build(r.module, slot->xref.syms);
 
-        QHash<Declaration*,DeclList>::const_iterator i;
-        for( i = slot->xref.subs.begin(); i != slot->xref.subs.end(); ++i )
-            subs[i.key()] += i.value();
+            QHash<Declaration*,DeclList>::const_iterator i;
+            for( i = slot->xref.subs.begin(); i != slot->xref.subs.end(); ++i )
+                subs[i.key()] += i.value();
+        }else
+            Symbol::deleteAll(r.xref.syms);
+        if( !dependencyOrder.contains(r.module) )
+            dependencyOrder << r.module;
     }
-    if( !dependencyOrder.contains(module) )
-        dependencyOrder << module;
-
-    return true;
+    return ok;
 }
 
 Project::File* Project::toFile(const QString& path)
@@ -603,12 +542,14 @@ bool Project::parse()
     }
 
     // then validate and connect everything
+    DeclList toValidate;
     for( i = d_files.begin(); i != d_files.end(); ++i )
     {
         Declaration* module = i.value()->d_mod;
         if( module && !module->validated )
-            validate(module);
+            toValidate << module;
     }
+    validate(toValidate);
 
     emit sigReparsed();
     return all == ok;
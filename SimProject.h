@@ -117,13 +117,14 @@ namespace Sim
         QStringList findFiles(const QDir& , bool recursive = false);
         void touch();
         Declaration* parse(const QString& imp);
-        bool validate(Declaration*);
+        bool validate(const DeclList&);
 
         struct ModuleSlot
         {
             QString file;
             Declaration* decl;
             Xref xref;
+            PosIndex index;
             ModuleSlot():decl(0) {}
             ModuleSlot( const QString& f, Declaration* d):file(f),decl(d){}
         };
@@ -0,0 +1,306 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimThunkAnalyzer.h"
+using namespace Sim;
+
+static Declaration* callee(Expression* call)
+{
+    Expression* e = call->lhs;
+    if( e && e->kind == Expression::Dot )
+        e = e->rhs;
+    if( e && e->kind == Expression::DeclRef )
+        return e->d;
+    return 0;
+}
+
+// Visits all statements and expressions of a tree; subclasses look at the ones they are interested in
+class ExprVisitor
+{
+public:
+    virtual ~ExprVisitor() {}
+    virtual void visit(Expression*) {}
+    virtual void visit(Statement*) {}
+
+    void decls(Declaration* d)
+    {
+        for( ; d != 0; d = d->next )
+            decl(d);
+    }
+
+    void decl(Declaration* d)
+    {
+        switch( d->kind )
+        {
+        case Declaration::Module:
+        case Declaration::Program:
+        case Declaration::Class:
+        case Declaration::Procedure:
+            decls(d->link);
+            stats(d->body);
+            break;
+        case Declaration::Variable:
+            exprs(d->init);
+            break;
+        case Declaration::Array:
+            if( d->type() )
+                exprs(d->type()->getExpr());
+            break;
+        case Declaration::Switch:
+            exprs(d->list);
+            break;
+        default:
+            break; // Block declarations are visited with their statement
+        }
+    }
+
+    void stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            visit(s);
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( s->scope )
+                    decls(s->scope->link);
+                exprs(s->prefix);
+                exprs(s->args);
+                break;
+            case Statement::If:
+            case Statement::While:
+                exprs(s->cond);
+                stats(s->elseStmt);
+                break;
+            case Statement::For:
+                exprs(s->var);
+                exprs(s->list);
+                break;
+            case Statement::Inspect:
+                exprs(s->obj);
+                for( Connection* c = s->conn; c != 0; c = c->next )
+                    stats(c->body);
+                stats(s->otherwise);
+                break;
+            case Statement::Activate:
+                if( s->activate )
+                {
+                    exprs(s->activate->obj);
+                    exprs(s->activate->at);
+                    exprs(s->activate->delay);
+                    exprs(s->activate->priorObj);
+                }
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+            case Statement::Goto:
+            case Statement::Detach:
+            case Statement::Resume:
+                exprs(s->lhs);
+                exprs(s->rhs);
+                break;
+            default:
+                break;
+            }
+            stats(s->body);
+        }
+    }
+
+    void exprs(Expression* e)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            visit(e);
+            exprs(e->lhs);
+            exprs(e->rhs);
+            exprs(e->condition);
+        }
+    }
+};
+
+class CallCollector : public ExprVisitor
+{
+public:
+    ThunkAnalyzer::Result& res;
+    CallCollector(ThunkAnalyzer::Result& r):res(r) {}
+
+    using ExprVisitor::visit;
+
+    void visit(Expression* e)
+    {
+        if( e->kind != Expression::Call )
+            return;
+        Declaration* proc = callee(e);
+        if( proc == 0 || proc->kind != Declaration::Procedure )
+            return;
+        const QString sig = ThunkAnalyzer::signature(proc, e->rhs);
+        if( sig.isEmpty() )
+            return;
+        res.calls++;
+        if( !ThunkAnalyzer::isSpecialized(sig) )
+            return;
+        if( !sig.contains('t') )
+            res.specialized++;
+        QStringList& sigs = res.variants[proc];
+        if( !sigs.contains(sig) )
+            sigs.append(sig);
+    }
+};
+
+class StoreFinder : public ExprVisitor
+{
+public:
+    Declaration* formal;
+    bool found;
+    StoreFinder(Declaration* f):formal(f),found(false) {}
+
+    bool isFormal(Expression* e) const
+    {
+        return e != 0 && e->kind == Expression::DeclRef && e->d == formal;
+    }
+
+    using ExprVisitor::visit;
+
+    void visit(Expression* e)
+    {
+        switch( e->kind )
+        {
+        case Expression::AssignVal:
+        case Expression::AssignRef:
+            if( isFormal(e->lhs) )
+                found = true;
+            break;
+        case Expression::Call:
+            // the callee might in turn take the parameter by name
+            for( Expression* arg = e->rhs; arg != 0; arg = arg->next )
+                if( isFormal(arg) )
+                    found = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void visit(Statement* s)
+    {
+        if( s->kind == Statement::For && isFormal(s->var) )
+            found = true;
+    }
+};
+
+static bool sameType(Type* a, Type* b)
+{
+    if( a == 0 || b == 0 || a->kind != b->kind )
+        return false;
+    if( a->kind == Type::Ref )
+        return a->getRefType() == b->getRefType();
+    return true;
+}
+
+ThunkAnalyzer::Result ThunkAnalyzer::analyze(Declaration* d)
+{
+    Result res;
+    if( d == 0 || d->kind == Declaration::Block )
+        return res; // analyzed with the block statement
+    CallCollector c(res);
+    c.decl(d);
+    return res;
+}
+
+ThunkAnalyzer::Result ThunkAnalyzer::analyze(Statement* s)
+{
+    Result res;
+    CallCollector c(res);
+    c.stats(s);
+    return res;
+}
+
+ThunkAnalyzer::Passing ThunkAnalyzer::passing(Declaration* formal, Expression* actual)
+{
+    Type* t = formal->type();
+    if( actual == 0 || t == 0 || actual->type() == 0 )
+        return Thunk;
+    switch( t->kind )
+    {
+    case Type::Procedure:
+    case Type::Label:
+    case Type::Switch:
+        return Thunk;
+    case Type::Array:
+        // the array itself is a reference which doesn't change between evaluations
+        if( actual->kind == Expression::DeclRef && actual->d && actual->d->kind == Declaration::Array )
+            return Value;
+        return Thunk;
+    default:
+        break;
+    }
+    if( actual->folded )
+        return Value;
+    if( actual->kind == Expression::DeclRef && actual->d && sameType(t, actual->type()) &&
+            ( actual->d->kind == Declaration::Variable ||
+              ( actual->d->kind == Declaration::Parameter && actual->d->mode != Declaration::ModeName ) ) )
+        return Reference;
+    return Thunk;
+}
+
+QString ThunkAnalyzer::signature(Declaration* proc, Expression* args)
+{
+    QString sig;
+    for( Declaration* formal = proc->link; formal != 0 && formal->kind == Declaration::Parameter;
+         formal = formal->next )
+    {
+        if( formal->mode == Declaration::ModeName )
+        {
+            switch( passing(formal, args) )
+            {
+            case Reference:
+                sig += 'r';
+                break;
+            case Value:
+                sig += isAssigned(formal) ? 'c' : 'v';
+                break;
+            default:
+                sig += 't';
+                break;
+            }
+        }
+        if( args )
+            args = args->next;
+    }
+    return sig;
+}
+
+bool ThunkAnalyzer::isSpecialized(const QString& signature)
+{
+    return signature.contains('r') || signature.contains('v') || signature.contains('c');
+}
+
+bool ThunkAnalyzer::isAssigned(Declaration* formal)
+{
+    Declaration* proc = formal->outer;
+    if( proc == 0 )
+        return true;
+    if( proc->isExternal || proc->body == 0 )
+        return true; // e.g. the seed of the random drawings; in streaming mode the body is gone once emitted
+    StoreFinder f(formal);
+    f.decls(proc->link);
+    f.stats(proc->body);
+    return f.found;
+}
@@ -0,0 +1,60 @@
+#ifndef __SIM_THUNKANALYZER__
+#define __SIM_THUNKANALYZER__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+#include <QHash>
+#include <QStringList>
+
+namespace Sim
+{
+    // Finds the calls which pass a NAME parameter an actual that needs no thunk. Re-evaluating a simple
+    // variable yields the same location each time, so it can be passed by address; a constant yields the
+    // same value, so it can be passed by value. If the procedure might assign the parameter, the constant
+    // is still passed by value, but the variant raises the run-time error Simula requires for assigning
+    // an actual which is no variable. The passing of the NAME parameters of a call is encoded in its
+    // signature, one letter per NAME parameter in declaration order ('r' address, 'v' value, 'c' value
+    // which must not be assigned, 't' thunk); the backends generate a variant of the procedure for each
+    // signature it is called with, besides the general one taking thunks only.
+    class ThunkAnalyzer
+    {
+    public:
+        enum Passing { Thunk, Reference, Value, Constant };
+
+        struct Result
+        {
+            QHash<Declaration*, QStringList> variants; // procedure -> signatures of its calls without only thunks
+            quint32 calls; // calls passing NAME parameters
+            quint32 specialized; // of which need no thunk at all
+            Result():calls(0),specialized(0) {}
+        };
+
+        static Result analyze(Declaration* d); // d and all it contains
+        static Result analyze(Statement* s); // the statement sequence
+
+        static Passing passing(Declaration* formal, Expression* actual);
+        static QString signature(Declaration* proc, Expression* args); // empty if proc has no NAME parameters
+        static bool isSpecialized(const QString& signature); // some NAME parameter needs no thunk
+        static bool isAssigned(Declaration* formal); // the procedure body may store to the parameter
+    };
+}
+
+#endif // __SIM_THUNKANALYZER__
@@ -0,0 +1,259 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimTreeShaker.h"
+#include "SimClassHierarchy.h"
+#include "SimEscapeAnalyzer.h"
+using namespace Sim;
+
+class Marker
+{
+public:
+    QSet<Declaration*> live;
+    QList<Declaration*> todo;
+    QList<Declaration*> classes; // the reachable classes visited so far
+    QSet<Atom> called; // the names of the virtual procedures called
+
+    void mark(Declaration* d)
+    {
+        if( d == 0 || live.contains(d) )
+            return;
+        live.insert(d);
+        todo.append(d);
+    }
+
+    void markInterface(Declaration* d)
+    {
+        // the declaration and the members other modules can use
+        if( !TreeShaker::isShakeable(d) )
+            return;
+        mark(d);
+        if( d->kind != Declaration::Class )
+            return;
+        for( Declaration* m = d->link; m != 0; m = m->next )
+            markInterface(m);
+        if( d->body && ( d->body->kind == Statement::Block || d->body->kind == Statement::Compound ) &&
+                d->body->scope )
+            for( Declaration* m = d->body->scope->link; m != 0; m = m->next )
+                markInterface(m);
+    }
+
+    void run()
+    {
+        while( !todo.isEmpty() )
+            visit(todo.takeFirst());
+    }
+
+    void visit(Declaration* d)
+    {
+        switch( d->kind )
+        {
+        case Declaration::Class:
+            mark(ClassHierarchy::prefixOf(d));
+            classes.append(d);
+            members(d->link);
+            stats(d->body);
+            foreach( Declaration* spec, ClassHierarchy::virtuals(d) )
+            {
+                const Atom name = ClassHierarchy::nameOf(spec);
+                if( called.contains(name) )
+                    mark(ClassHierarchy::implementation(d, name));
+            }
+            break;
+        case Declaration::Program:
+        case Declaration::Procedure:
+            mark(ClassHierarchy::owner(d)); // the procedure takes the object
+            type(d->type());
+            members(d->link);
+            stats(d->body);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ref(Declaration* d)
+    {
+        if( d == 0 )
+            return;
+        switch( d->kind )
+        {
+        case Declaration::Procedure:
+        case Declaration::VirtualSpec:
+            {
+                // a call of a virtual may end up in the implementation of any reachable class
+                Declaration* cls = ClassHierarchy::owner(d);
+                const Atom name = ClassHierarchy::nameOf(d);
+                if( cls && ClassHierarchy::virtualSpec(cls, name) && !called.contains(name) )
+                {
+                    called.insert(name);
+                    foreach( Declaration* c, classes )
+                        if( ClassHierarchy::virtualSpec(c, name) )
+                            mark(ClassHierarchy::implementation(c, name));
+                }
+                if( d->kind == Declaration::Procedure )
+                    mark(d);
+            }
+            break;
+        case Declaration::Class:
+            mark(d);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void type(Type* t)
+    {
+        while( t )
+        {
+            if( t->kind == Type::Ref )
+                ref(t->getRefType());
+            if( t->kind != Type::Array && t->kind != Type::Procedure )
+                break;
+            t = t->type(); // element or result type
+        }
+    }
+
+    void members(Declaration* d)
+    {
+        // the classes and procedures among the members are only reachable if referenced
+        for( ; d != 0; d = d->next )
+        {
+            switch( d->kind )
+            {
+            case Declaration::Variable:
+            case Declaration::Parameter:
+                type(d->type());
+                exprs(d->init);
+                break;
+            case Declaration::Array:
+                type(d->type());
+                if( d->type() )
+                    exprs(d->type()->getExpr());
+                break;
+            case Declaration::Switch:
+                exprs(d->list);
+                break;
+            case Declaration::VirtualSpec:
+                type(d->type());
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void stats(Statement* s)
+    {
+        for( ; s != 0; s = s->next )
+        {
+            switch( s->kind )
+            {
+            case Statement::Compound:
+            case Statement::Block:
+                if( s->scope )
+                    members(s->scope->link);
+                exprs(s->prefix);
+                exprs(s->args);
+                break;
+            case Statement::If:
+            case Statement::While:
+                exprs(s->cond);
+                stats(s->elseStmt);
+                break;
+            case Statement::For:
+                exprs(s->var);
+                exprs(s->list);
+                break;
+            case Statement::Inspect:
+                exprs(s->obj);
+                for( Connection* c = s->conn; c != 0; c = c->next )
+                {
+                    ref(c->classDecl);
+                    stats(c->body);
+                }
+                stats(s->otherwise);
+                break;
+            case Statement::Activate:
+                if( s->activate )
+                {
+                    exprs(s->activate->obj);
+                    exprs(s->activate->at);
+                    exprs(s->activate->delay);
+                    exprs(s->activate->priorObj);
+                }
+                break;
+            case Statement::Assign:
+            case Statement::Call:
+            case Statement::Goto:
+            case Statement::Detach:
+            case Statement::Resume:
+                exprs(s->lhs);
+                exprs(s->rhs);
+                break;
+            default:
+                break;
+            }
+            stats(s->body);
+        }
+    }
+
+    void exprs(Expression* e)
+    {
+        for( ; e != 0; e = e->next )
+        {
+            if( e->kind == Expression::DeclRef )
+                ref(e->d);
+            else if( e->kind == Expression::New )
+                ref(EscapeAnalyzer::generatedClass(e));
+            exprs(e->lhs);
+            exprs(e->rhs);
+            exprs(e->condition);
+        }
+    }
+};
+
+QSet<Declaration*> TreeShaker::reachable(Declaration* module)
+{
+    Marker m;
+    bool program = false;
+    for( Declaration* d = module->link; d != 0; d = d->next )
+    {
+        if( d->kind == Declaration::Program )
+        {
+            m.mark(d);
+            program = true;
+        }
+    }
+    if( !program )
+    {
+        for( Declaration* d = module->link; d != 0; d = d->next )
+            m.markInterface(d);
+    }
+    m.members(module->link);
+    m.stats(module->body);
+    m.run();
+    return m.live;
+}
+
+bool TreeShaker::isShakeable(Declaration* d)
+{
+    return d->kind == Declaration::Class || d->kind == Declaration::Procedure;
+}
@@ -0,0 +1,43 @@
+#ifndef __SIM_TREESHAKER__
+#define __SIM_TREESHAKER__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SimAst.h"
+#include <QSet>
+
+namespace Sim
+{
+    // Finds the classes and procedures of a validated module which are reachable from its main program, i.e.
+    // referenced by the program block or by a reachable declaration, following the same references the
+    // validator records in Xref::uses. A class is reachable if it is named in a reachable NEW, type, qualification
+    // or prefix; a reachable class makes its prefix reachable, but not its member procedures. An implementation
+    // of a virtual procedure is reachable if its class is and the virtual is called somewhere, since it could be
+    // the target of that call. A module without a main program is a library; all its top-level declarations
+    // are roots then. The backends drop the classes and procedures not in the set.
+    class TreeShaker
+    {
+    public:
+        static QSet<Declaration*> reachable(Declaration* module);
+        static bool isShakeable(Declaration* d); // a class or procedure of the module, not builtin or external
+    };
+}
+
+#endif // __SIM_TREESHAKER__
@@ -18,21 +18,42 @@
 */
 
 #include "SimValidator2.h"
+#include <QThread>
 #include <QtDebug>
 using namespace Sim;
 
+// Declaration::claim of a declaration which is completely validated
+static Validator2* const s_done = reinterpret_cast<Validator2*>(quintptr(1));
+
+// the validator which went on in spite of a circular wait, see waitFor
+static QAtomicPointer<Validator2> s_breaker;
+
+static bool s_resolveCache = true;
+static QAtomicInt s_lookups, s_hits, s_searches, s_avoided; // see Validator2::resolveStats
+
 Validator2::Validator2(AstModel* mdl, Loader * l, bool haveXref)
-    : module(0), mdl(mdl), first(0), last(0), loader(l)
+    : module(0), mdl(mdl), first(0), last(0), loader(l), streaming(false), designational(false)
 {
     Q_ASSERT(mdl);
     if (haveXref)
         first = last = new Symbol();
+    // looked up here, because the lookup may add to the lexer symbol table, which is not thread-safe
+    env = mdl->getEnv();
+    basicio = mdl->getBasicIo();
+    primitiveText = mdl->getPrimitiveText();
 }
 
 Validator2::~Validator2()
 {
+    s_lookups.fetchAndAddRelaxed(stats.lookups);
+    s_hits.fetchAndAddRelaxed(stats.hits);
+    s_searches.fetchAndAddRelaxed(stats.searches);
+    s_avoided.fetchAndAddRelaxed(stats.avoided);
     if (first)
         Symbol::deleteAll(first);
+    QHash<Declaration*,Fragment>::const_iterator i;
+    for( i = foreign.begin(); i != foreign.end(); ++i )
+        Symbol::deleteAll(i.value().first);
 }
 
 bool Validator2::validate(Declaration* mod)
@@ -59,12 +80,10 @@ bool Validator2::validate(Declaration* mod)
     
     this->module = mod;
     
-    Declaration* env = mdl->getEnv();
     if( env )
-        scopeStack.push_back(env);
-    Declaration* basicio = mdl->getBasicIo();
+        pushScope(env);
     if( basicio )
-        scopeStack.push_back(basicio);
+        pushScope(basicio);
 
     try {
         Module(mod);
@@ -72,9 +91,10 @@ bool Validator2::validate(Declaration* mod)
     }
 
     if( basicio )
-        scopeStack.pop_back();
+        popScope();
     if( env )
-        scopeStack.pop_back();
+        popScope();
+    releaseHeld();
     
     if (first)
         last->next = first; // close the circle
@@ -85,6 +105,332 @@ bool Validator2::validate(Declaration* mod)
     return errors.isEmpty();
 }
 
+bool Validator2::validateUnit(Declaration* d)
+{
+    Q_ASSERT(d);
+    const int count = errors.size();
+    openUnit(d->outer);
+    try {
+        Decl(d);
+    } catch (...) {
+    }
+    closeUnit();
+    return errors.size() == count;
+}
+
+bool Validator2::validateUnit(Statement* s, Declaration* scope)
+{
+    Q_ASSERT(s && scope);
+    const int count = errors.size();
+    openUnit(scope);
+    try {
+        StatSeq(s);
+    } catch (...) {
+    }
+    closeUnit();
+    return errors.size() == count;
+}
+
+bool Validator2::finishUnits(Declaration* scope)
+{
+    const int count = errors.size();
+    openUnit(scope);
+    for( int i = 0; i < pendingLabels.size(); i++ )
+    {
+        Declaration* d = resolve(pendingLabels[i].first);
+        if( d == 0 || d->kind != Declaration::LabelDecl )
+            error(pendingLabels[i].second, QString("declaration for '%1' not found").arg(pendingLabels[i].first));
+    }
+    pendingLabels.clear();
+    closeUnit();
+    return errors.size() == count;
+}
+
+void Validator2::openUnit(Declaration* scope)
+{
+    setContext(scope);
+    streaming = true;
+}
+
+void Validator2::setContext(Declaration* scope)
+{
+    QList<Declaration*> chain;
+    while( scope )
+    {
+        chain.prepend(scope);
+        scope = scope->outer;
+    }
+    Q_ASSERT(!chain.isEmpty() && chain.first()->kind == Declaration::Module);
+    module = chain.first();
+    sourcePath = *module->path;
+
+    scopeStack.clear();
+    resolved.clear();
+    if( env )
+        pushScope(env);
+    if( basicio )
+        pushScope(basicio);
+    for( int i = 0; i < chain.size(); i++ )
+        pushScope(chain[i]);
+}
+
+void Validator2::pushScope(Declaration* scope)
+{
+    if( scope->kind == Declaration::Block && scope->nameRef && scope->prefix == 0 )
+    {
+        // the prefix of a block is declared outside of it; BlockStat reports if it isn't found
+        Declaration* cls = resolve(scope->nameRef->a);
+        if( cls && ( cls->kind == Declaration::Class || cls->kind == Declaration::StandardClass ) )
+        {
+            Decl(cls);
+            scope->prefix = cls;
+        }
+    }
+    scopeStack.push_back(scope);
+    resolved.push_back(QHash<Atom,Resolved>());
+}
+
+void Validator2::popScope()
+{
+    scopeStack.pop_back();
+    resolved.pop_back();
+}
+
+bool Validator2::claim(Declaration* d)
+{
+    // the flag is only set by the AstModel, before the validators start, e.g. for the standard classes
+    if( d->validated )
+        return false;
+    return claim(d->claim);
+}
+
+bool Validator2::claim(QAtomicPointer<Validator2>& c)
+{
+    // true if this validator is to validate the node of c; if another validator is at it, wait until it is done
+    while( true )
+    {
+        Validator2* owner = c.loadAcquire();
+        if( owner == s_done || owner == this )
+            return false; // already validated or a recursive reference
+        if( owner != 0 )
+        {
+            waitFor(c);
+            return false;
+        }
+        if( c.testAndSetAcquire(0, this) )
+            return true;
+    }
+}
+
+void Validator2::release(Declaration* d)
+{
+    d->claim.storeRelease(s_done);
+}
+
+Validator2* Validator2::waitsFor() const
+{
+    // the validator this one can't go on without
+    if( Validator2* h = heldBy.loadAcquire() )
+        return h;
+    QAtomicPointer<Validator2>* c = awaiting.loadAcquire();
+    return c ? c->loadAcquire() : 0;
+}
+
+bool Validator2::stuck(Validator2* owner, QList<Validator2*>& chain) const
+{
+    // true if owner waits, directly or through others, for this validator or for one of the chain
+    chain.clear();
+    Validator2* v = owner;
+    while( v != 0 && v != s_done && v != this && !chain.contains(v) )
+    {
+        chain.append(v);
+        v = v->waitsFor();
+    }
+    return v == this || ( v != 0 && v != s_done );
+}
+
+void Validator2::waitFor(QAtomicPointer<Validator2>& c)
+{
+    // A wait which would never end, because the owner directly or indirectly waits for this validator, is
+    // resolved as a recursive reference in a single module: this validator goes on with the unfinished
+    // declaration. So that nobody changes it meanwhile, the validators of the circle stay held until this
+    // one has finished its module; only one validator at a time may do so.
+    waits.fetchAndAddOrdered(1);
+    awaiting.storeRelease(&c);
+    QList<Validator2*> chain;
+    while( true )
+    {
+        Validator2* owner = c.loadAcquire();
+        if( owner == s_done )
+        {
+            if( heldBy.loadAcquire() == 0 )
+                break;
+        }else if( stuck(owner, chain) &&
+                  ( s_breaker.loadAcquire() == this || s_breaker.testAndSetOrdered(0, this) ) )
+        {
+            // the chain is stuck if none of them stopped waiting while we looked twice, and none but this
+            // validator can break the circle
+            QList<int> counts;
+            for( int i = 0; i < chain.size(); i++ )
+                counts << chain[i]->waits.loadAcquire();
+            QList<Validator2*> again;
+            if( counts.size() == chain.size() && stuck(owner, again) && again == chain )
+            {
+                bool same = true;
+                for( int i = 0; i < chain.size() && same; i++ )
+                    same = chain[i]->waits.loadAcquire() == counts[i] && ( counts[i] & 1 ) == 1;
+                if( same )
+                {
+                    for( int i = 0; i < chain.size(); i++ )
+                    {
+                        if( chain[i]->heldBy.loadAcquire() == this )
+                            continue;
+                        chain[i]->heldBy.storeRelease(this);
+                        holding.append(chain[i]);
+                    }
+                    break;
+                }
+            }
+            if( holding.isEmpty() )
+                s_breaker.testAndSetOrdered(this, 0);
+        }
+        QThread::yieldCurrentThread();
+    }
+    awaiting.storeRelease(0);
+    waits.fetchAndAddOrdered(1);
+}
+
+void Validator2::releaseHeld()
+{
+    for( int i = 0; i < holding.size(); i++ )
+        holding[i]->heldBy.storeRelease(0);
+    holding.clear();
+    s_breaker.testAndSetOrdered(this, 0);
+}
+
+void Validator2::closeUnit()
+{
+    scopeStack.clear();
+    resolved.clear();
+    streaming = false;
+}
+
+class ValidationWorker : public QThread
+{
+public:
+    QList<Validator2*>* validators;
+    const QList<Declaration*>* modules;
+    QAtomicInt* next;
+    void run()
+    {
+        while( true )
+        {
+            const int i = next->fetchAndAddOrdered(1);
+            if( i >= modules->size() )
+                break;
+            (*validators)[i]->validate((*modules)[i]);
+        }
+    }
+};
+
+QList<Validator2::Result> Validator2::validateAll(AstModel* mdl, const QList<Declaration*>& modules, Loader* loader,
+                                                  bool haveXref, int threads)
+{
+    QList<Validator2*> validators;
+    for( int i = 0; i < modules.size(); i++ )
+        validators << new Validator2(mdl, loader, haveXref);
+
+    // the validators stay alive until all threads are done, since waiting validators look at each other
+    if( threads <= 0 )
+        threads = QThread::idealThreadCount();
+    threads = qMax(1, qMin(threads, modules.size()));
+    QAtomicInt next(0);
+    QList<ValidationWorker*> workers;
+    for( int i = 0; i < threads; i++ )
+    {
+        ValidationWorker* w = new ValidationWorker();
+        w->validators = &validators;
+        w->modules = &modules;
+        w->next = &next;
+        workers << w;
+        w->start();
+    }
+    for( int i = 0; i < workers.size(); i++ )
+    {
+        workers[i]->wait();
+        delete workers[i];
+    }
+
+    QList<Result> res;
+    QHash<QString,int> byPath;
+    for( int i = 0; i < modules.size(); i++ )
+    {
+        res << Result(modules[i]);
+        res.back().xref = validators[i]->takeXref();
+        if( modules[i]->kind == Declaration::Module )
+            byPath[*modules[i]->path] = i;
+    }
+    for( int i = 0; i < modules.size(); i++ )
+    {
+        // errors and symbols found while helping belong to the module they were found in
+        foreach( const Error& e, validators[i]->errors )
+            res[byPath.value(e.path, i)].errors << e;
+        QHash<Declaration*,Xref> fragments = validators[i]->takeForeignXref();
+        QHash<Declaration*,Xref>::iterator j;
+        for( j = fragments.begin(); j != fragments.end(); ++j )
+        {
+            const int k = modules.indexOf(j.key());
+            if( k >= 0 )
+                res[k].xref.merge(j.value());
+            else
+                Symbol::deleteAll(j.value().syms);
+        }
+        delete validators[i];
+    }
+    for( int i = 0; i < res.size(); i++ )
+        res[i].module->hasErrors = !res[i].errors.isEmpty();
+    return res;
+}
+
+QHash<Declaration*,Xref> Validator2::takeForeignXref()
+{
+    QHash<Declaration*,Xref> res;
+    QHash<Declaration*,Fragment>::iterator i;
+    for( i = foreign.begin(); i != foreign.end(); ++i )
+    {
+        Xref& x = res[i.key()];
+        x.syms = i.value().first;
+        i.value().last->next = i.value().first; // close the circle
+        x.uses = i.value().xref;
+        x.subs = i.value().subs;
+    }
+    foreign.clear();
+    return res;
+}
+
+Validator2::ResolveStats Validator2::resolveStats()
+{
+    ResolveStats res;
+    res.lookups = s_lookups.loadAcquire();
+    res.hits = s_hits.loadAcquire();
+    res.searches = s_searches.loadAcquire();
+    res.avoided = s_avoided.loadAcquire();
+    return res;
+}
+
+void Validator2::resetResolveStats()
+{
+    s_lookups.storeRelease(0);
+    s_hits.storeRelease(0);
+    s_searches.storeRelease(0);
+    s_avoided.storeRelease(0);
+}
+
+void Validator2::setResolveCache(bool on)
+{
+    s_resolveCache = on;
+}
+
 Xref Validator2::takeXref()
 {
     Xref res;
@@ -153,17 +499,43 @@ Symbol* Validator2::markUnref(int len, const RowCol& pos)
 
 void Validator2::Module(Declaration* mod)
 {
-    scopeStack.push_back(mod);
+    pushScope(mod);
     DeclSeq(mod->link);
     if (mod->body)
         Body(mod->body);
-    scopeStack.pop_back();
+    popScope();
 }
 
 void Validator2::Decl(Declaration *d)
 {
-    if (!d->validated) {
-        d->validated = true;
+    if (claim(d)) {
+        Declaration* m = d->getModule();
+        const bool help = m != 0 && module != 0 && m != module;
+        Declaration* oldModule = module;
+        QString oldPath;
+        QList<Declaration*> oldStack;
+        QList<QHash<Atom,Resolved> > oldResolved;
+        const bool oldDesignational = designational;
+        if( help )
+        {
+            oldPath = sourcePath;
+            oldStack = scopeStack;
+            oldResolved = resolved;
+            // a declaration of another module, which is validated in its own context; its symbols go to a
+            // separate fragment which is merged with the xref of that module later
+            if( first )
+            {
+                Fragment& f = foreign[m];
+                if( f.first == 0 )
+                    f.first = f.last = new Symbol();
+                qSwap(first, f.first);
+                qSwap(last, f.last);
+                qSwap(xref, f.xref);
+                qSwap(subs, f.subs);
+            }
+            setContext(d->outer);
+            designational = false;
+        }
         markDecl(d);
 
         switch (d->kind) {
@@ -189,6 +561,7 @@ void Validator2::Decl(Declaration *d)
         case Declaration::ExternalClass:
             ExternalDecl(d);
             break;
+        case Declaration::Program:
         case Declaration::Block:
             BlockDecl(d);
             break;
@@ -205,6 +578,24 @@ void Validator2::Decl(Declaration *d)
         default:
             break;
         }
+
+        if( help )
+        {
+            if( first )
+            {
+                Fragment& f = foreign[m];
+                qSwap(first, f.first);
+                qSwap(last, f.last);
+                qSwap(xref, f.xref);
+                qSwap(subs, f.subs);
+            }
+            module = oldModule;
+            sourcePath = oldPath;
+            scopeStack = oldStack;
+            resolved = oldResolved;
+            designational = oldDesignational;
+        }
+        release(d);
     }
 }
 
@@ -238,30 +629,22 @@ void Validator2::ClassDecl(Declaration* d)
                 subs[super].append(d);
         }
     }
+    AstModel::buildDisplay(d);
     
     // Open class scope
-    scopeStack.push_back(d);
+    pushScope(d);
     
     // Validate parameters
     Declaration* param = d->link;
     while (param && param->kind == Declaration::Parameter) {
-        if (!param->validated) {
-#if 1
-            Decl(param);
-#else
-            param->validated = true;
-            markDecl(param);
-            ParamDecl(param);
-#endif
-        }
+        Decl(param);
         param = param->next;
     }
     
     // Validate virtual specs
     Declaration* member = d->link;
     while (member) {
-        if (member->kind == Declaration::VirtualSpec && !member->validated) {
-            member->validated = true;
+        if (member->kind == Declaration::VirtualSpec && claim(member)) {
             if( member->sym )
                 // this is an abstract virtual declaration
                 markDecl(member);
@@ -270,6 +653,7 @@ void Validator2::ClassDecl(Declaration* d)
                 markRef(member->forward, member->pos);
             if (member->type())
                 Type_(member->type());
+            release(member);
         }
         member = member->next;
     }
@@ -278,10 +662,9 @@ void Validator2::ClassDecl(Declaration* d)
     member = d->link;
     while (member) {
         if (member->kind != Declaration::Parameter && 
-            member->kind != Declaration::VirtualSpec &&
-            !member->validated) {
+            member->kind != Declaration::VirtualSpec) {
 
-            Decl(member);
+            Decl(member); // only if not yet claimed
         }
         member = member->next;
     }
@@ -290,7 +673,7 @@ void Validator2::ClassDecl(Declaration* d)
     if (d->body)
         Body(d->body);
     
-    scopeStack.pop_back();
+    popScope();
 }
 
 void Validator2::ProcDecl(Declaration* d)
@@ -300,7 +683,7 @@ void Validator2::ProcDecl(Declaration* d)
         Type_(d->type());
     
     // Open procedure scope
-    scopeStack.push_back(d);
+    pushScope(d);
     
     // Validate parameters
     Declaration* param = d->link;
@@ -312,7 +695,7 @@ void Validator2::ProcDecl(Declaration* d)
     // Validate local declarations
     Declaration* local = d->link;
     while (local) {
-        if (local->kind != Declaration::Parameter && !local->validated) {
+        if (local->kind != Declaration::Parameter) {
             Decl(local);
         }
         local = local->next;
@@ -322,7 +705,7 @@ void Validator2::ProcDecl(Declaration* d)
     if (d->body)
         Body(d->body);
     
-    scopeStack.pop_back();
+    popScope();
 }
 
 void Validator2::VarDecl(Declaration* d)
@@ -345,11 +728,13 @@ void Validator2::SwitchDecl(Declaration* d)
 {
     // Validate switch list (label expressions)
     Expression* e = d->list;
+    designational = true;
     while (e) {
         Expr(e);
         // Each element should be a label designator
         e = e->next;
     }
+    designational = false;
 }
 
 void Validator2::ParamDecl(Declaration* d)
@@ -392,11 +777,11 @@ void Validator2::ExternalDecl(Declaration* d)
 
 void Validator2::BlockDecl(Declaration* d)
 {
-    scopeStack.push_back(d);
+    pushScope(d);
     DeclSeq(d->link);
     if (d->body)
         Body(d->body);
-    scopeStack.pop_back();
+    popScope();
 }
 
 void Validator2::LabelDecl(Declaration* d)
@@ -407,9 +792,11 @@ void Validator2::LabelDecl(Declaration* d)
 
 void Validator2::Type_(Type* t)
 {
-    if (!t || t->validated)
+    if (!t || t->kind < Type::MaxBasicType)
+        return; // basic types are shared by all modules and need no validation
+    // the declarations of a list share their type, and they might be validated by different validators
+    if (!claim(t->claim))
         return;
-    t->validated = true;
     
     switch (t->kind) {
     case Type::Array:
@@ -435,6 +822,7 @@ void Validator2::Type_(Type* t)
         // Basic types don't need validation
         break;
     }
+    t->claim.storeRelease(s_done);
 }
 
 void Validator2::Body(Statement* s)
@@ -447,10 +835,10 @@ void Validator2::StatSeq(Statement* s)
     while (s) {
         Declaration* scope = s->getScope();
         if( scope )
-            scopeStack.push_back(scope);
+            pushScope(scope);
         s = Stat(s);
         if( scope )
-            scopeStack.pop_back();
+            popScope();
     }
 }
 
@@ -516,13 +904,7 @@ Statement* Validator2::Stat(Statement* s)
 
 void Validator2::BlockStat(Statement* s)
 {
-    // Push block scope if it has local declarations
-    if (s->scope) {
-        scopeStack.push_back(s->scope);
-        DeclSeq(s->scope->link);
-    }
-    
-    // Validate prefix class arguments if present
+    // Validate prefix class arguments if present; they are evaluated outside of the block
     if (s->prefix) {
         Expr(s->prefix);
     }
@@ -534,19 +916,25 @@ void Validator2::BlockStat(Statement* s)
         }
     }
     
+    // Push block scope if it has local declarations
+    if (s->scope) {
+        pushScope(s->scope);
+        DeclSeq(s->scope->link);
+    }
+    
     // Validate body statements
     if (s->body)
         StatSeq(s->body);
     
     if (s->scope)
-        scopeStack.pop_back();
+        popScope();
 }
 
 void Validator2::CompoundStat(Statement* s)
 {
     // Push compound scope if it has local declarations
     if (s->scope) {
-        scopeStack.push_back(s->scope);
+        pushScope(s->scope);
         DeclSeq(s->scope->link);
     }
     
@@ -555,7 +943,7 @@ void Validator2::CompoundStat(Statement* s)
         StatSeq(s->body);
     
     if (s->scope)
-        scopeStack.pop_back();
+        popScope();
 }
 
 void Validator2::IfStat(Statement* s)
@@ -656,13 +1044,13 @@ void Validator2::InspectStat(Statement* s)
         }
         
         if( conn->classDecl )
-            scopeStack.push_back(conn->classDecl);
+            pushScope(conn->classDecl);
         // Validate when body
         if (conn->body)
             StatSeq(conn->body);
 
         if( conn->classDecl )
-            scopeStack.pop_back();
+            popScope();
 
         conn = conn->next;
     }
@@ -675,10 +1063,10 @@ void Validator2::InspectStat(Statement* s)
     if (s->body)
     {
         if( cls )
-            scopeStack.push_back(cls);
+            pushScope(cls);
         StatSeq(s->body);
         if( cls )
-            scopeStack.pop_back();
+            popScope();
     }
 }
 
@@ -686,7 +1074,9 @@ void Validator2::GotoStat(Statement* s)
 {
     // Validate label designator
     if (s->lhs) {
+        designational = true;
         Expr(s->lhs);
+        designational = false;
         // Should resolve to a label
     }
 }
@@ -772,6 +1162,12 @@ bool Validator2::Expr(Expression* e)
         return e->type() != 0;
     e->validated = true;
     
+    // a label may be referenced before it is declared only where CeeGen::emitGoto jumps to it by name, i.e. as
+    // the designator or an alternative of a conditional one; operands, indices and arguments must resolve now
+    const bool oldDesignational = designational;
+    if (e->kind != Expression::Identifier && e->kind != Expression::IfExpr)
+        designational = false;
+    
     bool ok = false;
     
     switch (e->kind) {
@@ -860,6 +1256,7 @@ bool Validator2::Expr(Expression* e)
         break;
     }
     
+    designational = oldDesignational;
     return ok;
 }
 
@@ -929,6 +1326,12 @@ bool Validator2::Identifier(Expression* e)
     Declaration* d = resolve(e->a);
     
     if (!d) {
+        if( streaming && designational )
+        {
+            // the label may be declared by a statement not yet parsed
+            pendingLabels << qMakePair(e->a, e->pos);
+            return false;
+        }
         // d = resolve(e->a); // TEST
         error(e->pos, QString("declaration for '%1' not found").arg(e->a));
         markUnref(strlen(e->a), e->pos);
@@ -980,7 +1383,7 @@ bool Validator2::DotExpr(Expression* e)
     if (lt->kind == Type::Ref)
         cls = lt->getRefType();
     else if( lt->kind == Type::Text )
-        cls = mdl->getPrimitiveText();
+        cls = primitiveText;
     
     // Get member name from rhs
     if (e->rhs && e->rhs->kind == Expression::Identifier) {
@@ -1038,11 +1441,9 @@ bool Validator2::SubscriptExpr(Expression* e)
         }
     }
     
-    // Result type is the element type
-    if (lt && lt->kind == Type::Array) {
-        // For arrays, the element type would be stored somewhere
-        // TODO For now, we don't have element type info in the Type structure
-    }
+    // Result type is the element type; an array declared without type is real
+    if (lt && lt->kind == Type::Array)
+        e->setType(lt->type() ? lt->type() : mdl->getType(Type::Real));
     
     return true;
 }
@@ -1055,6 +1456,19 @@ bool Validator2::CallExpr(Expression* e)
     
     Expr(e->lhs);
     
+    Type* lt = e->lhs->type();
+    if (lt && lt->kind == Type::Array) {
+        // a(i) is parsed as a call; it is the same as a[i]
+        e->kind = Expression::Subscript;
+        for (Expression* sub = e->rhs; sub; sub = sub->next) {
+            Expr(sub);
+            if (sub->type() && !sub->type()->isArithmetic())
+                error(sub->pos, "array subscript must be arithmetic"); // a real is rounded
+        }
+        e->setType(lt->type() ? lt->type() : mdl->getType(Type::Real));
+        return true;
+    }
+    
     // Validate arguments
     if (e->rhs) {
         Expression* arg = e->rhs;
@@ -1073,6 +1487,8 @@ bool Validator2::CallExpr(Expression* e)
             }
             if (d->type())
                 e->setType(d->type());
+            if (env && d->outer && d->outer->outer == env && d->type() && d->type()->isArithmetic())
+                arithmeticCall(d, e);
         }
     }else
     {
@@ -1167,7 +1583,10 @@ bool Validator2::IfExpr(Expression* e)
 {
     // IF cond THEN expr ELSE expr
     if (e->condition) {
+        const bool alternatives = designational;
+        designational = false;
         Expr(e->condition);
+        designational = alternatives;
         Type* ct = e->condition->type();
         if (ct && ct->kind != Type::Boolean)
             error(e->condition->pos, "if expression condition must be boolean");
@@ -1275,16 +1694,7 @@ bool Validator2::typeCompat(Type* t1, Type* t2)
 
 bool Validator2::isSubclassOf(Declaration* sub, Declaration* super)
 {
-    if (!sub || !super)
-        return false;
-    
-    Declaration* cur = sub;
-    while (cur) {
-        if (cur == super)
-            return true;
-        cur = cur->prefix;
-    }
-    return false;
+    return AstModel::isSubclassOf(sub, super);
 }
 
 Type* Validator2::resultType(Expression::Kind op, Type* lhs, Type* rhs)
@@ -1299,10 +1709,10 @@ Type* Validator2::resultType(Expression::Kind op, Type* lhs, Type* rhs)
     case Expression::Div:
     case Expression::Exp:
         if (lhs->isArithmetic() && rhs->isArithmetic()) {
-            // Return the wider type
+            // Return the wider type; the quotient is real even for integer operands
             if (lhs->kind == Type::LongReal || rhs->kind == Type::LongReal)
                 return mdl->getType(Type::LongReal);
-            if (lhs->kind == Type::Real || rhs->kind == Type::Real)
+            if (lhs->kind == Type::Real || rhs->kind == Type::Real || op == Expression::Div)
                 return mdl->getType(Type::Real);
             if (lhs->kind == Type::Integer || rhs->kind == Type::Integer)
                 return mdl->getType(Type::Integer);
@@ -1353,6 +1763,20 @@ Type* Validator2::resultType(Expression::Kind op, Type* lhs, Type* rhs)
     return 0;
 }
 
+void Validator2::arithmeticCall(Declaration* proc, Expression* e)
+{
+    // the environment declares the generic arithmetic procedures on long real; the result
+    // is integer for integer arguments
+    bool integer = e->rhs != 0;
+    for (Expression* arg = e->rhs; arg; arg = arg->next)
+        integer = integer && arg->type() && arg->type()->isInteger();
+    if (qstrcmp(proc->sym, "sign") == 0 ||
+            (integer && (qstrcmp(proc->sym, "abs") == 0 || qstrcmp(proc->sym, "mod") == 0)))
+        e->setType(mdl->getType(Type::Integer));
+    else if (qstrcmp(proc->sym, "abs") == 0 && e->rhs && e->rhs->type() && e->rhs->type()->kind == Type::Real)
+        e->setType(mdl->getType(Type::Real));
+}
+
 Type* Validator2::deref(Type* t)
 {
     return t;
@@ -1360,30 +1784,54 @@ Type* Validator2::deref(Type* t)
 
 Declaration* Validator2::resolve(Atom sym)
 {
+    stats.lookups++;
+    quint32 searched = 0, saved = 0;
+    Declaration* d = 0;
     // Search scope stack from innermost to outermost
-    for (int i = scopeStack.size() - 1; i >= 0; --i) {
+    for (int i = scopeStack.size() - 1; i >= 0 && d == 0; --i) {
+        if( s_resolveCache )
+        {
+            // a frame remembers the names resolved while it was the innermost one
+            QHash<Atom,Resolved>::const_iterator hit = resolved[i].find(sym);
+            if( hit != resolved[i].end() )
+            {
+                stats.hits++;
+                d = hit.value().d;
+                saved = hit.value().cost;
+                break;
+            }
+        }
+
         Declaration* scope = scopeStack[i];
 
         if( scope->kind == Declaration::Class )
             Decl(scope); // many names are resolved from classes defined after the reference
 
-        Declaration* d = AstModel::findInScope(scope, sym);
-        if (d)
-            return d;
+        searched++;
+        d = AstModel::findInScope(scope, sym);
         
-        // Also search prefix chain for classes
-        if (scope->kind == Declaration::Class) {
+        // Also search prefix chain for classes and prefixed blocks
+        if (d == 0 && ( scope->kind == Declaration::Class || scope->kind == Declaration::Block )) {
             Declaration* prefix = scope->prefix;
-            while (prefix) {
+            while (prefix && d == 0) {
                 Decl(prefix); // many names are resolved from classes defined after the reference
+                searched++;
                 d = AstModel::findInScope(prefix, sym);
-                if (d)
-                    return d;
                 prefix = prefix->prefix;
             }
         }
     }
-    return AstModel::findInScope(mdl->getGlobals(), sym);
+    if( d == 0 )
+    {
+        searched++;
+        d = AstModel::findInScope(mdl->getGlobals(), sym);
+    }
+    stats.searches += searched;
+    stats.avoided += saved;
+    // misses are not remembered, since in streaming mode the name might be declared by a later unit
+    if( d && s_resolveCache && !resolved.isEmpty() )
+        resolved.back().insert(sym, Resolved(d, searched + saved));
+    return d;
 }
 
 void Validator2::checkBuiltinCall(Declaration* builtin, Expression* args, const RowCol& pos)
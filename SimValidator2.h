@@ -23,6 +23,7 @@
 #include "SimAst.h"
 #include <QList>
 #include <QHash>
+#include <QPair>
 
 namespace Sim {
 
@@ -33,6 +34,11 @@ namespace Sim {
         
         bool validate(Declaration* module);
         Xref takeXref();
+
+        // Streaming mode, see Parser3::Consumer; each unit is validated in the scope it was parsed in.
+        bool validateUnit(Declaration* d);
+        bool validateUnit(Statement* s, Declaration* scope);
+        bool finishUnits(Declaration* scope); // check GOTOs to labels declared after the referring unit
         
         struct Error {
             QString msg;
@@ -42,6 +48,33 @@ namespace Sim {
                 : msg(m), pos(rc), path(p) {}
         };
         mutable QList<Error> errors;
+
+        // Validates the modules concurrently on up to 'threads' threads (default ideal thread count), one
+        // validator per module. Declarations used across modules are claimed atomically and validated in the
+        // context of their own module by whoever comes first; the symbols found this way are merged into the
+        // xref of the module they belong to. Validators waiting for each other in a circle are serialized: one
+        // goes on as with a recursive reference, the others wait until it has finished its module.
+        struct Result {
+            Declaration* module;
+            Xref xref;
+            QList<Error> errors;
+            Result(Declaration* m = 0):module(m) {}
+        };
+        static QList<Result> validateAll(AstModel* mdl, const QList<Declaration*>& modules, Loader* = 0,
+                                         bool haveXref = false, int threads = 0);
+        QHash<Declaration*,Xref> takeForeignXref(); // fragments of other modules collected by this validator
+
+        // Name resolution statistics, accumulated over all validators since the last reset
+        struct ResolveStats {
+            quint32 lookups; // calls of resolve()
+            quint32 hits; // resolved from the cache of one of the scope frames
+            quint32 searches; // scopes searched
+            quint32 avoided; // scope searches saved by hits
+            ResolveStats():lookups(0),hits(0),searches(0),avoided(0) {}
+        };
+        static ResolveStats resolveStats();
+        static void resetResolveStats();
+        static void setResolveCache(bool on); // on by default
         
     protected:
         void Module(Declaration* module);
@@ -96,12 +129,25 @@ namespace Sim {
         bool isSubclassOf(Declaration* sub, Declaration* super);
         Type* resultType(Expression::Kind op, Type* lhs, Type* rhs);
         Type* deref(Type* t);
+        void arithmeticCall(Declaration* proc, Expression* e);
         
         Declaration* resolve(Atom sym);
         
         void checkBuiltinCall(Declaration* builtin, Expression* args, const RowCol& pos);
         
     protected:
+        void openUnit(Declaration* scope);
+        void closeUnit();
+        void setContext(Declaration* scope);
+        void pushScope(Declaration* scope);
+        void popScope();
+        bool claim(Declaration* d);
+        bool claim(QAtomicPointer<Validator2>& c);
+        void release(Declaration* d);
+        void waitFor(QAtomicPointer<Validator2>& c);
+        Validator2* waitsFor() const;
+        bool stuck(Validator2* owner, QList<Validator2*>& chain) const;
+        void releaseHeld();
         void invalid(const char* what, const RowCol& pos);
         bool error(const RowCol& pos, const QString& msg) const;
         void markDecl(Declaration* d);
@@ -114,10 +160,37 @@ namespace Sim {
         AstModel* mdl;
         Loader* loader;
         QList<Declaration*> scopeStack;
+        struct Resolved {
+            Declaration* d;
+            quint32 cost; // scopes searched to find d starting from the frame
+            Resolved(Declaration* d = 0, quint32 c = 0):d(d),cost(c) {}
+        };
+        // resolve() results per scope frame, parallel to scopeStack; a frame's entry depends only on the
+        // frame and the ones below, so it is valid until the frame is popped
+        QList<QHash<Atom,Resolved> > resolved;
+        ResolveStats stats;
         Symbol* first;
         Symbol* last;
         QHash<Declaration*, QList<Symbol*> > xref;
         QHash<Declaration*, QList<Declaration*> > subs;
+        QList<QPair<Atom,RowCol> > pendingLabels;
+        bool streaming;
+        bool designational;
+        Declaration* env;
+        Declaration* basicio;
+        Declaration* primitiveText;
+        QAtomicPointer<QAtomicPointer<Validator2> > awaiting; // the claim this validator waits for, see waitFor
+        QAtomicInt waits; // counts the starts and ends of waiting
+        QAtomicPointer<Validator2> heldBy; // the validator which went on with claims this one had not finished
+        QList<Validator2*> holding; // the validators this one holds
+        struct Fragment {
+            Symbol* first;
+            Symbol* last;
+            QHash<Declaration*, QList<Symbol*> > xref;
+            QHash<Declaration*, QList<Declaration*> > subs;
+            Fragment():first(0),last(0) {}
+        };
+        QHash<Declaration*,Fragment> foreign;
     };
 }
 
@@ -19,6 +19,13 @@
 
 HEADERS += \
     $$PWD/SimAst.h \
+    $$PWD/SimFolder.h \
+    $$PWD/SimEscapeAnalyzer.h \
+    $$PWD/SimThunkAnalyzer.h \
+    $$PWD/SimClassHierarchy.h \
+    $$PWD/SimTreeShaker.h \
+    $$PWD/SimInliner.h \
+    $$PWD/SimLoopAnalyzer.h \
     $$PWD/SimLexer.h \
     $$PWD/SimParser3.h \
     $$PWD/SimRowCol.h \
@@ -29,6 +36,13 @@ HEADERS += \
 
 SOURCES += \
     $$PWD/SimAst.cpp \
+    $$PWD/SimFolder.cpp \
+    $$PWD/SimEscapeAnalyzer.cpp \
+    $$PWD/SimThunkAnalyzer.cpp \
+    $$PWD/SimClassHierarchy.cpp \
+    $$PWD/SimTreeShaker.cpp \
+    $$PWD/SimInliner.cpp \
+    $$PWD/SimLoopAnalyzer.cpp \
     $$PWD/SimLexer.cpp \
     $$PWD/SimParser3.cpp \
     $$PWD/SimRowCol.cpp \
@@ -0,0 +1,39 @@
+#/*
+#* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+#*
+#* This file is part of the Simula67 parser library.
+#*
+#* The following is the license that applies to this copy of the
+#* library. For a license to use the library under conditions
+#* other than those described here, please email to me@rochus-keller.ch.
+#*
+#* GNU General Public License Usage
+#* This file may be used under the terms of the GNU General Public
+#* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+#* Foundation and appearing in the file LICENSE.GPL included in
+#* the packaging of this file. Please review the following information
+#* to ensure GNU General Public Licensing requirements will be met:
+#* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+#* http://www.gnu.org/copyleft/gpl.html.
+#*/
+
+# Micro-benchmarks of the runtime primitives, see sim_bench.c
+
+TARGET = SimBench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt app_bundle
+
+QMAKE_CFLAGS += -std=c99
+QMAKE_CFLAGS_RELEASE += -O2
+
+HEADERS += sim_runtime.h
+
+SOURCES += sim_runtime.c \
+    sim_coroutine.c \
+    sim_simulation.c \
+    sim_simset.c \
+    sim_chars.c \
+    sim_bench.c
+
+LIBS += -lgc -lm
@@ -0,0 +1,811 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// Measures the primitives of sim_runtime the generated code spends its time in and prints ns per
+// operation; SimBench [iterations] [filter], where filter selects the benchmarks containing it.
+
+#define _POSIX_C_SOURCE 199309L
+#include "sim_runtime.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <gc.h>
+
+typedef struct Bench {
+    const char* name;
+    void (*run)(long n);
+} Bench;
+
+static volatile int64_t s_sink; // keeps the compiler from dropping the loops
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static SimText s_image1, s_image2, s_line;
+
+static const char s_lit_[] = "the quick brown fox";
+static const SimText s_lit = SIM_TEXT_LITERAL(s_lit_);
+
+static void textLiteral(long n)
+{
+    // a literal as emitted by CeeGen, scanned to the first blank
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+    {
+        SimText t = s_lit;
+        while( sim_text_more(t) && sim_text_getchar(&t) != ' ' )
+            ;
+        sum += sim_text_pos(t);
+    }
+    s_sink = sum;
+}
+
+static void textEq(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_text_eq(s_image1, s_image2);
+    s_sink = sum;
+}
+
+static void textCmp(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_text_cmp(s_image1, s_line) < 0;
+    s_sink = sum;
+}
+
+static void textAssign(long n)
+{
+    // an image sized value padded into a print line
+    for( long i = 0; i < n; i++ )
+        sim_text_assign(&s_line, s_image1);
+    s_sink = s_line.chars[0];
+}
+
+static void textSubStrip(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_text_strip(sim_text_sub(s_line, 1 + ( i & 31 ), 40)).length;
+    s_sink = sum;
+}
+
+static void textMain(long n)
+{
+    // a field of a line back to the whole line
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+    {
+        SimText t = sim_text_sub(s_line, 1 + ( i & 31 ), 40);
+        sum += sim_text_start(t) + sim_text_main(t).length;
+    }
+    s_sink = sum;
+}
+
+static void textGetchar(long n)
+{
+    // per character of a scanning loop, i.e. while t.more do c := t.getchar
+    int64_t sum = 0;
+    SimText t = s_line;
+    for( long i = 0; i < n; i++ )
+    {
+        if( !sim_text_more(t) )
+            sim_text_setpos(&t, 1);
+        sum += sim_text_getchar(&t);
+    }
+    s_sink = sum;
+}
+
+static void textPutint(long n)
+{
+    SimText t = sim_text_sub(s_line, 1, 12);
+    for( long i = 0; i < n; i++ )
+        sim_text_putint(&t, (int32_t)i);
+    s_sink = t.chars[11];
+}
+
+// The character kernels on image sized texts, with the plain loops, SSE2 and AVX2, see sim_chars.c
+
+static SimText s_print;
+
+static void charsEq(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_text_eq(s_image1, s_image2);
+    s_sink = sum;
+}
+
+static void charsCmp(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_text_cmp(s_image1, s_line) < 0;
+    s_sink = sum;
+}
+
+static void charsStrip(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_text_strip(s_line).length;
+    s_sink = sum;
+}
+
+static void charsPad(long n)
+{
+    for( long i = 0; i < n; i++ )
+        sim_text_assign(&s_print, s_image1);
+    s_sink = s_print.chars[131];
+}
+
+static void charsFill(long n)
+{
+    for( long i = 0; i < n; i++ )
+        sim_chars_fill(s_print.chars, s_print.length);
+    s_sink = s_print.chars[0];
+}
+
+#define CHARS_ISA(run, isa) static void run##_##isa(long n) { sim_chars_init(#isa); run(n); sim_chars_init(NULL); }
+#define CHARS_BENCH(run) CHARS_ISA(run, scalar) CHARS_ISA(run, sse2) CHARS_ISA(run, avx2)
+CHARS_BENCH(charsEq)
+CHARS_BENCH(charsCmp)
+CHARS_BENCH(charsStrip)
+CHARS_BENCH(charsPad)
+CHARS_BENCH(charsFill)
+
+static void blanksTmp(long n)
+{
+    // blanks(80) as a temporary of a statement
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+    {
+        SimTmpMark m = sim_tmp_mark();
+        sum += sim_blanks_tmp(80).length;
+        sim_tmp_release(m);
+    }
+    s_sink = sum;
+}
+
+static void blanksHeap(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_blanks(80).length;
+    s_sink = sum;
+}
+
+static SimArray* s_vector;
+static SimArray* s_matrix;
+
+static void arrayGet(long n)
+{
+    double sum = 0;
+    int32_t k = 1;
+    for( long i = 0; i < n; i++ )
+    {
+        sum += *(double*)sim_array_get(s_vector, k);
+        if( ++k > 1000 )
+            k = 1;
+    }
+    s_sink = (int64_t)sum;
+}
+
+static void arrayGetMulti(long n)
+{
+    double sum = 0;
+    int32_t r = 1, c = 1;
+    for( long i = 0; i < n; i++ )
+    {
+        sum += *(double*)sim_array_get_multi(s_matrix, 2, r, c);
+        if( ++c > 100 )
+        {
+            c = 1;
+            if( ++r > 100 )
+                r = 1;
+        }
+    }
+    s_sink = (int64_t)sum;
+}
+
+static void arrayElem(long n)
+{
+    // the same walk as arrayGetMulti addressed inline, as CeeGen emits a(r, c)
+    double sum = 0;
+    int32_t r = 1, c = 1;
+    for( long i = 0; i < n; i++ )
+    {
+        sum += *(double*)sim_array_elem(s_matrix, sizeof(double), 2, (const int32_t[]){ r, c }, 0x3);
+        if( ++c > 100 )
+        {
+            c = 1;
+            if( ++r > 100 )
+                r = 1;
+        }
+    }
+    s_sink = (int64_t)sum;
+}
+
+static void arrayElemLoop(long n, uint32_t checks)
+{
+    // for r := 1 step 1 until 100 do for c := 1 step 1 until 100 do sum := sum + a(r, c)
+    double sum = 0;
+    for( long i = 0; i < n; i += 100 * 100 )
+        for( int32_t r = 1; r <= 100; r++ )
+            for( int32_t c = 1; c <= 100; c++ )
+                sum += *(double*)sim_array_elem(s_matrix, sizeof(double), 2, (const int32_t[]){ r, c }, checks);
+    s_sink = (int64_t)sum;
+}
+
+static void arrayElemChecked(long n)
+{
+    arrayElemLoop(n, 0x3);
+}
+
+static void arrayElemElided(long n)
+{
+    // the indices are proven in range, see CeeGen::isInBounds
+    arrayElemLoop(n, 0);
+}
+
+// a class hierarchy shaped like the one CeeGen emits: a, b prefixed by a, c prefixed by b
+typedef struct A { SimObject _base; int32_t x; } A;
+typedef struct A_Vtable { SimVtable base; int32_t (*get)(A*); } A_Vtable;
+static int32_t A_get(A* self) { return self->x; }
+static int32_t C_get(A* self) { return self->x + 1; }
+static const int A_display[] = { SIM_CLASS_USER };
+static const int C_display[] = { SIM_CLASS_USER, SIM_CLASS_USER + 1, SIM_CLASS_USER + 2 };
+static A_Vtable A_vtable = {
+    .base = { .class_id = SIM_CLASS_USER, .class_name = "a",
+        .parent_id = 0, .level = 0, .display = A_display },
+    .get = A_get
+};
+static A_Vtable C_vtable = {
+    .base = { .class_id = SIM_CLASS_USER + 2, .class_name = "c",
+        .parent_id = SIM_CLASS_USER + 1, .level = 2, .display = C_display },
+    .get = C_get
+};
+static A* s_objs[2];
+
+static void isExact(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_is_exact((SimObject*)s_objs[i & 1], SIM_CLASS_USER + 2);
+    s_sink = sum;
+}
+
+static void inClass(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_in_class((SimObject*)s_objs[i & 1], 1, SIM_CLASS_USER + 1);
+    s_sink = sum;
+}
+
+static void qua(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += ((A*)sim_qua((SimObject*)s_objs[1], 0, SIM_CLASS_USER, "a"))->x;
+    s_sink = sum;
+}
+
+static void virtualCall(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+    {
+        A* self = s_objs[i & 1];
+        sum += ((A_Vtable*)((SimObject*)self)->_vt)->get(self);
+    }
+    s_sink = sum;
+}
+
+static void round_(long n)
+{
+    int64_t sum = 0;
+    double x = -1000.25;
+    for( long i = 0; i < n; i++, x += 0.5 )
+        sum += sim_round(x);
+    s_sink = sum;
+}
+
+static void ipow(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_ipow(3, (int32_t)( i & 15 ));
+    s_sink = sum;
+}
+
+static void mod(long n)
+{
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_mod((int32_t)i - 5000, 7);
+    s_sink = sum;
+}
+
+static void draw(long n)
+{
+    int32_t u = 907;
+    int64_t sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_draw(0.3, &u);
+    s_sink = sum;
+}
+
+static void negexp(long n)
+{
+    int32_t u = 907;
+    double sum = 0;
+    for( long i = 0; i < n; i++ )
+        sum += sim_negexp(2.0, &u);
+    s_sink = (int64_t)sum;
+}
+
+// the bodies of sim_start; each object stands for a generated class which detaches
+static SimObject s_gen, s_ping, s_pong, s_once;
+static long s_rounds;
+
+static void genBody(SimObject* self)
+{
+    for( ;; )
+        sim_detach(self);
+}
+
+static void pingBody(SimObject* self)
+{
+    sim_detach(self);
+    for( ;; )
+        sim_resume(&s_pong);
+}
+
+static void pongBody(SimObject* self)
+{
+    sim_detach(self);
+    for( ;; )
+    {
+        if( --s_rounds <= 0 )
+            sim_detach(self); // back to main
+        sim_resume(&s_ping);
+    }
+}
+
+static void onceBody(SimObject* self)
+{
+    (void)self;
+}
+
+static void callDetach(long n)
+{
+    // two switches per iteration, to the object and back
+    for( long i = 0; i < n; i++ )
+        sim_call(&s_gen);
+}
+
+static void resume(long n)
+{
+    // two switches per iteration, from pong to ping and back
+    s_rounds = n;
+    sim_resume(&s_pong);
+}
+
+static void startTerminate(long n)
+{
+    // NEW of an object whose body ends without detaching: a stack from the pool and two switches
+    for( long i = 0; i < n; i++ )
+        sim_start(&s_once, onceBody);
+}
+
+// the same as state machines, the way CeeGen -stackless emits them; a case label follows each suspension
+typedef struct Frame { SimObject _base; SimTask _task; } Frame;
+static Frame s_gen2, s_ping2, s_pong2, s_once2;
+
+static void genStep(SimObject* obj)
+{
+    Frame* self = (Frame*)obj;
+    switch( self->_task.pc )
+    {
+    case 0:
+        for( ;; )
+        {
+            self->_task.pc = 1;
+            sim_frame_detach(self);
+            return;
+    case 1:;
+        }
+    }
+    sim_frame_end(self);
+}
+
+static void pingStep(SimObject* obj)
+{
+    Frame* self = (Frame*)obj;
+    switch( self->_task.pc )
+    {
+    case 0:
+        self->_task.pc = 1;
+        sim_frame_detach(self);
+        return;
+    case 1:
+        for( ;; )
+        {
+            self->_task.pc = 2;
+            sim_frame_resume(&s_pong2);
+            return;
+    case 2:;
+        }
+    }
+    sim_frame_end(self);
+}
+
+static void pongStep(SimObject* obj)
+{
+    Frame* self = (Frame*)obj;
+    switch( self->_task.pc )
+    {
+    case 0:
+        self->_task.pc = 1;
+        sim_frame_detach(self);
+        return;
+    case 1:
+        for( ;; )
+        {
+            if( --s_rounds <= 0 )
+            {
+                self->_task.pc = 2;
+                sim_frame_detach(self);
+                return;
+    case 2:;
+            }
+            self->_task.pc = 3;
+            sim_frame_resume(&s_ping2);
+            return;
+    case 3:;
+        }
+    }
+    sim_frame_end(self);
+}
+
+static void onceStep(SimObject* obj)
+{
+    sim_frame_end(obj);
+}
+
+static void callDetachFrame(long n)
+{
+    for( long i = 0; i < n; i++ )
+        sim_call(&s_gen2);
+}
+
+static void resumeFrame(long n)
+{
+    s_rounds = n;
+    sim_resume(&s_pong2);
+}
+
+static void startTerminateFrame(long n)
+{
+    for( long i = 0; i < n; i++ )
+        sim_begin(&s_once2._base, &s_once2._task, onceStep);
+}
+
+static long resident(void)
+{
+    // Linux only; 0 elsewhere
+    long size = 0, pages = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if( f == NULL )
+        return 0;
+    if( fscanf(f, "%ld %ld", &size, &pages) != 2 )
+        pages = 0;
+    fclose(f);
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+static void detachedMemory(void)
+{
+    // what a detached object costs with each strategy, the object included
+    enum { Count = 10000 };
+    long before = resident();
+    for( int i = 0; i < Count; i++ )
+        sim_start((SimObject*)GC_MALLOC(sizeof(SimObject)), genBody);
+    const long stack = ( resident() - before ) / Count;
+    before = resident();
+    for( int i = 0; i < Count; i++ )
+    {
+        Frame* f = (Frame*)GC_MALLOC(sizeof(Frame));
+        sim_begin(&f->_base, &f->_task, genStep);
+    }
+    const long frame = ( resident() - before ) / Count;
+    printf("%-28s %10ld bytes resident\n", "detached object (stack)", stack);
+    printf("%-28s %10ld bytes resident, %d of SimTask\n", "detached object (frame)", frame, (int)sizeof(SimTask));
+}
+
+// the hold model: current leaves the sequencing set and is scheduled again after a drawn delay; the delays
+// are drawn in advance, so the loop measures the set
+enum { Delays = 4096 };
+static double s_delays[Delays];
+
+typedef struct Proc {
+    SimObject _base;
+    SimNotice _ev;
+} Proc;
+
+static void drawDelays(int mix)
+{
+    int32_t u = 907;
+    for( int i = 0; i < Delays; i++ )
+    {
+        switch( mix ? i % 4 : 0 )
+        {
+        case 0:
+            s_delays[i] = sim_negexp(1.0, &u);
+            break;
+        case 1:
+            s_delays[i] = sim_uniform(0.0, 2.0, &u);
+            break;
+        case 2:
+            s_delays[i] = 0.0; // ties, which must stay in FIFO order
+            break;
+        default:
+            s_delays[i] = sim_draw(0.9, &u) ? 0.1 : 10.0; // bimodal
+            break;
+        }
+    }
+}
+
+static void hold(long n, int size)
+{
+    SimSqs q = { 0 };
+    for( int i = 0; i < size; i++ )
+    {
+        Proc* p = (Proc*)GC_MALLOC(sizeof(Proc));
+        sim_sqs_at(&q, &p->_ev, s_delays[i % Delays], false);
+    }
+    for( long i = 0; i < n; i++ )
+    {
+        SimNotice* cur = sim_sqs_first(&q);
+        sim_sqs_at(&q, cur, cur->time + s_delays[i % Delays], false);
+    }
+    s_sink = (int64_t)sim_sqs_first(&q)->time;
+}
+
+static void holdNegexp(long n)
+{
+    drawDelays(0);
+    hold(n, 1000);
+}
+
+static void holdMixed(long n)
+{
+    drawDelays(1);
+    hold(n, 100000);
+}
+
+static void placement(long n)
+{
+    // current goes back in front of the set or next to another scheduled process, in turns
+    enum { Size = 1000 };
+    static Proc* procs[Size];
+    SimSqs q = { 0 };
+    int32_t u = 907;
+    for( int i = 0; i < Size; i++ )
+    {
+        procs[i] = (Proc*)GC_MALLOC(sizeof(Proc));
+        sim_sqs_at(&q, &procs[i]->_ev, sim_uniform(0.0, 100.0, &u), false);
+    }
+    for( long i = 0; i < n; i++ )
+    {
+        SimNotice* cur = sim_sqs_first(&q);
+        SimNotice* y = &procs[i % Size]->_ev;
+        switch( i % 3 )
+        {
+        case 0:
+            sim_sqs_at(&q, cur, cur->time + 1.0, true);
+            break;
+        case 1:
+            sim_sqs_after(&q, cur, y);
+            break;
+        default:
+            sim_sqs_before(&q, cur, y);
+            break;
+        }
+    }
+    s_sink = (int64_t)sim_sqs_first(&q)->time;
+}
+
+static SimHead* queue(int size)
+{
+    SimHead* q = SimHead_new();
+    for( int i = 0; i < size; i++ )
+        SimLink_into(SimLink_new(), q);
+    return q;
+}
+
+static void queueRotate(long n)
+{
+    // the waiting line of a resource: the first one leaves, another one enters at the end
+    SimHead* q = queue(1000);
+    for( long i = 0; i < n; i++ )
+    {
+        SimLink* l = SimHead_first(q);
+        SimLink_out(l);
+        SimLink_into(l, q);
+    }
+    s_sink = SimHead_cardinal(q);
+}
+
+static void queuePlace(long n)
+{
+    // a link moves next to another one, in turns before and after it
+    SimHead* q = queue(1000);
+    SimLink* x = SimHead_first(q);
+    SimLink* y = SimHead_last(q);
+    for( long i = 0; i < n; i++ )
+    {
+        if( i & 1 )
+            SimLink_follow(x, &y->_base);
+        else
+            SimLink_precede(x, &y->_base);
+        s_sink += SimHead_cardinal(q);
+    }
+}
+
+static SimOutFile* s_null;
+
+static void outint(long n)
+{
+    // per item; the image is written after ten of them
+    for( long i = 0; i < n; i++ )
+    {
+        SimOutFile_outint(s_null, (int32_t)i, 8);
+        if( i % 10 == 9 )
+            SimImageFile_outimage(s_null);
+    }
+}
+
+static void outtext(long n)
+{
+    SimText t = sim_text_const("the quick brown fox");
+    for( long i = 0; i < n; i++ )
+    {
+        SimOutFile_outtext(s_null, t);
+        if( i % 4 == 3 )
+            SimImageFile_outimage(s_null);
+    }
+}
+
+static const Bench s_benches[] = {
+    { "text literal (scan)", textLiteral },
+    { "text_eq (80 chars)", textEq },
+    { "text_cmp (80/132 chars)", textCmp },
+    { "text_assign (80 into 132)", textAssign },
+    { "text_sub + strip", textSubStrip },
+    { "text_sub + main/start", textMain },
+    { "text_getchar", textGetchar },
+    { "text_putint", textPutint },
+    { "chars eq 80 (scalar)", charsEq_scalar },
+    { "chars eq 80 (sse2)", charsEq_sse2 },
+    { "chars eq 80 (avx2)", charsEq_avx2 },
+    { "chars cmp 80/132 (scalar)", charsCmp_scalar },
+    { "chars cmp 80/132 (sse2)", charsCmp_sse2 },
+    { "chars cmp 80/132 (avx2)", charsCmp_avx2 },
+    { "chars strip 132 (scalar)", charsStrip_scalar },
+    { "chars strip 132 (sse2)", charsStrip_sse2 },
+    { "chars strip 132 (avx2)", charsStrip_avx2 },
+    { "chars pad 80 to 132 (scalar)", charsPad_scalar },
+    { "chars pad 80 to 132 (sse2)", charsPad_sse2 },
+    { "chars pad 80 to 132 (avx2)", charsPad_avx2 },
+    { "chars fill 132 (scalar)", charsFill_scalar },
+    { "chars fill 132 (sse2)", charsFill_sse2 },
+    { "chars fill 132 (avx2)", charsFill_avx2 },
+    { "blanks_tmp (80) + release", blanksTmp },
+    { "blanks (80, heap)", blanksHeap },
+    { "array_get (1-D)", arrayGet },
+    { "array_get_multi (2-D)", arrayGetMulti },
+    { "array_elem (2-D)", arrayElem },
+    { "array_elem loop (checked)", arrayElemChecked },
+    { "array_elem loop (elided)", arrayElemElided },
+    { "is_exact", isExact },
+    { "in_class", inClass },
+    { "qua", qua },
+    { "virtual call", virtualCall },
+    { "round", round_ },
+    { "ipow", ipow },
+    { "mod", mod },
+    { "draw", draw },
+    { "negexp", negexp },
+    { "call + detach", callDetach },
+    { "resume", resume },
+    { "start + terminate", startTerminate },
+    { "call + detach (frame)", callDetachFrame },
+    { "resume (frame)", resumeFrame },
+    { "start + terminate (frame)", startTerminateFrame },
+    { "sqs hold (negexp, 1k)", holdNegexp },
+    { "sqs hold (mixed, 100k)", holdMixed },
+    { "sqs prior/after/before", placement },
+    { "simset out + into (1k)", queueRotate },
+    { "simset follow/precede", queuePlace },
+    { "outint", outint },
+    { "outtext", outtext },
+};
+
+static void setup(void)
+{
+    s_image1 = sim_blanks(80);
+    s_image2 = sim_blanks(80);
+    s_line = sim_blanks(132);
+    s_print = sim_blanks(132);
+    for( int i = 0; i < 80; i++ )
+        s_image1.chars[i] = s_image2.chars[i] = s_line.chars[i] = (char)( 'a' + i % 26 );
+    s_line.chars[79] = 'z';
+
+    s_vector = sim_array_new(sizeof(double), 1, 1, 1000);
+    s_matrix = sim_array_new(sizeof(double), 2, 1, 100, 1, 100);
+    for( int32_t i = 1; i <= 1000; i++ )
+        *(double*)sim_array_get(s_vector, i) = i;
+
+    s_objs[0] = (A*)GC_MALLOC(sizeof(A));
+    s_objs[0]->_base._vt = &A_vtable.base;
+    s_objs[1] = (A*)GC_MALLOC(sizeof(A));
+    s_objs[1]->_base._vt = &C_vtable.base;
+
+    sim_start(&s_gen, genBody);
+    sim_start(&s_ping, pingBody);
+    sim_start(&s_pong, pongBody);
+    sim_begin(&s_gen2._base, &s_gen2._task, genStep);
+    sim_begin(&s_ping2._base, &s_ping2._task, pingStep);
+    sim_begin(&s_pong2._base, &s_pong2._task, pongStep);
+
+    s_null = SimOutFile_new(sim_text_const("/dev/null"));
+    SimFile_open(s_null, sim_blanks(132));
+}
+
+int main(int argc, char* argv[])
+{
+    GC_INIT();
+    sim_init();
+    setup();
+    const long n = argc > 1 ? atol(argv[1]) : 10000000;
+    const char* filter = argc > 2 ? argv[2] : "";
+    printf("%-28s %10s\n", "primitive", "ns/op");
+    for( size_t i = 0; i < sizeof(s_benches) / sizeof(s_benches[0]); i++ )
+    {
+        if( strstr(s_benches[i].name, filter) == NULL )
+            continue;
+        s_benches[i].run(n / 10); // warm up
+        const double start = now();
+        s_benches[i].run(n);
+        printf("%-28s %10.2f\n", s_benches[i].name, ( now() - start ) * 1e9 / n);
+    }
+    if( strstr("detached object", filter) != NULL )
+        detachedMemory();
+    SimFile_close(s_null);
+    sim_cleanup();
+    return 0;
+}
@@ -0,0 +1,215 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// The character kernels of the text operations. Texts are mostly images of 80 to 132 characters, which are too
+// short for the call and the setup of the library functions to pay off, and strip has no library function at all.
+// On x86 the kernels work on 16 characters at a time with SSE2, which every x86-64 processor has, or on 32 with
+// AVX2 if sim_chars_init finds it; a run shorter than a vector is done by the first and the last vector of the
+// run overlapping. Elsewhere the kernels are plain loops.
+
+#include "sim_runtime.h"
+#include <string.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || ( defined(__i386__) && defined(__SSE2__) ) )
+#define SIM_CHARS_X86
+#include <immintrin.h>
+#endif
+
+/* Scalar ------------------------------------------------------------------------------------------- */
+
+static int32_t mismatchScalar(const char* a, const char* b, int32_t n)
+{
+    int32_t i = 0;
+    while( i < n && a[i] == b[i] )
+        i++;
+    return i;
+}
+
+static int32_t trimScalar(const char* s, int32_t n)
+{
+    while( n > 0 && s[n - 1] == ' ' )
+        n--;
+    return n;
+}
+
+static void fillScalar(char* d, int32_t n)
+{
+    for( int32_t i = 0; i < n; i++ )
+        d[i] = ' ';
+}
+
+#ifdef SIM_CHARS_X86
+
+/* SSE2 --------------------------------------------------------------------------------------------- */
+
+static int32_t mismatchSse2(const char* a, const char* b, int32_t n)
+{
+    int32_t i = 0;
+    for( ; i + 16 <= n; i += 16 )
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)( a + i ));
+        const __m128i y = _mm_loadu_si128((const __m128i*)( b + i ));
+        const unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffffu;
+        if( m != 0 )
+            return i + __builtin_ctz(m);
+    }
+    if( i < n && n >= 16 )
+    {
+        // the last vector overlaps the ones compared equal before
+        const int32_t j = n - 16;
+        const __m128i x = _mm_loadu_si128((const __m128i*)( a + j ));
+        const __m128i y = _mm_loadu_si128((const __m128i*)( b + j ));
+        const unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffffu;
+        return m != 0 ? j + __builtin_ctz(m) : n;
+    }
+    return i + mismatchScalar(a + i, b + i, n - i);
+}
+
+static int32_t trimSse2(const char* s, int32_t n)
+{
+    const __m128i blank = _mm_set1_epi8(' ');
+    while( n >= 16 )
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)( s + n - 16 ));
+        const unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, blank)) ^ 0xffffu;
+        if( m != 0 )
+            return n - 16 + 32 - __builtin_clz(m); // one past the last non-blank
+        n -= 16;
+    }
+    return trimScalar(s, n);
+}
+
+static void fillSse2(char* d, int32_t n)
+{
+    if( n < 16 )
+    {
+        fillScalar(d, n);
+        return;
+    }
+    const __m128i blank = _mm_set1_epi8(' ');
+    for( int32_t i = 0; i < n - 16; i += 16 )
+        _mm_storeu_si128((__m128i*)( d + i ), blank);
+    _mm_storeu_si128((__m128i*)( d + n - 16 ), blank);
+}
+
+/* AVX2 --------------------------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static int32_t mismatchAvx2(const char* a, const char* b, int32_t n)
+{
+    int32_t i = 0;
+    for( ; i + 32 <= n; i += 32 )
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)( a + i ));
+        const __m256i y = _mm256_loadu_si256((const __m256i*)( b + i ));
+        const unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if( m != 0 )
+            return i + __builtin_ctz(m);
+    }
+    if( i < n && n >= 32 )
+    {
+        const int32_t j = n - 32;
+        const __m256i x = _mm256_loadu_si256((const __m256i*)( a + j ));
+        const __m256i y = _mm256_loadu_si256((const __m256i*)( b + j ));
+        const unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        return m != 0 ? j + __builtin_ctz(m) : n;
+    }
+    return i + mismatchSse2(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int32_t trimAvx2(const char* s, int32_t n)
+{
+    const __m256i blank = _mm256_set1_epi8(' ');
+    while( n >= 32 )
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)( s + n - 32 ));
+        const unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, blank));
+        if( m != 0 )
+            return n - 32 + 32 - __builtin_clz(m);
+        n -= 32;
+    }
+    return trimSse2(s, n);
+}
+
+__attribute__((target("avx2")))
+static void fillAvx2(char* d, int32_t n)
+{
+    if( n < 32 )
+    {
+        fillSse2(d, n);
+        return;
+    }
+    const __m256i blank = _mm256_set1_epi8(' ');
+    for( int32_t i = 0; i < n - 32; i += 32 )
+        _mm256_storeu_si256((__m256i*)( d + i ), blank);
+    _mm256_storeu_si256((__m256i*)( d + n - 32 ), blank);
+}
+
+int32_t (*sim_chars_mismatch)(const char* a, const char* b, int32_t n) = mismatchSse2;
+int32_t (*sim_chars_trim)(const char* s, int32_t n) = trimSse2;
+void (*sim_chars_fill)(char* d, int32_t n) = fillSse2;
+
+#else
+
+int32_t (*sim_chars_mismatch)(const char* a, const char* b, int32_t n) = mismatchScalar;
+int32_t (*sim_chars_trim)(const char* s, int32_t n) = trimScalar;
+void (*sim_chars_fill)(char* d, int32_t n) = fillScalar;
+
+#endif
+
+void sim_chars_copy_pad(char* d, int32_t n, const char* s, int32_t m)
+{
+    // the value may be part of the same frame as the text it is assigned to
+    if( m > 0 )
+        memmove(d, s, m);
+    sim_chars_fill(d + m, n - m);
+}
+
+void sim_chars_init(const char* isa)
+{
+    if( isa == NULL )
+    {
+#ifdef SIM_CHARS_X86
+        __builtin_cpu_init();
+        isa = __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+#else
+        isa = "scalar";
+#endif
+    }
+    if( strcmp(isa, "scalar") == 0 )
+    {
+        sim_chars_mismatch = mismatchScalar;
+        sim_chars_trim = trimScalar;
+        sim_chars_fill = fillScalar;
+    }
+#ifdef SIM_CHARS_X86
+    else if( strcmp(isa, "avx2") == 0 )
+    {
+        sim_chars_mismatch = mismatchAvx2;
+        sim_chars_trim = trimAvx2;
+        sim_chars_fill = fillAvx2;
+    }else
+    {
+        sim_chars_mismatch = mismatchSse2;
+        sim_chars_trim = trimSse2;
+        sim_chars_fill = fillSse2;
+    }
+#endif
+}
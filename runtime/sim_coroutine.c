@@ -0,0 +1,445 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// The quasi-parallel sequencing of Simula: each object whose body detaches gets a stack of its own and
+// detach, resume and call switch between these stacks. On x86-64 ELF targets the switch saves the callee-saved
+// registers on the stack it leaves and loads them from the one it enters, i.e. it costs about a function call;
+// elsewhere, AArch64 included until a switch for it is tested, or with SIM_UCONTEXT defined, swapcontext is used.
+// The stacks come from a pool of mmap'ed regions with a guard page at the low end; a terminated body gives its
+// region back to the pool.
+//
+// Limitation: the stacks of all live coroutines are roots of the collector, and the stack of a detached object
+// refers to the object itself. So a detached object stays reachable until its body terminates, even when no
+// reference to it is left; its storage and its stack region are never reclaimed. Programs which generate many
+// objects that detach and are then dropped, instead of being run to their end, grow accordingly.
+//
+// A body compiled to a state machine has no stack; its step function runs on the stack which happens to
+// operate, called by wait from the resume point saved in the task. Only when the step function itself waits,
+// e.g. for the body of an object it generates, its frame is pinned to that stack until the wait ends.
+
+#define _DEFAULT_SOURCE
+#include "sim_runtime.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <gc.h>
+#include <gc/gc_mark.h>
+
+#ifndef SIM_STACK_SIZE
+#define SIM_STACK_SIZE ( 256 * 1024 ) // only the touched pages are committed
+#endif
+
+#if defined(__ELF__) && defined(__x86_64__) && !defined(SIM_UCONTEXT)
+#define SIM_SWITCH_ASM
+#else
+#include <ucontext.h>
+#endif
+
+enum State { Attached, Detached, Resumed };
+enum { TmpSize = 4096 }; // the first chunk of the statement temporaries is part of the region
+
+typedef struct SimCoroutine {
+    void* sp; // saved by the switch while suspended; the registers are stored above it
+    SimTask task; // task.stack is the coroutine itself
+#ifndef SIM_SWITCH_ASM
+    ucontext_t uc;
+#endif
+    SimBody body;
+    struct SimCoroutine* prev; // the live coroutines, or the pool with next only
+    struct SimCoroutine* next;
+    char* stack; // lowest usable address
+    char* top;
+    SimTmpChunk* chunk;
+    SimTmpMark tmp; // the temporaries of the suspended statement, see sim_tmp_mark
+} SimCoroutine;
+
+static SimCoroutine s_main; // the main program, on the stack of the process
+static SimTask* s_current = &s_main.task; // the operating object
+static SimCoroutine* s_stack = &s_main; // the stack we run on
+static SimCoroutine s_live; // list head
+static SimCoroutine* s_pool;
+static void* s_gcThread;
+static struct GC_stack_base s_mainBase;
+static GC_push_other_roots_proc s_pushOther;
+
+#ifdef SIM_SWITCH_ASM
+// void sim_switch(void** from, void* to): push the callee-saved registers, store the stack pointer in *from,
+// continue on the stack to and pop its registers. sim_switch_entry is where a new stack starts.
+void sim_switch(void** from, void* to) __attribute__((visibility("hidden")));
+void sim_switch_entry(void) __attribute__((visibility("hidden")));
+void sim_coroutine_run(void) __attribute__((visibility("hidden"), used, noreturn));
+
+enum { FrameSize = 7 * sizeof(void*), FrameReturn = 6 }; // r15 r14 r13 r12 rbx rbp, return address
+__asm__(
+    ".text\n"
+    ".globl sim_switch\n"
+    ".hidden sim_switch\n"
+    ".type sim_switch,@function\n"
+    "sim_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size sim_switch,.-sim_switch\n"
+    ".globl sim_switch_entry\n"
+    ".hidden sim_switch_entry\n"
+    ".type sim_switch_entry,@function\n"
+    "sim_switch_entry:\n"
+    "    call sim_coroutine_run\n"
+    "    ud2\n"
+    ".size sim_switch_entry,.-sim_switch_entry\n"
+);
+#else
+static void sim_coroutine_run(void) SIM_NORETURN;
+#endif
+
+static void pushStacks(void)
+{
+    // the collector scans the running stack itself, see setStackBottom
+    for( SimCoroutine* co = s_live.next; co != &s_live; co = co->next )
+    {
+        GC_push_all(&co->task, &co->task + 1);
+        if( co == s_stack )
+            continue;
+        GC_push_all(co->sp, co->top);
+#ifndef SIM_SWITCH_ASM
+        GC_push_all(&co->uc, &co->uc + 1);
+#endif
+    }
+    if( s_stack != &s_main )
+    {
+        GC_push_all(s_main.sp, s_mainBase.mem_base);
+#ifndef SIM_SWITCH_ASM
+        GC_push_all(&s_main.uc, &s_main.uc + 1);
+#endif
+    }
+    if( s_pushOther )
+        s_pushOther();
+}
+
+static inline void setStackBottom(SimCoroutine* co)
+{
+    struct GC_stack_base sb = s_mainBase;
+    if( co != &s_main )
+        sb.mem_base = co->top;
+    GC_set_stackbottom(s_gcThread, &sb);
+}
+
+static inline void transfer(SimCoroutine* to)
+{
+    SimCoroutine* from = s_stack;
+    from->tmp = sim_tmp;
+    sim_tmp = to->tmp;
+    s_stack = to;
+    setStackBottom(to);
+#ifdef SIM_SWITCH_ASM
+    sim_switch(&from->sp, to->sp);
+#else
+    char here;
+    from->sp = &here;
+    swapcontext(&from->uc, &to->uc);
+#endif
+}
+
+static SimCoroutine* allocate(void)
+{
+    SimCoroutine* co = s_pool;
+    if( co != NULL )
+    {
+        s_pool = co->next;
+        return co;
+    }
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* base = (char*)mmap(NULL, SIM_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                             -1, 0);
+    if( base == MAP_FAILED )
+        sim_error_cstr("out of memory for coroutine stacks");
+    if( mprotect(base, page, PROT_NONE) != 0 ) // an overflow faults instead of running into the next region
+        sim_error_cstr("cannot protect coroutine stack");
+    uintptr_t at = (uintptr_t)( base + SIM_STACK_SIZE - TmpSize - sizeof(SimTmpChunk) - sizeof(SimCoroutine) );
+    co = (SimCoroutine*)( at & ~(uintptr_t)63 );
+    co->stack = base + page;
+    co->top = (char*)co;
+    co->chunk = (SimTmpChunk*)( co + 1 );
+    co->chunk->size = TmpSize;
+    co->chunk->next = NULL;
+    return co;
+}
+
+static void release(SimCoroutine* co)
+{
+    co->prev->next = co->next;
+    co->next->prev = co->prev;
+    // the chunks sim_tmp_grow added while the body ran
+    for( SimTmpChunk* c = co->chunk->next; c != NULL; )
+    {
+        SimTmpChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    co->chunk->next = NULL;
+    co->task.obj = NULL;
+    co->task.caller = NULL;
+    co->next = s_pool;
+    s_pool = co;
+}
+
+static void dispatch(SimTask* me)
+{
+    // run the objects which operate until me does again; a step function is called right here
+    const bool frame = me->step != NULL;
+    if( frame )
+        me->stack = s_stack; // its frame is below us
+    while( s_current != me )
+    {
+        SimTask* t = s_current;
+        if( t->stack == NULL )
+            t->step(t->obj);
+        else if( t->stack != s_stack )
+            transfer(t->stack); // back when an object on this stack operates
+        else
+            sim_error_cstr("cannot continue an object which waits below the operating one");
+    }
+    if( frame )
+        me->stack = NULL;
+}
+
+static inline void wait(SimTask* me)
+{
+    // a stack is only switched to when the object waiting on top of it operates, so the usual case of a
+    // stack switching to another one needs no check when it continues
+    SimTask* t = s_current;
+    if( me->step == NULL && t->stack != NULL && t->stack != s_stack )
+        transfer(t->stack);
+    else
+        dispatch(me);
+}
+
+static SimTask* returnTo(SimTask* t)
+{
+    // where an object goes when it detaches or ends
+    return t->state == Attached ? t->caller : &s_main.task;
+}
+
+void sim_coroutine_run(void)
+{
+    SimCoroutine* co = s_stack;
+    co->body(co->task.obj);
+
+    // the object is terminated; the stack is reused by the next sim_start, which can't happen before we left.
+    // The step functions to continue still run here, see wait.
+    s_current = returnTo(&co->task);
+    co->task.obj->_co = NULL;
+    while( s_current->stack == NULL )
+        s_current->step(s_current->obj);
+    release(co);
+    SimCoroutine* next = s_current->stack;
+    s_stack = next;
+    sim_tmp = next->tmp;
+    setStackBottom(next);
+#ifdef SIM_SWITCH_ASM
+    sim_switch(&co->sp, next->sp);
+    __builtin_unreachable();
+#else
+    setcontext(&next->uc);
+    abort();
+#endif
+}
+
+void sim_start(SimObject* self, SimBody body)
+{
+    SimCoroutine* co = allocate();
+    SimTask* me = s_current;
+    co->task.caller = me;
+    co->task.stack = co;
+    co->task.obj = self;
+    co->task.step = NULL;
+    co->task.state = Attached;
+    co->body = body;
+    co->tmp.chunk = co->chunk;
+    co->tmp.used = 0;
+    co->next = s_live.next;
+    co->prev = &s_live;
+    s_live.next->prev = co;
+    s_live.next = co;
+    self->_co = &co->task;
+#ifdef SIM_SWITCH_ASM
+    uintptr_t* frame = (uintptr_t*)( co->top - FrameSize );
+    memset(frame, 0, FrameSize);
+    frame[FrameReturn] = (uintptr_t)sim_switch_entry;
+    co->sp = frame;
+#else
+    getcontext(&co->uc);
+    co->uc.uc_stack.ss_sp = co->stack;
+    co->uc.uc_stack.ss_size = co->top - co->stack;
+    co->uc.uc_link = NULL;
+    makecontext(&co->uc, sim_coroutine_run, 0);
+#endif
+    s_current = &co->task;
+    wait(me);
+}
+
+void sim_begin(SimObject* self, SimTask* task, SimBody step)
+{
+    SimTask* me = s_current;
+    task->caller = me;
+    task->stack = NULL;
+    task->obj = self;
+    task->step = step;
+    task->state = Attached;
+    task->pc = 0;
+    self->_co = task;
+    s_current = task;
+    wait(me);
+}
+
+static SimTask* detach(void* self)
+{
+    SimTask* t = self ? ((SimObject*)self)->_co : NULL;
+    if( SIM_UNLIKELY(t == NULL || t != s_current) )
+        sim_error_cstr("detach: the object is not operating");
+    s_current = returnTo(t);
+    t->state = Detached;
+    t->caller = NULL;
+    return t;
+}
+
+void sim_detach(void* self)
+{
+    wait(detach(self));
+}
+
+void sim_frame_detach(void* self)
+{
+    detach(self);
+}
+
+static SimTask* resume(void* obj)
+{
+    if( SIM_UNLIKELY(obj == NULL) )
+        sim_error_cstr("resume: NONE");
+    SimTask* t = ((SimObject*)obj)->_co;
+    SimTask* from = s_current;
+    if( t == from )
+        return from;
+    if( SIM_UNLIKELY(t == NULL || t->state != Detached) )
+        sim_error_cstr("resume: the object is not detached");
+    // the operating object is suspended; an attached one leaves the component of its caller
+    if( from != &s_main.task )
+    {
+        from->state = Detached;
+        from->caller = NULL;
+    }
+    t->state = Resumed;
+    s_current = t;
+    return from;
+}
+
+void sim_resume(void* obj)
+{
+    wait(resume(obj));
+}
+
+void sim_frame_resume(void* obj)
+{
+    resume(obj);
+}
+
+static SimTask* call(void* obj)
+{
+    if( SIM_UNLIKELY(obj == NULL) )
+        sim_error_cstr("call: NONE");
+    SimTask* t = ((SimObject*)obj)->_co;
+    if( SIM_UNLIKELY(t == NULL || t->state != Detached) )
+        sim_error_cstr("call: the object is not detached");
+    t->state = Attached;
+    t->caller = s_current;
+    s_current = t;
+    return t->caller;
+}
+
+void sim_call(void* obj)
+{
+    wait(call(obj));
+}
+
+void sim_frame_call(void* obj)
+{
+    call(obj);
+}
+
+void sim_transfer(SimTask* t)
+{
+    // the sequencing of SIMULATION, which keeps the states of its processes itself: the operating object
+    // waits until it is transferred to again
+    SimTask* me = s_current;
+    if( t == me )
+        return;
+    s_current = t;
+    wait(me);
+}
+
+void sim_frame_transfer(SimTask* t)
+{
+    s_current = t;
+}
+
+SimTask* sim_operating(void)
+{
+    return s_current;
+}
+
+void sim_end_to(void* self, SimTask* t)
+{
+    // the body of self is about to end and continues t instead of its caller
+    SimTask* me = ((SimObject*)self)->_co;
+    me->state = Attached;
+    me->caller = t;
+}
+
+void sim_frame_end(void* self)
+{
+    SimTask* t = ((SimObject*)self)->_co;
+    s_current = returnTo(t);
+    t->obj->_co = NULL;
+}
+
+void sim_coroutine_init(void)
+{
+    if( s_live.next != NULL )
+        return;
+    s_live.next = s_live.prev = &s_live;
+    s_main.task.stack = &s_main;
+    s_main.task.state = Resumed;
+    s_gcThread = GC_get_my_stackbottom(&s_mainBase);
+    s_pushOther = GC_get_push_other_roots();
+    GC_set_push_other_roots(pushStacks);
+}
@@ -0,0 +1,999 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+#include "sim_runtime.h"
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <gc.h>
+
+enum { TmpChunkSize = 64 * 1024, SysInLength = 80, SysOutLength = 132, LinesPerPage = 60 };
+
+SimInFile* SysIn;
+SimPrintFile* SysOut;
+SimTmpMark sim_tmp;
+
+const double maxreal = 1.7976931348623157e308;
+const double minreal = -1.7976931348623157e308;
+const int32_t maxint = INT32_MAX;
+const int32_t minint = INT32_MIN;
+const double simula_pi = 3.14159265358979323846;
+const char decimalmark = '.';
+const char lowten = '&';
+
+static struct timespec s_start;
+
+/* Errors --------------------------------------------------------------------------------------------- */
+
+void sim_error_cstr(const char* msg)
+{
+    if( SysOut && SysOut->isopen )
+        fflush(SysOut->fp);
+    fprintf(stderr, "\nRuntime error: %s\n", msg);
+    exit(1);
+}
+
+void sim_error(SimText msg)
+{
+    if( SysOut && SysOut->isopen )
+        fflush(SysOut->fp);
+    fprintf(stderr, "\nRuntime error: %.*s\n", (int)msg.length, msg.chars ? msg.chars : "");
+    exit(1);
+}
+
+void sim_qua_error(SimObject* o, const char* name)
+{
+    char msg[128];
+    if( o == NULL )
+        snprintf(msg, sizeof(msg), "qua %s: the object is NONE", name);
+    else
+        snprintf(msg, sizeof(msg), "qua %s: illegal on an object of class %s", name, o->_vt->class_name);
+    sim_error_cstr(msg);
+}
+
+void sim_array_index_error(SimArray* a, int32_t d, int32_t i)
+{
+    char msg[128];
+    const int lower = a->dim[d].lower;
+    const int upper = (int)( (int64_t)a->dim[d].lower + a->dim[d].count - 1 );
+    if( a->dims == 1 )
+        snprintf(msg, sizeof(msg), "array index %d out of bounds %d:%d", (int)i, lower, upper);
+    else
+        snprintf(msg, sizeof(msg), "array index %d out of bounds %d:%d of dimension %d", (int)i, lower, upper,
+                 (int)d + 1);
+    sim_error_cstr(msg);
+}
+
+void sim_array_rank_error(SimArray* a, int32_t n)
+{
+    char msg[128];
+    snprintf(msg, sizeof(msg), "array with %d dimensions used with %d indices", (int)a->dims, (int)n);
+    sim_error_cstr(msg);
+}
+
+/* Texts ---------------------------------------------------------------------------------------------- */
+
+int sim_text_cmp(SimText a, SimText b)
+{
+    // the characters are compared by rank; a text is less than the texts it is a proper prefix of
+    const int32_t n = a.length < b.length ? a.length : b.length;
+    if( n > 0 && a.chars != b.chars )
+    {
+        const int32_t i = sim_chars_mismatch(a.chars, b.chars, n);
+        if( i < n )
+            return (unsigned char)a.chars[i] - (unsigned char)b.chars[i];
+    }
+    return ( a.length > b.length ) - ( a.length < b.length );
+}
+
+SimText sim_text_strip(SimText t)
+{
+    const int32_t n = sim_chars_trim(t.chars, t.length);
+    if( n == 0 )
+        return sim_notext();
+    t.length = n;
+    t.pos = 1;
+    return t;
+}
+
+SimText sim_text_assign(SimText* lhs, SimText rhs)
+{
+    if( SIM_UNLIKELY(rhs.length > lhs->length) )
+        sim_error_cstr("text value assignment: the value is longer than the text");
+    if( lhs->length == 0 )
+        return *lhs;
+    if( SIM_UNLIKELY(lhs->constant) )
+        sim_error_cstr("text value assignment: constant text");
+    sim_chars_copy_pad(lhs->chars, lhs->length, rhs.chars, rhs.length);
+    return *lhs;
+}
+
+SimText sim_blanks(int32_t n)
+{
+    if( n < 0 )
+        sim_error_cstr("blanks: negative length");
+    if( n == 0 )
+        return sim_notext();
+    SimText t = sim_text_frame((char*)GC_MALLOC_ATOMIC(n), n, false);
+    sim_chars_fill(t.chars, n);
+    return t;
+}
+
+SimText sim_copy(SimText s)
+{
+    if( s.length == 0 )
+        return sim_notext();
+    SimText t = sim_text_frame((char*)GC_MALLOC_ATOMIC(s.length), s.length, false);
+    memcpy(t.chars, s.chars, s.length);
+    return t;
+}
+
+char* sim_tmp_grow(size_t n)
+{
+    // continue in the next chunk; the chunks stay allocated and are reused by the following statements
+    SimTmpChunk* c = sim_tmp.chunk;
+    while( c->next && c->next->size < n )
+    {
+        SimTmpChunk* small = c->next; // too small for n, so give it back
+        c->next = small->next;
+        free(small);
+    }
+    if( c->next == NULL )
+    {
+        const size_t size = n > TmpChunkSize ? n : TmpChunkSize;
+        SimTmpChunk* d = (SimTmpChunk*)malloc(sizeof(SimTmpChunk) + size);
+        if( d == NULL )
+            sim_error_cstr("out of memory");
+        d->next = NULL;
+        d->size = size;
+        c->next = d;
+    }
+    sim_tmp.chunk = c->next;
+    sim_tmp.used = n;
+    return sim_tmp.chunk->data;
+}
+
+static void putField(SimText* t, const char* s, int32_t n)
+{
+    // right-justified into all of t; asterisks if it doesn't fit
+    if( t->constant )
+        sim_error_cstr("put: constant text");
+    if( n > t->length )
+    {
+        memset(t->chars, '*', t->length);
+        fprintf(stderr, "Warning: the item doesn't fit into the text\n");
+    }else
+    {
+        memset(t->chars, ' ', t->length - n);
+        memcpy(t->chars + t->length - n, s, n);
+    }
+    t->pos = t->length + 1;
+}
+
+static int formatReal(char* buf, size_t size, double r, int32_t n)
+{
+    // n significant digits and the exponent after lowten, e.g. 1.25&+03
+    if( n < 1 )
+        n = 1;
+    int len = snprintf(buf, size, "%.*E", (int)( n - 1 ), r);
+    for( int i = 0; i < len; i++ )
+        if( buf[i] == 'E' )
+            buf[i] = lowten;
+    return len;
+}
+
+static int formatFrac(char* buf, size_t size, int32_t i, int32_t n)
+{
+    // the digits in groups of three, n of them after the decimal mark
+    char digits[16];
+    const int64_t v = i;
+    int nd = snprintf(digits, sizeof(digits), "%lld", (long long)( v < 0 ? -v : v ));
+    char tmp[64];
+    int len = 0;
+    if( n < 0 )
+        n = 0;
+    else if( n > 10 )
+        n = 10; // all the digits of an integer
+    while( nd <= n )
+    {
+        memmove(digits + 1, digits, nd + 1);
+        digits[0] = '0';
+        nd++;
+    }
+    const int intDigits = nd - n;
+    for( int k = 0; k < nd; k++ )
+    {
+        if( k == intDigits )
+            tmp[len++] = decimalmark;
+        else if( k > 0 && ( k < intDigits ? ( intDigits - k ) % 3 == 0 : ( k - intDigits ) % 3 == 0 ) )
+            tmp[len++] = ' ';
+        tmp[len++] = digits[k];
+    }
+    return snprintf(buf, size, "%s%.*s", v < 0 ? "-" : "", len, tmp);
+}
+
+int32_t sim_text_getint(SimText* t)
+{
+    int32_t i = 0;
+    while( i < t->length && t->chars[i] == ' ' )
+        i++;
+    bool neg = false;
+    if( i < t->length && ( t->chars[i] == '+' || t->chars[i] == '-' ) )
+    {
+        neg = t->chars[i++] == '-';
+        while( i < t->length && t->chars[i] == ' ' )
+            i++;
+    }
+    if( i >= t->length || !sim_digit(t->chars[i]) )
+        sim_error_cstr("getint: no integer item");
+    int64_t v = 0;
+    while( i < t->length && sim_digit(t->chars[i]) )
+    {
+        v = v * 10 + ( t->chars[i++] - '0' );
+        if( v > (int64_t)INT32_MAX + 1 )
+            sim_error_cstr("getint: the item is too large");
+    }
+    t->pos = i + 1;
+    return (int32_t)( neg ? -v : v );
+}
+
+double sim_text_getreal(SimText* t)
+{
+    char buf[128];
+    int32_t i = 0, n = 0;
+    while( i < t->length && t->chars[i] == ' ' )
+        i++;
+    const int32_t start = i;
+    while( i < t->length && n < (int32_t)sizeof(buf) - 2 )
+    {
+        char c = t->chars[i];
+        if( c == lowten )
+        {
+            if( i + 1 < t->length && t->chars[i + 1] == lowten )
+                i++; // long real exponent
+            c = 'e';
+        }else if( c == ' ' && n > 0 && ( buf[n - 1] == '+' || buf[n - 1] == '-' ) )
+        {
+            i++;
+            continue; // blanks after the sign
+        }else if( !sim_digit(c) && c != '.' && c != '+' && c != '-' )
+            break;
+        if( c == 'e' && n == 0 )
+            buf[n++] = '1'; // the mantissa may be missing
+        buf[n++] = c;
+        i++;
+    }
+    buf[n] = 0;
+    char* end = buf;
+    const double r = strtod(buf, &end);
+    if( end == buf || i == start )
+        sim_error_cstr("getreal: no real item");
+    t->pos = start + (int32_t)( end - buf ) + 1;
+    return r;
+}
+
+int32_t sim_text_getfrac(SimText* t)
+{
+    // the digits of a grouped item, ignoring the blanks between groups and the decimal mark
+    int32_t i = 0;
+    while( i < t->length && t->chars[i] == ' ' )
+        i++;
+    bool neg = false;
+    if( i < t->length && ( t->chars[i] == '+' || t->chars[i] == '-' ) )
+        neg = t->chars[i++] == '-';
+    int64_t v = 0;
+    int digits = 0;
+    while( i < t->length )
+    {
+        const char c = t->chars[i];
+        if( sim_digit(c) )
+        {
+            v = v * 10 + ( c - '0' );
+            digits++;
+        }else if( !( c == decimalmark || ( c == ' ' && i + 1 < t->length && sim_digit(t->chars[i + 1]) ) ) )
+            break;
+        i++;
+    }
+    if( digits == 0 )
+        sim_error_cstr("getfrac: no grouped item");
+    t->pos = i + 1;
+    return (int32_t)( neg ? -v : v );
+}
+
+void sim_text_putint(SimText* t, int32_t i)
+{
+    char buf[16];
+    putField(t, buf, snprintf(buf, sizeof(buf), "%d", (int)i));
+}
+
+void sim_text_putfix(SimText* t, double r, int32_t n)
+{
+    char buf[400];
+    putField(t, buf, snprintf(buf, sizeof(buf), "%.*f", (int)( n < 0 ? 0 : n ), r));
+}
+
+void sim_text_putreal(SimText* t, double r, int32_t n)
+{
+    char buf[64];
+    putField(t, buf, formatReal(buf, sizeof(buf), r, n));
+}
+
+void sim_text_putfrac(SimText* t, int32_t i, int32_t n)
+{
+    char buf[64];
+    putField(t, buf, formatFrac(buf, sizeof(buf), i, n));
+}
+
+/* Arrays --------------------------------------------------------------------------------------------- */
+
+SimArray* sim_array_new(int32_t elemSize, int32_t dims, ...)
+{
+    va_list ap;
+    va_start(ap, dims);
+    SimArrayDim dim[16];
+    if( dims < 1 || dims > 16 )
+        sim_error_cstr("array: unsupported number of dimensions");
+    int64_t count = 1;
+    for( int32_t i = 0; i < dims; i++ )
+    {
+        dim[i].lower = va_arg(ap, int32_t);
+        const int32_t upper = va_arg(ap, int32_t);
+        if( upper < dim[i].lower - 1 )
+            sim_error_cstr("array: the upper bound is less than the lower bound");
+        dim[i].count = upper - dim[i].lower + 1;
+        count *= dim[i].count;
+        if( count * elemSize > INT32_MAX )
+            sim_error_cstr("array: too large");
+    }
+    va_end(ap);
+    int32_t stride = 1;
+    int64_t origin = 0;
+    for( int32_t i = dims - 1; i >= 0; i-- )
+    {
+        dim[i].stride = stride;
+        origin -= (int64_t)dim[i].lower * stride;
+        stride *= dim[i].count;
+    }
+    // the elements start at the next 16 byte boundary after the header; the block is zeroed, which is
+    // 0, false, NOTEXT and NONE for all element types
+    const size_t header = ( sizeof(SimArray) + dims * sizeof(SimArrayDim) + 15 ) & ~(size_t)15;
+    SimArray* a = (SimArray*)GC_MALLOC(header + (size_t)count * elemSize);
+    if( a == NULL )
+        sim_error_cstr("out of memory");
+    a->data = (char*)a + header;
+    a->elemSize = elemSize;
+    a->dims = dims;
+    a->origin = origin;
+    memcpy(a->dim, dim, dims * sizeof(SimArrayDim));
+    return a;
+}
+
+void* sim_array_get_multi(SimArray* a, int32_t n, ...)
+{
+    va_list ap;
+    va_start(ap, n);
+    size_t off = 0;
+    for( int32_t d = 0; d < n; d++ )
+    {
+        const int32_t i = va_arg(ap, int32_t);
+        const uint32_t k = (uint32_t)i - (uint32_t)a->dim[d].lower;
+        if( SIM_UNLIKELY(k >= (uint32_t)a->dim[d].count) )
+            sim_array_index_error(a, d, i);
+        off += (size_t)k * a->dim[d].stride;
+    }
+    va_end(ap);
+    return a->data + off * a->elemSize;
+}
+
+int32_t sim_lowerbound(SimArray* a, int32_t i)
+{
+    if( i < 1 || i > a->dims )
+        sim_error_cstr("lowerbound: no such dimension");
+    return a->dim[i - 1].lower;
+}
+
+int32_t sim_upperbound(SimArray* a, int32_t i)
+{
+    if( i < 1 || i > a->dims )
+        sim_error_cstr("upperbound: no such dimension");
+    return a->dim[i - 1].lower + a->dim[i - 1].count - 1;
+}
+
+void sim_goto(SimLabel l)
+{
+    if( l.frame == NULL )
+        sim_error_cstr("goto: the label is not accessible");
+    longjmp(*l.frame, l.id);
+}
+
+/* Arithmetic and random drawing ------------------------------------------------------------------------ */
+
+double sim_cotan(double x)
+{
+    return cos(x) / sin(x);
+}
+
+int32_t sim_randint(int32_t a, int32_t b, int32_t* u)
+{
+    if( b < a )
+        sim_error_cstr("randint: b is less than a");
+    return a + (int32_t)( sim_basic_draw(u) * ( (double)b - a + 1 ) );
+}
+
+double sim_uniform(double a, double b, int32_t* u)
+{
+    if( b < a )
+        sim_error_cstr("uniform: b is less than a");
+    return a + ( b - a ) * sim_basic_draw(u);
+}
+
+double sim_normal(double a, double b, int32_t* u)
+{
+    // Box and Muller, one of the pair
+    const double r = sqrt(-2.0 * log(sim_basic_draw(u)));
+    return a + b * r * cos(2.0 * simula_pi * sim_basic_draw(u));
+}
+
+double sim_negexp(double a, int32_t* u)
+{
+    if( a <= 0 )
+        sim_error_cstr("negexp: a is not positive");
+    return -log(sim_basic_draw(u)) / a;
+}
+
+int32_t sim_poisson(double a, int32_t* u)
+{
+    if( a > 20.0 )
+    {
+        const int32_t n = sim_round(sim_normal(a, sqrt(a), u));
+        return n < 0 ? 0 : n;
+    }
+    const double limit = exp(-a);
+    double p = sim_basic_draw(u);
+    int32_t n = 0;
+    while( p >= limit )
+    {
+        p *= sim_basic_draw(u);
+        n++;
+    }
+    return n;
+}
+
+double sim_erlang(double a, double b, int32_t* u)
+{
+    // mean 1/a and standard deviation 1/(a*sqrt(b))
+    if( a <= 0 || b <= 0 )
+        sim_error_cstr("erlang: a or b is not positive");
+    const int32_t k = sim_entier(b);
+    double p = 1.0;
+    for( int32_t i = 0; i < k; i++ )
+        p *= sim_basic_draw(u);
+    if( b > k )
+        p *= pow(sim_basic_draw(u), b - k);
+    return -log(p) / ( a * b );
+}
+
+static double* realElems(SimArray* a, const char* proc)
+{
+    if( a->dims != 1 || a->elemSize != sizeof(double) )
+        sim_error_cstr(proc);
+    return (double*)a->data;
+}
+
+int32_t sim_discrete(SimArray* a, int32_t* u)
+{
+    // a holds the cumulative distribution
+    const double* p = realElems(a, "discrete: one dimensional real array expected");
+    const double x = sim_basic_draw(u);
+    for( int32_t i = 0; i < a->dim[0].count; i++ )
+        if( p[i] > x )
+            return a->dim[0].lower + i;
+    return a->dim[0].lower + a->dim[0].count;
+}
+
+int32_t sim_histd(SimArray* a, int32_t* u)
+{
+    // a holds the weights of the indices
+    const double* w = realElems(a, "histd: one dimensional real array expected");
+    double sum = 0;
+    for( int32_t i = 0; i < a->dim[0].count; i++ )
+    {
+        if( w[i] < 0 )
+            sim_error_cstr("histd: negative weight");
+        sum += w[i];
+    }
+    const double x = sim_basic_draw(u) * sum;
+    double acc = 0;
+    for( int32_t i = 0; i < a->dim[0].count; i++ )
+    {
+        acc += w[i];
+        if( acc > x )
+            return a->dim[0].lower + i;
+    }
+    return a->dim[0].lower + a->dim[0].count - 1;
+}
+
+double sim_linear(SimArray* a, SimArray* b, int32_t* u)
+{
+    // a holds the cumulative probabilities of the values in b; interpolated linearly
+    const double* p = realElems(a, "linear: one dimensional real array expected");
+    const double* v = realElems(b, "linear: one dimensional real array expected");
+    const int32_t n = a->dim[0].count;
+    if( n != b->dim[0].count || n < 2 || p[0] != 0.0 || p[n - 1] != 1.0 )
+        sim_error_cstr("linear: illegal distribution");
+    const double x = sim_basic_draw(u);
+    int32_t i = 1;
+    while( i < n - 1 && p[i] < x )
+        i++;
+    const double d = p[i] - p[i - 1];
+    if( d == 0.0 )
+        return v[i - 1];
+    return v[i - 1] + ( v[i] - v[i - 1] ) * ( x - p[i - 1] ) / d;
+}
+
+/* Files ----------------------------------------------------------------------------------------------- */
+
+static const int s_fileDisplay[] = { SIM_CLASS_FILE, SIM_CLASS_IMAGEFILE, SIM_CLASS_INFILE };
+static const int s_outDisplay[] = { SIM_CLASS_FILE, SIM_CLASS_IMAGEFILE, SIM_CLASS_OUTFILE, SIM_CLASS_PRINTFILE };
+static const int s_directDisplay[] = { SIM_CLASS_FILE, SIM_CLASS_DIRECTFILE };
+static SimVtable s_infile = {
+    .class_id = SIM_CLASS_INFILE, .class_name = "infile",
+    .parent_id = SIM_CLASS_IMAGEFILE, .level = 2, .display = s_fileDisplay
+};
+static SimVtable s_outfile = {
+    .class_id = SIM_CLASS_OUTFILE, .class_name = "outfile",
+    .parent_id = SIM_CLASS_IMAGEFILE, .level = 2, .display = s_outDisplay
+};
+static SimVtable s_printfile = {
+    .class_id = SIM_CLASS_PRINTFILE, .class_name = "printfile",
+    .parent_id = SIM_CLASS_OUTFILE, .level = 3, .display = s_outDisplay
+};
+static SimVtable s_directfile = {
+    .class_id = SIM_CLASS_DIRECTFILE, .class_name = "directfile",
+    .parent_id = SIM_CLASS_FILE, .level = 1, .display = s_directDisplay
+};
+
+static SimFile* initFile(SimFile* f, SimVtable* vt, SimText fname)
+{
+    memset(f, 0, sizeof(SimFile));
+    f->_base._vt = vt;
+    f->fname = fname;
+    f->filename = fname;
+    f->image = sim_notext();
+    f->line = 1;
+    f->linesPerPage = LinesPerPage;
+    f->spacing = 1;
+    f->location = 1;
+    return f;
+}
+
+static inline int fileClass(SimFile* f)
+{
+    return f->_base._vt->class_id;
+}
+
+static inline bool isOut(SimFile* f)
+{
+    return sim_in_class(&f->_base, 2, SIM_CLASS_OUTFILE);
+}
+
+SimInFile* SimInFile_init(SimInFile* self, SimText fname) { return initFile(self, &s_infile, fname); }
+SimInFile* SimInFile_new(SimText fname) { return SimInFile_init((SimFile*)GC_MALLOC(sizeof(SimFile)), fname); }
+SimOutFile* SimOutFile_init(SimOutFile* self, SimText fname) { return initFile(self, &s_outfile, fname); }
+SimOutFile* SimOutFile_new(SimText fname) { return SimOutFile_init((SimFile*)GC_MALLOC(sizeof(SimFile)), fname); }
+SimPrintFile* SimPrintFile_init(SimPrintFile* self, SimText fname) { return initFile(self, &s_printfile, fname); }
+SimPrintFile* SimPrintFile_new(SimText fname) { return SimPrintFile_init((SimFile*)GC_MALLOC(sizeof(SimFile)), fname); }
+SimDirectFile* SimDirectFile_init(SimDirectFile* self, SimText fname) { return initFile(self, &s_directfile, fname); }
+SimDirectFile* SimDirectFile_new(SimText fname) { return SimDirectFile_init((SimFile*)GC_MALLOC(sizeof(SimFile)), fname); }
+
+void SimFile_open(SimFile* f, SimText image)
+{
+    if( f->isopen )
+        sim_error_cstr("open: the file is already open");
+    char name[1024];
+    if( f->filename.length >= (int32_t)sizeof(name) )
+        sim_error_cstr("open: the file name is too long");
+    memcpy(name, f->filename.chars, f->filename.length);
+    name[f->filename.length] = 0;
+    const char* mode = "r";
+    if( fileClass(f) == SIM_CLASS_DIRECTFILE )
+        mode = "r+b";
+    else if( isOut(f) )
+        mode = "w";
+    f->fp = fopen(name, mode);
+    if( f->fp == NULL && fileClass(f) == SIM_CLASS_DIRECTFILE )
+        f->fp = fopen(name, "w+b");
+    if( f->fp == NULL )
+        sim_error_cstr("open: the file cannot be opened");
+    f->image = image;
+    f->isopen = true;
+    f->endfile = false;
+    f->line = 1;
+    f->location = 1;
+    // an infile starts with an exhausted image, so the first inchar reads a record
+    sim_text_setpos(&f->image, fileClass(f) == SIM_CLASS_INFILE ? image.length + 1 : 1);
+}
+
+void SimFile_close(SimFile* f)
+{
+    if( !f->isopen )
+        return;
+    if( isOut(f) && f->image.pos > 1 )
+        SimImageFile_outimage(f);
+    if( f->fp != stdin && f->fp != stdout )
+        fclose(f->fp);
+    else
+        fflush(f->fp);
+    f->fp = NULL;
+    f->isopen = false;
+}
+
+bool SimFile_isopen(SimFile* f) { return f->isopen; }
+void SimFile_setpos(SimFile* f, int32_t i) { sim_text_setpos(&f->image, i); }
+int32_t SimFile_pos(SimFile* f) { return f->image.pos; }
+int32_t SimFile_length(SimFile* f) { return f->image.length; }
+bool SimFile_more(SimFile* f) { return sim_text_more(f->image); }
+
+void SimImageFile_setimage(SimImageFile* f, SimText t)
+{
+    f->image = t;
+}
+
+static void checkOpen(SimFile* f)
+{
+    if( SIM_UNLIKELY(!f->isopen) )
+        sim_error_cstr("the file is not open");
+}
+
+void SimImageFile_outimage(SimImageFile* f)
+{
+    checkOpen(f);
+    if( fileClass(f) == SIM_CLASS_DIRECTFILE )
+    {
+        fseek(f->fp, (long)( f->location - 1 ) * ( f->image.length + 1 ), SEEK_SET);
+        fwrite(f->image.chars, 1, f->image.length, f->fp);
+        fputc('\n', f->fp);
+        f->location++;
+    }else
+    {
+        // the trailing blanks are not written
+        const int32_t n = sim_chars_trim(f->image.chars, f->image.length);
+        fwrite(f->image.chars, 1, n, f->fp);
+        fputc('\n', f->fp);
+        if( fileClass(f) == SIM_CLASS_PRINTFILE )
+        {
+            for( int32_t i = 1; i < f->spacing; i++ )
+                fputc('\n', f->fp);
+            f->line += f->spacing;
+            if( f->line > f->linesPerPage )
+                SimPrintFile_eject(f, 1);
+        }
+    }
+    sim_chars_fill(f->image.chars, f->image.length);
+    f->image.pos = 1;
+}
+
+void SimImageFile_inimage(SimImageFile* f)
+{
+    checkOpen(f);
+    if( f->endfile )
+        sim_error_cstr("inimage: end of file");
+    if( fileClass(f) == SIM_CLASS_DIRECTFILE )
+        fseek(f->fp, (long)( f->location - 1 ) * ( f->image.length + 1 ), SEEK_SET);
+    int32_t n = 0;
+    int c = 0;
+    while( ( c = fgetc(f->fp) ) != EOF && c != '\n' )
+    {
+        if( c == '\r' )
+            continue;
+        if( n < f->image.length )
+            f->image.chars[n++] = (char)c;
+    }
+    if( c == EOF && n == 0 )
+    {
+        // the image holds the end of medium character when the file is exhausted
+        f->endfile = true;
+        if( f->image.length > 0 )
+        {
+            f->image.chars[0] = 25;
+            n = 1;
+        }
+    }
+    if( f->image.length > n )
+        sim_chars_fill(f->image.chars + n, f->image.length - n);
+    f->image.pos = 1;
+    f->location++;
+}
+
+char SimInFile_inchar(SimInFile* f)
+{
+    if( !sim_text_more(f->image) )
+        SimImageFile_inimage(f);
+    return sim_text_getchar(&f->image);
+}
+
+bool SimInFile_lastitem(SimInFile* f)
+{
+    // skips blanks, also across records; true if the file is exhausted
+    for( ;; )
+    {
+        if( f->endfile )
+            return true;
+        while( sim_text_more(f->image) )
+        {
+            const char c = f->image.chars[f->image.pos - 1];
+            if( c != ' ' && c != '\t' )
+                return false;
+            f->image.pos++;
+        }
+        SimImageFile_inimage(f);
+    }
+}
+
+static SimText rest(SimFile* f)
+{
+    return sim_text_sub(f->image, f->image.pos, f->image.length - f->image.pos + 1);
+}
+
+int32_t SimInFile_inint(SimInFile* f)
+{
+    if( SimInFile_lastitem(f) )
+        sim_error_cstr("inint: end of file");
+    SimText t = rest(f);
+    const int32_t i = sim_text_getint(&t);
+    f->image.pos += t.pos - 1;
+    return i;
+}
+
+double SimInFile_inreal(SimInFile* f)
+{
+    if( SimInFile_lastitem(f) )
+        sim_error_cstr("inreal: end of file");
+    SimText t = rest(f);
+    const double r = sim_text_getreal(&t);
+    f->image.pos += t.pos - 1;
+    return r;
+}
+
+int32_t SimInFile_infrac(SimInFile* f)
+{
+    if( SimInFile_lastitem(f) )
+        sim_error_cstr("infrac: end of file");
+    SimText t = rest(f);
+    const int32_t i = sim_text_getfrac(&t);
+    f->image.pos += t.pos - 1;
+    return i;
+}
+
+SimText SimInFile_intext(SimInFile* f, int32_t w)
+{
+    SimText t = sim_blanks(w);
+    for( int32_t i = 0; i < w; i++ )
+        t.chars[i] = SimInFile_inchar(f);
+    return t;
+}
+
+bool SimInFile_endfile(SimInFile* f)
+{
+    return f->endfile || !f->isopen;
+}
+
+static char* field(SimFile* f, int32_t n)
+{
+    // the next n characters of the image; the image is written first if they don't fit
+    checkOpen(f);
+    if( n > f->image.length - f->image.pos + 1 )
+    {
+        if( f->image.pos > 1 )
+            SimImageFile_outimage(f);
+        if( n > f->image.length )
+            sim_error_cstr("the item is longer than the image");
+    }
+    char* p = f->image.chars + f->image.pos - 1;
+    f->image.pos += n;
+    return p;
+}
+
+static void outItem(SimFile* f, const char* s, int32_t n, int32_t w)
+{
+    // right-justified in w characters, left-justified in -w, or as is if w is 0
+    const int32_t width = w < 0 ? -w : w;
+    if( w == 0 )
+    {
+        memcpy(field(f, n), s, n);
+        return;
+    }
+    char* p = field(f, width);
+    if( n > width )
+        memset(p, '*', width);
+    else if( w > 0 )
+    {
+        memset(p, ' ', width - n);
+        memcpy(p + width - n, s, n);
+    }else
+    {
+        memcpy(p, s, n);
+        memset(p + n, ' ', width - n);
+    }
+}
+
+void SimOutFile_outchar(SimOutFile* f, char c)
+{
+    *field(f, 1) = c;
+}
+
+void SimOutFile_outtext(SimOutFile* f, SimText t)
+{
+    if( t.length > 0 )
+        memcpy(field(f, t.length), t.chars, t.length);
+}
+
+void SimOutFile_outint(SimOutFile* f, int32_t i, int32_t w)
+{
+    char buf[16];
+    outItem(f, buf, snprintf(buf, sizeof(buf), "%d", (int)i), w);
+}
+
+void SimOutFile_outreal(SimOutFile* f, double r, int32_t n, int32_t w)
+{
+    char buf[64];
+    outItem(f, buf, formatReal(buf, sizeof(buf), r, n), w);
+}
+
+void SimOutFile_outfix(SimOutFile* f, double r, int32_t n, int32_t w)
+{
+    char buf[400];
+    outItem(f, buf, snprintf(buf, sizeof(buf), "%.*f", (int)( n < 0 ? 0 : n ), r), w);
+}
+
+void SimOutFile_outfrac(SimOutFile* f, int32_t i, int32_t n, int32_t w)
+{
+    char buf[64];
+    outItem(f, buf, formatFrac(buf, sizeof(buf), i, n), w);
+}
+
+void SimPrintFile_lines(SimPrintFile* f, int32_t n)
+{
+    f->linesPerPage = n > 0 ? n : INT32_MAX;
+}
+
+void SimPrintFile_spacing(SimPrintFile* f, int32_t n)
+{
+    if( n < 0 || n > f->linesPerPage )
+        sim_error_cstr("spacing: out of range");
+    f->spacing = n;
+}
+
+void SimPrintFile_eject(SimPrintFile* f, int32_t n)
+{
+    // positions to line n, on the next page if the current line is not above it
+    checkOpen(f);
+    if( n <= 0 )
+        sim_error_cstr("eject: the line is not positive");
+    if( n > f->linesPerPage )
+        n = 1;
+    if( n <= f->line )
+    {
+        fputc('\f', f->fp);
+        f->line = 1;
+    }
+    for( ; f->line < n; f->line++ )
+        fputc('\n', f->fp);
+}
+
+int32_t SimPrintFile_line(SimPrintFile* f)
+{
+    return f->line;
+}
+
+void SimDirectFile_locate(SimDirectFile* f, int32_t i)
+{
+    if( i < 1 )
+        sim_error_cstr("locate: the location is not positive");
+    f->location = i;
+    f->endfile = false;
+    f->image.pos = f->image.length + 1;
+}
+
+int32_t SimDirectFile_location(SimDirectFile* f) { return f->location; }
+char SimDirectFile_inchar(SimDirectFile* f) { return SimInFile_inchar(f); }
+int32_t SimDirectFile_inint(SimDirectFile* f) { return SimInFile_inint(f); }
+double SimDirectFile_inreal(SimDirectFile* f) { return SimInFile_inreal(f); }
+void SimDirectFile_outchar(SimDirectFile* f, char c) { SimOutFile_outchar(f, c); }
+void SimDirectFile_outint(SimDirectFile* f, int32_t i, int32_t w) { SimOutFile_outint(f, i, w); }
+void SimDirectFile_outreal(SimDirectFile* f, double r, int32_t n, int32_t w) { SimOutFile_outreal(f, r, n, w); }
+void SimDirectFile_outfix(SimDirectFile* f, double r, int32_t n, int32_t w) { SimOutFile_outfix(f, r, n, w); }
+
+/* System -------------------------------------------------------------------------------------------- */
+
+static double seconds(const struct timespec* t)
+{
+    return t->tv_sec + t->tv_nsec * 1e-9;
+}
+
+double sim_time(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return seconds(&t);
+}
+
+double sim_cputime(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+double sim_elapsed(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return seconds(&t) - seconds(&s_start);
+}
+
+int32_t sim_sourceline(void)
+{
+    return 0; // the generated code doesn't track the lines
+}
+
+void sim_terminate_program(void)
+{
+    sim_cleanup();
+    exit(0);
+}
+
+void sim_init(void)
+{
+    static SimTmpChunk* first;
+    clock_gettime(CLOCK_MONOTONIC, &s_start);
+    if( first == NULL )
+    {
+        first = (SimTmpChunk*)malloc(sizeof(SimTmpChunk) + TmpChunkSize);
+        if( first == NULL )
+            sim_error_cstr("out of memory");
+        first->next = NULL;
+        first->size = TmpChunkSize;
+    }
+    sim_tmp.chunk = first;
+    sim_tmp.used = 0;
+    sim_coroutine_init();
+    sim_chars_init(NULL);
+
+    SysIn = SimInFile_new(sim_text_const("SYSIN"));
+    SysIn->fp = stdin;
+    SysIn->isopen = true;
+    SysIn->image = sim_blanks(SysInLength);
+    SysIn->image.pos = SysInLength + 1;
+    SysOut = SimPrintFile_new(sim_text_const("SYSOUT"));
+    SysOut->fp = stdout;
+    SysOut->isopen = true;
+    SysOut->image = sim_blanks(SysOutLength);
+    SysOut->linesPerPage = INT32_MAX; // no page breaks on the terminal
+}
+
+void sim_cleanup(void)
+{
+    if( SysOut && SysOut->isopen )
+    {
+        if( SysOut->image.pos > 1 )
+            SimImageFile_outimage(SysOut);
+        fflush(SysOut->fp);
+    }
+}
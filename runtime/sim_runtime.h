@@ -0,0 +1,747 @@
+#ifndef __SIM_RUNTIME__
+#define __SIM_RUNTIME__
+
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// The C99 runtime of the code generated by Sim::CeeGen. A generated program is built with
+//   cc -std=c99 -O2 -I runtime prog.c runtime/sim_runtime.c -lgc -lm
+// The operations in the inner loops of Simula programs (text access, array indexing, instance tests,
+// the arithmetic intrinsics) are static inline functions here, so the C compiler sees through them;
+// everything which formats, allocates or reports an error lives in sim_runtime.c.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SIM_NORETURN __attribute__((noreturn))
+#define SIM_COLD __attribute__((cold, noinline))
+#define SIM_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define SIM_NORETURN
+#define SIM_COLD
+#define SIM_UNLIKELY(x) (x)
+#endif
+
+/* Objects ------------------------------------------------------------------------------------------ */
+
+// The class ids of the standard classes; CeeGen numbers the classes of the program from SIM_CLASS_USER on.
+enum {
+    SIM_CLASS_ENVIRONMENT = 1, SIM_CLASS_BASICIO, SIM_CLASS_FILE, SIM_CLASS_IMAGEFILE, SIM_CLASS_INFILE,
+    SIM_CLASS_OUTFILE, SIM_CLASS_PRINTFILE, SIM_CLASS_DIRECTFILE, SIM_CLASS_SIMSET, SIM_CLASS_LINKAGE,
+    SIM_CLASS_LINK, SIM_CLASS_HEAD, SIM_CLASS_SIMULATION, SIM_CLASS_PROCESS,
+    SIM_CLASS_USER = 16
+};
+
+// The vtable of every class starts with this; display[l] is the id of the prefix on level l, so that
+// "x in C" is a bounds check and a single load.
+typedef struct SimVtable {
+    int class_id;
+    const char* class_name;
+    int parent_id;
+    int level;
+    const int* display;
+} SimVtable;
+
+typedef struct SimObject {
+    SimVtable* _vt;
+    struct SimTask* _co; // while the body runs or is detached, see sim_start
+} SimObject;
+
+typedef void* SimProcRef;
+
+static inline bool sim_is_exact(SimObject* o, int id)
+{
+    return o != NULL && o->_vt->class_id == id;
+}
+
+static inline bool sim_in_class(SimObject* o, int level, int id)
+{
+    return o != NULL && o->_vt->level >= level && o->_vt->display[level] == id;
+}
+
+SIM_NORETURN SIM_COLD void sim_qua_error(SimObject* o, const char* name);
+
+static inline SimObject* sim_qua(SimObject* o, int level, int id, const char* name)
+{
+    if( SIM_UNLIKELY(!sim_in_class(o, level, id)) )
+        sim_qua_error(o, name);
+    return o;
+}
+
+/* Texts -------------------------------------------------------------------------------------------- */
+
+// A text reference designates length characters starting at chars, which belong to a text frame on the
+// collected heap, to a string literal (constant) or to the temporaries of a statement. sub and strip
+// designate part of the same characters without a copy; pos is the current position, 1 to length + 1.
+// start and frame locate the characters in their frame, so main is found again without a header in front
+// of the frame; getchar and putchar only use chars and pos. The reference is passed by value in 24 bytes.
+typedef struct SimText {
+    char* chars; // the first character designated, NULL for NOTEXT
+    int32_t length;
+    int32_t pos;
+    int32_t start; // of chars in the frame
+    uint32_t frame : 31; // the length of the frame
+    uint32_t constant : 1;
+} SimText;
+
+// The text of a literal of the program is a static of the generated code, see CeeGen::emitLiteral;
+// s is a non-empty char array.
+#define SIM_TEXT_LITERAL(s) { (char*)(s), (int32_t)sizeof(s) - 1, 1, 1, sizeof(s) - 1, 1 }
+
+SIM_NORETURN SIM_COLD void sim_error_cstr(const char* msg);
+
+static inline SimText sim_text_frame(char* chars, int32_t n, bool constant)
+{
+    // all of a frame of n characters
+    SimText t = { chars, n, 1, 1, (uint32_t)n, constant };
+    return t;
+}
+
+static inline SimText sim_notext(void)
+{
+    return sim_text_frame(NULL, 0, false);
+}
+
+static inline SimText sim_text_const(const char* s)
+{
+    // strlen of a literal is folded by the compiler
+    const int32_t n = (int32_t)strlen(s);
+    return n == 0 ? sim_notext() : sim_text_frame((char*)s, n, true);
+}
+
+static inline bool sim_text_constant(SimText t) { return t.constant || t.chars == NULL; }
+static inline int32_t sim_text_length(SimText t) { return t.length; }
+static inline int32_t sim_text_pos(SimText t) { return t.pos; }
+static inline int32_t sim_text_start(SimText t) { return t.start; }
+static inline bool sim_text_more(SimText t) { return t.pos <= t.length; }
+
+static inline SimText sim_text_main(SimText t)
+{
+    if( t.chars == NULL )
+        return t;
+    return sim_text_frame(t.chars - ( t.start - 1 ), (int32_t)t.frame, t.constant);
+}
+
+static inline void sim_text_setpos(SimText* t, int32_t i)
+{
+    t->pos = ( i < 1 || i > t->length + 1 ) ? t->length + 1 : i;
+}
+
+static inline char sim_text_getchar(SimText* t)
+{
+    if( SIM_UNLIKELY(t->pos > t->length) )
+        sim_error_cstr("getchar: pos out of range");
+    return t->chars[t->pos++ - 1];
+}
+
+static inline void sim_text_putchar(SimText* t, char c)
+{
+    if( SIM_UNLIKELY(t->pos > t->length || t->constant) )
+        sim_error_cstr(t->constant ? "putchar: constant text" : "putchar: pos out of range");
+    t->chars[t->pos++ - 1] = c;
+}
+
+static inline SimText sim_text_sub(SimText t, int32_t i, int32_t n)
+{
+    if( SIM_UNLIKELY(i < 1 || n < 0 || (int64_t)i + n - 1 > t.length) )
+        sim_error_cstr("sub: out of range");
+    if( n == 0 )
+        return sim_notext();
+    SimText s = { t.chars + i - 1, n, 1, t.start + i - 1, t.frame, t.constant };
+    return s;
+}
+
+// The character kernels of the text operations, see sim_chars.c; mismatch is the index of the first character in
+// which a and b differ, n if none, and trim the length of s without its trailing blanks. sim_chars_init selects
+// the kernels for isa, i.e. "avx2", "sse2" or "scalar", or for the processor if isa is NULL.
+extern int32_t (*sim_chars_mismatch)(const char* a, const char* b, int32_t n);
+extern int32_t (*sim_chars_trim)(const char* s, int32_t n);
+extern void (*sim_chars_fill)(char* d, int32_t n);
+void sim_chars_copy_pad(char* d, int32_t n, const char* s, int32_t m);
+void sim_chars_init(const char* isa); // by sim_init
+
+static inline bool sim_text_same(SimText a, SimText b)
+{
+    // reference equality, i.e. ==
+    return a.chars == b.chars && a.length == b.length;
+}
+
+static inline bool sim_text_eq(SimText a, SimText b)
+{
+    return a.length == b.length && ( a.chars == b.chars || sim_chars_mismatch(a.chars, b.chars, a.length) == a.length );
+}
+
+int sim_text_cmp(SimText a, SimText b);
+SimText sim_text_strip(SimText t);
+SimText sim_text_assign(SimText* lhs, SimText rhs);
+int32_t sim_text_getint(SimText* t);
+double sim_text_getreal(SimText* t);
+int32_t sim_text_getfrac(SimText* t);
+void sim_text_putint(SimText* t, int32_t i);
+void sim_text_putfix(SimText* t, double r, int32_t n);
+void sim_text_putreal(SimText* t, double r, int32_t n);
+void sim_text_putfrac(SimText* t, int32_t i, int32_t n);
+
+SimText sim_blanks(int32_t n);
+SimText sim_copy(SimText t);
+
+// The blanks and copy which don't survive the statement evaluating them come from a stack of chunks
+// which is reset when the statement completes, see CeeGen::emitExprStmt.
+typedef struct SimTmpChunk {
+    struct SimTmpChunk* next;
+    size_t size;
+    char data[];
+} SimTmpChunk;
+
+typedef struct SimTmpMark {
+    SimTmpChunk* chunk;
+    size_t used;
+} SimTmpMark;
+
+extern SimTmpMark sim_tmp;
+
+char* sim_tmp_grow(size_t n);
+
+static inline SimTmpMark sim_tmp_mark(void)
+{
+    return sim_tmp;
+}
+
+static inline void sim_tmp_release(SimTmpMark m)
+{
+    sim_tmp = m;
+}
+
+static inline char* sim_tmp_alloc(size_t n)
+{
+    if( SIM_UNLIKELY(sim_tmp.used + n > sim_tmp.chunk->size) )
+        return sim_tmp_grow(n);
+    char* p = sim_tmp.chunk->data + sim_tmp.used;
+    sim_tmp.used += n;
+    return p;
+}
+
+static inline SimText sim_blanks_tmp(int32_t n)
+{
+    if( n <= 0 )
+        return sim_notext();
+    SimText t = sim_text_frame(sim_tmp_alloc(n), n, false);
+    sim_chars_fill(t.chars, n);
+    return t;
+}
+
+static inline SimText sim_copy_tmp(SimText s)
+{
+    if( s.length == 0 )
+        return sim_notext();
+    SimText t = sim_text_frame(sim_tmp_alloc(s.length), s.length, false);
+    memcpy(t.chars, s.chars, s.length);
+    return t;
+}
+
+/* Arrays ------------------------------------------------------------------------------------------- */
+
+typedef struct SimArrayDim {
+    int32_t lower;
+    int32_t count;
+    int32_t stride; // in elements
+} SimArrayDim;
+
+// The elements follow the header in the same block, in row major order. origin is the offset of the element with
+// all indices 0 from data, in elements, so that an element is at data + origin + the sum of each index times stride.
+typedef struct SimArray {
+    char* data;
+    int32_t elemSize;
+    int32_t dims;
+    int64_t origin;
+    SimArrayDim dim[];
+} SimArray;
+
+SimArray* sim_array_new(int32_t elemSize, int32_t dims, ...); // followed by the lower and upper bound of each dimension
+void* sim_array_get_multi(SimArray* a, int32_t n, ...);
+// index i is not within the bounds of dimension d, counted from 0
+SIM_NORETURN SIM_COLD void sim_array_index_error(SimArray* a, int32_t d, int32_t i);
+
+// the address of an element; a single unsigned compare checks both bounds
+static inline void* sim_array_get(SimArray* a, int32_t i)
+{
+    const uint32_t k = (uint32_t)i - (uint32_t)a->dim[0].lower;
+    if( SIM_UNLIKELY(k >= (uint32_t)a->dim[0].count) )
+        sim_array_index_error(a, 0, i);
+    return a->data + (size_t)k * a->elemSize;
+}
+
+#define SIM_CHECK_RANK 0x80000000u // see sim_array_elem
+
+SIM_NORETURN SIM_COLD void sim_array_rank_error(SimArray* a, int32_t n);
+
+// the address of the element at the n indices of idx; index d is checked against its bounds if bit d of checks is
+// set, and the number of dimensions against n if SIM_CHECK_RANK is. CeeGen passes size and n as constants and idx
+// as an array literal, so that the loop unrolls to the arithmetic of the element type where this is inlined, and
+// clears the bits of the indices it proved in range, see CeeGen::emitSubscript.
+static inline void* sim_array_elem(SimArray* a, size_t size, int32_t n, const int32_t* idx, uint32_t checks)
+{
+    if( ( checks & SIM_CHECK_RANK ) && SIM_UNLIKELY(a->dims != n) )
+        sim_array_rank_error(a, n);
+    int64_t off = a->origin;
+    for( int32_t d = 0; d < n; d++ )
+    {
+        if( ( checks >> d ) & 1 )
+        {
+            const uint32_t k = (uint32_t)idx[d] - (uint32_t)a->dim[d].lower;
+            if( SIM_UNLIKELY(k >= (uint32_t)a->dim[d].count) )
+                sim_array_index_error(a, d, idx[d]);
+        }
+        off += (int64_t)idx[d] * a->dim[d].stride;
+    }
+    return a->data + off * (int64_t)size;
+}
+
+int32_t sim_lowerbound(SimArray* a, int32_t i);
+int32_t sim_upperbound(SimArray* a, int32_t i);
+
+/* Labels, switches and parameters by name ------------------------------------------------------------ */
+
+// A label outside of the C function, reached by a longjmp to the block which declares it; the block
+// dispatches on id.
+typedef struct SimLabel {
+    jmp_buf* frame;
+    int32_t id;
+} SimLabel;
+
+typedef struct SimSwitch {
+    int32_t count;
+    SimLabel* labels;
+} SimSwitch;
+
+SIM_NORETURN void sim_goto(SimLabel l);
+
+// The closure of an actual parameter by name; eval returns the address of the location designated by
+// the actual or of a temporary holding its value. The closures of the call sites embed it first.
+typedef struct SimThunk {
+    void* (*eval)(struct SimThunk* self);
+} SimThunk;
+
+static inline void* sim_thunk_eval(SimThunk* t)
+{
+    return t->eval(t);
+}
+
+/* Arithmetic --------------------------------------------------------------------------------------- */
+
+static inline int32_t sim_entier(double x)
+{
+    const int32_t i = (int32_t)x;
+    return ( x < 0 && (double)i != x ) ? i - 1 : i;
+}
+
+static inline int32_t sim_round(double x)
+{
+    // Simula rounds to the nearest integer, halves up, i.e. entier(x + 0.5)
+    return sim_entier(x + 0.5);
+}
+
+static inline int32_t sim_sign(double x)
+{
+    return ( x > 0 ) - ( x < 0 );
+}
+
+static inline double sim_abs(double x)
+{
+    return x < 0 ? -x : x;
+}
+
+static inline int32_t sim_mod(int32_t i, int32_t j)
+{
+    // the result has the sign of j, unlike C's %
+    if( SIM_UNLIKELY(j == 0) )
+        sim_error_cstr("mod: division by zero");
+    const int32_t r = i % j;
+    return ( r != 0 && ( ( r < 0 ) != ( j < 0 ) ) ) ? r + j : r;
+}
+
+static inline int32_t sim_ipow(int32_t x, int32_t n)
+{
+    if( SIM_UNLIKELY(n < 0 || ( x == 0 && n == 0 )) )
+        sim_error_cstr("integer exponentiation: undefined");
+    int32_t r = 1;
+    while( n )
+    {
+        if( n & 1 )
+            r *= x;
+        x *= x;
+        n >>= 1;
+    }
+    return r;
+}
+
+static inline double sim_rpowi(double x, int32_t n)
+{
+    if( SIM_UNLIKELY(x == 0 && n <= 0) )
+        sim_error_cstr("real exponentiation: undefined");
+    uint32_t m = n < 0 ? -(uint32_t)n : (uint32_t)n;
+    double r = 1.0;
+    while( m )
+    {
+        if( m & 1 )
+            r *= x;
+        x *= x;
+        m >>= 1;
+    }
+    return n < 0 ? 1.0 / r : r;
+}
+
+double sim_cotan(double x);
+
+/* Characters ------------------------------------------------------------------------------------------ */
+
+static inline char sim_char(int32_t i) { return (char)i; }
+static inline char sim_isochar(int32_t i) { return (char)i; }
+static inline int32_t sim_rank(char c) { return (unsigned char)c; }
+static inline int32_t sim_isorank(char c) { return (unsigned char)c; }
+static inline bool sim_digit(char c) { return c >= '0' && c <= '9'; }
+static inline bool sim_letter(char c) { return ( c | 0x20 ) >= 'a' && ( c | 0x20 ) <= 'z'; }
+static inline char sim_upcase(char c) { return ( c >= 'a' && c <= 'z' ) ? c - 32 : c; }
+static inline char sim_lowcase(char c) { return ( c >= 'A' && c <= 'Z' ) ? c + 32 : c; }
+
+/* Random drawing ---------------------------------------------------------------------------------------- */
+
+// The seed U is the NAME parameter of the drawing procedures; it is passed by address.
+static inline double sim_basic_draw(int32_t* u)
+{
+    // Park and Miller's minimal standard generator; the value is in the open interval (0, 1)
+    uint32_t x = (uint32_t)( *u < 0 ? -(int64_t)*u : *u ) % 2147483647u;
+    if( x == 0 )
+        x = 1;
+    x = (uint32_t)( (uint64_t)x * 48271u % 2147483647u );
+    *u = (int32_t)x;
+    return x / 2147483647.0;
+}
+
+static inline bool sim_draw(double a, int32_t* u) { return sim_basic_draw(u) < a; }
+int32_t sim_randint(int32_t a, int32_t b, int32_t* u);
+double sim_uniform(double a, double b, int32_t* u);
+double sim_normal(double a, double b, int32_t* u);
+double sim_negexp(double a, int32_t* u);
+int32_t sim_poisson(double a, int32_t* u);
+double sim_erlang(double a, double b, int32_t* u);
+int32_t sim_discrete(SimArray* a, int32_t* u);
+int32_t sim_histd(SimArray* a, int32_t* u);
+double sim_linear(SimArray* a, SimArray* b, int32_t* u);
+
+/* Files ------------------------------------------------------------------------------------------------- */
+
+// All file classes share this layout, so an attribute of a file is a member whatever the class of the
+// reference; the fields up to image are the attributes declared in runtime/builtins.sim.
+typedef struct SimFile {
+    SimObject _base;
+    SimText fname;
+    SimText filename;
+    SimText image;
+    FILE* fp;
+    int32_t line;
+    int32_t linesPerPage;
+    int32_t spacing;
+    int32_t location;
+    bool isopen;
+    bool endfile;
+} SimFile;
+
+typedef SimFile SimImageFile;
+typedef SimFile SimInFile;
+typedef SimFile SimOutFile;
+typedef SimFile SimPrintFile;
+typedef SimFile SimDirectFile;
+
+// The objects of the standard classes which don't have a native implementation yet.
+typedef struct SimEnvironment { SimObject _base; } SimEnvironment;
+typedef struct SimBasicIO { SimEnvironment _base; } SimBasicIO;
+typedef struct SimSimset { SimBasicIO _base; } SimSimset;
+
+extern SimInFile* SysIn;
+extern SimPrintFile* SysOut;
+
+SimInFile* SimInFile_init(SimInFile* self, SimText fname);
+SimInFile* SimInFile_new(SimText fname);
+SimOutFile* SimOutFile_init(SimOutFile* self, SimText fname);
+SimOutFile* SimOutFile_new(SimText fname);
+SimPrintFile* SimPrintFile_init(SimPrintFile* self, SimText fname);
+SimPrintFile* SimPrintFile_new(SimText fname);
+SimDirectFile* SimDirectFile_init(SimDirectFile* self, SimText fname);
+SimDirectFile* SimDirectFile_new(SimText fname);
+
+void SimFile_open(SimFile* f, SimText image);
+void SimFile_close(SimFile* f);
+bool SimFile_isopen(SimFile* f);
+void SimFile_setpos(SimFile* f, int32_t i);
+int32_t SimFile_pos(SimFile* f);
+int32_t SimFile_length(SimFile* f);
+bool SimFile_more(SimFile* f);
+
+void SimImageFile_setimage(SimImageFile* f, SimText t);
+void SimImageFile_outimage(SimImageFile* f);
+void SimImageFile_inimage(SimImageFile* f);
+
+char SimInFile_inchar(SimInFile* f);
+bool SimInFile_lastitem(SimInFile* f);
+int32_t SimInFile_inint(SimInFile* f);
+double SimInFile_inreal(SimInFile* f);
+int32_t SimInFile_infrac(SimInFile* f);
+SimText SimInFile_intext(SimInFile* f, int32_t w);
+bool SimInFile_endfile(SimInFile* f);
+
+void SimOutFile_outchar(SimOutFile* f, char c);
+void SimOutFile_outtext(SimOutFile* f, SimText t);
+void SimOutFile_outint(SimOutFile* f, int32_t i, int32_t w);
+void SimOutFile_outreal(SimOutFile* f, double r, int32_t n, int32_t w);
+void SimOutFile_outfix(SimOutFile* f, double r, int32_t n, int32_t w);
+void SimOutFile_outfrac(SimOutFile* f, int32_t i, int32_t n, int32_t w);
+
+void SimPrintFile_lines(SimPrintFile* f, int32_t n);
+void SimPrintFile_spacing(SimPrintFile* f, int32_t n);
+void SimPrintFile_eject(SimPrintFile* f, int32_t n);
+int32_t SimPrintFile_line(SimPrintFile* f);
+
+void SimDirectFile_locate(SimDirectFile* f, int32_t i);
+int32_t SimDirectFile_location(SimDirectFile* f);
+char SimDirectFile_inchar(SimDirectFile* f);
+int32_t SimDirectFile_inint(SimDirectFile* f);
+double SimDirectFile_inreal(SimDirectFile* f);
+void SimDirectFile_outchar(SimDirectFile* f, char c);
+void SimDirectFile_outint(SimDirectFile* f, int32_t i, int32_t w);
+void SimDirectFile_outreal(SimDirectFile* f, double r, int32_t n, int32_t w);
+void SimDirectFile_outfix(SimDirectFile* f, double r, int32_t n, int32_t w);
+
+// The procedures of basicio which use SysIn and SysOut.
+static inline void sim_inimage(void) { SimImageFile_inimage(SysIn); }
+static inline int32_t sim_inint(void) { return SimInFile_inint(SysIn); }
+static inline double sim_inreal(void) { return SimInFile_inreal(SysIn); }
+static inline int32_t sim_infrac(void) { return SimInFile_infrac(SysIn); }
+static inline char sim_inchar(void) { return SimInFile_inchar(SysIn); }
+static inline bool sim_lastitem(void) { return SimInFile_lastitem(SysIn); }
+static inline SimText sim_intext(int32_t w) { return SimInFile_intext(SysIn, w); }
+static inline void sim_outimage(void) { SimImageFile_outimage(SysOut); }
+static inline void sim_outint(int32_t i, int32_t w) { SimOutFile_outint(SysOut, i, w); }
+static inline void sim_outreal(double r, int32_t n, int32_t w) { SimOutFile_outreal(SysOut, r, n, w); }
+static inline void sim_outfrac(int32_t i, int32_t n, int32_t w) { SimOutFile_outfrac(SysOut, i, n, w); }
+static inline void sim_outchar(char c) { SimOutFile_outchar(SysOut, c); }
+static inline void sim_outtext(SimText t) { SimOutFile_outtext(SysOut, t); }
+static inline void sim_outfix(double r, int32_t n, int32_t w) { SimOutFile_outfix(SysOut, r, n, w); }
+static inline void sim_setpos(int32_t i) { SimFile_setpos(SysOut, i); }
+static inline int32_t sim_pos(void) { return SimFile_pos(SysOut); }
+static inline void sim_eject(int32_t n) { SimPrintFile_eject(SysOut, n); }
+static inline int32_t sim_line(void) { return SimPrintFile_line(SysOut); }
+
+/* Simset ------------------------------------------------------------------------------------------------ */
+
+// The two-way lists of SIMSET are intrusive, see sim_simset.c: a head keeps its first and last link and their
+// number, and a link its neighbours and the head of its set, so into, out, follow, precede, first, last and
+// cardinal are O(1) and allocate nothing. A zeroed object is an empty head or a link in no set, so the objects of
+// the subclasses of the program need no initialization by the runtime.
+typedef struct SimLinkage {
+    SimObject _base;
+    struct SimLink* _suc; // the next link, of a head the first one; NULL at the end
+    struct SimLink* _pred; // the previous link, of a head the last one
+} SimLinkage;
+
+typedef struct SimLink {
+    SimLinkage _base;
+    struct SimHead* _head; // NULL if the link is in no set
+} SimLink;
+
+typedef struct SimHead {
+    SimLinkage _base;
+    int32_t _cardinal;
+} SimHead;
+
+SimLink* SimLink_init(SimLink* self);
+SimLink* SimLink_new(void);
+SimHead* SimHead_init(SimHead* self);
+SimHead* SimHead_new(void);
+
+static inline SimLink* SimLinkage_suc(SimLinkage* x) { return x->_suc; }
+static inline SimLink* SimLinkage_pred(SimLinkage* x) { return x->_pred; }
+SimLinkage* SimLinkage_prev(SimLinkage* x);
+
+void SimLink_out(SimLink* x);
+void SimLink_follow(SimLink* x, SimLinkage* y);
+void SimLink_precede(SimLink* x, SimLinkage* y);
+void SimLink_into(SimLink* x, SimHead* h);
+
+static inline SimLink* SimHead_first(SimHead* h) { return h->_base._suc; }
+static inline SimLink* SimHead_last(SimHead* h) { return h->_base._pred; }
+static inline bool SimHead_empty(SimHead* h) { return h->_cardinal == 0; }
+static inline int32_t SimHead_cardinal(SimHead* h) { return h->_cardinal; }
+void SimHead_clear(SimHead* h);
+
+/* System ------------------------------------------------------------------------------------------------ */
+
+extern const double maxreal;
+extern const double minreal;
+extern const int32_t maxint;
+extern const int32_t minint;
+extern const double simula_pi;
+extern const char decimalmark;
+extern const char lowten;
+
+SIM_NORETURN void sim_error(SimText msg);
+double sim_time(void);
+double sim_cputime(void);
+double sim_elapsed(void);
+int32_t sim_sourceline(void);
+SIM_NORETURN void sim_terminate_program(void);
+
+/* Coroutines ------------------------------------------------------------------------------------------ */
+
+// The body of a class which detaches runs on a stack of its own, see sim_coroutine.c. The initializer of the
+// object starts it with sim_start and continues when the body detaches or ends; the object is attached to
+// the component which generated or called it, and a resumed object returns to the main program.
+typedef void (*SimBody)(SimObject* self);
+
+// A body compiled to a state machine (CeeGen -stackless) keeps its state in a SimTask member of the object
+// instead. The initializer starts it with sim_begin; at a suspension point the step function saves its resume
+// point in pc, calls sim_frame_detach, sim_frame_resume or sim_frame_call, or in the body of a process
+// sim_frame_hold, sim_frame_passivate or sim_frame_wait, which return at once, and returns.
+// It is called again on whatever stack operates when the object continues.
+typedef struct SimTask {
+    struct SimTask* caller; // the component an attached object returns to
+    struct SimCoroutine* stack; // the stack the task continues on, NULL for a suspended step function
+    SimObject* obj;
+    SimBody step; // NULL for a body with a stack of its own
+    int32_t state;
+    int32_t pc;
+} SimTask;
+
+void sim_start(SimObject* self, SimBody body);
+void sim_detach(void* self);
+void sim_resume(void* obj);
+void sim_call(void* obj);
+void sim_begin(SimObject* self, SimTask* task, SimBody step);
+void sim_frame_detach(void* self);
+void sim_frame_resume(void* obj);
+void sim_frame_call(void* obj);
+void sim_frame_end(void* self);
+void sim_transfer(SimTask* t);
+void sim_frame_transfer(SimTask* t);
+SimTask* sim_operating(void);
+void sim_end_to(void* self, SimTask* t);
+void sim_coroutine_init(void); // by sim_init
+
+/* Sequencing set ------------------------------------------------------------------------------------------- */
+
+// The event notice of a process in the sequencing set of a simulation block, see sim_simulation.c. The set is a
+// heap of the notices ordered by time and, for equal times, by seq, which counts up for an activation after the
+// notices of the same time and down for one prior to them. A notice placed before or after another one joins its
+// run instead, the list of notices which directly follow the one in the heap and share its time.
+typedef struct SimNotice {
+    double time; // evtime
+    struct SimNotice* next; // the run
+    struct SimNotice* prev; // NULL for the head of a run
+    struct SimSqs* sqs; // NULL while not scheduled
+    int32_t index; // the heap entry of a run head, -1 in a run
+} SimNotice;
+
+typedef struct SimEvent {
+    double time;
+    int64_t seq;
+    SimNotice* notice;
+} SimEvent;
+
+typedef struct SimSqs {
+    SimEvent* heap; // 4-ary, on the collected heap
+    int32_t count;
+    int32_t capacity;
+    int64_t after; // the last seq given to an activation after the notices of equal time
+    int64_t prior;
+} SimSqs;
+
+static inline SimNotice* sim_sqs_first(SimSqs* q) { return q->count ? q->heap[0].notice : 0; }
+
+void sim_sqs_at(SimSqs* q, SimNotice* n, double t, bool prior);
+void sim_sqs_before(SimSqs* q, SimNotice* n, SimNotice* y);
+void sim_sqs_after(SimSqs* q, SimNotice* n, SimNotice* y);
+void sim_sqs_remove(SimSqs* q, SimNotice* n);
+SimNotice* sim_sqs_next(SimSqs* q, SimNotice* n);
+
+/* Simulation ------------------------------------------------------------------------------------------------- */
+
+// A block prefixed by SIMULATION starts with sim_simulation_begin, which schedules the main program as its first
+// process, and ends with sim_simulation_end. The body of a process starts with sim_process_begin, which detaches
+// it, and ends with sim_process_end. Whenever the first notice of the sequencing set changes, the new current
+// process continues by sim_transfer. Each form of the activation statement has a function of its own; the flags
+// are constants of the statement.
+typedef struct SimProcess {
+    SimLink _base;
+    SimNotice _ev;
+    struct SimSimulation* _sim; // the simulation which runs when the process is generated
+    bool _terminated;
+} SimProcess;
+
+typedef struct SimSimulation {
+    SimSimset _base;
+    SimSqs _sqs;
+    SimProcess* _main;
+    struct SimSimulation* _outer; // the simulation block which ran before this one
+} SimSimulation;
+
+void sim_simulation_begin(void);
+void sim_simulation_end(void);
+void sim_process_begin(void* self);
+void sim_process_end(void* self);
+void sim_frame_process_begin(void* self);
+
+void sim_activate(void* x, bool re);
+void sim_activate_at(void* x, double t, bool prior, bool re);
+void sim_activate_delay(void* x, double t, bool prior, bool re);
+void sim_activate_before(void* x, void* y, bool re);
+void sim_activate_after(void* x, void* y, bool re);
+
+SimProcess* sim_current(void);
+SimProcess* sim_main(void);
+double sim_simulation_time(void);
+void sim_hold(double t);
+void sim_passivate(void);
+void sim_wait(SimHead* h);
+void sim_frame_hold(double t);
+void sim_frame_passivate(void);
+void sim_frame_wait(SimHead* h);
+void sim_cancel(void* x);
+
+bool SimProcess_idle(SimProcess* p);
+bool SimProcess_terminated(SimProcess* p);
+double SimProcess_evtime(SimProcess* p);
+SimProcess* SimProcess_nextev(SimProcess* p);
+
+void sim_init(void);
+void sim_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIM_RUNTIME__
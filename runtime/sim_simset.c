@@ -0,0 +1,156 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// The sets of class SIMSET. Instead of the circular list through the head of the Common Base, the links of a set
+// form a list which ends with NULL on both sides, and the head holds its ends; a link knows its head. suc and pred
+// are then plain loads, the head is found without a walk to the end of the set, and the cardinal is counted when a
+// link enters or leaves it.
+
+#include "sim_runtime.h"
+#include <string.h>
+#include <gc.h>
+
+static const int s_linkDisplay[] = { SIM_CLASS_LINKAGE, SIM_CLASS_LINK };
+static const int s_headDisplay[] = { SIM_CLASS_LINKAGE, SIM_CLASS_HEAD };
+static SimVtable s_link = {
+    .class_id = SIM_CLASS_LINK, .class_name = "link",
+    .parent_id = SIM_CLASS_LINKAGE, .level = 1, .display = s_linkDisplay
+};
+static SimVtable s_head = {
+    .class_id = SIM_CLASS_HEAD, .class_name = "head",
+    .parent_id = SIM_CLASS_LINKAGE, .level = 1, .display = s_headDisplay
+};
+
+SimLink* SimLink_init(SimLink* self)
+{
+    memset(self, 0, sizeof(SimLink));
+    self->_base._base._vt = &s_link;
+    return self;
+}
+
+SimLink* SimLink_new(void)
+{
+    return SimLink_init((SimLink*)GC_MALLOC(sizeof(SimLink)));
+}
+
+SimHead* SimHead_init(SimHead* self)
+{
+    memset(self, 0, sizeof(SimHead));
+    self->_base._base._vt = &s_head;
+    return self;
+}
+
+SimHead* SimHead_new(void)
+{
+    return SimHead_init((SimHead*)GC_MALLOC(sizeof(SimHead)));
+}
+
+static inline bool isHead(SimLinkage* x)
+{
+    return sim_in_class(&x->_base, 1, SIM_CLASS_HEAD);
+}
+
+static inline SimHead* headOf(SimLinkage* x)
+{
+    // the set of a link, or NULL; an object of a subclass of linkage of the program is neither head nor link
+    return sim_in_class(&x->_base, 1, SIM_CLASS_LINK) ? ((SimLink*)x)->_head : NULL;
+}
+
+SimLinkage* SimLinkage_prev(SimLinkage* x)
+{
+    // the first link of a set is preceded by the head, an empty head by itself
+    if( x->_pred != NULL )
+        return &x->_pred->_base;
+    if( isHead(x) )
+        return x;
+    return (SimLinkage*)headOf(x);
+}
+
+static void link(SimLink* x, SimHead* h, SimLink* pred, SimLink* suc)
+{
+    // x is in no set
+    x->_head = h;
+    x->_base._pred = pred;
+    x->_base._suc = suc;
+    if( pred != NULL )
+        pred->_base._suc = x;
+    else
+        h->_base._suc = x;
+    if( suc != NULL )
+        suc->_base._pred = x;
+    else
+        h->_base._pred = x;
+    h->_cardinal++;
+}
+
+void SimLink_out(SimLink* x)
+{
+    SimHead* h = x->_head;
+    if( h == NULL )
+        return;
+    SimLink* pred = x->_base._pred;
+    SimLink* suc = x->_base._suc;
+    if( pred != NULL )
+        pred->_base._suc = suc;
+    else
+        h->_base._suc = suc;
+    if( suc != NULL )
+        suc->_base._pred = pred;
+    else
+        h->_base._pred = pred;
+    x->_base._pred = x->_base._suc = NULL;
+    x->_head = NULL;
+    h->_cardinal--;
+}
+
+void SimLink_follow(SimLink* x, SimLinkage* y)
+{
+    // x stays out of all sets if y is none or no head and in no set
+    SimLink_out(x);
+    if( y == NULL )
+        return;
+    if( isHead(y) )
+        link(x, (SimHead*)y, NULL, y->_suc);
+    else if( headOf(y) != NULL )
+        link(x, headOf(y), (SimLink*)y, y->_suc);
+}
+
+void SimLink_precede(SimLink* x, SimLinkage* y)
+{
+    SimLink_out(x);
+    if( y == NULL )
+        return;
+    if( isHead(y) )
+        link(x, (SimHead*)y, y->_pred, NULL);
+    else if( headOf(y) != NULL )
+        link(x, headOf(y), y->_pred, (SimLink*)y);
+}
+
+void SimLink_into(SimLink* x, SimHead* h)
+{
+    SimLink_out(x);
+    if( h != NULL )
+        link(x, h, h->_base._pred, NULL);
+}
+
+void SimHead_clear(SimHead* h)
+{
+    while( h->_base._suc != NULL )
+        SimLink_out(h->_base._suc);
+}
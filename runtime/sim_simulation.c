@@ -0,0 +1,470 @@
+/*
+* Copyright 2026 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Simula67 parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+// The sequencing set of class SIMULATION. The run heads live in an implicit 4-ary heap of (time, seq, notice)
+// entries, so a comparison doesn't touch the process objects and a sift stays within a few cache lines; each
+// notice knows its entry for cancel and reactivation. Ties are broken by seq, so the heap is stable: notices of
+// equal time leave it in the order they were scheduled, and a PRIOR activation takes a number below all of them.
+// A notice placed BEFORE or AFTER another one can't be given a key between two existing ones; it is linked into
+// the run of that notice instead, and when the head of a run leaves the heap, its successor inherits the entry.
+// So PRIOR, BEFORE and AFTER placements are O(1), and the hold of current sifts its entry down in place.
+//
+// The processes of a simulation are objects whose bodies detach in sim_process_begin. The first notice of the
+// set is current; when it changes, the operating process or main program waits in sim_transfer and the new
+// current one continues, so an activation, hold or passivate of the operating one returns when it is first
+// again. The body of a process compiled to a step function calls the sim_frame_ variants instead, which return
+// at once; the step function returns as well and is called again when the process is current again. The main program of the simulation block is a process object of the runtime whose task is the one which
+// began the block.
+
+#include "sim_runtime.h"
+#include <stddef.h>
+#include <gc.h>
+
+static inline bool earlier(const SimEvent* a, const SimEvent* b)
+{
+    return a->time < b->time || ( a->time == b->time && a->seq < b->seq );
+}
+
+static void up(SimEvent* h, int32_t i, SimEvent e)
+{
+    while( i > 0 )
+    {
+        const int32_t p = ( i - 1 ) / 4;
+        if( !earlier(&e, &h[p]) )
+            break;
+        h[i] = h[p];
+        h[i].notice->index = i;
+        i = p;
+    }
+    h[i] = e;
+    e.notice->index = i;
+}
+
+static void down(SimEvent* h, int32_t count, int32_t i, SimEvent e)
+{
+    for( ;; )
+    {
+        const int32_t c = 4 * i + 1;
+        if( c >= count )
+            break;
+        const int32_t end = c + 4 < count ? c + 4 : count;
+        int32_t m = c;
+        for( int32_t k = c + 1; k < end; k++ )
+            if( earlier(&h[k], &h[m]) )
+                m = k;
+        if( !earlier(&h[m], &e) )
+            break;
+        h[i] = h[m];
+        h[i].notice->index = i;
+        i = m;
+    }
+    h[i] = e;
+    e.notice->index = i;
+}
+
+// e goes to entry i, which was vacated or had another key
+static inline void place(SimSqs* q, int32_t i, SimEvent e)
+{
+    if( i > 0 && earlier(&e, &q->heap[( i - 1 ) / 4]) )
+        up(q->heap, i, e);
+    else
+        down(q->heap, q->count, i, e);
+}
+
+void sim_sqs_at(SimSqs* q, SimNotice* n, double t, bool prior)
+{
+    const SimEvent e = { t, prior ? q->prior-- : ++q->after, n };
+    n->time = t;
+    if( n->sqs == q && n->index >= 0 && n->next == 0 )
+    {
+        place(q, n->index, e); // e.g. hold(t) of current
+        return;
+    }
+    if( n->sqs )
+        sim_sqs_remove(n->sqs, n);
+    if( q->count == q->capacity )
+    {
+        q->capacity = q->capacity ? 2 * q->capacity : 64;
+        q->heap = (SimEvent*)GC_REALLOC(q->heap, q->capacity * sizeof(SimEvent));
+    }
+    n->next = n->prev = 0;
+    n->sqs = q;
+    up(q->heap, q->count++, e);
+}
+
+void sim_sqs_before(SimSqs* q, SimNotice* n, SimNotice* y)
+{
+    if( n == y )
+        return;
+    if( n->sqs )
+        sim_sqs_remove(n->sqs, n);
+    if( y == 0 || y->sqs != q )
+        return; // like cancel if y is not scheduled
+    n->sqs = q;
+    n->time = y->time;
+    n->prev = y->prev;
+    if( n->prev )
+    {
+        n->prev->next = n;
+        n->index = -1;
+    }else
+    {
+        // n takes over the entry of y, which continues the run
+        n->index = y->index;
+        q->heap[n->index].notice = n;
+        y->index = -1;
+    }
+    n->next = y;
+    y->prev = n;
+}
+
+void sim_sqs_after(SimSqs* q, SimNotice* n, SimNotice* y)
+{
+    if( n == y )
+        return;
+    if( n->sqs )
+        sim_sqs_remove(n->sqs, n);
+    if( y == 0 || y->sqs != q )
+        return; // like cancel if y is not scheduled
+    n->sqs = q;
+    n->time = y->time;
+    n->index = -1;
+    n->prev = y;
+    n->next = y->next;
+    if( n->next )
+        n->next->prev = n;
+    y->next = n;
+}
+
+void sim_sqs_remove(SimSqs* q, SimNotice* n)
+{
+    if( n->sqs == 0 )
+        return;
+    if( n->prev )
+    {
+        n->prev->next = n->next;
+        if( n->next )
+            n->next->prev = n->prev;
+    }else if( n->next )
+    {
+        SimNotice* s = n->next;
+        s->prev = 0;
+        s->index = n->index;
+        q->heap[s->index].notice = s;
+    }else
+    {
+        const SimEvent last = q->heap[--q->count];
+        if( n->index < q->count )
+            place(q, n->index, last);
+        q->heap[q->count].notice = 0; // no longer keeps the process alive
+    }
+    n->next = n->prev = 0;
+    n->sqs = 0;
+    n->index = -1;
+}
+
+SimNotice* sim_sqs_next(SimSqs* q, SimNotice* n)
+{
+    // nextev is rare, so this scans the heap for the entry following the one of the run
+    if( n->sqs != q )
+        return 0;
+    if( n->next )
+        return n->next;
+    while( n->prev )
+        n = n->prev;
+    const SimEvent* h = &q->heap[n->index];
+    int32_t best = -1;
+    for( int32_t i = 0; i < q->count; i++ )
+        if( earlier(h, &q->heap[i]) && ( best < 0 || earlier(&q->heap[i], &q->heap[best]) ) )
+            best = i;
+    return best < 0 ? 0 : q->heap[best].notice;
+}
+
+static SimSimulation* s_simulation; // the innermost simulation block which runs
+
+static const int s_processDisplay[] = { SIM_CLASS_LINKAGE, SIM_CLASS_LINK, SIM_CLASS_PROCESS };
+static const int s_simulationDisplay[] = { SIM_CLASS_BASICIO, SIM_CLASS_SIMSET, SIM_CLASS_SIMULATION };
+static SimVtable s_process = {
+    .class_id = SIM_CLASS_PROCESS, .class_name = "process",
+    .parent_id = SIM_CLASS_LINK, .level = 2, .display = s_processDisplay
+};
+static SimVtable s_simulationClass = {
+    .class_id = SIM_CLASS_SIMULATION, .class_name = "simulation",
+    .parent_id = SIM_CLASS_SIMSET, .level = 2, .display = s_simulationDisplay
+};
+
+static inline SimProcess* process(SimNotice* n)
+{
+    return n ? (SimProcess*)( (char*)n - offsetof(SimProcess, _ev) ) : NULL;
+}
+
+static SimSimulation* simulation(void)
+{
+    if( SIM_UNLIKELY(s_simulation == NULL) )
+        sim_error_cstr("no simulation block is running");
+    return s_simulation;
+}
+
+static SimTask* firstChanged(SimSimulation* s, SimNotice* before)
+{
+    // the task of the new current process if the scheduling changed the first notice, else NULL
+    SimNotice* first = sim_sqs_first(&s->_sqs);
+    if( first == before )
+        return NULL;
+    if( SIM_UNLIKELY(first == NULL) )
+        sim_error_cstr("the sequencing set is empty");
+    return ((SimObject*)process(first))->_co;
+}
+
+static void continueFirst(SimSimulation* s, SimNotice* before)
+{
+    SimTask* t = firstChanged(s, before);
+    if( t != NULL )
+        sim_transfer(t);
+}
+
+static void frameFirst(SimSimulation* s, SimNotice* before)
+{
+    // the step function of the operating process returns, and the new current one continues
+    SimTask* t = firstChanged(s, before);
+    if( t != NULL )
+        sim_frame_transfer(t);
+}
+
+void sim_simulation_begin(void)
+{
+    SimSimulation* s = (SimSimulation*)GC_MALLOC(sizeof(SimSimulation));
+    ((SimObject*)s)->_vt = &s_simulationClass;
+    SimProcess* m = (SimProcess*)GC_MALLOC(sizeof(SimProcess));
+    ((SimObject*)m)->_vt = &s_process;
+    ((SimObject*)m)->_co = ((SimObject*)s)->_co = sim_operating();
+    m->_sim = s;
+    s->_main = m;
+    s->_outer = s_simulation;
+    sim_sqs_at(&s->_sqs, &m->_ev, 0.0, false);
+    s_simulation = s;
+}
+
+void sim_simulation_end(void)
+{
+    // the processes still scheduled stay where they are
+    SimSimulation* s = simulation();
+    s_simulation = s->_outer;
+}
+
+static void processBegin(void* self)
+{
+    SimProcess* p = (SimProcess*)self;
+    p->_sim = s_simulation;
+    p->_ev.index = -1;
+}
+
+void sim_process_begin(void* self)
+{
+    // the body of class process starts with detach
+    processBegin(self);
+    sim_detach(self);
+}
+
+void sim_frame_process_begin(void* self)
+{
+    processBegin(self);
+    sim_frame_detach(self);
+}
+
+void sim_process_end(void* self)
+{
+    // terminated, then passivate; the body returns to the new current process, see sim_coroutine.c
+    SimProcess* p = (SimProcess*)self;
+    p->_terminated = true;
+    SimSimulation* s = p->_sim;
+    if( s == NULL || p->_ev.sqs == NULL )
+        return;
+    const bool current = sim_sqs_first(&s->_sqs) == &p->_ev;
+    sim_sqs_remove(&s->_sqs, &p->_ev);
+    if( !current )
+        return;
+    SimNotice* first = sim_sqs_first(&s->_sqs);
+    if( SIM_UNLIKELY(first == NULL) )
+        sim_error_cstr("the sequencing set is empty");
+    sim_end_to(p, ((SimObject*)process(first))->_co);
+}
+
+static SimSimulation* activated(void* x, bool re)
+{
+    // the simulation of x if the statement applies to it, else NULL
+    SimProcess* p = (SimProcess*)x;
+    if( p == NULL || p->_terminated || ( !re && p->_ev.sqs != NULL ) )
+        return NULL;
+    if( SIM_UNLIKELY(p->_sim == NULL) )
+        sim_error_cstr("activate: the process was not generated in a simulation block");
+    return p->_sim;
+}
+
+void sim_activate(void* x, bool re)
+{
+    SimSimulation* s = activated(x, re);
+    if( s == NULL )
+        return;
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    sim_sqs_at(&s->_sqs, &((SimProcess*)x)->_ev, before ? before->time : 0.0, true);
+    continueFirst(s, before);
+}
+
+void sim_activate_at(void* x, double t, bool prior, bool re)
+{
+    SimSimulation* s = activated(x, re);
+    if( s == NULL )
+        return;
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    const double now = before ? before->time : 0.0;
+    sim_sqs_at(&s->_sqs, &((SimProcess*)x)->_ev, t < now ? now : t, prior);
+    continueFirst(s, before);
+}
+
+void sim_activate_delay(void* x, double t, bool prior, bool re)
+{
+    SimSimulation* s = activated(x, re);
+    if( s == NULL )
+        return;
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    const double now = before ? before->time : 0.0;
+    sim_sqs_at(&s->_sqs, &((SimProcess*)x)->_ev, t < 0.0 ? now : now + t, prior);
+    continueFirst(s, before);
+}
+
+void sim_activate_before(void* x, void* y, bool re)
+{
+    SimSimulation* s = activated(x, re);
+    if( s == NULL )
+        return;
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    sim_sqs_before(&s->_sqs, &((SimProcess*)x)->_ev, y ? &((SimProcess*)y)->_ev : NULL);
+    continueFirst(s, before);
+}
+
+void sim_activate_after(void* x, void* y, bool re)
+{
+    SimSimulation* s = activated(x, re);
+    if( s == NULL )
+        return;
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    sim_sqs_after(&s->_sqs, &((SimProcess*)x)->_ev, y ? &((SimProcess*)y)->_ev : NULL);
+    continueFirst(s, before);
+}
+
+SimProcess* sim_current(void)
+{
+    return process(sim_sqs_first(&simulation()->_sqs));
+}
+
+SimProcess* sim_main(void)
+{
+    return simulation()->_main;
+}
+
+double sim_simulation_time(void)
+{
+    SimNotice* first = sim_sqs_first(&simulation()->_sqs);
+    return first ? first->time : 0.0;
+}
+
+static SimNotice* held(SimSimulation* s, double t)
+{
+    // current goes behind the notices of its new time
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    sim_sqs_at(&s->_sqs, before, t > 0.0 ? before->time + t : before->time, false);
+    return before;
+}
+
+static SimNotice* passivated(SimSimulation* s)
+{
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    sim_sqs_remove(&s->_sqs, before);
+    return before;
+}
+
+void sim_hold(double t)
+{
+    SimSimulation* s = simulation();
+    continueFirst(s, held(s, t));
+}
+
+void sim_passivate(void)
+{
+    SimSimulation* s = simulation();
+    continueFirst(s, passivated(s));
+}
+
+void sim_wait(SimHead* h)
+{
+    SimLink_into(&sim_current()->_base, h);
+    sim_passivate();
+}
+
+void sim_frame_hold(double t)
+{
+    SimSimulation* s = simulation();
+    frameFirst(s, held(s, t));
+}
+
+void sim_frame_passivate(void)
+{
+    SimSimulation* s = simulation();
+    frameFirst(s, passivated(s));
+}
+
+void sim_frame_wait(SimHead* h)
+{
+    SimLink_into(&sim_current()->_base, h);
+    sim_frame_passivate();
+}
+
+void sim_cancel(void* x)
+{
+    SimProcess* p = (SimProcess*)x;
+    if( p == NULL || p->_ev.sqs == NULL )
+        return;
+    SimSimulation* s = p->_sim;
+    SimNotice* before = sim_sqs_first(&s->_sqs);
+    sim_sqs_remove(&s->_sqs, &p->_ev);
+    continueFirst(s, before);
+}
+
+bool SimProcess_idle(SimProcess* p)
+{
+    return p->_ev.sqs == NULL;
+}
+
+bool SimProcess_terminated(SimProcess* p)
+{
+    return p->_terminated;
+}
+
+double SimProcess_evtime(SimProcess* p)
+{
+    if( SIM_UNLIKELY(p->_ev.sqs == NULL) )
+        sim_error_cstr("evtime: the process is idle");
+    return p->_ev.time;
+}
+
+SimProcess* SimProcess_nextev(SimProcess* p)
+{
+    return p->_ev.sqs ? process(sim_sqs_next(p->_ev.sqs, &p->_ev)) : NULL;
+}